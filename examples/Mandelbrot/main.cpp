@@ -31,6 +31,116 @@ RGBc mandelbrot(const fVec2 & pos, const fBox2 & R, int32 nbiter)
     }
 
 
+/* Mandelbrot again, using the batch method getColorRow()
+-> the drawer queries a whole row of pixels at once: the points are iterated
+   4 at a time without branching in the inner loop so that the compiler can
+   vectorize it (SSE2/AVX2).
+*/
+struct MandelbrotRow
+    {
+    void getColorRow(const double * xs, double y, size_t n, RGBc * out)
+        {
+        const int nbi = inIt + (inIt/10);
+        for (size_t k = 0; k < n; k += 4)
+            {
+            const size_t m = std::min<size_t>(4, n - k);
+            double cx[4], X[4] = { 0.0, 0.0, 0.0, 0.0 }, Y[4] = { 0.0, 0.0, 0.0, 0.0 };
+            int it[4] = { nbi, nbi, nbi, nbi }; // escape time (nbi if not escaped yet)
+            for (size_t l = 0; l < 4; l++) { cx[l] = xs[k + ((l < m) ? l : 0)]; }
+            int alive = 4;
+            for (int i = 0; (i < nbi) && (alive > 0); i++)
+                {
+                alive = 0;
+                for (int l = 0; l < 4; l++)
+                    {
+                    const double sX = X[l];
+                    const double sY = Y[l];
+                    X[l] = sX*sX - sY*sY + cx[l];
+                    Y[l] = 2 * sX*sY + y;
+                    it[l] = (((X[l]*X[l] + Y[l]*Y[l]) > 4) && (it[l] == nbi)) ? i : it[l];
+                    alive += (it[l] == nbi);
+                    }
+                }
+            for (size_t l = 0; l < m; l++) { out[k + l] = (it[l] == nbi) ? RGBc::c_Black : RGBc::jetPalette(it[l], 1, nbi); }
+            }
+        }
+    };
+
+
+/* Mandelbrot for deep zooms (perturbation method)
+-> uses the deep zoom getColor() method: the position is given relatively to a
+   reference point with double-double precision. The orbit of the reference point
+   is computed once with full precision and each pixel only iterates, in double
+   precision, the (small) difference between its orbit and the reference orbit.
+*/
+class MandelbrotDeep
+    {
+    public:
+
+    RGBc getColor(const ddVec2 & ref, const fVec2 & pos, const fBox2 & R)
+        {
+        const int nbi = inIt + (inIt/10);
+        std::shared_ptr<const std::vector<fVec2> > orbit = _orbit(ref, nbi);
+        const std::vector<fVec2> & Z = *orbit;
+        const int m = (int)Z.size() - 1; // number of iterations of the reference point before escaping
+        double dx = 0.0, dy = 0.0;
+        int i = 0;
+        for (; (i < nbi) && (i < m); i++)
+            { // delta(i+1) = 2 Z(i) delta(i) + delta(i)^2 + delta_c
+            const double zx = Z[i].X(), zy = Z[i].Y();
+            const double ndx = 2 * (zx*dx - zy*dy) + (dx*dx - dy*dy) + pos.X();
+            const double ndy = 2 * (zx*dy + zy*dx) + 2 * dx*dy + pos.Y();
+            dx = ndx; dy = ndy;
+            const double X = Z[i + 1].X() + dx, Y = Z[i + 1].Y() + dy;
+            if ((X*X + Y*Y) > 4) { return RGBc::jetPalette(i, 1, nbi); }
+            }
+        // the reference point escaped first: finish with the usual iteration in double precision
+        const double cx = (ref.X() + pos.X()).toDouble(), cy = (ref.Y() + pos.Y()).toDouble();
+        double X = Z[i].X() + dx, Y = Z[i].Y() + dy;
+        for (; i < nbi; i++)
+            {
+            const double sX = X;
+            const double sY = Y;
+            X = sX*sX - sY*sY + cx;
+            Y = 2 * sX*sY + cy;
+            if ((X*X + Y*Y) > 4) { return RGBc::jetPalette(i, 1, nbi); }
+            }
+        return RGBc::c_Black;
+        }
+
+    private:
+
+    /* return the orbit of the reference point (computed once per reference point) */
+    std::shared_ptr<const std::vector<fVec2> > _orbit(const ddVec2 & ref, int nbi)
+        {
+        std::lock_guard<std::mutex> lock(_mut);
+        if ((_orb != nullptr) && (_ref == ref) && (_nbi == nbi)) return _orb;
+        auto orb = std::make_shared<std::vector<fVec2> >();
+        orb->reserve(nbi + 1);
+        DoubleDouble X = 0.0, Y = 0.0;
+        orb->push_back(fVec2(0.0, 0.0));
+        for (int i = 0; i < nbi; i++)
+            {
+            const DoubleDouble sX = X;
+            const DoubleDouble sY = Y;
+            X = sX*sX - sY*sY + ref.X();
+            Y = 2.0 * sX*sY + ref.Y();
+            orb->push_back(fVec2(X.toDouble(), Y.toDouble()));
+            if ((X.hi*X.hi + Y.hi*Y.hi) > 4) break;
+            }
+        _orb = orb;
+        _ref = ref;
+        _nbi = nbi;
+        return _orb;
+        }
+
+    std::mutex _mut;
+    std::shared_ptr<const std::vector<fVec2> > _orb;
+    ddVec2 _ref;
+    int _nbi = 0;
+    };
+
+
 /* Douady's rabbit
 here, the return type is 'std::pair<RGBc,bool>' 
 -> setting the bool to true forces the returned color to overwrite previous color at the same pixel. 
@@ -62,13 +172,21 @@ int main(int argc, char *argv[])
     cout << "Drawing Mandelbrot + Douady's rabbit.\n";
     cout << "**************************************\n";
     inIt = arg('n', 256).info("initial number of iterations");
+    bool batch = arg("batch").info("draw the Mandelbrot set with the batch method getColorRow()");
+    bool deep = arg("deep").info("draw the Mandelbrot set with the perturbation method (deep zoom mode)");
     Plotter2D Plotter;  // create the plotter
     int nb = nbHardwareThreads(); // total number of thread we can use
+    MandelbrotRow MR;
+    MandelbrotDeep MD;
     auto M = makePlot2DPlane(mandelbrot, nb/2, "Mandelbrot Set"); // the mandelbrot set
+    auto MB = makePlot2DPlane(MR, nb/2, "Mandelbrot Set (batch)"); // the mandelbrot set, row by row
+    auto MP = makePlot2DPlane(MD, nb/2, "Mandelbrot Set (deep zoom)"); // the mandelbrot set, with perturbation
     auto D = makePlot2DPlane(rabbit, nb-1 - nb/2, "Douady's rabbit"); // the mandelbrot set
-    Plotter[M][D];
+    if (deep) { Plotter[MP][D]; Plotter.range().deepZoom(true); } else if (batch) { Plotter[MB][D]; } else { Plotter[M][D]; }
     Plotter.sensibility(1);
     M.opacity(1.0);
+    MB.opacity(1.0);
+    MP.opacity(1.0);
     D.opacity(0.5);
     Plotter.range().setRange(fBox2(-0.65, -0.15, 0.4, 0.8));
     watch("Nb of iterations", inIt);
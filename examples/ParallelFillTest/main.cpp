@@ -0,0 +1,77 @@
+/***********************************************
+* Check that the filled shapes drawn by several
+* threads are identical, pixel by pixel, to those
+* drawn with a single thread.
+*
+* Return 0 if every drawing matches and 1 otherwise.
+ ***********************************************/
+
+#include "mtools/mtools.hpp"
+
+using namespace mtools;
+
+MT2004_64 gen;
+
+
+/* draw with fun() on two copies of the same image, once with a single thread and once with the
+   parallel path, and return the number of pixels that differ. */
+template<typename FUN> int64 compareFill(FUN fun)
+    {
+    Image serial(1500, 1300, RGBc::c_White);
+    Image parallel(1500, 1300, RGBc::c_White);
+    Image::parallelFillThreshold(std::numeric_limits<int64>::max());
+    fun(serial);
+    Image::parallelFillThreshold(0);
+    fun(parallel);
+    Image::parallelFillThreshold(Image::PARALLEL_FILL_THRESHOLD);
+    int64 nb = 0;
+    for (int64 j = 0; j < serial.ly(); j++) for (int64 i = 0; i < serial.lx(); i++) { if (serial(i, j) != parallel(i, j)) nb++; }
+    return nb;
+    }
+
+
+int main(int argc, char *argv[])
+    {
+    MTOOLS_SWAP_THREADS(argc,argv); // required on OSX, does nothing on Linux/Windows
+    int nberr = 0;
+
+    // thick polyline (self overlapping stroke)
+    std::vector<fVec2> line = { {100,150}, {1400,230}, {200,900}, {1300,1100}, {700,100}, {750,1250} };
+    for (int aa = 0; aa < 2; aa++) for (int blend = 0; blend < 2; blend++)
+        {
+        const int64 d = compareFill([&](Image & im) { im.draw_thick_polyline(line, 60, RGBc(0, 0, 0, 120), aa != 0, blend != 0); });
+        if (d != 0) { cout << "thick polyline (aa=" << aa << ", blend=" << blend << ") : " << d << " pixels differ\n"; nberr++; }
+        }
+
+    // random (non convex) filled polygons
+    for (int k = 0; k < 40; k++)
+        {
+        std::vector<fVec2> pol;
+        const int n = 5 + (int)(Unif(gen) * 40);
+        for (int i = 0; i < n; i++) pol.push_back({ Unif(gen) * 1700 - 100, Unif(gen) * 1500 - 100 });
+        const bool aa = (Unif(gen) < 0.5), blend = (Unif(gen) < 0.5);
+        const int64 d = compareFill([&](Image & im) { im.draw_filled_polygon(pol, RGBc(10, 200, 30, 150), RGBc(200, 30, 30, 100), aa, blend); });
+        if (d != 0) { cout << "filled polygon " << k << " : " << d << " pixels differ\n"; nberr++; }
+        }
+
+    // random thick filled ellipses (whole and parts)
+    for (int k = 0; k < 400; k++)
+        {
+        const fVec2 C(Unif(gen) * 2100 - 300, Unif(gen) * 1900 - 300);
+        const double rx = 2 + Unif(gen) * 1200, ry = 2 + Unif(gen) * 1200;
+        const double tx = 1 + Unif(gen) * 300, ty = 1 + Unif(gen) * 300;
+        const int part = (int)(Unif(gen) * 8);
+        const bool aa = (Unif(gen) < 0.5), blend = (Unif(gen) < 0.5);
+        const RGBc color(10, 200, 30, (uint8)(Unif(gen) * 256)), fillcolor(200, 30, 30, (uint8)(Unif(gen) * 256));
+        const int64 d = compareFill([&](Image & im)
+            {
+            if (k % 2) im.draw_thick_filled_ellipse(C, rx, ry, tx, ty, color, fillcolor, aa, blend);
+            else im.draw_part_thick_filled_ellipse(part, C, rx, ry, tx, ty, color, fillcolor, aa, blend);
+            });
+        if (d != 0) { cout << "thick filled ellipse " << k << " : " << d << " pixels differ\n"; nberr++; }
+        }
+
+    cout << ((nberr == 0) ? "OK: the parallel and serial fills are identical.\n" : "FAILED.\n");
+    return ((nberr == 0) ? 0 : 1);
+    }
+
@@ -22,6 +22,8 @@
 
 #include "../misc/internal/mtools_export.hpp"
 #include "../misc/error.hpp"
+#include "../misc/memory.hpp"
+#include "../misc/timefct.hpp"
 #include "../maths/vec.hpp"
 #include "../maths/box.hpp"
 #include "image.hpp"
@@ -31,6 +33,8 @@
 #include "svgelement.hpp"
 
 #include <type_traits>
+#include <fstream>
+#include <cstdio>
 
 #include "tinyxml2.h"
 
@@ -46,6 +50,7 @@ namespace mtools
 		namespace internals_figure
 			{
 			class FigureInterface;		// interface for a figure object
+			template<typename BATCH> void batchSpatialOrder(const BATCH & batch, std::vector<size_t> & order); // used when inserting batches
 			}
 
 		class Group;	// need specific code using move semantic when pushing it into a canvas. 
@@ -174,9 +179,10 @@ namespace mtools
 		/**
 		 * Constructor: create an empty canvas with a given number of layers. 
 		 **/
-		FigureCanvas(size_t nbLayers = 1) : _vecallocp(), _nbLayers(nbLayers), _figLayers(nullptr)
+		FigureCanvas(size_t nbLayers = 1) : _arenas(), _nbLayers(nbLayers), _figLayers(nullptr)
 			{
 			MTOOLS_INSURE(nbLayers > 0);
+			_arenas.resize(nbLayers);
 			_figLayers = new TreeFigure<Figure::internals_figure::FigureInterface*,N> [nbLayers];
 			}
 
@@ -194,8 +200,9 @@ namespace mtools
 		/**
 		* Move constructor
 		**/
-		FigureCanvas(FigureCanvas && o) : _vecallocp(std::move(o._vecallocp)), _nbLayers(o._nbLayers), _figLayers(o._figLayers)
+		FigureCanvas(FigureCanvas && o) : _arenas(std::move(o._arenas)), _nbLayers(o._nbLayers), _figLayers(o._figLayers)
 			{
+			o._arenas.clear(); o._arenas.resize(o._nbLayers);
 			o._figLayers = new TreeFigure<Figure::internals_figure::FigureInterface*, N>[o._nbLayers]; // create empty objects to replace to ones moved.
 			}
 
@@ -206,10 +213,13 @@ namespace mtools
 		FigureCanvas & operator=(FigureCanvas && o) 
 			{
 			if (&o == this) return *this;
-			_vecallocp = std::move(o._vecallocp);
+			clear();
+			delete[] _figLayers;
+			_arenas = std::move(o._arenas);
+			o._arenas.clear(); o._arenas.resize(o._nbLayers);
 			_nbLayers = o._nbLayers;
 			_figLayers = o._figLayers;
-			o._figLayers = new TreeFigure<Figure::internals_figure::FigureInterface*, N>(o._nbLayers); // create empty objects to replace to ones moved.
+			o._figLayers = new TreeFigure<Figure::internals_figure::FigureInterface*, N>[o._nbLayers]; // create empty objects to replace to ones moved.
 			return *this;
 			}
 
@@ -221,6 +231,15 @@ namespace mtools
 		template<typename FIGURECLASS> MTOOLS_FORCEINLINE void operator()(const FIGURECLASS & figure, size_t layer = 0);
 
 
+		/**
+		* Insert a temporary figure into the canvas, inside a given layer.
+		* The figure is moved into the memory pool of the layer instead of being copied.
+		* (IMPLEMENTATION AT BOTTOM OF FILE)
+		*/
+		template<typename FIGURECLASS, typename = typename std::enable_if<!std::is_lvalue_reference<FIGURECLASS>::value>::type>
+		MTOOLS_FORCEINLINE void operator()(FIGURECLASS && figure, size_t layer = 0);
+
+
 		/**
 		* Insert a group into a canvas, inside a given layer
 		* The group is emptied. 
@@ -237,13 +256,60 @@ namespace mtools
 		MTOOLS_FORCEINLINE void operator()(Figure::Pair & grp, size_t layer = 0);
 
 
+		/** Default number of elements per chunk when inserting a batch with insertBatch() */
+		static const size_t BATCH_CHUNK_SIZE = 4096;
+
+
+		/**
+		 * Insert a batch figure (Figure::DotBatch, Figure::SegmentBatch, Figure::CircleBatch...) into
+		 * the canvas, inside a given layer.
+		 * 
+		 * The elements of the batch are sorted along a space filling curve and split into chunks of
+		 * at most 'chunksize' elements, each chunk being inserted as a single figure. This way, only the
+		 * chunks that intersect the drawing range are visited when drawing.
+		 *
+		 * @param	batch	 	the batch to insert.
+		 * @param	layer	 	(Optional) the layer.
+		 * @param	chunksize	(Optional) maximum number of elements per chunk.
+		 **/
+		template<typename BATCH> void insertBatch(const BATCH & batch, size_t layer = 0, size_t chunksize = BATCH_CHUNK_SIZE)
+			{
+			MTOOLS_INSURE(layer < _nbLayers);
+			MTOOLS_INSURE(chunksize > 0);
+			const size_t n = batch.size();
+			if (n == 0) return;
+			if (n <= chunksize) { operator()(batch, layer); return; }
+			std::vector<size_t> order;
+			Figure::internals_figure::batchSpatialOrder(batch, order);
+			for (size_t k = 0; k < n; k += chunksize)
+				{
+				const size_t e = std::min<size_t>(n, k + chunksize);
+				BATCH chunk = batch.emptyClone();
+				chunk.reserve(e - k);
+				for (size_t j = k; j < e; j++) { chunk.appendFrom(batch, order[j]); }
+				operator()(std::move(chunk), layer);
+				}
+			}
+
+
 		/**   
 		 * Empty the canvas. 
 		 **/
 		void clear()
 			{
-			_deallocateAll();
-			for (size_t i = 0; i < _nbLayers; i++) _figLayers[i].reset();
+			for (size_t i = 0; i < _nbLayers; i++) clearLayer(i);
+			}
+
+
+		/**
+		 * Empty a given layer of the canvas.
+		 * All the memory used by the figures of this layer is released at once.
+		 **/
+		void clearLayer(size_t layer)
+			{
+			MTOOLS_INSURE(layer < _nbLayers);
+			_figLayers[layer].reset();
+			_deallocateLayer(layer);
 			}
 
 
@@ -259,7 +325,7 @@ namespace mtools
 		MTOOLS_FORCEINLINE size_t size() const
 			{
 			size_t tot = 0;
-			for (size_t i = 0; i < _nbLayers; i++) tot += _figLayers[0].size();
+			for (size_t i = 0; i < _nbLayers; i++) tot += _figLayers[i].size();
 			return tot;  
 			}
 
@@ -344,6 +410,9 @@ namespace mtools
 		 * 
 		 * An archive of the canvas is added at the end of the file so it can be reconstructed exactly
 		 * later using loadSVG()
+		 * 
+		 * The file is written in streaming fashion (no DOM of the document is created) so the memory
+		 * used does not depend on the number of figures in the canvas. 
 		 *
 		 * @param	filename	name of the file.
 		 * @param	minBB   	(Optional) True to use the minimal bounding box, false to use the main
@@ -355,21 +424,17 @@ namespace mtools
          *                      
 		 * @param   add_info	(Optional) True to add information about the canvas in the SVG file that allows 
          *                      to reconstruct the canvas later.
+		 * @param	mergePaths	(Optional) True to merge consecutive lines/polylines with the same style
+		 * 						into a single path element (much smaller files, see SVGWriter). Beware
+		 * 						that merging is lossy: the ids/comments of the merged figures are lost
+		 * 						and overlapping translucent strokes are blended only once.
+		 * @param	nbthreads 	(Optional) number of threads used to write the layers in parallel (each
+		 * 						layer is written in a temporary file with a unique name next to the 
+		 * 						output file and the files are concatenated at the end). 1 to write 
+		 * 						sequentially and 0 to use all hardware threads.
 		 **/
-		void saveSVG(const std::string & filename, bool minBB = true, fVec2 SVGSize = fVec2(-1, -1), bool add_info = true) const
+		void saveSVG(const std::string & filename, bool minBB = true, fVec2 SVGSize = fVec2(-1, -1), bool add_info = true, bool mergePaths = false, int nbthreads = 1) const
 			{
-			tinyxml2::XMLDocument xmlDoc;									// create main document
-			xmlDoc.InsertEndChild(xmlDoc.NewDeclaration());					// standard xml declaration
-
-			tinyxml2::XMLComment * com = xmlDoc.NewComment("File generated from a mtools::FigureCanvas object.");
-			xmlDoc.InsertEndChild(com);
-
-			tinyxml2::XMLUnknown * doc = xmlDoc.NewUnknown("DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\"");
-			xmlDoc.InsertEndChild(doc);
-
-			tinyxml2::XMLElement * svg = xmlDoc.NewElement("svg");			// main svg element
-			xmlDoc.InsertEndChild(svg);										// standard xml declaration
-
 			// minimum bounding box for all the object in the canvas
 			BBox bb; // global bounding box
 			for (size_t i = 0; i < _nbLayers; i++)
@@ -403,47 +468,71 @@ namespace mtools
 					svg_ly = BR.ly();
 					}
 				}
-			// set <svg> attributes
-			svg->SetAttribute("version", "1.1");
-			svg->SetAttribute("xmlns", "http://www.w3.org/2000/svg");
-			svg->SetAttribute("xmlns:xlink", "http://www.w3.org/1999/xlink");
-			svg->SetAttribute("width", svg_lx);
-			svg->SetAttribute("height", svg_ly);
+
+			std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+			if (!file.is_open())
+				{
+				MTOOLS_ERROR("FigureCanvas::saveSVG(). Cannot open file [" << filename << "].");
+				}
+			SVGWriter W(file, mergePaths);
+
+			// header and <svg> element
+			internals_svgelement::XMLNode svg;
+			svg.SetName("svg");
+			svg.SetAttribute("version", "1.1");
+			svg.SetAttribute("xmlns", "http://www.w3.org/2000/svg");
+			svg.SetAttribute("xmlns:xlink", "http://www.w3.org/1999/xlink");
+			svg.SetAttribute("width", svg_lx);
+			svg.SetAttribute("height", svg_ly);
 			mtools::ostringstream os;
 			os << bb.min[0] << " " << -(bb.max[1]) << " " << bb.lx() << " " << bb.ly();
-			svg->SetAttribute("viewBox", os.toString().c_str());
+			svg.SetAttribute("viewBox", os.toString().c_str());
+			std::string header = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<!--File generated from a mtools::FigureCanvas object.-->\n<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n<svg";
+			for (auto & A : svg.attributes) { header += " " + A.first + "=\""; SVGWriter::escape(header, A.second, true); header += "\""; }
+			header += ">\n";
+			W.raw(header);
 
 			// iterate over all layer, in order
-			for (size_t i = 0; i < _nbLayers; i++)
+			if (nbthreads <= 0) nbthreads = nbHardwareThreads();
+			if ((nbthreads == 1) || (_nbLayers == 1))
 				{
-				// Insert a group for this layer
-				tinyxml2::XMLElement * layer = xmlDoc.NewElement("g"); 
-				svg->InsertEndChild(layer);
-				layer->SetAttribute("id", (std::string("Figure Layer ") + mtools::toString(i)).c_str());
-
-				// iterate over all element in this layer
-				_figLayers[i].iterate_all([&](typename mtools::TreeFigure<typename Figure::internals_figure::FigureInterface *, N, double>::BoundedObject & bo) -> void
+				for (size_t i = 0; i < _nbLayers; i++) { _saveSVGLayer(W, i, fVec2(svg_lx, svg_ly), bb); }
+				}
+			else
+				{
+				std::vector<std::string> tmpnames(_nbLayers);
+				const std::string tmpbase = filename + "." + mtools::toString(randomID()) + ".layer"; // unique prefix (no collision with existing files or concurrent saves)
+				parallelFor((int64)_nbLayers, [&](int64 i)
 					{
-					SVGElement el(xmlDoc, layer);	// create an SVGElement for this figure (destroyed out of scope but the tinyxml2::XMLElement survives.
-					auto p = typeid(*(bo.object)).name();
-					MTOOLS_INSURE(strlen(p) > 14);							// make sure its contains "class mtools::..."
-					el.xml->SetAttribute("id", el.getUID(p+14).c_str());	// id  by its type
-					bo.object->svg(&el, fVec2(svg_lx, svg_ly), bb);			// draw on the SVGElement
-					});
+					tmpnames[(size_t)i] = tmpbase + mtools::toString(i) + ".tmp";
+					std::ofstream tmpfile(tmpnames[(size_t)i], std::ios::binary | std::ios::trunc);
+					if (!tmpfile.is_open()) { MTOOLS_ERROR("FigureCanvas::saveSVG(). Cannot open temporary file [" << tmpnames[(size_t)i] << "]."); }
+					SVGWriter LW(tmpfile, mergePaths);
+					_saveSVGLayer(LW, (size_t)i, fVec2(svg_lx, svg_ly), bb);
+					}, nbthreads);
+				W.flush();
+				for (size_t i = 0; i < _nbLayers; i++)
+					{ // concatenate
+					{
+					std::ifstream tmpfile(tmpnames[i], std::ios::binary);
+					if (tmpfile.peek() != std::ifstream::traits_type::eof()) { file << tmpfile.rdbuf(); }
+					}
+					std::remove(tmpnames[i].c_str());
+					}
 				}
 		
 			// add archive at the end of the svg element
 			if (add_info)
 				{
-				tinyxml2::XMLElement* mtoolsarchive = xmlDoc.NewElement("data-mtools");
-				svg->InsertEndChild(mtoolsarchive);
 				OStringArchive ar;
 				serialize(ar);
-				mtoolsarchive->SetText(ar.get().c_str());				
+				W.raw("<data-mtools>");
+				W.text(ar.get());
+				W.raw("</data-mtools>\n");
                 }
 
-			// and save everything
-			xmlDoc.SaveFile(filename.c_str()); 
+			W.raw("</svg>\n");
+			W.flush();
 			}
 
 
@@ -502,51 +591,66 @@ namespace mtools
 		FigureCanvas & operator=(const FigureCanvas &) = delete;
 
 		
+		/* write all the figures of a given layer */
+		void _saveSVGLayer(SVGWriter & W, size_t layer, fVec2 svg_size, const BBox & bb) const
+			{
+			W.raw(std::string("<g id=\"Figure Layer ") + mtools::toString(layer) + "\">\n");
+			_figLayers[layer].iterate_all([&](typename mtools::TreeFigure<typename Figure::internals_figure::FigureInterface *, N, double>::BoundedObject & bo) -> void
+				{
+				SVGElement el;											// element for this figure, written and discarded at once.
+				auto p = typeid(*(bo.object)).name();
+				MTOOLS_INSURE(strlen(p) > 14);							// make sure its contains "class mtools::..."
+				el.xml->SetAttribute("id", el.getUID(p+14).c_str());	// id  by its type
+				bo.object->svg(&el, svg_size, bb);						// draw on the SVGElement
+				W.write(el, 1);
+				});
+			W.raw("</g>\n");
+			}
+
+
 		/* Make a copy of the figure object inside the memory pool */
-		template<typename FIGURECLASS> MTOOLS_FORCEINLINE Figure::internals_figure::FigureInterface * _copyInPool(const FIGURECLASS & figure)
+		template<typename FIGURECLASS> MTOOLS_FORCEINLINE Figure::internals_figure::FigureInterface * _copyInPool(const FIGURECLASS & figure, size_t layer)
 			{
-			void * p = _allocate(sizeof(FIGURECLASS));					// allocate memory in the memory pool for the figure object
+			void * p = _allocate(sizeof(FIGURECLASS), layer);					// allocate memory in the memory pool for the figure object
 			new (p) FIGURECLASS(figure);								// placement new : copy constructor. 
 			return ((Figure::internals_figure::FigureInterface *)p);	// cast to base class. 
 			}
 
 
 		/* Make a copy of the figure object inside the memory pool, use move constructor */
-		template<typename FIGURECLASS> MTOOLS_FORCEINLINE Figure::internals_figure::FigureInterface * _copyInPoolWithMove(FIGURECLASS & figure)
+		template<typename FIGURECLASS> MTOOLS_FORCEINLINE Figure::internals_figure::FigureInterface * _copyInPoolWithMove(FIGURECLASS & figure, size_t layer)
 			{
-			void * p = _allocate(sizeof(FIGURECLASS));					// allocate memory in the memory pool for the figure object
+			void * p = _allocate(sizeof(FIGURECLASS), layer);					// allocate memory in the memory pool for the figure object
 			new (p) FIGURECLASS(std::move(figure));						// placement new : move constructor. 
 			return ((Figure::internals_figure::FigureInterface *)p);	// cast to base class. 
 			}
 
 
 		/* create a figure from an archive derectly inside the memory pool */
-		template<typename FIGURECLASS> MTOOLS_FORCEINLINE Figure::internals_figure::FigureInterface * _archiveInPool(mtools::IBaseArchive & ar, FIGURECLASS * dummy)
+		template<typename FIGURECLASS> MTOOLS_FORCEINLINE Figure::internals_figure::FigureInterface * _archiveInPool(mtools::IBaseArchive & ar, FIGURECLASS * dummy, size_t layer)
 			{
-			void * p = _allocate(sizeof(FIGURECLASS));					// allocate memory in the memory pool for the figure object
+			void * p = _allocate(sizeof(FIGURECLASS), layer);					// allocate memory in the memory pool for the figure object
 			new (p) FIGURECLASS(ar);									// placement new : copy constructor. 
 			return ((Figure::internals_figure::FigureInterface *)p);	// cast to base class. 
 			}
 
 
-		/******************** MEMORY POOL IMPLEMENTATION (TODO : REPLACE BY BETTER VERSION) **********************/
+		/******************** MEMORY POOL IMPLEMENTATION **********************/
 
-		/* allocate size bytes in the memory pool. TODO: REPLACE A BY BETTER VERSION THAN MALLOC/FREE */
-		MTOOLS_FORCEINLINE void * _allocate(size_t size)
+		/* allocate size bytes in the memory pool of a layer */
+		MTOOLS_FORCEINLINE void * _allocate(size_t size, size_t layer)
 			{
-			void * p = malloc(size);
-			_vecallocp.push_back(p); 
-			return  p;
+			return _arenas[layer].allocate(size);
 			}
 
 
-		/* delete all allocated memory TODO: REPLACE A BY BETTER VERSION THAN MALLOC/FREE 
+		/* destroy all the figures of a layer and release the memory
 		 * (IMPLEMENTATION AT BOTTOM OF FILE)
 		 */
-		void _deallocateAll();
+		void _deallocateLayer(size_t layer);
 
 
-		std::vector<void *>	_vecallocp;	// vector containing pointers to all allocated figures (TEMP WHILE USING MALLOC/FREE). 
+		std::vector<SizeClassArena>	_arenas;	// memory pool for each layer (figures of the same size are stored contiguously). 
 
 		/*********************************************************************************************************/
 
@@ -5665,6 +5769,470 @@ namespace mtools
 
 
 
+
+
+
+
+		/************************************************************************************************************************************
+		*
+		* BATCHES
+		*
+		* Homogeneous collections of simple primitives stored as structures of arrays. A batch is a
+		* single figure for the canvas (one virtual call and one entry in the tree for the whole
+		* batch) and draws its elements with a tight loop. Use FigureCanvas::insertBatch() to split a
+		* large batch into spatially coherent chunks so that the tree can still discard the parts
+		* outside of the drawing range.
+		*
+		* Every batch class provides size(), reserve(), anchor(i), appendFrom(src, i) and
+		* emptyClone() which are used by FigureCanvas::insertBatch().
+		*
+		*************************************************************************************************************************************/
+
+
+		namespace internals_figure
+			{
+
+			/* Affine map from a range to the image coordinates (same as boxTransform() but computed once for all the elements of a batch). */
+			struct BatchTransform
+				{
+				BatchTransform(const fBox2 & R, const fBox2 & imBox)
+					{
+					mx = (imBox.max[0] - imBox.min[0]) / (R.max[0] - R.min[0]);
+					my = (imBox.max[1] - imBox.min[1]) / (R.max[1] - R.min[1]);
+					rx = R.min[0];
+					ry = R.min[1];
+					xmin = imBox.min[0]; xmax = imBox.max[0];
+					ymin = imBox.min[1]; ymax = imBox.max[1];
+					}
+
+				/* same formula as boxTransform() (the offset is not folded into a constant to avoid cancellation at deep zoom) */
+				MTOOLS_FORCEINLINE double X(double x) const { return xmin + mx*(x - rx); }
+				MTOOLS_FORCEINLINE double Y(double y) const { return ymax - my*(y - ry); }
+
+				/* true if the box [x1,x2]x[y1,y2] (image coordinates) enlarged by margin does not intersect the image */
+				MTOOLS_FORCEINLINE bool outside(double x1, double x2, double y1, double y2, double margin) const
+					{
+					return ((x2 < xmin - margin) || (x1 > xmax + margin) || (y2 < ymin - margin) || (y1 > ymax + margin));
+					}
+
+				double mx, my, rx, ry;
+				double xmin, xmax, ymin, ymax;
+				};
+
+
+			/* Compute the permutation 'order' which sorts the elements of a batch along the Morton (Z-order) curve of their anchor points. */
+			template<typename BATCH> void batchSpatialOrder(const BATCH & batch, std::vector<size_t> & order)
+				{
+				const size_t n = batch.size();
+				fBox2 B;
+				for (size_t i = 0; i < n; i++) { B.swallowPoint(batch.anchor(i)); }
+				const double sx = (B.lx() > 0) ? (65535.0 / B.lx()) : 0.0;
+				const double sy = (B.ly() > 0) ? (65535.0 / B.ly()) : 0.0;
+				auto spread = [](uint32 v) -> uint32
+					{
+					v = (v | (v << 8)) & 0x00FF00FF;
+					v = (v | (v << 4)) & 0x0F0F0F0F;
+					v = (v | (v << 2)) & 0x33333333;
+					v = (v | (v << 1)) & 0x55555555;
+					return v;
+					};
+				std::vector<std::pair<uint32, size_t> > keys(n);
+				for (size_t i = 0; i < n; i++)
+					{
+					const fVec2 P = batch.anchor(i);
+					const uint32 qx = (uint32)((P.X() - B.min[0])*sx);
+					const uint32 qy = (uint32)((P.Y() - B.min[1])*sy);
+					keys[i] = std::pair<uint32, size_t>(spread(qx) | (spread(qy) << 1), i);
+					}
+				std::sort(keys.begin(), keys.end());
+				order.resize(n);
+				for (size_t i = 0; i < n; i++) { order[i] = keys[i].second; }
+				}
+
+			}
+
+
+
+		/*********************************************************
+		*
+		* DotBatch : a collection of square dots with individual
+		*            positions and colors and a common radius.
+		*
+		* The radius of the dots is absolute and does not scale
+		* with the range.
+		*
+		**********************************************************/
+		FIGURECLASS_BEGIN(DotBatch)
+
+
+			std::vector<double>	X;		// x coordinates
+			std::vector<double>	Y;		// y coordinates
+			std::vector<RGBc>	colors;	// colors
+			int32				pw;		// radius of the dots (0 = unit pixel)
+			fBox2				bb;		// bounding box (updated by push())
+
+
+			/**
+			 * Construct an empty batch
+			 *
+			 * @param	penwidth (Optional) radius (in pixels) of the dots.
+			 */
+			DotBatch(int32 penwidth = 0) : X(), Y(), colors(), pw(penwidth), bb()
+				{
+				MTOOLS_ASSERT(penwidth >= 0);
+				}
+
+
+			/** Add a dot to the batch. */
+			MTOOLS_FORCEINLINE void push(fVec2 P, RGBc color)
+				{
+				X.push_back(P.X()); Y.push_back(P.Y()); colors.push_back(color);
+				bb.swallowPoint(P);
+				}
+
+
+			/** Number of dots in the batch. */
+			MTOOLS_FORCEINLINE size_t size() const { return X.size(); }
+
+
+			/** Reserve memory for n dots. */
+			void reserve(size_t n) { X.reserve(n); Y.reserve(n); colors.reserve(n); }
+
+
+			/** Position of the i-th dot. */
+			MTOOLS_FORCEINLINE fVec2 anchor(size_t i) const { return fVec2(X[i], Y[i]); }
+
+
+			/** Append the i-th dot of another batch. */
+			MTOOLS_FORCEINLINE void appendFrom(const DotBatch & src, size_t i) { push(src.anchor(i), src.colors[i]); }
+
+
+			/** Return an empty batch with the same parameters (and the same transformation). */
+			DotBatch emptyClone() const
+				{
+				DotBatch res(pw);
+				static_cast<internals_figure::FigureInterface &>(res) = static_cast<const internals_figure::FigureInterface &>(*this);
+				return res;
+				}
+
+
+			virtual void virt_draw(Image & im, const fBox2 & R, bool highQuality, double min_thickness) override
+				{
+				const internals_figure::BatchTransform T(R, im.imagefBox());
+				const double margin = pw + 1.0;
+				const size_t n = X.size();
+				for (size_t i = 0; i < n; i++)
+					{
+					const double x = T.X(X[i]), y = T.Y(Y[i]);
+					if (T.outside(x, x, y, y, margin)) continue;
+					im.draw_square_dot(fVec2(x, y), colors[i], true, pw);
+					}
+				}
+
+
+			virtual fBox2 virt_boundingBox() const override { return bb; }
+
+
+			virtual std::string virt_toString(bool debug = false) const override
+				{
+				OSS os;
+				os << "DotBatch [" << X.size() << " dots, " << pw << "]";
+				if (debug) { for (size_t i = 0; i < X.size(); i++) { os << "\n " << anchor(i) << " " << colors[i]; } }
+				return os.str();
+				}
+
+
+			virtual void virt_serialize(OBaseArchive & ar) const override
+				{
+				ar & X & Y & colors & pw & bb;
+				}
+
+
+			DotBatch(IBaseArchive & ar) : FigureInterface(ar)
+				{
+				ar & X & Y & colors & pw & bb;
+				}
+
+
+			virtual void virt_svg(mtools::SVGElement * el, fVec2 svg_size, fBox2 svg_box) const override
+				{
+				el->SetName("g");
+				el->noStroke();
+				const double l = pw * pixelSize(svg_size, svg_box);
+				for (size_t i = 0; i < X.size(); i++)
+					{
+					auto d = el->NewChildSVGElement("rect");
+					d->setFillColor(colors[i]);
+					d->xml->SetAttribute("x", TX(X[i]) - l);
+					d->xml->SetAttribute("y", TY(Y[i]) - l);
+					d->xml->SetAttribute("width", 2 * l);
+					d->xml->SetAttribute("height", 2 * l);
+					}
+				}
+
+		FIGURECLASS_END()
+
+
+
+
+
+		/*********************************************************
+		*
+		* SegmentBatch : a collection of line segments with
+		*                individual endpoints and colors and a
+		*                common pen width.
+		*
+		**********************************************************/
+		FIGURECLASS_BEGIN(SegmentBatch)
+
+
+			std::vector<double>	X1, Y1;	// first endpoints
+			std::vector<double>	X2, Y2;	// second endpoints
+			std::vector<RGBc>	colors;	// colors
+			int32				pw;		// pen width (0 = unit pixel line)
+			fBox2				bb;		// bounding box (updated by push())
+
+
+			/**
+			 * Construct an empty batch
+			 *
+			 * @param	penwidth (Optional) pen width of the segments (0 = unit pixel line).
+			 */
+			SegmentBatch(int32 penwidth = 0) : X1(), Y1(), X2(), Y2(), colors(), pw(penwidth), bb()
+				{
+				}
+
+
+			/** Add a segment to the batch. */
+			MTOOLS_FORCEINLINE void push(fVec2 P1, fVec2 P2, RGBc color)
+				{
+				X1.push_back(P1.X()); Y1.push_back(P1.Y());
+				X2.push_back(P2.X()); Y2.push_back(P2.Y());
+				colors.push_back(color);
+				bb.swallowPoint(P1);
+				bb.swallowPoint(P2);
+				}
+
+
+			/** Number of segments in the batch. */
+			MTOOLS_FORCEINLINE size_t size() const { return X1.size(); }
+
+
+			/** Reserve memory for n segments. */
+			void reserve(size_t n) { X1.reserve(n); Y1.reserve(n); X2.reserve(n); Y2.reserve(n); colors.reserve(n); }
+
+
+			/** Middle of the i-th segment. */
+			MTOOLS_FORCEINLINE fVec2 anchor(size_t i) const { return fVec2((X1[i] + X2[i]) / 2, (Y1[i] + Y2[i]) / 2); }
+
+
+			/** Append the i-th segment of another batch. */
+			MTOOLS_FORCEINLINE void appendFrom(const SegmentBatch & src, size_t i) { push(fVec2(src.X1[i], src.Y1[i]), fVec2(src.X2[i], src.Y2[i]), src.colors[i]); }
+
+
+			/** Return an empty batch with the same parameters (and the same transformation). */
+			SegmentBatch emptyClone() const
+				{
+				SegmentBatch res(pw);
+				static_cast<internals_figure::FigureInterface &>(res) = static_cast<const internals_figure::FigureInterface &>(*this);
+				return res;
+				}
+
+
+			virtual void virt_draw(Image & im, const fBox2 & R, bool highQuality, double min_thickness) override
+				{
+				const internals_figure::BatchTransform T(R, im.imagefBox());
+				const double margin = pw + min_thickness + 1.0;
+				const size_t n = X1.size();
+				for (size_t i = 0; i < n; i++)
+					{
+					const double x1 = T.X(X1[i]), y1 = T.Y(Y1[i]);
+					const double x2 = T.X(X2[i]), y2 = T.Y(Y2[i]);
+					if (T.outside(std::min(x1, x2), std::max(x1, x2), std::min(y1, y2), std::max(y1, y2), margin)) continue;
+					im.draw_line(fVec2(x1, y1), fVec2(x2, y2), colors[i], true, highQuality, true, pw, min_thickness);
+					}
+				}
+
+
+			virtual fBox2 virt_boundingBox() const override { return bb; }
+
+
+			virtual std::string virt_toString(bool debug = false) const override
+				{
+				OSS os;
+				os << "SegmentBatch [" << X1.size() << " segments, " << pw << "]";
+				if (debug) { for (size_t i = 0; i < X1.size(); i++) { os << "\n " << fVec2(X1[i], Y1[i]) << " " << fVec2(X2[i], Y2[i]) << " " << colors[i]; } }
+				return os.str();
+				}
+
+
+			virtual void virt_serialize(OBaseArchive & ar) const override
+				{
+				ar & X1 & Y1 & X2 & Y2 & colors & pw & bb;
+				}
+
+
+			SegmentBatch(IBaseArchive & ar) : FigureInterface(ar)
+				{
+				ar & X1 & Y1 & X2 & Y2 & colors & pw & bb;
+				}
+
+
+			virtual void virt_svg(mtools::SVGElement * el, fVec2 svg_size, fBox2 svg_box) const override
+				{
+				el->SetName("g");
+				el->tinyStroke(svg_size, svg_box);
+				for (size_t i = 0; i < X1.size(); i++)
+					{
+					auto d = el->NewChildSVGElement("line");
+					d->xml->SetAttribute("x1", TX(X1[i]));
+					d->xml->SetAttribute("y1", TY(Y1[i]));
+					d->xml->SetAttribute("x2", TX(X2[i]));
+					d->xml->SetAttribute("y2", TY(Y2[i]));
+					d->setStrokeColor(colors[i]);
+					}
+				}
+
+		FIGURECLASS_END()
+
+
+
+
+
+		/*********************************************************
+		*
+		* CircleBatch : a collection of circles with individual
+		*               centers, radii and colors.
+		*
+		**********************************************************/
+		FIGURECLASS_BEGIN(CircleBatch)
+
+
+			std::vector<double>	X;			// x coordinates of the centers
+			std::vector<double>	Y;			// y coordinates of the centers
+			std::vector<double>	radius;		// radii
+			std::vector<RGBc>	colors;		// outline colors
+			std::vector<RGBc>	fillcolors;	// fill colors (transparent = no filling)
+			fBox2				bb;			// bounding box (updated by push())
+
+
+			/** Construct an empty batch. */
+			CircleBatch() : X(), Y(), radius(), colors(), fillcolors(), bb()
+				{
+				}
+
+
+			/** Add a circle to the batch (without filling). */
+			MTOOLS_FORCEINLINE void push(fVec2 center, double rad, RGBc color)
+				{
+				push(center, rad, color, RGBc::c_Transparent);
+				}
+
+
+			/** Add a filled circle to the batch. */
+			MTOOLS_FORCEINLINE void push(fVec2 center, double rad, RGBc color, RGBc fillcolor)
+				{
+				MTOOLS_ASSERT(rad >= 0);
+				X.push_back(center.X()); Y.push_back(center.Y()); radius.push_back(rad);
+				colors.push_back(color); fillcolors.push_back(fillcolor);
+				bb.swallowBox(fBox2(center.X() - rad, center.X() + rad, center.Y() - rad, center.Y() + rad));
+				}
+
+
+			/** Number of circles in the batch. */
+			MTOOLS_FORCEINLINE size_t size() const { return X.size(); }
+
+
+			/** Reserve memory for n circles. */
+			void reserve(size_t n) { X.reserve(n); Y.reserve(n); radius.reserve(n); colors.reserve(n); fillcolors.reserve(n); }
+
+
+			/** Center of the i-th circle. */
+			MTOOLS_FORCEINLINE fVec2 anchor(size_t i) const { return fVec2(X[i], Y[i]); }
+
+
+			/** Append the i-th circle of another batch. */
+			MTOOLS_FORCEINLINE void appendFrom(const CircleBatch & src, size_t i) { push(src.anchor(i), src.radius[i], src.colors[i], src.fillcolors[i]); }
+
+
+			/** Return an empty batch with the same transformation. */
+			CircleBatch emptyClone() const
+				{
+				CircleBatch res;
+				static_cast<internals_figure::FigureInterface &>(res) = static_cast<const internals_figure::FigureInterface &>(*this);
+				return res;
+				}
+
+
+			virtual void virt_draw(Image & im, const fBox2 & R, bool highQuality, double min_thickness) override
+				{
+				const double EPS = 0.4;
+				const internals_figure::BatchTransform T(R, im.imagefBox());
+				const size_t n = X.size();
+				for (size_t i = 0; i < n; i++)
+					{
+					const double x = T.X(X[i]), y = T.Y(Y[i]);
+					const double rx = T.mx*radius[i], ry = T.my*radius[i];
+					if (T.outside(x - rx, x + rx, y - ry, y + ry, 1.0)) continue;
+					const fVec2 C(x, y);
+					if (fillcolors[i].isTransparent())
+						{
+						if (std::abs<double>(rx - ry) < EPS) im.draw_circle(C, rx, colors[i], highQuality, true);
+						else im.draw_ellipse(C, rx, ry, colors[i], highQuality, true);
+						}
+					else
+						{
+						if (std::abs<double>(rx - ry) < EPS) im.draw_filled_circle(C, rx, colors[i], fillcolors[i], highQuality, true);
+						else im.draw_filled_ellipse(C, rx, ry, colors[i], fillcolors[i], highQuality, true);
+						}
+					}
+				}
+
+
+			virtual fBox2 virt_boundingBox() const override { return bb; }
+
+
+			virtual std::string virt_toString(bool debug = false) const override
+				{
+				OSS os;
+				os << "CircleBatch [" << X.size() << " circles]";
+				if (debug) { for (size_t i = 0; i < X.size(); i++) { os << "\n " << anchor(i) << " " << radius[i] << " " << colors[i] << " " << fillcolors[i]; } }
+				return os.str();
+				}
+
+
+			virtual void virt_serialize(OBaseArchive & ar) const override
+				{
+				ar & X & Y & radius & colors & fillcolors & bb;
+				}
+
+
+			CircleBatch(IBaseArchive & ar) : FigureInterface(ar)
+				{
+				ar & X & Y & radius & colors & fillcolors & bb;
+				}
+
+
+			virtual void virt_svg(mtools::SVGElement * el, fVec2 svg_size, fBox2 svg_box) const override
+				{
+				el->SetName("g");
+				el->tinyStroke(svg_size, svg_box);
+				for (size_t i = 0; i < X.size(); i++)
+					{
+					auto d = el->NewChildSVGElement("circle");
+					d->setFillColor(fillcolors[i]);
+					d->setStrokeColor(colors[i]);
+					d->xml->SetAttribute("cx", TX(X[i]));
+					d->xml->SetAttribute("cy", TY(Y[i]));
+					d->xml->SetAttribute("r", TR(radius[i]));
+					}
+				}
+
+		FIGURECLASS_END()
+
+
+
+
 /*********************************************************************************************************
 * Undef macro used for creating figure classes
 **********************************************************************************************************/
@@ -5703,6 +6271,7 @@ namespace mtools
 				delete[] _figLayers;
 				_nbLayers = nblayers_ar;
 				_figLayers = new TreeFigure<Figure::internals_figure::FigureInterface*, N>[_nbLayers];
+				_arenas.resize(_nbLayers);
 			}
 
 			// add all the elements
@@ -5731,7 +6300,20 @@ namespace mtools
 	template <typename FIGURECLASS> MTOOLS_FORCEINLINE void FigureCanvas<N>::operator()(const FIGURECLASS & figure, size_t layer)
 		{
 		MTOOLS_INSURE(layer < _nbLayers);
-		Figure::internals_figure::FigureInterface * pf = _copyInPool(figure);			// save a copy of the object in the memory pool
+		Figure::internals_figure::FigureInterface * pf = _copyInPool(figure, layer);	// save a copy of the object in the memory pool
+		_figLayers[layer].insert(pf->boundingBox(), pf);	// add to the corresponding layer. 
+		return;
+		}
+
+
+	/**
+	* Insert a temporary figure into the canvas, inside a given layer (move semantics).
+	*/
+	template<int N> 
+	template <typename FIGURECLASS, typename> MTOOLS_FORCEINLINE void FigureCanvas<N>::operator()(FIGURECLASS && figure, size_t layer)
+		{
+		MTOOLS_INSURE(layer < _nbLayers);
+		Figure::internals_figure::FigureInterface * pf = _copyInPoolWithMove(figure, layer);	// move the object in the memory pool
 		_figLayers[layer].insert(pf->boundingBox(), pf);	// add to the corresponding layer. 
 		return;
 		}
@@ -5743,7 +6325,7 @@ namespace mtools
 	template<int N> MTOOLS_FORCEINLINE void FigureCanvas<N>::operator()(Figure::Group & grp, size_t layer)
 		{
 		MTOOLS_INSURE(layer < _nbLayers);
-		Figure::internals_figure::FigureInterface * pf = _copyInPoolWithMove(grp);		// copy the object in the memory pool
+		Figure::internals_figure::FigureInterface * pf = _copyInPoolWithMove(grp, layer);	// copy the object in the memory pool
 		_figLayers[layer].insert(pf->boundingBox(), pf);								// add to the corresponding layer. 
 		grp._disable();																	// disable the group object since it  has been inserted
 		return;
@@ -5756,7 +6338,7 @@ namespace mtools
 	template<int N> MTOOLS_FORCEINLINE void FigureCanvas<N>::operator()(Figure::Pair & grp, size_t layer)
 		{
 		MTOOLS_INSURE(layer < _nbLayers);
-		Figure::internals_figure::FigureInterface * pf = _copyInPoolWithMove(grp);		// copy the object in the memory pool
+		Figure::internals_figure::FigureInterface * pf = _copyInPoolWithMove(grp, layer);	// copy the object in the memory pool
 		_figLayers[layer].insert(pf->boundingBox(), pf);								// add to the corresponding layer. 
 		grp._disable();																	// disable the group object since it  has been inserted
 		return;
@@ -5764,15 +6346,10 @@ namespace mtools
 
 
 
-	/* delete all allocated memory TODO: REPLACE A BY BETTER VERSION THAN MALLOC/FREE */
-	template<int N> void FigureCanvas<N>::_deallocateAll()
+	/* destroy all the figures of a layer and release the memory */
+	template<int N> void FigureCanvas<N>::_deallocateLayer(size_t layer)
 		{
-		for (void *  p : _vecallocp) 
-			{
-			((Figure::internals_figure::FigureInterface*)p)->~FigureInterface();	// call dtor
-			free(p);																// free memory
-			}
-		_vecallocp.clear();
+		_arenas[layer].destroyAll<Figure::internals_figure::FigureInterface>();	// call the dtors and release the slabs at once
 		}
 
 
@@ -5790,7 +6367,7 @@ namespace mtools
 			if (match != 0) { MTOOLS_ERROR("class name [" << classname << "] is already in use by another class !"); }
 			if (canvas != nullptr)
 				{
-				pfig = canvas->_archiveInPool(ar, (FIGURECLASS*)(0)); 
+				pfig = canvas->_archiveInPool(ar, (FIGURECLASS*)(0), layer); 
 				}
 			else
 				{
@@ -5903,6 +6480,16 @@ namespace mtools
 
 		REGISTER_ARCHIVE_FIGURE_CLASS(Figure::Pair);
 
+		/************************************************************************************************************************************
+		* BATCHES
+		*************************************************************************************************************************************/
+
+		REGISTER_ARCHIVE_FIGURE_CLASS(Figure::DotBatch);
+
+		REGISTER_ARCHIVE_FIGURE_CLASS(Figure::SegmentBatch);
+
+		REGISTER_ARCHIVE_FIGURE_CLASS(Figure::CircleBatch);
+
 
 		// make sure we had a match, otherwise this means that the classname is not registered
 		if (match == 0) { MTOOLS_ERROR("Figure class name [" << classname << "] is not registered with any class !"); }
@@ -29,6 +29,11 @@
 #include "rgbc.hpp"
 #include "../io/serialization.hpp"
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+
 
 namespace mtools
 	{
@@ -86,6 +91,9 @@ namespace mtools
 
 
 
+	class GlyphAtlas;
+
+
 	/**
 	* Class object representing a font at a given size.
 	*
@@ -99,7 +107,7 @@ namespace mtools
 		public:
 
 			/** Default constructor. Empty font */
-			Font() : _fontsize(0), _tab() {}
+			Font() : _fontsize(0), _tab(), _id(0) {}
 
 
 			/**
@@ -118,9 +126,9 @@ namespace mtools
 			*
 			* @param [in,out]	ar	The archive.
 			**/
-			Font(IBaseArchive & ar) : _fontsize(0), _tab()
+			Font(IBaseArchive & ar) : _fontsize(0), _tab(), _id(0)
 				{
-				serialize(ar);
+				deserialize(ar);
 				}
 
 
@@ -130,7 +138,7 @@ namespace mtools
 			* @param	ft			the font to copy.
 			* @param	fontsize	the font size.
 			**/
-			Font(const Font & ft, int fontsize) : _fontsize(0), _tab()
+			Font(const Font & ft, int fontsize) : _fontsize(0), _tab(), _id(0)
 				{
 				createFrom(ft, fontsize);
 				}
@@ -139,17 +147,18 @@ namespace mtools
 			/**
 			* Move constructor.
 			**/
-			Font(Font && ft) : _fontsize(ft._fontsize), _tab(std::move(ft._tab))
+			Font(Font && ft) : _fontsize(ft._fontsize), _tab(std::move(ft._tab)), _id(ft._id)
 				{
 				ft._fontsize = 0;
 				ft._tab.clear();
+				ft._id = 0;
 				}
 
 
 			/**
 			* Copy constructor (shallow !)
 			**/
-			Font(const Font & ft) : _fontsize(ft._fontsize), _tab(ft._tab)
+			Font(const Font & ft) : _fontsize(ft._fontsize), _tab(ft._tab), _id(ft._id)
 				{
 				}
 
@@ -164,8 +173,10 @@ namespace mtools
 					_tab.clear();
 					_fontsize = ft._fontsize;
 					_tab = std::move(ft._tab);
+					_id = ft._id;
 					ft._fontsize = 0;
 					ft._tab.clear();
+					ft._id = 0;
 					}
 				return(*this);
 				}
@@ -180,6 +191,7 @@ namespace mtools
 					{
 					_fontsize = ft._fontsize;
 					_tab = ft._tab;
+					_id = ft._id;
 					}
 				return(*this);
 				}
@@ -293,22 +305,53 @@ namespace mtools
 
 
 			/**
-			* serialize/deserialize the font.
+			 * Return the glyph atlas of the font for a given color.
+			 *
+			 * Atlases are kept in a global cache (shared between threads) so calling this method
+			 * repeatedly with the same color is cheap.
+			 *
+			 * @param	color	The color of the glyphs.
+			 *
+			 * @return	The atlas (nullptr if the font is empty).
+			 **/
+			std::shared_ptr<const GlyphAtlas> atlas(RGBc color) const;
+
+
+			/**
+			* Serialize the font.
+			**/
+			void serialize(OBaseArchive & ar) const
+				{
+				ar & _fontsize;
+				ar & _tab;
+				}
+
+
+			/**
+			* Deserialize the font.
 			**/
-			template<typename ARCHIVE> void serialize(ARCHIVE & ar)
+			void deserialize(IBaseArchive & ar)
 				{
 				ar & _fontsize;
 				ar & _tab;
+				_id = _newId();
 				}
 
 
+			static const int MAX_ATLAS_FONT_SIZE = 256;	///< text with a larger font is drawn glyph by glyph without using an atlas.
+
+
 
 		private:
 
 			friend class FontFamily;
+			friend class GlyphAtlas;
 
 			/** Empty the font (only for friend class) **/
-			void empty() { _fontsize = 0; _tab.clear(); }
+			void empty() { _fontsize = 0; _tab.clear(); _id = 0; }
+
+			/* return a new unique identifier for the glyphs of a font */
+			static uint64 _newId();
 
 			/* trim the glyph image and set glyph.offx and glyph.offy values */
 			void _trim(int c);
@@ -329,12 +372,87 @@ namespace mtools
 
 			int64 _fontsize;			// size of the font
 			std::vector<Glyph> _tab;	// vector containing the glyphs. 
+			uint64 _id;					// identifier of the glyphs (shared by shallow copies), used as key for the atlas cache.
 
 		};
 
 
 
 
+	/**
+	 * Glyph atlas.
+	 *
+	 * All the glyphs of a font, rendered with a given color and packed into a single image. The
+	 * sprites store the color already multiplied by the opacity of the glyph (premultiplied alpha)
+	 * so drawing a glyph is a plain blend (or a copy for opaque pixels) and each row of a sprite
+	 * records its first and last non transparent pixel so that empty parts are skipped. The
+	 * result is identical to masking the glyphs of the font with the color.
+	 *
+	 * An atlas is immutable once constructed hence it can be shared between threads. Use
+	 * Font::atlas() to obtain one from the global cache.
+	 **/
+	class GlyphAtlas
+		{
+
+		public:
+
+			/**
+			 * Constructor. Render all the glyphs of a font with a given color.
+			 *
+			 * @param	font 	The font.
+			 * @param	color	The color of the glyphs.
+			 **/
+			GlyphAtlas(const Font & font, RGBc color);
+
+
+			/**
+			 * Draw a text on an image.
+			 *
+			 * @param [in,out]	im	The image to draw onto.
+			 * @param	pos		  	position of the upper left corner of the text.
+			 * @param	txt		  	The text to draw.
+			 **/
+			void drawText(Image & im, iVec2 pos, const std::string & txt) const;
+
+
+			/** The color of the glyphs. */
+			RGBc color() const { return _color; }
+
+
+			/** Size of the font. */
+			int fontsize() const { return (int)_fontsize; }
+
+
+			/** Approximate memory used by the atlas (in bytes). */
+			size_t memory() const { return (size_t)(_atlas.lx()*_atlas.ly()) * sizeof(RGBc) + _spans.size() * sizeof(_spans[0]) + sizeof(GlyphAtlas); }
+
+
+		private:
+
+			/* position of a glyph sprite inside the atlas */
+			struct Sprite
+				{
+				int64 x0, y0;		// upper left corner in the atlas image
+				int64 lx, ly;		// size of the sprite
+				int64 offx, offy;	// offset of the glyph
+				int64 width;		// advance
+				size_t row;			// index of the first row of the sprite in _spans
+				};
+
+			/* blend a sprite at a given position */
+			void _blit(Image & im, const Sprite & S, int64 x, int64 y) const;
+
+			int64 _fontsize;							// size of the font
+			RGBc _color;								// color of the glyphs
+			Image _atlas;								// image containing all the (premultiplied) sprites
+			std::vector<Sprite> _sprites;				// the 256 sprites
+			std::vector<std::pair<int32, int32> > _spans; // for each row of each sprite, range of non transparent pixels (empty if first > second)
+		};
+
+
+
+
+
 
 
 
@@ -386,6 +504,7 @@ namespace mtools
 					int fs; ar & fs;
 					_nativeset.insert(fs);
 					ar & _fonts[fs];
+					_ready[fs].store(true, std::memory_order_release);
 					}
 				}
 
@@ -402,6 +521,7 @@ namespace mtools
 				if ((size <= 0)||(size >= MAX_FONT_SIZE)) return; 
 				_fonts[size] = font;
 				_nativeset.insert(size);
+				_ready[size].store(true, std::memory_order_release);
 				}
 
 
@@ -432,7 +552,7 @@ namespace mtools
 			inline const Font & operator()(int fontsize, int  method = MTOOLS_NATIVE_FONT_BELOW)
 				{
 				int fs = nearestSize(fontsize, method);
-				if (_fonts[fontsize].isEmpty()) { _constructFont(fs); }
+				if (!_ready[fs].load(std::memory_order_acquire)) { _constructFont(fs); }
 				return _fonts[fs];
 				}
 
@@ -470,6 +590,7 @@ namespace mtools
 
 			std::set<int>		_nativeset;				// set that keep tracks of native fonts
 			std::vector<Font>	_fonts;					// vector of fonts. 
+			std::unique_ptr<std::atomic<bool>[]> _ready;	// _ready[fs] is set once _fonts[fs] is completely constructed.
 			std::mutex			_mut;					// mutex for mutlithread access to global font objects. 
 		};
 
@@ -33,10 +33,16 @@
 #include "internal/clipping.hpp"
 #include "internal/polyline.hpp"
 #include "internal/bseg.hpp"
+#include "internal/floodfill.hpp"
+#include "pngwriter.hpp"
+
+#include "../misc/internal/threadworker.hpp"
 
 #include "../misc/timefct.hpp"
 
 #include <iostream>
+#include <atomic>
+#include <limits>
 
 #if (MTOOLS_USE_CAIRO)
 #include <cairo.h>
@@ -168,6 +174,24 @@ namespace mtools
 			static constexpr bool	DEFAULT_BLEND		  = true;			///< default mode is to use blending.
 			static constexpr bool	DEFAULT_GRID_ALIGN    = true;			///< default mode is to align to grid for faster drawing.
 			static constexpr double DEFAULT_MIN_THICKNESS = 0.5;			///< default minimum thickness set to 0.5 
+			static constexpr int64	PARALLEL_FILL_THRESHOLD = 512*512;	///< default minimum area (in pixels) of the visible bounding box of a primitive for filling it with several threads.
+
+
+			/**
+			 * Set the minimum area (in pixels) of the visible bounding box of a thick filled ellipse for
+			 * drawing it with several threads (default PARALLEL_FILL_THRESHOLD). The drawing does not
+			 * depend on this value: a very large value simply forces the use of a single thread.
+			 *
+			 * @param	area	The new threshold.
+			 */
+			static void parallelFillThreshold(int64 area) { _parallelFillThreshold() = area; }
+
+
+			/**
+			 * Return the minimum area (in pixels) of the visible bounding box of a thick filled ellipse
+			 * for drawing it with several threads.
+			 */
+			static int64 parallelFillThreshold() { return _parallelFillThreshold(); }
 
 
 			/******************************************************************************************************************************************************
@@ -3757,8 +3781,7 @@ namespace mtools
 				const double arx = std::max<double>(rx - thickness_x, 0);
 				const double ary = std::max<double>(ry - thickness_y, 0);
 				const iBox2 B = imageBox();
-				if (blend) _draw_ellipse_thick_AA<true, true>(B, center, arx, ary, rx, ry, color, fillcolor);
-				else _draw_ellipse_thick_AA<false, true>(B, center, arx, ary, rx, ry, color, fillcolor);
+				_draw_ellipse_thick_AA_parallel(B, center, arx, ary, rx, ry, color, fillcolor, blend);
 			}
 
 
@@ -3791,8 +3814,7 @@ namespace mtools
 				const double arx = std::max<double>(rx - thickness_x, 0);
 				const double ary = std::max<double>(ry - thickness_y, 0);
 				iBox2 B = intersectionRect(imageBox(), _ellipseBBox(center, rx, ry).get_split(part));
-				if (blend) _draw_ellipse_thick_AA<true, true>(B, center, arx, ary, rx, ry, color, fillcolor);
-				else _draw_ellipse_thick_AA<false, true>(B, center, arx, ary, rx, ry, color, fillcolor);
+				_draw_ellipse_thick_AA_parallel(B, center, arx, ary, rx, ry, color, fillcolor, blend);
 				}
 
 
@@ -4459,6 +4481,69 @@ namespace mtools
 
 
 
+			/**
+			 * Flood fill the connected region containing pixel (x,y).
+			 *
+			 * The region consists of all the pixels connected to (x,y) whose color is within 'tolerance'
+			 * of the color of pixel (x,y) (i.e. each of the four channels R,G,B,A differs by at most
+			 * 'tolerance'). The filling is done span by span (scanline seed fill) using an explicit stack
+			 * that is reused between calls so there is no recursion and no allocation per pixel.
+			 *
+			 * When several threads are used, the pending spans are shared dynamically between the
+			 * threads. This is only worth it for very large regions (several millions of pixels).
+			 *
+			 * @param	x		  	x coordinate of the starting pixel.
+			 * @param	y		  	y coordinate of the starting pixel.
+			 * @param	fillcolor 	the color to fill the region with.
+			 * @param	tolerance 	maximum difference per channel with the color of the starting pixel
+			 * 						(0 for exact match).
+			 * @param	connect8  	true to use 8-connectivity (diagonal neighbours) and false for
+			 * 						4-connectivity.
+			 * @param	blending  	true to blend fillcolor over the region and false to overwrite it.
+			 * @param	nbthreads 	number of threads to use (0 to use all the hardware threads).
+			 *
+			 * @return	the number of pixels filled (0 if (x,y) is outside of the image).
+			 **/
+			int64 floodFill(int64 x, int64 y, RGBc fillcolor, int tolerance = 0, bool connect8 = false, bool blending = false, int nbthreads = 1)
+				{
+				if ((x < 0) || (y < 0) || (x >= _lx) || (y >= _ly)) return 0;
+				if (nbthreads <= 0) nbthreads = nbHardwareThreads();
+				const RGBc target = _data[x + _stride*y];
+				_FloodWorkspace & W = _floodWorkspace();
+				if ((!blending) && (nbthreads == 1) && (!_floodMatch(fillcolor, target, tolerance)))
+					{ // filled pixels do not match anymore: no need to mark them.
+					auto inside = [&](int64 i, int64 j) -> bool { return _floodMatch(_data[i + _stride*j], target, tolerance); };
+					auto fill = [&](int64 x1, int64 x2, int64 j) { _hline<false, false>(x1, x2, j, fillcolor); };
+					return internals_floodfill::spanFill(x, y, _lx, _ly, connect8, inside, fill, W.stack);
+					}
+				W.visited.reset(_lx, _ly);
+				auto inside = [&](int64 i, int64 j) -> bool { return ((W.visited.claim(i, j)) && (_floodMatch(_data[i + _stride*j], target, tolerance))); };
+				auto fill = [&](int64 x1, int64 x2, int64 j) { if (blending) _hline<true, false>(x1, x2, j, fillcolor); else _hline<false, false>(x1, x2, j, fillcolor); };
+				if (nbthreads > 1) return internals_floodfill::parallelSpanFill(x, y, _lx, _ly, connect8, inside, fill, nbthreads);
+				return internals_floodfill::spanFill(x, y, _lx, _ly, connect8, inside, fill, W.stack);
+				}
+
+
+			/**
+			 * Flood fill the connected region containing pixel pos.
+			 *
+			 * @param	pos		  	position of the starting pixel.
+			 * @param	fillcolor 	the color to fill the region with.
+			 * @param	tolerance 	maximum difference per channel with the color of the starting pixel
+			 * 						(0 for exact match).
+			 * @param	connect8  	true to use 8-connectivity and false for 4-connectivity.
+			 * @param	blending  	true to blend fillcolor over the region and false to overwrite it.
+			 * @param	nbthreads 	number of threads to use (0 to use all the hardware threads).
+			 *
+			 * @return	the number of pixels filled.
+			 **/
+			inline int64 floodFill(const iVec2 & pos, RGBc fillcolor, int tolerance = 0, bool connect8 = false, bool blending = false, int nbthreads = 1)
+				{
+				return floodFill(pos.X(), pos.Y(), fillcolor, tolerance, connect8, blending, nbthreads);
+				}
+
+
+
 			/******************************************************************************************************************************************************
 			*******************************************************************************************************************************************************
 			*																				   																      *
@@ -5024,8 +5109,30 @@ namespace mtools
 
 
 			/**
-			 * Saves the image into a file. uses CImg's save method (hence support all formats supported by
-			 * CImg).
+			 * Saves the image into a file in PNG format using the native streaming PNGWriter.
+			 *
+			 * The rows of the image are split into bands which are filtered and deflated in parallel and
+			 * written incrementally: the image is never copied as a whole.
+			 *
+			 * @param	filename		  	name of the file.
+			 * @param	compression_level 	zlib compression level between 0 (no compression) and 9 (best compression).
+			 * @param	filter_strategy   	filtering strategy (one of the PNGWriter::FilterStrategy values).
+			 * @param	nb_threads		  	number of threads to use (0 to use all hardware threads).
+			 *
+			 * @return	true if the operation succedded and false if it failed.
+			 */
+			bool save_png(const char * filename, int compression_level = PNGWriter::DEFAULT_COMPRESSION_LEVEL, int filter_strategy = PNGWriter::DEFAULT_FILTER, int nb_threads = 0) const
+				{
+				if (isEmpty()) return false;
+				PNGWriter png(filename, _lx, _ly, compression_level, filter_strategy, nb_threads);
+				if (!png.write(_data, _stride, _ly, true)) return false;
+				return png.close();
+				}
+
+
+			/**
+			 * Saves the image into a file. Files with extension "png" are written with save_png(), other
+			 * formats use CImg's save method (hence support all formats supported by CImg).
 			 *
 			 * @param	filename name of the file.
 			 * @param	number   number to apped to the file name (if positive)
@@ -5033,6 +5140,20 @@ namespace mtools
 			 */
 			void save(const char * filename, const int number = -1, const unsigned int digits = 6) const
 				{
+				std::string fn(filename);
+				const size_t dot = fn.find_last_of('.');
+				std::string ext = ((dot == std::string::npos) ? std::string() : fn.substr(dot + 1));
+				if (toLowerCase(ext) == "png")
+					{
+					if (number >= 0)
+						{ // same naming convention as CImg: name_000123.png
+						std::string num = std::to_string(number);
+						while (num.size() < digits) { num = "0" + num; }
+						fn = fn.substr(0, dot) + "_" + num + "." + ext;
+						}
+					if (!save_png(fn.c_str())) { MTOOLS_ERROR("Image::save() : cannot write file [" << fn << "]"); }
+					return;
+					}
 				cimg_library::CImg<unsigned char> im;
 				toCImg(im);
 				im.save(filename, number, digits);
@@ -8225,6 +8346,70 @@ namespace mtools
 				}
 
 
+			/* workspace reused by floodFill() (one per thread) */
+			struct _FloodWorkspace
+				{
+				internals_floodfill::FloodStack		stack;
+				internals_floodfill::VisitedBitmap	visited;
+				};
+
+
+			static _FloodWorkspace & _floodWorkspace()
+				{
+				thread_local _FloodWorkspace W;
+				return W;
+				}
+
+
+			/* check if color c is within tolerance of the target color */
+			static MTOOLS_FORCEINLINE bool _floodMatch(RGBc c, RGBc target, int tolerance)
+				{
+				if (tolerance <= 0) return (c.color == target.color);
+				return ((std::abs((int)c.comp.R - (int)target.comp.R) <= tolerance) && (std::abs((int)c.comp.G - (int)target.comp.G) <= tolerance)
+					 && (std::abs((int)c.comp.B - (int)target.comp.B) <= tolerance) && (std::abs((int)c.comp.A - (int)target.comp.A) <= tolerance));
+				}
+
+
+			/* the threshold returned by parallelFillThreshold() */
+			static std::atomic<int64> & _parallelFillThreshold()
+				{
+				static std::atomic<int64> threshold(PARALLEL_FILL_THRESHOLD);
+				return threshold;
+				}
+
+
+			/**
+			 * Query if a primitive is large enough to be filled with several threads.
+			 *
+			 * @param	bb	The (real valued) bounding box of the primitive.
+			 *
+			 * @return	true if the visible part of the bounding box contains at least
+			 * 			parallelFillThreshold() pixels. This does not depend on the number of hardware
+			 * 			threads (the bands are simply drawn one after the other with a single one).
+			 */
+			MTOOLS_FORCEINLINE bool _useParallelFill(const fBox2 & bb) const
+				{
+				const fBox2 B = intersectionRect(bb, imagefBox());
+				if (B.isEmpty()) return false;
+				return ((B.lx() + 1)*(B.ly() + 1) >= (double)_parallelFillThreshold());
+				}
+
+
+			/**
+			 * Split the rows [y0,y1] into bands and call fun(ya,yb) for each band [ya,yb] using several
+			 * threads. The bands are disjoints hence fun() may freely draw on its rows.
+			 */
+			template<typename FUN> void _parallelRowBands(int64 y0, int64 y1, FUN fun)
+				{
+				const int64 MIN_BAND_ROWS = 16;
+				const int64 ly = y1 - y0 + 1;
+				if (ly <= 0) return;
+				int64 nbands = std::min<int64>(4 * (int64)nbHardwareThreads(), ly / MIN_BAND_ROWS);
+				if (nbands < 1) nbands = 1;
+				parallelFor(nbands, [&](int64 i) { fun(y0 + (ly*i) / nbands, y0 + (ly*(i + 1)) / nbands - 1); });
+				}
+
+
 			/**
 			* Draw tiny shapes on the image : draw it when the bounding is small enough
 			*
@@ -12110,13 +12295,38 @@ namespace mtools
 
 
 			/**
-			 * Draw a thick ellipse. 
+			 * Draw a thick filled ellipse. Same as _draw_ellipse_thick_AA<blend,true>() but large ellipses
+			 * are drawn by several threads, each one taking care of a band of rows of B. The tests on the
+			 * whole box are still made on B by every band and each row is computed independently of the
+			 * previous ones, hence the output is identical.
+			 **/
+			void _draw_ellipse_thick_AA_parallel(iBox2 B, fVec2 P, double arx, double ary, double Arx, double Ary, RGBc color, RGBc fillcolor, bool blend)
+				{
+				if ((Arx <= 0) || (Ary <= 0)) return;
+				const iBox2 V = intersectionRect(B, _ellipseBBox(P, Arx + 1, Ary + 1));
+				if (!_useParallelFill(fBox2((double)V.min[0], (double)V.max[0], (double)V.min[1], (double)V.max[1])))
+					{
+					if (blend) _draw_ellipse_thick_AA<true, true>(B, P, arx, ary, Arx, Ary, color, fillcolor);
+					else _draw_ellipse_thick_AA<false, true>(B, P, arx, ary, Arx, Ary, color, fillcolor);
+					return;
+					}
+				_parallelRowBands(V.min[1], V.max[1], [&](int64 ya, int64 yb)
+					{
+					if (blend) _draw_ellipse_thick_AA<true, true>(V, P, arx, ary, Arx, Ary, color, fillcolor, ya, yb);
+					else _draw_ellipse_thick_AA<false, true>(V, P, arx, ary, Arx, Ary, color, fillcolor, ya, yb);
+					});
+				}
+
+
+			/**
+			 * Draw a thick ellipse.
 			 * Support real valued paramter and drawing only the part inside a box.
 			 *
 			 * (arx,ary) raddi for the interior ring
 			 * (Arx,Ary) radii for the exterior ring
+			 * [ya,yb]   only the rows of B in this range are drawn.
 			 */
-			template<bool blend, bool fill> void _draw_ellipse_thick_AA(iBox2 B, fVec2 P, double arx, double ary, double Arx, double Ary, RGBc color, RGBc fillcolor)
+			template<bool blend, bool fill> void _draw_ellipse_thick_AA(iBox2 B, fVec2 P, double arx, double ary, double Arx, double Ary, RGBc color, RGBc fillcolor, int64 ya = std::numeric_limits<int64>::min(), int64 yb = std::numeric_limits<int64>::max())
 				{
 				if ((Arx <= 0) || (Ary <= 0)) return;
 				if (arx <= 0) arx = 0;
@@ -12139,7 +12349,7 @@ namespace mtools
 					q = _ellipseIntersection(B, P, arx, ary);
 					if (q > 0)
 						{	
-						if (fill) { draw_box(B, fillcolor, true); }
+						if (fill) { draw_box(iBox2(B.min[0], B.max[0], std::max<int64>(B.min[1], ya), std::min<int64>(B.max[1], yb)), fillcolor, blend); }
 						return;
 						}
 				}
@@ -12181,7 +12391,8 @@ namespace mtools
 				int64 axmin = B.max[0];
 				int64 axmax = B.min[0];
 
-				for (int64 y = B.min[1]; y <= B.max[1]; y++)
+				const int64 y1 = std::min<int64>(B.max[1], yb);
+				for (int64 y = std::max<int64>(B.min[1], ya); y <= y1; y++)
 				{
 					const double dy = (double)(y - P.Y());
 					const double absdy = ((dy > 0) ? dy : -dy);
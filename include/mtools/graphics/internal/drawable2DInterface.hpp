@@ -26,6 +26,7 @@
 #include "../../misc/error.hpp"
 
 #include "../image.hpp"
+#include "../progressimg.hpp"
 
 #include "drawable2Dobject.hpp"
 
@@ -97,6 +98,20 @@ namespace internals_graphics
          **/
         virtual int quality() const { if (nbThreads()>0) { MTOOLS_ERROR("quality() should be overriden."); } return 100;  }
 
+
+        /**
+         * Return the ProgressImg that drawOnto() would blit (with classic blending and the y axis
+         * reversed) so that the caller can compose several objects in a single pass with
+         * ProgressImg::blitLayers() instead of calling drawOnto(). The default implementation returns
+         * nullptr, meaning that the object must be drawn with drawOnto().
+         *
+         * @param [in,out]  quality Set to the quality that drawOnto() would return (unchanged if
+         *                          nullptr is returned).
+         *
+         * @return  The image of the object or nullptr if drawOnto() must be used.
+         **/
+        virtual const ProgressImg * progressLayer(int & /*quality*/) { return nullptr; }
+
 		
         /**
          * Number of threads used to generate the drawing.
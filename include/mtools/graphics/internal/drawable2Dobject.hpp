@@ -27,6 +27,9 @@
 #include "../image.hpp"
 
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
 
 namespace mtools
 {
@@ -146,6 +149,10 @@ namespace internals_graphics
      * `needWork()` return false) then this object does nothing (but it still provide an interface
      * to the underlying object). On the other hand, if `needWork()` return true, the worker thread
      * is created and can be managed via the `workThread()` method.
+     * 
+     * The work is done by tasks submitted to the shared thread pool. Once the drawing is complete,
+     * no task is running: the worker is woken up when the parameters or the drawing change (via
+     * setParam(), resetDrawing() or when drawOnto() returns an incomplete drawing).
      **/
     class AutoDrawable2DObject
     {
@@ -243,15 +250,28 @@ namespace internals_graphics
         AutoDrawable2DObject(const AutoDrawable2DObject &) = delete;                // no copy.
         AutoDrawable2DObject & operator=(const AutoDrawable2DObject &) = delete;    //
 
-        void _workerThread(); 
+        /* state shared between the object and the task submitted to the thread pool */
+        struct WorkerState
+            {
+            std::mutex              m;
+            std::condition_variable cv;
+            bool stop = false;          // set when the worker is stopped: pending tasks return immediately
+            bool queued = false;        // true when a task is submitted or executing
+            bool executing = false;     // true while the task is inside _obj->work()
+            bool dirty = false;         // set when the drawing changed since the task started
+            };
+
+        static void _workerTask(std::shared_ptr<WorkerState> state, Drawable2DObject * obj);
 
         void _stopThread();
 
         void _startThread();
 
+        void _wakeUp();
+
         mutable std::mutex _mut;
-        std::atomic<bool> _mustexit;
         std::atomic<bool> _threadon;
+        std::shared_ptr<WorkerState> _state;    // state of the worker (nullptr when stopped)
 
         Drawable2DObject * _obj; // the drawable object to manage
     };
@@ -0,0 +1,361 @@
+/** @file drawtiles.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../../mtools_config.hpp"
+#include "../../misc/error.hpp"
+#include "../../misc/misc.hpp"
+#include "../../maths/box.hpp"
+#include "../progressimg.hpp"
+#include "../rendercache.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <atomic>
+#include <memory>
+
+
+namespace mtools
+    {
+
+
+    namespace internals_drawtiles
+        {
+
+
+        /** A tile of an image drawn by several workers (cf. DrawTileQueue). */
+        struct DrawTile
+            {
+            iBox2 box;                  // part of the image covered by the tile
+            fBox2 range;                // corresponding range
+            std::atomic<int> progress;  // quality of the drawing of the tile (between 0 and 100)
+            int stage;                  // next drawing stage (STAGE_DONE or a value defined by the drawer)
+            int batch;                  // stage specific data, used by the drawer
+            int passes;                 // number of passes remaining in the current stage (or passes done for the stochastic stage of PlaneDrawer)
+            bool last;                  // true if the current series of passes is the last one (PixelDrawer)
+            int sampleDone;             // number of samples per pixel already computed (PixelDrawer)
+            bool busy;                  // true while a worker draws the tile
+            bool reused;                // true if the content of the tile was scrolled from a previous drawing
+            };
+
+
+        /**
+         * Queue of tiles shared by the workers of a drawer (PixelDrawer, PlaneDrawer).
+         *
+         * The part of the image to draw is split in small tiles. Each drawing stage of a tile is a
+         * separate step and the workers always pull the least advanced tile so the whole image
+         * progresses uniformly whatever the cost of the drawing in the different regions.
+         *
+         * When the new range is a translation of the previous one by an integer number of pixels (the
+         * user pans the view), the content of the image is scrolled instead of being discarded: the
+         * newly exposed strips are covered by fresh tiles and the tiles of the scrolled part inherit the
+         * state of the least advanced tile they were covering before. The drawer then decides what to
+         * do with those (cf. the 'reused' flag).
+         *
+         * If the render cache is enabled, completed drawings are saved in the cache before the range
+         * changes and a view found in the cache is restored directly with all its tiles completed.
+         *
+         * The meaning of the stages (other than STAGE_DONE) is left to the drawer. The geometry must
+         * only be changed while no worker is drawing.
+         **/
+        class DrawTileQueue
+            {
+
+            public:
+
+                static const int STAGE_DONE = 0;
+                static const int64 TILE_SIZE = 64;      // size of the tiles in pixels
+
+
+                /** Constructor. The geometry is initially invalid. */
+                DrawTileQueue() : _valid(false), _im(nullptr), _subBox(iBox2()), _range(fBox2()), _dlx(0.0), _dly(0.0), _nbtiles(0), _capacity(0), _version(0)
+                    {
+                    }
+
+
+                /** Query if the geometry is valid. */
+                bool valid() const { return _valid; }
+
+
+                /** Return the quality of the drawing: the minimum of the progress of the tiles. */
+                int progress() const
+                    {
+                    std::unique_lock<std::mutex> lock(_mut);
+                    if ((!_valid) || (_nbtiles == 0)) return 0;
+                    int p = 100;
+                    for (size_t i = 0; i < _nbtiles; i++) { const int q = _tiles[i].progress; if (q < p) p = q; }
+                    return p;
+                    }
+
+
+                /**
+                 * Take the least advanced tile which is not completed and not already being drawn. Return
+                 * nullptr if there is none. The tile must be given back with release().
+                 **/
+                DrawTile * acquire()
+                    {
+                    std::unique_lock<std::mutex> lock(_mut);
+                    DrawTile * best = nullptr;
+                    for (size_t i = 0; i < _nbtiles; i++)
+                        {
+                        DrawTile & T = _tiles[i];
+                        if ((T.busy) || (T.stage == STAGE_DONE)) continue;
+                        if ((best == nullptr) || (T.progress < best->progress)) best = &T;
+                        }
+                    if (best != nullptr) best->busy = true;
+                    return best;
+                    }
+
+
+                /** Give back a tile obtained with acquire(). */
+                void release(DrawTile * T)
+                    {
+                    std::unique_lock<std::mutex> lock(_mut);
+                    T->busy = false;
+                    }
+
+
+                /** The image. */
+                ProgressImg * image() const { return _im; }
+
+                /** The part of the image to draw. */
+                const iBox2 & subBox() const { return _subBox; }
+
+                /** The range corresponding to subBox() */
+                const fBox2 & range() const { return _range; }
+
+                /** Size of an image pixel in real coordinates. */
+                double dlx() const { return _dlx; }
+                double dly() const { return _dly; }
+
+                /** The cache of completed drawings. */
+                RenderCache & renderCache() { return _cache; }
+
+
+            protected:
+
+
+                /* mark the geometry as invalid, _mut must be locked */
+                void _invalidate()
+                    {
+                    _valid = false;
+                    _nbtiles = 0;
+                    }
+
+
+                /* set the geometry and split subBox into fresh tiles (at stage 'stage' with progress 0), _mut must be locked */
+                void _setTiles(const fBox2 & range, ProgressImg * im, const iBox2 & subBox, int stage)
+                    {
+                    _im = im;
+                    _setGeometry(range, subBox);
+                    const int64 ilx = _subBox.lx() + 1;
+                    const int64 ily = _subBox.ly() + 1;
+                    const size_t n = _nbTiles(ilx, ily);
+                    if (n > _capacity) { _tiles.reset(new DrawTile[n]); _capacity = n; }
+                    _nbtiles = 0;
+                    _addTiles(iBox2(0, ilx - 1, 0, ily - 1), stage);
+                    _valid = true;
+                    _newDrawing();
+                    }
+
+
+                /* record the version of the render cache when a drawing is started from scratch (the scrolled
+                   tiles of _scroll() keep the version of the drawing they come from), _mut must be locked */
+                void _newDrawing()
+                    {
+                    _version = _cache.version();
+                    }
+
+
+                /**
+                 * Query if 'range' is obtained from the current range by a translation of an integer
+                 * number of pixels (for the same image, subbox and scale). In this case, (dx,dy) is set to
+                 * the displacement of the content of the image. Return false if there is no displacement
+                 * or if the displacement is larger than the subbox. _mut must be locked.
+                 **/
+                bool _isPan(const fBox2 & range, ProgressImg * im, const iBox2 & subBox, int64 & dx, int64 & dy) const
+                    {
+                    const double SCALE_TOLERANCE = 1.0e-9;  // relative difference of pixel size below which the scale is considered unchanged
+                    const double SHIFT_TOLERANCE = 1.0e-3;  // maximal distance (in pixels) to an integer translation
+                    if ((!_valid) || (im != _im) || (subBox != _subBox)) return false;
+                    const int64 ilx = _subBox.lx() + 1;
+                    const int64 ily = _subBox.ly() + 1;
+                    if ((std::abs(range.lx() / ilx - _dlx) > SCALE_TOLERANCE*_dlx) || (std::abs(range.ly() / ily - _dly) > SCALE_TOLERANCE*_dly)) return false;
+                    const double tx = (range.min[0] - _range.min[0]) / _dlx;
+                    const double ty = (range.min[1] - _range.min[1]) / _dly;
+                    if ((std::abs(tx) >= (double)ilx) || (std::abs(ty) >= (double)ily)) return false;
+                    const double rx = std::round(tx);
+                    const double ry = std::round(ty);
+                    if ((std::abs(tx - rx) > SHIFT_TOLERANCE) || (std::abs(ty - ry) > SHIFT_TOLERANCE)) return false;
+                    dx = -(int64)rx;
+                    dy = -(int64)ry;
+                    if ((dx == 0) && (dy == 0)) return false;
+                    if ((std::abs(dx) >= ilx) || (std::abs(dy) >= ily)) return false;
+                    return true;
+                    }
+
+
+                /**
+                 * Scroll the image by (dx,dy) (as returned by _isPan()) and rebuild the tiles for the new
+                 * range. The exposed strips are covered by fresh tiles (at stage 'stage' with progress 0).
+                 * The tiles of the scrolled part have their 'reused' flag set and copy the state of the
+                 * least advanced tile they overlapped before the scroll. _mut must be locked.
+                 **/
+                void _scroll(const fBox2 & range, int64 dx, int64 dy, int stage)
+                    {
+                    MTOOLS_ASSERT(_valid);
+                    _im->scroll(_subBox, dx, dy);
+                    std::unique_ptr<DrawTile[]> oldtiles(std::move(_tiles));
+                    const size_t nbold = _nbtiles;
+                    _setGeometry(range, _subBox);
+                    const int64 ilx = _subBox.lx() + 1;
+                    const int64 ily = _subBox.ly() + 1;
+                    // the scrolled part and the exposed strips (relative to the subbox)
+                    const iBox2 R(std::max<int64>(dx, 0), std::min<int64>(ilx, ilx + dx) - 1, std::max<int64>(dy, 0), std::min<int64>(ily, ily + dy) - 1);
+                    const iBox2 V = (dx > 0) ? iBox2(0, dx - 1, 0, ily - 1) : ((dx < 0) ? iBox2(ilx + dx, ilx - 1, 0, ily - 1) : iBox2());
+                    const iBox2 H = (dy > 0) ? iBox2(R.min[0], R.max[0], 0, dy - 1) : ((dy < 0) ? iBox2(R.min[0], R.max[0], ily + dy, ily - 1) : iBox2());
+                    const size_t n = _nbTiles(R.lx() + 1, R.ly() + 1) + ((V.isEmpty()) ? 0 : _nbTiles(V.lx() + 1, V.ly() + 1)) + ((H.isEmpty()) ? 0 : _nbTiles(H.lx() + 1, H.ly() + 1));
+                    _tiles.reset(new DrawTile[n]);
+                    _capacity = n;
+                    _nbtiles = 0;
+                    _addTiles(R, stage);
+                    for (size_t i = 0; i < _nbtiles; i++)
+                        { // find the least advanced tile which covered the source of the tile
+                        DrawTile & T = _tiles[i];
+                        const iBox2 src(T.box.min[0] - dx, T.box.max[0] - dx, T.box.min[1] - dy, T.box.max[1] - dy);
+                        const DrawTile * S = nullptr;
+                        for (size_t k = 0; k < nbold; k++)
+                            {
+                            const DrawTile & O = oldtiles[k];
+                            if ((O.box.max[0] < src.min[0]) || (O.box.min[0] > src.max[0]) || (O.box.max[1] < src.min[1]) || (O.box.min[1] > src.max[1])) continue;
+                            if ((S == nullptr) || (O.progress < S->progress) || ((O.progress == S->progress) && (S->stage == STAGE_DONE))) S = &O;
+                            }
+                        MTOOLS_ASSERT(S != nullptr);
+                        T.progress = (int)S->progress;
+                        T.stage = S->stage;
+                        T.batch = S->batch;
+                        T.passes = S->passes;
+                        T.last = S->last;
+                        T.sampleDone = S->sampleDone;
+                        T.reused = true;
+                        }
+                    if (!V.isEmpty()) _addTiles(V, stage);
+                    if (!H.isEmpty()) _addTiles(H, stage);
+                    MTOOLS_ASSERT(_nbtiles == n);
+                    }
+
+
+                /* save the current drawing in the render cache if it is completed, _mut must be locked */
+                void _storeView()
+                    {
+                    if ((!_valid) || (!_cache.enabled())) return;
+                    for (size_t i = 0; i < _nbtiles; i++) { if (_tiles[i].stage != STAGE_DONE) return; }
+                    _cache.store(_range, *_im, _subBox, _version); // discarded if the model changed since the drawing started
+                    }
+
+
+                /* if the view is in the render cache, copy it in the image and set the geometry with completed tiles. _mut must be locked */
+                bool _restoreView(const fBox2 & range, ProgressImg * im, const iBox2 & subBox)
+                    {
+                    const uint64 version = _cache.version();
+                    if (!_cache.retrieve(range, *im, subBox)) return false;
+                    _setTiles(range, im, subBox, STAGE_DONE);
+                    _version = version;
+                    for (size_t i = 0; i < _nbtiles; i++) { _tiles[i].progress = 100; }
+                    return true;
+                    }
+
+
+                mutable std::mutex _mut;                // mutex protecting the tiles array and the busy flags.
+                bool _valid;                            // true if the geometry is valid
+                ProgressImg * _im;                      // the image to draw onto
+                iBox2 _subBox;                          // part of the image to draw
+                fBox2 _range;                           // the range
+                double _dlx, _dly;                      // size of an image pixel in real coord
+                std::unique_ptr<DrawTile[]> _tiles;     // the tiles
+                size_t _nbtiles;                        // number of tiles
+                size_t _capacity;                       // size of the _tiles array
+                RenderCache _cache;                     // cache of completed drawings
+                uint64 _version;                        // version of the render cache when the current drawing was started
+
+
+            private:
+
+
+                /* set the range and subbox */
+                void _setGeometry(const fBox2 & range, const iBox2 & subBox)
+                    {
+                    _range = range;
+                    _subBox = subBox;
+                    _dlx = _range.lx() / (_subBox.lx() + 1);
+                    _dly = _range.ly() / (_subBox.ly() + 1);
+                    }
+
+
+                /* number of tiles needed to cover a lx x ly rectangle */
+                static size_t _nbTiles(int64 lx, int64 ly)
+                    {
+                    return (size_t)((lx + TILE_SIZE - 1) / TILE_SIZE) * (size_t)((ly + TILE_SIZE - 1) / TILE_SIZE);
+                    }
+
+
+                /* append fresh tiles covering the rectangle B (relative to the subbox) */
+                void _addTiles(const iBox2 & B, int stage)
+                    {
+                    for (int64 y = B.min[1]; y <= B.max[1]; y += TILE_SIZE)
+                        {
+                        for (int64 x = B.min[0]; x <= B.max[0]; x += TILE_SIZE)
+                            {
+                            DrawTile & T = _tiles[_nbtiles++];
+                            T.box.min[0] = _subBox.min[0] + x; T.box.max[0] = _subBox.min[0] + std::min<int64>(x + TILE_SIZE - 1, B.max[0]);
+                            T.box.min[1] = _subBox.min[1] + y; T.box.max[1] = _subBox.min[1] + std::min<int64>(y + TILE_SIZE - 1, B.max[1]);
+                            T.range.min[0] = _range.min[0] + _dlx*(T.box.min[0] - _subBox.min[0]);
+                            T.range.max[0] = _range.min[0] + _dlx*(T.box.max[0] + 1 - _subBox.min[0]);
+                            T.range.min[1] = _range.min[1] + _dly*(T.box.min[1] - _subBox.min[1]);
+                            T.range.max[1] = _range.min[1] + _dly*(T.box.max[1] + 1 - _subBox.min[1]);
+                            T.progress = 0;
+                            T.stage = stage;
+                            T.batch = 0;
+                            T.passes = 0;
+                            T.last = false;
+                            T.sampleDone = 0;
+                            T.busy = false;
+                            T.reused = false;
+                            }
+                        }
+                    }
+
+
+                DrawTileQueue(const DrawTileQueue &) = delete;
+                DrawTileQueue & operator=(const DrawTileQueue &) = delete;
+
+            };
+
+
+        }
+
+
+    }
+
+
+/* end of file */
+
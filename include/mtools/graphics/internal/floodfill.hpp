@@ -0,0 +1,263 @@
+/** @file floodfill.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../../mtools_config.hpp"
+#include "../../misc/error.hpp"
+#include "../../misc/misc.hpp"
+#include "../../misc/internal/threadworker.hpp"
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+
+namespace mtools
+{
+
+
+namespace internals_floodfill
+	{
+
+
+	/**
+	 * A span of the flood fill stack: the span [xl,xr] on row y - dy was filled and the row y must
+	 * now be scanned above/below it.
+	 **/
+	struct FloodSpan
+		{
+		int64 y;
+		int64 xl, xr;
+		int64 dy;
+		};
+
+
+	/** Stack of spans (a simple vector which is reused between calls to avoid reallocations). */
+	typedef std::vector<FloodSpan> FloodStack;
+
+
+	/**
+	 * Bitmap with one (atomic) bit per pixel. Used to mark the pixels already visited when the
+	 * fill color alone cannot be used for this purpose (blending, fill color inside the tolerance
+	 * range, parallel filling).
+	 **/
+	class VisitedBitmap
+		{
+
+		public:
+
+			VisitedBitmap() : _lx(0), _ly(0), _nbwords(0), _capacity(0) {}
+
+
+			/** Resize to lx x ly and clear all the bits. Reuse the current buffer if large enough. */
+			void reset(int64 lx, int64 ly)
+				{
+				_lx = lx; _ly = ly;
+				_nbwords = (size_t)((lx*ly + 63) >> 6);
+				if (_nbwords > _capacity)
+					{
+					_tab.reset(new std::atomic<uint64>[_nbwords]);
+					_capacity = _nbwords;
+					}
+				for (size_t i = 0; i < _nbwords; i++) { _tab[i].store(0, std::memory_order_relaxed); }
+				}
+
+
+			/**
+			 * Mark pixel (x,y) as visited. Return true if the pixel was not yet visited (i.e. the caller
+			 * now owns the pixel) and false otherwise. Thread safe.
+			 **/
+			MTOOLS_FORCEINLINE bool claim(int64 x, int64 y)
+				{
+				const uint64 i = (uint64)(x + _lx*y);
+				const uint64 mask = ((uint64)1) << (i & 63);
+				std::atomic<uint64> & w = _tab[(size_t)(i >> 6)];
+				if (w.load(std::memory_order_relaxed) & mask) return false;
+				return ((w.fetch_or(mask, std::memory_order_relaxed) & mask) == 0);
+				}
+
+
+		private:
+
+			int64 _lx, _ly;
+			size_t _nbwords, _capacity;
+			std::unique_ptr<std::atomic<uint64>[]> _tab;
+		};
+
+
+	/**
+	 * Process one span of the stack (Heckbert's seed fill algorithm).
+	 *
+	 * inside(x,y) must return true if pixel (x,y) belongs to the region and has not been filled yet
+	 * (and, once it returned true for a pixel, it must return false for any subsequent call for the
+	 * same pixel after fill() is called on it). fill(x1,x2,y) fills a span.
+	 *
+	 * Return the number of pixels filled.
+	 **/
+	template<typename INSIDE, typename FILL, typename PUSH> MTOOLS_FORCEINLINE int64 processSpan(const FloodSpan & S, int64 lx, int64 ly, bool connect8, INSIDE & inside, FILL & fill, PUSH & push)
+		{
+		const int64 y = S.y;
+		if ((y < 0) || (y >= ly)) return 0;
+		int64 a = S.xl, b = S.xr;
+		if (connect8) { a--; b++; }
+		if (a < 0) a = 0;
+		if (b > lx - 1) b = lx - 1;
+		int64 tot = 0;
+		int64 x = a;
+		while (x <= b)
+			{
+			if (!inside(x, y)) { x++; continue; }
+			int64 l = x;
+			if (x == a) { while ((l > 0) && (inside(l - 1, y))) { l--; } }
+			int64 r = x;
+			while ((r < lx - 1) && (inside(r + 1, y))) { r++; }
+			fill(l, r, y);
+			tot += (r - l + 1);
+			push(FloodSpan{ y + S.dy, l, r, S.dy });
+			// the span may leak back around the parent span
+			if (l < S.xl) push(FloodSpan{ y - S.dy, l, S.xl - 1, -S.dy });
+			if (r > S.xr) push(FloodSpan{ y - S.dy, S.xr + 1, r, -S.dy });
+			x = r + 2; // pixel r+1 is not inside
+			}
+		return tot;
+		}
+
+
+	/**
+	 * Fill the seed span containing (x,y) and push its neighbours. Return the number of pixels filled.
+	 **/
+	template<typename INSIDE, typename FILL, typename PUSH> int64 seedSpan(int64 x, int64 y, int64 lx, INSIDE & inside, FILL & fill, PUSH & push)
+		{
+		if (!inside(x, y)) return 0;
+		int64 l = x, r = x;
+		while ((l > 0) && (inside(l - 1, y))) { l--; }
+		while ((r < lx - 1) && (inside(r + 1, y))) { r++; }
+		fill(l, r, y);
+		push(FloodSpan{ y + 1, l, r, 1 });
+		push(FloodSpan{ y - 1, l, r, -1 });
+		return (r - l + 1);
+		}
+
+
+	/**
+	 * Sequential span flood fill starting from (x,y). Use the explicit stack 'stack' (emptied
+	 * before returning). Return the number of pixels filled.
+	 **/
+	template<typename INSIDE, typename FILL> int64 spanFill(int64 x, int64 y, int64 lx, int64 ly, bool connect8, INSIDE & inside, FILL & fill, FloodStack & stack)
+		{
+		stack.clear();
+		auto push = [&](const FloodSpan & S) { stack.push_back(S); };
+		int64 tot = seedSpan(x, y, lx, inside, fill, push);
+		while (!stack.empty())
+			{
+			const FloodSpan S = stack.back();
+			stack.pop_back();
+			tot += processSpan(S, lx, ly, connect8, inside, fill, push);
+			}
+		return tot;
+		}
+
+
+	/**
+	 * Parallel span flood fill starting from (x,y).
+	 *
+	 * Each thread works on its own local stack. When a thread runs out of work, it takes spans from
+	 * a shared pool; threads with large stacks give half of their spans to the pool whenever some
+	 * thread is waiting. The algorithm terminates when all the participating threads are idle and the
+	 * pool is empty (the tasks run on the shared thread pool so some of them may start late, or not at
+	 * all: a task only participates if it starts before the fill is completed).
+	 *
+	 * inside() must be thread safe and claim the pixels (i.e. return true at most once per pixel).
+	 **/
+	template<typename INSIDE, typename FILL> int64 parallelSpanFill(int64 x, int64 y, int64 lx, int64 ly, bool connect8, INSIDE & inside, FILL & fill, int nbthreads)
+		{
+		const size_t GRAB = 16;		// number of spans taken from the pool at once.
+		struct
+			{
+			std::mutex m;
+			std::condition_variable cv;
+			FloodStack spans;
+			std::atomic<int> idle;
+			int active;		// number of participating threads
+			bool done;
+			} pool;
+		pool.idle = 0;
+		pool.active = 0;
+		pool.done = false;
+		std::atomic<int64> total(0);
+		{
+		auto push = [&](const FloodSpan & S) { pool.spans.push_back(S); };
+		total += seedSpan(x, y, lx, inside, fill, push);
+		}
+		if (pool.spans.empty()) return total;
+		parallelFor(nbthreads, [&](int64)
+			{
+			FloodStack local;
+			int64 tot = 0;
+			auto push = [&](const FloodSpan & S) { local.push_back(S); };
+				{
+				std::unique_lock<std::mutex> lock(pool.m);
+				if (pool.done) return;
+				pool.active++;
+				}
+			while (1)
+				{
+				if (local.empty())
+					{
+					std::unique_lock<std::mutex> lock(pool.m);
+					pool.idle++;
+					while (pool.spans.empty())
+						{
+						if ((pool.done) || (pool.idle == pool.active)) { pool.done = true; pool.cv.notify_all(); total += tot; return; }
+						pool.cv.wait(lock);
+						}
+					pool.idle--;
+					const size_t n = std::min<size_t>(GRAB, pool.spans.size());
+					local.insert(local.end(), pool.spans.end() - n, pool.spans.end());
+					pool.spans.resize(pool.spans.size() - n);
+					}
+				const FloodSpan S = local.back();
+				local.pop_back();
+				tot += processSpan(S, lx, ly, connect8, inside, fill, push);
+				if ((local.size() >= 2 * GRAB) && (pool.idle.load() > 0))
+					{ // share half of the work
+					std::unique_lock<std::mutex> lock(pool.m);
+					const size_t n = local.size() / 2;
+					pool.spans.insert(pool.spans.end(), local.begin(), local.begin() + n);
+					local.erase(local.begin(), local.begin() + n);
+					pool.cv.notify_all();
+					}
+				}
+			}, nbthreads);
+		return total;
+		}
+
+
+	}
+
+
+}
+
+
+/* end of file */
+
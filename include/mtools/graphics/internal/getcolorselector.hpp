@@ -24,6 +24,7 @@
 #include "../rgbc.hpp"
 #include "../../maths/vec.hpp"
 #include "../../maths/box.hpp"
+#include "../../maths/doubledouble.hpp"
 #include "../../misc/misc.hpp"
 #include "../../misc/metaprog.hpp"
 
@@ -81,6 +82,27 @@ namespace mtools
     *  RGBc getColor([const] double [&] x, [const] double [&] y)
     *  RGBc operator()([const] double [&] x, [const] double [&] y)
     *
+    * In addition, the selector detects the (optional) batch method used to draw a whole scanline
+    * at once, which can be called with callRow():
+    *
+    *  void getColorRow(const double * xs, double y, size_t n, RGBc * out)
+    *
+    * The method must write in out[i] the color at position (xs[i], y) for i = 0..n-1. The colors are
+    * blended with the previous values (as with the RGBc return type above). Since the abscissas are
+    * given in a contiguous array, the method can evaluate several pixels at once with SIMD
+    * instructions. When present, it is used by the PlaneDrawer instead of getColor().
+    *
+    * Finally, the selector detects the (optional) deep zoom methods which can be called with
+    * callDeep():
+    *
+    *  std::pair<RGBc,bool> getColor([const] ddVec2 [&] ref, [const] fVec2 [&] pos, [const] fBox2 [&] box)
+    *  RGBc getColor([const] ddVec2 [&] ref, [const] fVec2 [&] pos, [const] fBox2 [&] box)
+    *
+    * Here, ref is a reference point given with double-double precision and pos/box are the position
+    * and the area covered by the pixel relative to this reference point (i.e. the absolute position
+    * is ref + pos). This permits to remain accurate at zoom levels beyond the precision of a double
+    * (e.g. using perturbation methods for escape time fractals). When present, it is used by the
+    * PlaneDrawer instead of the methods above.
     **/
     template<typename T> class GetColorPlaneSelector
         {
@@ -181,6 +203,23 @@ namespace mtools
         static std::pair<mtools::RGBc, bool> call19(T & obj, const fVec2 & pos, const fBox2 & box, int32 nbiter, void * &data, mtools::metaprog::dummy<false> D) { return call20(obj, pos, box, nbiter, data, mtools::metaprog::dummy<version20>()); }
         static std::pair<mtools::RGBc, bool> call20(T & obj, const fVec2 & pos, const fBox2 & box, int32 nbiter, void * &data, mtools::metaprog::dummy<false> D) { MTOOLS_DEBUG("GetColorPlaneSelector: no getColor() found."); return std::pair<mtools::RGBc, bool>(RGBc::c_Transparent, false); }
 
+        template<typename U> static decltype((*(U*)(0)).getColorRow((const double *)(0), 0.0, (size_t)(0), (mtools::RGBc *)(0))) versrow(int);
+        template<typename> static metaprog::no versrow(...);
+        static const bool versionrow = !std::is_same<decltype(versrow<T>(0)), metaprog::no>::value;
+
+        static void callrow(T & obj, const double * xs, double y, size_t n, mtools::RGBc * out, mtools::metaprog::dummy<true> D) { obj.getColorRow(xs, y, n, out); }
+        static void callrow(T & obj, const double * xs, double y, size_t n, mtools::RGBc * out, mtools::metaprog::dummy<false> D) { MTOOLS_DEBUG("GetColorPlaneSelector: no getColorRow() found."); for (size_t i = 0; i < n; i++) { out[i] = RGBc::c_Transparent; } }
+
+        template<typename U> static decltype((*(U*)(0)).getColor(ddVec2(), fVec2(), fBox2())) versdeep(int);
+        template<typename> static metaprog::no versdeep(...);
+        static const bool versiondeep = std::is_same<typename std::decay<decltype(versdeep<T>(0))>::type, decaypair >::value;
+        static const bool versiondeep1 = std::is_same<typename std::decay<decltype(versdeep<T>(0))>::type, decayrgb >::value;
+
+        static std::pair<mtools::RGBc, bool> calldeep1(T & obj, const ddVec2 & ref, const fVec2 & pos, const fBox2 & box, mtools::metaprog::dummy<true> D) { return obj.getColor(ref, pos, box); }
+        static std::pair<mtools::RGBc, bool> calldeep2(T & obj, const ddVec2 & ref, const fVec2 & pos, const fBox2 & box, mtools::metaprog::dummy<true> D) { return std::pair<mtools::RGBc, bool>(obj.getColor(ref, pos, box), false); }
+        static std::pair<mtools::RGBc, bool> calldeep1(T & obj, const ddVec2 & ref, const fVec2 & pos, const fBox2 & box, mtools::metaprog::dummy<false> D) { return calldeep2(obj, ref, pos, box, mtools::metaprog::dummy<versiondeep1>()); }
+        static std::pair<mtools::RGBc, bool> calldeep2(T & obj, const ddVec2 & ref, const fVec2 & pos, const fBox2 & box, mtools::metaprog::dummy<false> D) { MTOOLS_DEBUG("GetColorPlaneSelector: no deep getColor() found."); return std::pair<mtools::RGBc, bool>(RGBc::c_Transparent, false); }
+
         public:
 
             static const bool has_getColor = version1 | version2 | version3 | version4 | version5 | version6 | version7 | version8 | version9 | version10 |
@@ -188,6 +227,14 @@ namespace mtools
 
             static std::pair<mtools::RGBc, bool> call(T & obj, const fVec2 & pos, const fBox2 & box, int32 nbiter, void * &data) { return call1(obj, pos, box, nbiter, data, mtools::metaprog::dummy<version1>()); }
 
+            static const bool has_getColorRow = versionrow;
+
+            static void callRow(T & obj, const double * xs, double y, size_t n, mtools::RGBc * out) { callrow(obj, xs, y, n, out, mtools::metaprog::dummy<versionrow>()); }
+
+            static const bool has_getColorDeep = versiondeep | versiondeep1;
+
+            static std::pair<mtools::RGBc, bool> callDeep(T & obj, const ddVec2 & ref, const fVec2 & pos, const fBox2 & box) { return calldeep1(obj, ref, pos, box, mtools::metaprog::dummy<versiondeep>()); }
+
         };
 
 
@@ -347,6 +347,19 @@ namespace mtools
             int drawOnto(Image & im);
 
 
+            /**
+             * Return the image of the underlying drawable object if it can be composed with
+             * ProgressImg::blitLayers() (using the opacity() of this object) in place of calling
+             * drawOnto(). Return nullptr if the object is not inserted, not enabled or suspended, or if the
+             * underlying object must be drawn with drawOnto().
+             *
+             * @param [in,out]  quality Set to the quality of the drawing when the image is returned.
+             *
+             * @return  the image of the object or nullptr if drawOnto() must be used.
+             **/
+            const ProgressImg * progressLayer(int & quality);
+
+
             /**
              * Sets the parameters of the drawing. Does nothing if not inserted. This method is a forward of
              * the setParam() method of the underlying DRawable2DObject.
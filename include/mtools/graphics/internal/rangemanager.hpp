@@ -23,6 +23,7 @@
 #include "../../mtools_config.hpp"
 #include "../../maths/box.hpp"
 #include "../../maths/vec.hpp"
+#include "../../maths/doubledouble.hpp"
 
 #include <cstdint>
 #include <mutex>
@@ -50,6 +51,10 @@ namespace mtools
          * is called to inform of the change and confirm that it accepts it. The method can be overriden
          * in a derived class to capture these events or a callback function can be set.
          * 
+         * In deep zoom mode (see deepZoom()), the range is stored as a reference point with double-double
+         * precision plus a range of double offsets relative to this point so that it is possible to zoom
+         * far beyond the precision of a double.
+         * 
          * The object is completely thread safe.
          **/
         class RangeManager
@@ -339,6 +344,89 @@ namespace mtools
             iVec2 absToPix(fVec2 abspos) const;
 
 
+            /**
+             * Zoom in, keeping the position under a given pixel of the window fixed. Same as
+             * zoomIn(pixelToAbs(pixpos)) but without rounding the position to double precision.
+             *
+             * @return  true if the operation succeded and false if its failed (either the lock could not be
+             *          acquired in time or the notification callback rejected the range).
+             **/
+            bool zoomInPixel(iVec2 pixpos);
+
+
+            /**
+             * Zoom out, keeping the position under a given pixel of the window fixed. Same as
+             * zoomOut(pixelToAbs(pixpos)) but without rounding the position to double precision.
+             *
+             * @return  true if the operation succeded and false if its failed (either the lock could not be
+             *          acquired in time or the notification callback rejected the range).
+             **/
+            bool zoomOutPixel(iVec2 pixpos);
+
+
+            /**
+             * Centers the range around the position under a given pixel of the window. Same as
+             * center(pixelToAbs(pixpos)) but without rounding the position to double precision.
+             *
+             * @return  true if the operation succeded and false if its failed (either the lock could not be
+             *          aquired in time or the notification callback rejected the range).
+             **/
+            bool centerPixel(iVec2 pixpos);
+
+
+            /**
+             * Set the range to the rectangle with opposite corners at two given pixels of the window (the
+             * largest enclosed rectangle with the current aspect ratio is used if the "fixed aspect ratio"
+             * flag is on). The positions are not rounded to double precision.
+             *
+             * @return  true if the operation succeded and false if its failed (either the lock could not be
+             *          aquired in time or the notification callback rejected the range).
+             **/
+            bool setRangePixel(iVec2 pix1, iVec2 pix2);
+
+
+            /**
+             * Query if the deep zoom mode is enabled.
+             **/
+            bool deepZoom() const;
+
+
+            /**
+             * Enable/disable the deep zoom mode (disabled by default).
+             * 
+             * In deep zoom mode, the range is stored as a reference point with double-double precision
+             * plus a range of double offsets relative to it. The reference point is moved automatically
+             * when the view drifts away from it so the offsets remain accurate and it is possible to zoom
+             * down to about 1.0e-28 relative to the position. getRange() returns the range rounded to
+             * double precision: objects which must remain accurate at deep zoom levels (e.g. Plot2DPlane)
+             * use getDeepRange() instead.
+             * 
+             * Disabling the mode rounds the range to double precision (and the canonical range is used if
+             * the result is not valid).
+             *
+             * @return  true if the operation succeded and false if its failed (either the lock could not be
+             *          aquired in time or the notification callback rejected the range).
+             **/
+            bool deepZoom(bool status);
+
+
+            /**
+             * Return the current range as a reference point and a range relative to this point. When the
+             * deep zoom mode is disabled, the reference point is the origin and offsetRange is the same as
+             * getRange().
+             *
+             * @param   absRange            The range as returned by getRange() when the parameters of the
+             *                              drawing were set.
+             * @param [in,out]  reference   The reference point (the origin if the method fails).
+             * @param [in,out]  offsetRange The range relative to the reference point (absRange if the method
+             *                              fails).
+             *
+             * @return  true if the current range is absRange and false otherwise (if the range changed in
+             *          the meantime or if the lock could not be acquired in time).
+             **/
+            bool getDeepRange(const mtools::fBox2 & absRange, mtools::ddVec2 & reference, mtools::fBox2 & offsetRange) const;
+
+
 
             protected:
 
@@ -382,29 +470,56 @@ namespace mtools
             private:
             
             static const double PRECISIONDOUBLE;
+            static const double PRECISIONDOUBLEDOUBLE;
+            static const double DEEPREBASE;
             static const double MAXDOUBLE;
             static const double MINDOUBLE;
 
             static const int MAXLOCKTIME; // maximum time we can wait for aquiring a lock, otherwise the method fails.
 
-            /* return true if the range is Ok */
+            /* return true if the range (relative to the reference point) is Ok */
             bool _rangeOK(mtools::fBox2 r);
 
-            /* fix the range if the aspect ratio is close but not equal to 1:1 */
+            /* move the reference point if needed and fix the range if the aspect ratio is close but not equal to 1:1 */
             void _fixRange();
 
+            /* move the reference point to the center of the range if the range drifted too far away from it (deep zoom mode only) */
+            void _rebase();
+
+            /* set a new range (relative to the reference point), same as setRange() but without locking */
+            bool _setRange(mtools::fBox2 newRange);
+
+            /* zoom in/out around a position (relative to the reference point), without locking */
+            bool _zoomIn(fVec2 center);
+            bool _zoomOut(fVec2 center);
+
+            /* center the range around a position (relative to the reference point), without locking */
+            bool _center(fVec2 center);
+
+            /* convert between absolute positions and positions relative to a reference point */
+            static mtools::fBox2 _toAbs(const mtools::fBox2 & r, const mtools::ddVec2 & ref);
+            static mtools::fVec2 _toAbs(const mtools::fVec2 & pos, const mtools::ddVec2 & ref);
+            static mtools::fBox2 _toOffset(const mtools::fBox2 & r, const mtools::ddVec2 & ref);
+            static mtools::fVec2 _toOffset(const mtools::fVec2 & pos, const mtools::ddVec2 & ref);
+
             /* set the default range */
             void _defaultrange();
 
+            /* translate the range by (sx,sy) times 1/20th of its size, rounded to an integer number of pixels */
+            mtools::fBox2 _shiftedRange(int sx, int sy) const;
+
             pnotif _cbfun;              // the callback function
             void * _data;               // the data to pass to the callback
             void * _data2;              // the data to pass to the callback
-            mtools::fBox2 _startRange;  // initial starting range
-            mtools::fBox2 _range;       // current range
+            mtools::fBox2 _startRange;  // initial starting range (relative to _startRef)
+            mtools::ddVec2 _startRef;   // reference point of the starting range
+            mtools::fBox2 _range;       // current range (relative to _ref)
+            mtools::ddVec2 _ref;        // current reference point (always the origin if not in deep zoom mode)
             mtools::iVec2 _startWin;    //initial window size
             mtools::iVec2 _winSize;     // window size
             double _minValue, _maxValue, _precision; // the extremal admissible values
             std::atomic<bool> _fixedAR; // do we keep a fixed aspect ratio
+            std::atomic<bool> _deep;    // deep zoom mode
             mutable std::recursive_timed_mutex _mut;    // mutex for sync.
 
         };
@@ -30,12 +30,16 @@
 #include "../misc/metaprog.hpp"
 #include "../random/gen_fastRNG.hpp"
 #include "internal/getcolorselector.hpp"
+#include "progressimg.hpp"
+#include "rendercache.hpp"
 
 #include <algorithm>
+#include <cstring>
 #include <ctime>
 #include <mutex>
 #include <atomic>
 #include <vector>
+#include <unordered_map>
 
 
 namespace mtools
@@ -74,6 +78,13 @@ namespace mtools
  * - The `getImage` method must return a pointer to a Image object. It can be nullptr: in this
  * case, the drawer interpret this as the site being completely transparent.
  *
+ * - Sprites which do not have the requested size are first drawn with a fast rescaling. They
+ * are then redrawn with a high quality rescaling which is performed only once per distinct sprite
+ * (the rescaled sprites are kept in an atlas indexed by their content for the current site size).
+ *
+ * - When zooming very close (a site larger than the window), the sprites are requested with a
+ * size capped to the size of the window and magnified when drawn.
+ *
  *        
  * @tparam  LatticeObj  Type of the lattice object. Can be any class provided that satisfy the 
  * 						requierement of GetColorSelector and possible GetImageSelector.
@@ -98,7 +109,7 @@ public:
      *
      * @param [in,out]  obj The object to draw, it must survive the drawer.
      **/
-    LatticeDrawer(LatticeObj * obj) : _g_requestAbort(0), _g_current_quality(0), _g_obj(obj), _g_drawingtype(TYPEPIXEL), _g_reqdrawtype(TYPEPIXEL), _g_imSize(201, 201), _g_r(-100.5, 100.5, -100.5, 100.5), _g_redraw_im(true), _g_redraw_pix(true), _g_removeColor(REMOVE_NOTHING), _g_opacify(1.0f)
+    LatticeDrawer(LatticeObj * obj) : _g_requestAbort(0), _g_current_quality(0), _g_obj(obj), _g_drawingtype(TYPEPIXEL), _g_reqdrawtype(TYPEPIXEL), _g_imSize(201, 201), _g_r(-100.5, 100.5, -100.5, 100.5), _g_redraw_im(true), _g_redraw_pix(true), _g_removeColor(REMOVE_NOTHING), _g_opacify(1.0f), _pix_version(0), _atlas_sx(0), _atlas_sy(0), _atlas_mem(0)
 		{
         static_assert((HAS_GETCOLOR || HAS_GETIMAGE), "No compatible getColor / getImage / operator() method found...");
         _initInt16Buf();
@@ -200,6 +211,17 @@ public:
     void transparentColor(int type) { MTOOLS_ASSERT((type == REMOVE_BLACK)|| (type == REMOVE_WHITE)|| (type == REMOVE_NOTHING)); _g_removeColor = type; }
 
 
+    /**
+     * The cache of completed drawings (disabled by default). Set a positive memory budget with
+     * renderCache().maxMemory() to make revisited views instantaneous and call
+     * renderCache().invalidate() whenever the lattice object changes. Only pixel-type drawings are
+     * cached.
+     *
+     * @return  A reference to the render cache.
+     **/
+    RenderCache & renderCache() { return _g_cache; }
+
+
     /**
      * Get the definition domain of the lattice (does not interrupt any computation in progress).
      * By default this is everything.
@@ -246,6 +268,7 @@ public:
             std::lock_guard<std::timed_mutex> lg(_g_lock); // and wait until we aquire the lock 
             --_g_requestAbort; // and then remove the stop request
             _g_domR = R;
+            _g_cache.invalidate(); // the cached drawings depend on the domain
             _g_redraw_im = true;   // request redraw
             _g_redraw_pix = true;  //
             }
@@ -265,6 +288,7 @@ public:
             _g_domR.max[0] = std::numeric_limits<int64>::max();
             _g_domR.min[1] = std::numeric_limits<int64>::min();
             _g_domR.max[1] = std::numeric_limits<int64>::max();
+            _g_cache.invalidate(); // the cached drawings depend on the domain
             _g_redraw_im = true;   // request redraw
             _g_redraw_pix = true;  //
             }
@@ -281,6 +305,7 @@ public:
             std::lock_guard<std::timed_mutex> lg(_g_lock); // and wait until we aquire the lock 
             --_g_requestAbort; // and then remove the stop request
             _g_domR.clear(); // clear the domain
+            _g_cache.invalidate(); // the cached drawings depend on the domain
             _g_redraw_im = true;   // request redraw
             _g_redraw_pix = true;  //
             }
@@ -439,6 +464,7 @@ private:
     std::atomic<int>  _g_removeColor;       // one of REMOVE_NOTHING, REMOVE_WHITE, REMOVE_BLACK
     std::atomic<float> _g_opacify;          // opacification ratio for pixel drawing
     iBox2             _g_domR;              // definition domain of the object 
+    RenderCache       _g_cache;             // cache of completed pixel drawings
 
 
 
@@ -448,7 +474,6 @@ private:
         if (imageType != TYPEIMAGE) { _g_drawingtype = TYPEPIXEL; return; }
         if (!hasImage()) { _g_drawingtype = TYPEPIXEL; return; }
         if (((_g_imSize.X() / _g_r.lx()) < 6) || ((_g_imSize.Y() / _g_r.ly()) < 6))  { _g_drawingtype = TYPEPIXEL; return; }
-        if ((_g_r.lx() < 0.25) || (_g_r.ly() < 0.25)) { _g_drawingtype = TYPEPIXEL; return; }
         _g_drawingtype = TYPEIMAGE; 
         return;
         }
@@ -600,16 +625,19 @@ void _drawPixel_perfect(int maxtime_ms)
 void _workPixel(int maxtime_ms)
     {
     _startTimer();
-    if (_g_imSize != _int16_buffer_dim) { _g_redraw_pix = true; } //set redraw to true if the size of the image changed
-    if (_g_r != _pr) _g_redraw_pix = true; // set redraw to true if the range changed
+    const bool newview = ((_g_imSize != _int16_buffer_dim) || (_g_r != _pr)); // true if the size of the image or the range changed
+    if (newview) { _g_redraw_pix = true; }
     if (_g_redraw_pix)
         { // we must completly redraw, initialize everything
+        if (newview) _storePixelView(); // save the previous drawing if completed
+        _pix_version = _g_cache.version(); // version of the model for the new drawing
         _g_redraw_pix = false;
         _pr = _g_r;
         _qi = 0; _qj = 0;
         _counter1 = 0; _counter2 = 0;
         _resizeInt16Buf(_g_imSize);
         _phase = 0;
+        if (newview) _restorePixelView(); // and look for the new one in the cache
         }
     if (maxtime_ms > 0) 
         {
@@ -642,6 +670,49 @@ void _workPixel(int maxtime_ms)
 
 
 
+/* save the current drawing in the render cache if it is completed */
+void _storePixelView()
+    {
+    if ((!_g_cache.enabled()) || (_phase != 3) || (_int16_buffer == nullptr)) return;
+    const int64 lx = _int16_buffer_dim.X(), ly = _int16_buffer_dim.Y();
+    const size_t dxy = (size_t)(lx*ly);
+    _cache_im.resize((size_t)lx, (size_t)ly);
+    RGBc64 * pdest = _cache_im.imData();
+    for (size_t i = 0; i < dxy; i++)
+        { // at phase 3, the buffer contains the exact colors (_counter1 = _counter2 = 1)
+        pdest[i] = RGBc64(_int16_buffer[i], _int16_buffer[i + dxy], _int16_buffer[i + 2 * dxy], _int16_buffer[i + 3 * dxy]);
+        }
+    std::memset(_cache_im.normData(), 0, dxy);
+    _g_cache.store(_pr, _cache_im, iBox2(0, lx - 1, 0, ly - 1), _pix_version); // discarded if the model changed since the drawing started
+    }
+
+
+/* if the current view is in the render cache, copy it in the buffer and mark the drawing as completed */
+void _restorePixelView()
+    {
+    if ((!_g_cache.enabled()) || (_int16_buffer == nullptr)) return;
+    const int64 lx = _int16_buffer_dim.X(), ly = _int16_buffer_dim.Y();
+    const size_t dxy = (size_t)(lx*ly);
+    _cache_im.resize((size_t)lx, (size_t)ly);
+    if (!_g_cache.retrieve(_pr, _cache_im, iBox2(0, lx - 1, 0, ly - 1))) return;
+    const RGBc64 * psrc = _cache_im.imData();
+    for (size_t i = 0; i < dxy; i++)
+        {
+        _int16_buffer[i] = psrc[i].comp.R;
+        _int16_buffer[i + dxy] = psrc[i].comp.G;
+        _int16_buffer[i + 2 * dxy] = psrc[i].comp.B;
+        _int16_buffer[i + 3 * dxy] = psrc[i].comp.A;
+        }
+    _counter1 = 1; _counter2 = 1;
+    _qi = 0; _qj = 0;
+    _phase = 3;
+    }
+
+
+ProgressImg _cache_im;      // temporary image used to exchange drawings with the render cache
+uint64      _pix_version;   // version of the render cache when the current pixel drawing was started
+
+
 // *****************************
 // Dealing with the int16 buffer 
 // *****************************
@@ -843,6 +914,18 @@ int					_exact_phase;			// 0 = remain undrawn sites, 1 = remain dirty site, 2 =
 uint32              _exact_Q0;              // number of images not drawn 
 uint32              _exact_Q23;             // number of images of good quality
 
+/* atlas of rescaled sprites */
+struct _AtlasEntry
+    {
+    Image src;  // copy of the sprite returned by getImage()
+    Image spr;  // the sprite rescaled to the size of a site
+    };
+static const size_t _ATLAS_MAXMEM = 64 * 1024 * 1024;  // memory budget for the atlas (in bytes)
+static const int    _ATLAS_QUALITY = 10;                // quality of the rescaling of the sprites in the atlas
+std::unordered_map<uint64, _AtlasEntry> _atlas;       // rescaled sprites indexed by the hash of the source sprite
+int                 _atlas_sx, _atlas_sy;   // site size for the sprites in the atlas
+size_t              _atlas_mem;             // memory used by the atlas
+
 
 /* version when LatticeObj implement the getImage method */
 inline const Image * _getimage(int64 i, int64 j, int lx, int ly, mtools::metaprog::dummy<true> D)
@@ -862,6 +945,72 @@ inline const Image * _getimage(int64 i, int64 j, int lx, int ly, mtools::metapro
     }
 
 
+/* hash of the content of a sprite (computed on a sample of at most 16x16 pixels) */
+static uint64 _spriteHash(const Image & spr)
+    {
+    uint64 h = 14695981039346656037ULL ^ ((uint64)spr.lx()) ^ (((uint64)spr.ly()) << 32);
+    const int64 lx = spr.lx();
+    const int64 ly = spr.ly();
+    const int64 stepx = std::max<int64>(1, lx / 16);
+    const int64 stepy = std::max<int64>(1, ly / 16);
+    for (int64 j = 0; j < ly; j += stepy)
+        {
+        const RGBc * p = spr.data() + j*spr.stride();
+        for (int64 i = 0; i < lx; i += stepx) { h = (h ^ p[i].color) * 1099511628211ULL; }
+        }
+    return h;
+    }
+
+
+/* query if two sprites have the same content */
+static bool _sameSprite(const Image & spr1, const Image & spr2)
+    {
+    if ((spr1.lx() != spr2.lx()) || (spr1.ly() != spr2.ly())) return false;
+    for (int64 j = 0; j < spr1.ly(); j++)
+        {
+        if (std::memcmp(spr1.data() + j*spr1.stride(), spr2.data() + j*spr2.stride(), (size_t)spr1.lx()*sizeof(RGBc)) != 0) return false;
+        }
+    return true;
+    }
+
+
+/* return the sprite rescaled (high quality) to the size of a site if it is already in the atlas and nullptr otherwise */
+const Image * _atlasFind(const Image & spr)
+    {
+    if ((_atlas_sx != _exact_sx) || (_atlas_sy != _exact_sy))
+        { // site size changed: the atlas is useless now
+        _atlas.clear(); _atlas_mem = 0;
+        _atlas_sx = _exact_sx; _atlas_sy = _exact_sy;
+        return nullptr;
+        }
+    auto it = _atlas.find(_spriteHash(spr));
+    if ((it != _atlas.end()) && (_sameSprite(it->second.src, spr))) return &(it->second.spr);
+    return nullptr;
+    }
+
+
+/* return the sprite rescaled (high quality) to the size of a site (_exact_sx,_exact_sy), taken from the atlas if already there */
+const Image & _atlasSprite(const Image & spr)
+    {
+    const Image * A = _atlasFind(spr);
+    if (A != nullptr) return *A;
+    const uint64 h = _spriteHash(spr);
+    auto it = _atlas.find(h);
+    if (it != _atlas.end())
+        {
+        _atlas_mem -= (size_t)(it->second.src.lx()*it->second.src.ly() + it->second.spr.lx()*it->second.spr.ly())*sizeof(RGBc); // same hash but different sprite: replace the entry
+        _atlas.erase(it);
+        }
+    const size_t bytes = (size_t)(spr.lx()*spr.ly() + ((int64)_exact_sx)*_exact_sy)*sizeof(RGBc);
+    if (_atlas_mem + bytes > _ATLAS_MAXMEM) { _atlas.clear(); _atlas_mem = 0; }
+    _AtlasEntry & E = _atlas[h];
+    E.src = spr.get_standalone();
+    E.spr = spr.get_rescale(_ATLAS_QUALITY, _exact_sx, _exact_sy);
+    _atlas_mem += bytes;
+    return E.spr;
+    }
+
+
 
 
 /* improve the quality of the image */
@@ -895,9 +1044,18 @@ void _improveImage(int maxtime_ms)
 								_exact_im.blit(*spr, _exact_sx*i, _exact_sy*(_exact_qbuf.height() - 1 - j));
                                 } 
                             else
-                                { // not at the right dimension, we resize before blitting
-                                _exact_qbuf(i, j) = 1;
-								_exact_im.blit_rescaled(0, *spr, _exact_sx*i, _exact_sy*(_exact_qbuf.height() - 1 - j), _exact_sx, _exact_sy); // fast rescaling then blit.
+                                { // not at the right dimension
+                                const Image * A = _atlasFind(*spr);
+                                if (A != nullptr)
+                                    { // already rescaled in the atlas: the site is final and is not fetched again during the refinement pass
+                                    _exact_qbuf(i, j) = 2; ++_exact_Q23;
+                                    _exact_im.blit(*A, _exact_sx*i, _exact_sy*(_exact_qbuf.height() - 1 - j));
+                                    }
+                                else
+                                    { // fast rescaling then blit, refined later.
+                                    _exact_qbuf(i, j) = 1;
+                                    _exact_im.blit_rescaled(0, *spr, _exact_sx*i, _exact_sy*(_exact_qbuf.height() - 1 - j), _exact_sx, _exact_sy);
+                                    }
                                 }
                             }
                         }
@@ -930,8 +1088,8 @@ void _improveImage(int maxtime_ms)
 								_exact_im.blit(*spr, _exact_sx*i, _exact_sy*(_exact_qbuf.height() - 1 - j)); // copy
                                 }
                             else
-                                { // still not at the right dimension, we resize before blitting
-								_exact_im.blit_rescaled(0, *spr, _exact_sx*i, _exact_sy*(_exact_qbuf.height() - 1 - j), _exact_sx, _exact_sy); // high quality rescaling then blit.
+                                { // still not at the right dimension, we use the high quality rescaled sprite from the atlas
+								_exact_im.blit(_atlasSprite(*spr), _exact_sx*i, _exact_sy*(_exact_qbuf.height() - 1 - j));
                                 }
                             }
 						}
@@ -1051,6 +1209,8 @@ void _adjustSiteImageSize(int & sx,int & sy,int winx,int winy,const fBox2 & pr)
 	{
 	double fsx = ((double)winx)/((double)pr.lx());
 	double fsy = ((double)winy)/((double)pr.ly());
+	const double maxs = (double)std::max<int>(std::max<int>(winx, winy), 1); // large zoom: do not make sprites larger than the window, they are magnified when drawn
+	if ((fsx > maxs) || (fsy > maxs)) { const double f = maxs / std::max<double>(fsx, fsy); fsx = std::max<double>(fsx*f, 1.0); fsy = std::max<double>(fsy*f, 1.0); }
 	if (std::abs(fsx - _exact_sx) < 1) {sx = _exact_sx;} else {sx = (int)ceil(fsx -0.5);}
 	if (std::abs(fsy - _exact_sy) < 1) {sy = _exact_sy;} else {sy = (int)ceil(fsy -0.5);}
 	return;
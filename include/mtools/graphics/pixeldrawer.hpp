@@ -32,11 +32,14 @@
 #include "../random/gen_fastRNG.hpp"
 #include "../random/classiclaws.hpp"
 #include "internal/getcolorselector.hpp"
+#include "internal/drawtiles.hpp"
 
 #include <algorithm>
 #include <ctime>
 #include <mutex>
 #include <atomic>
+#include <memory>
+#include <vector>
 
 
 
@@ -46,11 +49,215 @@ namespace mtools
 
 
 
+    namespace internals_pixeldrawer
+        {
+
+
+        /**
+         * Per pixel statistics for adaptive stochastic sampling: running mean and variance (Welford) of
+         * the luminance of the samples. A pixel is frozen (n < 0) once the standard error of its mean
+         * is below ADAPTIVE_TOLERANCE: no more samples are spent on it.
+         **/
+        struct PixelStat
+            {
+            float n;        // number of samples (negated once the pixel is frozen)
+            float mean;     // running mean
+            float m2;       // running sum of squared deviations from the mean
+            };
+
+
+        /**
+         * Queue of tiles shared by the workers of a PixelDrawer.
+         *
+         * The part of the image to draw is split in small tiles. Each drawing stage of a tile (fast
+         * drawing, one pass of stochastic sampling, perfect drawing) is a separate step and the workers
+         * always pull the least advanced tile so the whole image progresses uniformly whatever the cost of
+         * getColor() in the different regions.
+         *
+         * When the view is panned at a fixed scale, the previous drawing is scrolled and only the newly
+         * exposed strips are drawn from scratch. Scrolled tiles which were completed stay completed and
+         * the others resume from their normalized content.
+         *
+         * The parameters must only be changed while no worker is drawing.
+         **/
+        class TileQueue : public internals_drawtiles::DrawTileQueue
+            {
+
+            public:
+
+                static const int STAGE_1TO1 = 1;
+                static const int STAGE_FAST = 2;
+                static const int STAGE_STOCHASTIC = 3;
+                static const int STAGE_PERFECT = 4;
+
+                static constexpr double DENSITY_SKIP_STOCHASTIC = 5.0;  // density below which the stochastic stage is skipped
+                static const int ADAPTIVE_MIN_SAMPLES = 32;             // minimum number of samples before a pixel can be frozen
+                static constexpr float ADAPTIVE_TOLERANCE = 0.25f;      // standard error (in color units) below which a pixel is frozen
+
+
+                /** Constructor. The parameters are initially invalid. */
+                TileQueue() : DrawTileQueue(), _dens(0.0), _is1to1(false), _range1to1(iBox2()), _sampleToDo(0), _stride(0)
+                    {
+                    }
+
+
+                /**
+                 * Sets the drawing parameters and reset all the tiles (or only those of the newly exposed
+                 * part of the image if the range is a translation of the previous one by an integer number
+                 * of pixels). The previous drawing is saved in the render cache if completed and the new one
+                 * is taken from the cache if available.
+                 *
+                 * @return  true if the parameters are valid. If not, nothing will be drawn.
+                 **/
+                bool setParameters(fBox2 range, ProgressImg * im, iBox2 subBox)
+                    {
+                    const int MIN_IMAGE_SIZE = 2;
+                    const double RANGE_MIN_VALUE = 1.0e-17;
+                    const double RANGE_MAX_VALUE = 1.0e17;
+                    std::unique_lock<std::mutex> lock(_mut);
+                    _storeView();
+                    if ((im == nullptr) || (im->width() < MIN_IMAGE_SIZE) || (im->height() < MIN_IMAGE_SIZE)) { _invalidate(); return false; }  // make sure im is not nullptr and is big enough.
+                    if (subBox.isEmpty()) { subBox = iBox2(0, im->width() - 1, 0, im->height() - 1); } // subbox = whole image if empty.
+                    if ((subBox.min[0] < 0) || (subBox.max[0] >= (int64)im->width()) || (subBox.min[1] < 0) || (subBox.max[1] >= (int64)im->height())) { _invalidate(); return false; } // make sure subBox is a proper subbox of im
+                    if ((subBox.lx() < MIN_IMAGE_SIZE) || (subBox.ly() < MIN_IMAGE_SIZE)) { _invalidate(); return false; }
+                    const double rlx = range.lx();
+                    const double rly = range.ly();
+                    if ((rlx < RANGE_MIN_VALUE) || (rly < RANGE_MIN_VALUE)) { _invalidate(); return false; } // prevent zooming in too far
+                    if ((std::abs(range.min[0]) > RANGE_MAX_VALUE) || (std::abs(range.max[0]) > RANGE_MAX_VALUE) || (std::abs(range.min[1]) > RANGE_MAX_VALUE) || (std::abs(range.max[1]) > RANGE_MAX_VALUE)) { _invalidate(); return false; } // prevent zooming out too far
+                    const int64 ilx = subBox.lx() + 1;
+                    const int64 ily = subBox.ly() + 1;
+                    const double epsx = rlx - ilx;
+                    const double epsy = rly - ily;
+                    const bool is1to1 = ((std::abs(epsx) < 1.0) && (std::abs(epsy) < 1.0));
+                    iBox2 range1to1;
+                    if (is1to1)
+                        {// do 1 to 1 drawing;
+                        range.min[0] += epsx / 2.0; range.max[0] -= epsx / 2.0;
+                        range.min[1] += epsy / 2.0; range.max[1] -= epsy / 2.0;
+                        range1to1.min[0] = (int64)std::ceil(range.min[0]); range1to1.max[0] = (int64)range1to1.min[0] + ilx - 1;
+                        range1to1.min[1] = (int64)std::ceil(range.min[1]); range1to1.max[1] = (int64)range1to1.min[1] + ily - 1;
+                        }
+                    int64 dx, dy;
+                    bool pan = _isPan(range, im, subBox, dx, dy);
+                    if ((pan) && (is1to1)) { pan = (_is1to1) && (range1to1.min[0] == _range1to1.min[0] - dx) && (range1to1.min[1] == _range1to1.min[1] - dy); } // the sites must be scrolled exactly
+                    _is1to1 = is1to1;
+                    _range1to1 = range1to1;
+                    const bool cached = _restoreView(range, im, subBox);
+                    if ((pan) && (!cached))
+                        {
+                        _scroll(range, dx, dy, (_is1to1 ? STAGE_1TO1 : STAGE_FAST));
+                        for (size_t i = 0; i < _nbtiles; i++)
+                            {
+                            internals_drawtiles::DrawTile & T = _tiles[i];
+                            if ((!T.reused) || (T.stage == STAGE_DONE) || (T.stage == STAGE_PERFECT)) continue; // the perfect stage overwrites the whole tile
+                            _resetTile(T, true);
+                            }
+                        std::fill(_stats.begin(), _stats.end(), PixelStat{ 0.0f, 0.0f, 0.0f });
+                        return true;
+                        }
+                    if (!cached) _setTiles(range, im, subBox, STAGE_FAST);
+                    _dens = _dlx*_dly;
+                    // number of stochastic samples per pixel
+                    if (_dens < DENSITY_SKIP_STOCHASTIC) { _sampleToDo = 0; }
+                    else if (_dens < 10.0) { _sampleToDo = (int)_dens / 2; }
+                    else if (_dens < 20000) { _sampleToDo = 5 + ((int)_dens) / 20; }
+                    else _sampleToDo = 1000;
+                    _stride = (size_t)ilx;
+                    if (_sampleToDo > 0) { _stats.resize((size_t)(ilx*ily)); } else { _stats.clear(); _stats.shrink_to_fit(); }
+                    if (!cached) _reset(false);
+                    return true;
+                    }
+
+
+                /**
+                 * Reset the tiles to start a new drawing.
+                 *
+                 * @param   keepPrevious    If true, keep the previous drawing of the tiles which are already
+                 *                          past the fast drawing stage.
+                 **/
+                void redraw(bool keepPrevious)
+                    {
+                    std::unique_lock<std::mutex> lock(_mut);
+                    if (_valid) _reset(keepPrevious);
+                    }
+
+
+                /** Set a tile at the beginning of the stochastic stage (or at the perfect stage if the density is too low). */
+                void initStochastic(internals_drawtiles::DrawTile & T) const
+                    {
+                    T.sampleDone = 1; // the fast drawing
+                    T.batch = 1;
+                    if (_sampleToDo - T.sampleDone <= 0) { T.stage = STAGE_PERFECT; return; }
+                    T.stage = STAGE_STOCHASTIC;
+                    if ((_sampleToDo - T.sampleDone) < 199) { T.passes = _sampleToDo - T.sampleDone; T.last = true; }
+                    else { T.passes = 199; T.last = false; } // the number of queries is limited to 255 per pixel so we go to 200 and then divide by 2
+                    }
+
+
+                /** Average number of sites per pixel. */
+                double density() const { return _dens; }
+
+                /** Query if the drawing is done 1 to 1. */
+                bool is1to1() const { return _is1to1; }
+
+                /** The integer range box in the case of 1 to 1 drawing. */
+                const iBox2 & range1to1() const { return _range1to1; }
+
+                /** The number of stochastic samples per pixel. */
+                int sampleToDo() const { return _sampleToDo; }
+
+                /** The statistics of pixel (x,y) of the image (only for the stochastic stage). */
+                PixelStat * stats(int64 x, int64 y) { return _stats.data() + (size_t)(x - _subBox.min[0]) + _stride*(size_t)(y - _subBox.min[1]); }
+
+
+            private:
+
+                /* reset the tiles, _mut must be locked */
+                void _reset(bool keepPrevious)
+                    {
+                    for (size_t i = 0; i < _nbtiles; i++) { _resetTile(_tiles[i], keepPrevious); }
+                    std::fill(_stats.begin(), _stats.end(), PixelStat{ 0.0f, 0.0f, 0.0f });
+                    if (!keepPrevious) _newDrawing();
+                    }
+
+                /* reset a tile, _mut must be locked */
+                void _resetTile(internals_drawtiles::DrawTile & T, bool keepPrevious)
+                    {
+                    T.busy = false;
+                    if (_is1to1) { T.stage = STAGE_1TO1; T.progress = 0; return; }
+                    if ((keepPrevious) && (T.progress >= 5))
+                        {
+                        _im->normalize(T.box);
+                        T.progress = 5;
+                        initStochastic(T);
+                        return;
+                        }
+                    T.progress = 0;
+                    T.stage = STAGE_FAST;
+                    }
+
+                TileQueue(const TileQueue &) = delete;
+                TileQueue & operator=(const TileQueue &) = delete;
+
+                double _dens;                           // density : average number of sites per pixel
+                bool _is1to1;                           // true if we have a 1 to 1 drawing
+                iBox2 _range1to1;                       // integer range box in the case of 1 to 1 drawing
+                int _sampleToDo;                        // number of stochastic samples per pixel
+                std::vector<PixelStat> _stats;          // statistics of the pixels for adaptive sampling
+                size_t _stride;                         // width of the subbox
+            };
+
+
+        }
+
+
     /**
      * Thread pixel drawer class.
      * 
-     * Template class that create a unique thread used to draw inside a progressImg. This class is
-     * used by the PixelDrawer class which combine several threads together for faster drawing.
+     * Template class that create a worker used to draw inside a progressImg. Several workers share a
+     * queue of tiles: each one repeatedly takes the least advanced tile and performs the next drawing
+     * stage on it. This class is used by the PixelDrawer class which combines several workers together
+     * for faster drawing.
      *
      * @tparam  ObjType Type of object to draw. Must implement a color recognized by the
      *                  GetColorSelector() (cf file getcolorselector.hpp).
@@ -65,20 +272,18 @@ namespace mtools
             *
             * @param [in,out]  obj     pointer to the object to be drawn. Must implement a method recognized
             *                          by GetColorSelector().
+            * @param [in,out]  queue   the queue of tiles to draw (shared with the other workers).
             * @param [in,out]  opaque  (Optional) The opaque data to passed to getColor(), nullptr if not
             *                          specified.
             **/
-            ThreadPixelDrawer(ObjType * obj, void * opaque = nullptr) : ThreadWorker(),
+            ThreadPixelDrawer(ObjType * obj, internals_pixeldrawer::TileQueue * queue, void * opaque = nullptr) : ThreadWorker(),
                 _obj(obj),
                 _opaque(opaque),
-                _keepPrevious(false),
-                _validParam(false),
+                _queue(queue),
+                _tile(nullptr),
                 _range(fBox2()),
-                _temp_range(fBox2()),
                 _im(nullptr),
-                _temp_im(nullptr),
                 _subBox(iBox2()),
-                _temp_subBox(iBox2()),
                 _dens(0.0),
                 _dlx(0.0), _dly(0.0),
                 _is1to1(false),
@@ -99,49 +304,27 @@ namespace mtools
 
 
             /**
-            * Determines if the drawing parameter are valid. Return false if for example, the image is set
-            * to nullptr, or the subbox is incorrect, or if the range is too small, or too large, or empty.
-            *
-            * If it return false, nothing will be drawn and the quality will stay 0.
-            *
-            * @return  true if the paramter are valid and false otherwise.
-            **/
-            inline bool validParam()  const { return (bool)_validParam; }
-
-
-            /**
-            * Sets the drawing parameters.
+            * Start drawing the tiles of the queue (from their current state).
             *
             * Returns immediately, use sync() to wait for the operation to complete.
-            *
-            * @param   range       The range to draw.
-            * @param [in,out]  im  The image to draw into.
-            * @param   subBox      The part of the image to draw (border inclusive). If empty, use the whole
-            *                      image.
             **/
-            void setParameters(const fBox2 & range, ProgressImg * im, const iBox2 & subBox = iBox2())
+            void restart()
                 {
                 sync();
-                _temp_range = range;
-                _temp_im = im;
-                _temp_subBox = subBox;
-                signal(SIGNAL_NEWPARAM);
+                signal(SIGNAL_RESTART);
                 }
 
 
             /**
-            * Force a redraw.
+            * Stop drawing. Once the command is completed (use sync()), the worker does not access the
+            * queue of tiles anymore.
             *
             * Returns immediately, use sync() to wait for the operation to complete.
-            *
-            * @param   keepPrevious    If true, keep the previous drawing so that quality starts from 1 and
-            *                          not 0 if possible.
             **/
-            void redraw(bool keepPrevious = true)
+            void stop()
                 {
                 sync();
-                _keepPrevious = keepPrevious;
-                signal(SIGNAL_REDRAW);
+                signal(SIGNAL_STOP);
                 }
 
 
@@ -151,16 +334,26 @@ namespace mtools
 
             /**
             * Override from the ThreadWorker class.
-            * The main 'work' method
+            * The main 'work' method: draw tiles until there is nothing left to do.
             **/
             virtual void work() override
                 {
-                MTOOLS_INSURE((bool)_validParam);
-                // if (!((bool)_keepPrevious)) _draw_veryfast();   // <- Disabled. Not very efficient as is. 
-                if ((bool)_is1to1) { _draw_1to1(); return; }
-                if (!((bool)_keepPrevious)) _draw_fast();
-                _draw_stochastic();
-                _draw_perfect();
+                MTOOLS_INSURE(_queue->valid());
+                while (1)
+                    {
+                    internals_drawtiles::DrawTile * T = _queue->acquire();
+                    if (T == nullptr) return;
+                    TileGuard guard(_queue, T); // give the tile back even if interrupted
+                    _setTile(T);
+                    switch (T->stage)
+                        {
+                        case internals_pixeldrawer::TileQueue::STAGE_1TO1: { _draw_1to1(); T->stage = internals_pixeldrawer::TileQueue::STAGE_DONE; break; }
+                        case internals_pixeldrawer::TileQueue::STAGE_FAST: { _draw_fast(); _queue->initStochastic(*T); break; }
+                        case internals_pixeldrawer::TileQueue::STAGE_STOCHASTIC: { _draw_stochastic(); break; }
+                        case internals_pixeldrawer::TileQueue::STAGE_PERFECT: { _draw_perfect(); T->stage = internals_pixeldrawer::TileQueue::STAGE_DONE; break; }
+                        default: { MTOOLS_ERROR("wtf!"); }
+                        }
+                    }
                 }
 
 
@@ -172,71 +365,47 @@ namespace mtools
                 {
                 switch (code)
                     {
-                    case SIGNAL_NEWPARAM: { return _setNewParam(); }
-                    case SIGNAL_REDRAW: { return _setRedraw(); }
+                    case SIGNAL_RESTART: { return (_queue->valid() ? THREAD_RESET : THREAD_RESET_AND_WAIT); }
+                    case SIGNAL_STOP: { return THREAD_RESET_AND_WAIT; }
                     default: { MTOOLS_ERROR("wtf!"); return 0; }
                     }
                 }
 
 
-            /* set the new parameter */
-            int _setNewParam()
+            /* give back the tile to the queue when going out of scope */
+            struct TileGuard
                 {
-                const int MIN_IMAGE_SIZE = 2;
-                const double RANGE_MIN_VALUE = 1.0e-17;
-                const double RANGE_MAX_VALUE = 1.0e17;
-                _range = _temp_range;
-                _im = _temp_im;
-                _subBox = _temp_subBox;
-                _keepPrevious = false;
-                setProgress(0);
-                if ((_im == nullptr) || (_im->width() < MIN_IMAGE_SIZE) || (_im->height() < MIN_IMAGE_SIZE)) { _validParam = false; return THREAD_RESET_AND_WAIT; }   // make sure im is not nullptr and is big enough.
-                if (_subBox.isEmpty()) { _subBox = iBox2(0, _im->width() - 1, 0, _im->height() - 1); } // subbox = whole image if empty. 
-                if ((_subBox.min[0] < 0) || (_subBox.max[0] >= (int64)_im->width()) || (_subBox.min[1] < 0) || (_subBox.max[1] >= (int64)_im->height())) { setProgress(0); _validParam = false; return THREAD_RESET_AND_WAIT; } // make sure _subBox is a proper subbox of im
-                if ((_subBox.lx() < MIN_IMAGE_SIZE) || (_subBox.ly() < MIN_IMAGE_SIZE)) { _validParam = false; return THREAD_RESET_AND_WAIT; } // make sure _subBox is a proper subbox of im
-                const double rlx = _range.lx();
-                const double rly = _range.ly();
-                if ((rlx < RANGE_MIN_VALUE) || (rly < RANGE_MIN_VALUE)) { _validParam = false; return THREAD_RESET_AND_WAIT; } // prevent zooming in too far
-                if ((std::abs(_range.min[0]) > RANGE_MAX_VALUE) || (std::abs(_range.max[0]) > RANGE_MAX_VALUE) || (std::abs(_range.min[1]) > RANGE_MAX_VALUE) || (std::abs(_range.max[1]) > RANGE_MAX_VALUE)) { _validParam = false; return THREAD_RESET_AND_WAIT; } // prevent zooming out too far
-                _validParam = true;
-                const int64 ilx = _subBox.lx() + 1;
-                const int64 ily = _subBox.ly() + 1;
-                _dlx = rlx / ilx;
-                _dly = rly / ily;
-                _dens = _dlx*_dly;
-                const double epsx = rlx - ilx;
-                const double epsy = rly - ily;
-                if ((std::abs(epsx) < 1.0) && (std::abs(epsy) < 1.0))
-                    {// do 1 to 1 drawing;
-                    _is1to1 = true;
-                    _range.min[0] += epsx / 2.0; _range.max[0] -= epsx / 2.0;
-                    _range.min[1] += epsy / 2.0; _range.max[1] -= epsy / 2.0;
-                    _range1to1.min[0] = (int64)std::ceil(_range.min[0]); _range1to1.max[0] = (int64)_range1to1.min[0] + ilx - 1;
-                    _range1to1.min[1] = (int64)std::ceil(_range.min[1]); _range1to1.max[1] = (int64)_range1to1.min[1] + ily - 1;
-                    }
-                else
-                    {
-                    _is1to1 = false;
-                    }
-                return THREAD_RESET;
-                }
+                TileGuard(internals_pixeldrawer::TileQueue * queue, internals_drawtiles::DrawTile * tile) : Q(queue), T(tile) {}
+                ~TileGuard() { Q->release(T); }
+                internals_pixeldrawer::TileQueue * Q;
+                internals_drawtiles::DrawTile * T;
+                };
 
 
-            /* trigger a redraw */
-            int _setRedraw()
+            /* set the drawing parameters for a tile */
+            void _setTile(internals_drawtiles::DrawTile * T)
                 {
-                if (!((bool)_validParam)) return THREAD_RESET_AND_WAIT;
-                if ((progress() >= 5) && ((bool)_keepPrevious))
+                _tile = T;
+                _range = T->range;
+                _im = _queue->image();
+                _subBox = T->box;
+                _dens = _queue->density();
+                _dlx = _queue->dlx();
+                _dly = _queue->dly();
+                _is1to1 = _queue->is1to1();
+                if (_is1to1)
                     {
-                    _im->normalize(_subBox);
-                    setProgress(5);
-                    return THREAD_RESET;
+                    const iBox2 & B = _queue->subBox();
+                    const iBox2 & R = _queue->range1to1();
+                    _range1to1 = iBox2(R.min[0] + (_subBox.min[0] - B.min[0]), R.min[0] + (_subBox.max[0] - B.min[0]), R.min[1] + (_subBox.min[1] - B.min[1]), R.min[1] + (_subBox.max[1] - B.min[1]));
                     }
-                setProgress(0);
-                return THREAD_RESET;
                 }
 
 
+            /* set the progress of the current tile */
+            inline void _setProgress(int val) { _tile->progress = val; }
+
+
             /* very fast drawing 
              * Used when drawing very large image. 
              * This method first draw by approximation replacing pixels by larger square.
@@ -245,7 +414,7 @@ namespace mtools
                 {
                 const double MAX_WITHOUT_APPROX = 2000*2000;
                 double L = sqrt((double)_nbPixels()/MAX_WITHOUT_APPROX);
-                if (L > 1.0) { _draw_veryfast((int)(2*L)); setProgress(1); }
+                if (L > 1.0) { _draw_veryfast((int)(2*L)); _setProgress(1); }
                 return;
                 }
 
@@ -437,7 +606,7 @@ namespace mtools
                         off += pa;
                         }
                     }
-                setProgress(5);
+                _setProgress(5);
                 }
 
 
@@ -482,45 +651,35 @@ namespace mtools
                             }
                         }
                     }
-                setProgress(100);
+                _setProgress(100);
                 }
 
 
-            /* stochastic drawing */
+            /* one pass of stochastic drawing on the current tile */
             void _draw_stochastic()
                 {
-                const double DENSITY_SKIP_STOCHASTIC = 5.0;
-                if (_dens < DENSITY_SKIP_STOCHASTIC) return;
-                // compute the number of sample required            
-                int sampleToDo;
-                if (_dens < 10.0) { sampleToDo = (int)_dens / 2; }
-                else if (_dens < 20000) { sampleToDo = 5 + ((int)_dens) / 20; }
-                else sampleToDo = 1000;
-                int sampleDone = 1; // 1 sample currently done (the fast one)            
-                if ((sampleToDo - sampleDone) < 199)
-                    { // ok, we do everything on a single pass. 
-                    _draw_stochastic_batch(1, sampleToDo - sampleDone, sampleDone, sampleToDo);
-                    }
-                else
-                    { // need multiple passes
-                    _draw_stochastic_batch(1, 199, sampleDone, sampleToDo);  // go to 200
+                internals_drawtiles::DrawTile & T = *_tile;
+                const int sampleToDo = _queue->sampleToDo();
+                const int64 nbactive = _draw_stochastic_batch(T.batch);
+                T.sampleDone += T.batch;
+                T.passes--;
+                if (nbactive == 0) { T.passes = 0; T.last = true; } // every pixel of the tile is frozen
+                if (T.passes > 0) { _setProgress(5 + std::min<int>(44, (45 * T.sampleDone) / sampleToDo)); return; }
+                if (!T.last)
+                    { // end of a round
                     _progimage_div2(); // go back to 100
-                    int batchSize = 2;
-                    while (batchSize * 100 < sampleToDo)
-                        {
-                        _draw_stochastic_batch(batchSize, 100, sampleDone, sampleToDo); // go from 100 to 200
-                        _progimage_div2(); // back to 100
-                        batchSize *= 2;
-                        }
-                    _draw_stochastic_batch(batchSize, sampleToDo / batchSize, sampleDone, sampleToDo); // do the remaining passes
+                    T.batch *= 2;
+                    if (T.batch * 100 < sampleToDo) { T.passes = 100; } // go from 100 to 200
+                    else { T.passes = sampleToDo / T.batch; T.last = true; } // do the remaining passes
+                    if (T.passes > 0) return;
                     }
-                setProgress(50);
-                return;
+                T.stage = internals_pixeldrawer::TileQueue::STAGE_PERFECT;
+                _setProgress(50);
                 }
 
 
             /* divide by two the color and number of query in every pixel
-            of the subbox of the progressimage. */
+            of the subbox of the progressimage (except the frozen ones). */
             void _progimage_div2()
                 {
                 RGBc64 * imData = _im->imData();
@@ -534,10 +693,14 @@ namespace mtools
                 for (int64 jj = 0; jj < ily; jj++)
                     {
 					check();
+                    const internals_pixeldrawer::PixelStat * stat = _queue->stats(_subBox.min[0], _subBox.min[1] + jj);
 					for (int64 ii = 0; ii < ilx; ii++)
                         {
-						imData[off].div2();
-                        normData[off] >>= 1;
+                        if (stat[ii].n >= 0)
+                            {
+                            imData[off].div2();
+                            normData[off] >>= 1;
+                            }
                         off++;
                         }
                     off += pa;
@@ -547,9 +710,11 @@ namespace mtools
                 }
 
 
-            /* draw a 'batch' with stochastic drawing. Used by _draw_stochastic() */
-            void _draw_stochastic_batch(const int batchsize, const int nb, int & sampleDone, const int sampleToDo)
+            /* draw a pass with stochastic drawing: add the average of 'batchsize' random samples to every pixel
+               which is not frozen. Return the number of pixels that are not frozen. Used by _draw_stochastic() */
+            int64 _draw_stochastic_batch(const int batchsize)
                 {
+                const float tol2 = internals_pixeldrawer::TileQueue::ADAPTIVE_TOLERANCE*internals_pixeldrawer::TileQueue::ADAPTIVE_TOLERANCE;
                 RGBc64 * imData = _im->imData();
                 uint8 * normData = _im->normData();
                 const double px = _dlx; // lenght of a screen pixel
@@ -559,20 +724,22 @@ namespace mtools
                 const fBox2 r = _range; // corresponding range
                 const int64 width = _im->width();
                 const size_t pa = (size_t)(width - ilx);
-                const int sd = sampleDone;
 				FastLaw randX(1);
 				FastLaw randY(1);
 				uint32 bln = highestBit((uint32)batchsize) - 1; // shift needed to divide by batchsize
 				MTOOLS_ASSERT((1L << bln) == batchsize);
-				for (int nbb = 0; nbb < nb; nbb++)
+                int64 nbactive = 0;
+                size_t off = (size_t)(_subBox.min[0] + _im->width()*(_subBox.min[1]));
+                fBox2 pixBox(r.min[0], r.min[0] + px, r.min[1], r.min[1] + py);
+                for (int64 jj = 0; jj < ily; jj++)
                     {
-                    size_t off = (size_t)(_subBox.min[0] + _im->width()*(_subBox.min[1]));
-                    fBox2 pixBox(r.min[0], r.min[0] + px, r.min[1], r.min[1] + py);
-                    for (int64 jj = 0; jj < ily; jj++)
+                    internals_pixeldrawer::PixelStat * stat = _queue->stats(_subBox.min[0], _subBox.min[1] + jj);
+                    for (int64 ii = 0; ii < ilx; ii++)
                         {
-                        for (int64 ii = 0; ii < ilx; ii++)
+						if (!(ii & 127)) check();
+                        internals_pixeldrawer::PixelStat & S = stat[ii];
+                        if (S.n >= 0)
                             {
-							if (!(ii & 127)) check();
                             iBox2 siteBox((int64)std::floor(pixBox.min[0] + 0.5), (int64)std::ceil(pixBox.max[0] - 0.5), (int64)std::floor(pixBox.min[1] + 0.5), (int64)std::ceil(pixBox.max[1] - 0.5));
 							randX.setParam((uint32)(siteBox.max[0] - siteBox.min[0] + 1));
 							randY.setParam((uint32)(siteBox.max[1] - siteBox.min[1] + 1));
@@ -584,21 +751,29 @@ namespace mtools
 								const int64 j = siteBox.min[1] +  randY(rr >> 16);
                                 const RGBc c = mtools::GetColorSelector<ObjType>::call(*_obj, { i, j }, _opaque);
                                 iR += c.comp.R; iG += c.comp.G; iB += c.comp.B; iA += c.comp.A;
+                                // update the running variance of the luminance
+                                const float v = (float)(3 * c.comp.R + 5 * c.comp.G + 7 * c.comp.B + c.comp.A) * (1.0f / 16.0f);
+                                S.n += 1.0f;
+                                const float d = v - S.mean;
+                                S.mean += d / S.n;
+                                S.m2 += d * (v - S.mean);
                                 }
 							imData[off].add(RGBc64((uint16)(iR >> bln), (uint16)(iG >> bln), (uint16)(iB >> bln), (uint16)(iA >> bln)));
                             normData[off]++;
-                            off++;
-                            pixBox.min[0] += px; pixBox.max[0] += px;
+                            nbactive++;
+                            // freeze the pixel once the standard error of its mean is small enough
+                            if ((S.n >= internals_pixeldrawer::TileQueue::ADAPTIVE_MIN_SAMPLES) && (S.m2 <= tol2 * S.n * (S.n - 1.0f))) { S.n = -S.n; }
                             }
-                        off += pa;
-                        pixBox.min[1] += py;
-                        pixBox.max[1] += py;
-                        pixBox.min[0] = r.min[0];
-                        pixBox.max[0] = r.min[0] + px;
+                        off++;
+                        pixBox.min[0] += px; pixBox.max[0] += px;
                         }
-                    setProgress(5 + (45 * (sd + nbb)) / sampleToDo);
+                    off += pa;
+                    pixBox.min[1] += py;
+                    pixBox.max[1] += py;
+                    pixBox.min[0] = r.min[0];
+                    pixBox.max[0] = r.min[0] + px;
                     }
-                sampleDone += (nb*batchsize);
+                return nbactive;
                 }
 
 
@@ -612,7 +787,7 @@ namespace mtools
                     {
                     if (_dens < PERFECT_ULTRAHIGH_DENSITY) _draw_perfect_highdensity(); else _draw_perfect_ultrahighdensity();
                     }
-                setProgress(100);
+                _setProgress(100);
                 return;
                 }
 
@@ -676,7 +851,7 @@ namespace mtools
 							pixBox.max[1] += py;
 							pixBox.min[0] = r.min[0];
 							pixBox.max[0] = r.min[0] + px;
-							setProgress((int)((50 * jj) / ily + 50));
+							_setProgress((int)((50 * jj) / ily + 50));
 							}
 						}
 					else
@@ -712,7 +887,7 @@ namespace mtools
 							pixBox.max[1] += py;
 							pixBox.min[0] = r.min[0];
 							pixBox.max[0] = r.min[0] + px;
-							setProgress((int)((50 * jj) / ily + 50));
+							_setProgress((int)((50 * jj) / ily + 50));
 							}
 						}
 					}
@@ -748,7 +923,7 @@ namespace mtools
 						pixBox.max[1] += py;
 						pixBox.min[0] = r.min[0];
 						pixBox.max[0] = r.min[0] + px;
-						setProgress((int)((50 * jj) / ily + 50));
+						_setProgress((int)((50 * jj) / ily + 50));
 						}
 					}
                 return;
@@ -951,7 +1126,7 @@ namespace mtools
                     pixBox.max[1] += py;
                     pixBox.min[0] = r.min[0];
                     pixBox.max[0] = r.min[0] + px;
-                    setProgress((int)((50 * jj) / ily + 50));
+                    _setProgress((int)((50 * jj) / ily + 50));
                     }
                 return;
                 }
@@ -962,21 +1137,18 @@ namespace mtools
             ThreadPixelDrawer & operator=(const ThreadPixelDrawer &) = delete;   //
 
 
-            static const int SIGNAL_NEWPARAM = 4;
-            static const int SIGNAL_REDRAW = 5;
+            static const int SIGNAL_RESTART = 4;
+            static const int SIGNAL_STOP = 5;
 
             ObjType * _obj;                         // the object to draw.
             void * _opaque;                         // opaque data passed to _obj;
 
-            std::atomic<bool> _keepPrevious;        // do we keep something from the previous drawing
-            std::atomic<bool> _validParam;          // indicate if the parameter are valid.
+            internals_pixeldrawer::TileQueue * _queue;  // the queue of tiles
+            internals_drawtiles::DrawTile * _tile;   // the tile currently drawn
 
-            fBox2 _range;                           // the range
-            std::atomic<fBox2> _temp_range;         // and the temporary use to communicate with the thread.
+            fBox2 _range;                           // the range of the current tile
             ProgressImg* _im;                       // the image to draw onto
-            std::atomic<ProgressImg*> _temp_im;     // and the temporary use to communicate with the thread.
-            iBox2 _subBox;                          // part of the image to draw
-            std::atomic<iBox2> _temp_subBox;        // and the temporary use to communicate with the thread.
+            iBox2 _subBox;                          // part of the image covered by the current tile
 
             double _dens;                           // density : average number of sites per pixel
             double _dlx, _dly;                      // horizontal and vertical density (size of image pixel in real coord)
@@ -994,6 +1166,10 @@ namespace mtools
     *
     * Uses several threads to draw from a getColor function into a progressImg.
     *
+    * The image is split into small tiles which are dispatched dynamically to the threads so that the
+    * work stays balanced even when the cost of getColor() varies a lot across the image. During the
+    * stochastic stage, samples are only spent on pixels whose color has not yet converged.
+    *
     * @tparam  ObjType Type of object to draw. Must implement a color recognized by the
     *                  GetColorSelector().
     **/
@@ -1039,7 +1215,7 @@ namespace mtools
                 if (nb == nbThreads()) return;
                 _deleteAllThread();
                 _vecThread.resize(nb);
-                for (int i = 0; i < nb; i++) { _vecThread[i] = new ThreadPixelDrawer<ObjType>(_obj); }
+                for (int i = 0; i < nb; i++) { _vecThread[i] = new ThreadPixelDrawer<ObjType>(_obj, &_queue); }
                 }
 
 
@@ -1050,8 +1226,7 @@ namespace mtools
                 {
                 if (_vecThread.size() == 0) return false;
                 sync();
-                for (size_t i = 0; i < _vecThread.size(); i++) { if (!((_vecThread[i])->validParam())) return false; }
-                return true;
+                return _queue.valid();
                 }
 
 
@@ -1066,18 +1241,12 @@ namespace mtools
 
 
             /**
-            * Get the current progress value (which is the min of the progress of all the threads).
+            * Get the current progress value (which is the min of the progress of all the tiles).
             **/
             inline int progress() const
                 {
                 if (_vecThread.size() == 0) return 0;
-                int pr = (_vecThread[0])->progress();
-                for (size_t i = 1; i < _vecThread.size(); i++)
-                    {
-                    const int q = (_vecThread[i])->progress();
-                    if (q < pr) { pr = q; }
-                    }
-                return pr;
+                return _queue.progress();
                 }
 
 
@@ -1107,7 +1276,8 @@ namespace mtools
             /**
             * Sets the drawing parameters.
             *
-            * Returns immediately, use sync() to wait for the operation to complete.
+            * Wait for the threads to stop drawing with the previous parameters then returns immediately,
+            * use sync() to wait for the operation to complete.
             *
             * @param   range       The range to draw.
             * @param [in,out]  im  The image to draw into.
@@ -1116,52 +1286,54 @@ namespace mtools
             **/
             void setParameters(const fBox2 & range, ProgressImg * im, iBox2 subBox = iBox2())
                 {
-                if (subBox.isEmpty()) { subBox = iBox2(0, im->width() - 1, 0, im->height() - 1); }
-                const size_t nt = _vecThread.size();
-                const int64 H = subBox.ly() + 1;
-                if ((nt == 0) || (H < (int64)(3 * nt))) return;
-                int64 h = H / nt;
-                size_t m = (size_t)(H % nt);
-                iBox2 cbox(subBox.min[0], subBox.max[0], subBox.min[1], subBox.min[1] + h - 1);
-                for (size_t i = 0; i < (nt - m); i++)
-                    {
-                    _vecThread[i]->setParameters(_computeRange(range, subBox, cbox), im, cbox);
-                    cbox.min[1] += h; cbox.max[1] += h;
-                    }
-                cbox.max[1]++;
-                for (size_t i = (nt - m); i < nt; i++)
-                    {
-                    _vecThread[i]->setParameters(_computeRange(range, subBox, cbox), im, cbox);
-                    cbox.min[1] += (h + 1); cbox.max[1] += (h + 1);
-                    }
-                MTOOLS_INSURE(cbox.min[1] == 1 + subBox.max[1]);
+                if (_vecThread.size() == 0) return;
+                _stopAll();
+                _queue.setParameters(range, im, subBox);
+                _restartAll();
                 }
 
 
             /**
             * Force a redraw.
             *
-            * Returns immediately, use sync() to wait for the operation to complete.
+            * Wait for the threads to stop drawing then returns immediately, use sync() to wait for the
+            * operation to complete.
+            *
+            * @param   keepPrevious    If true, keep the previous drawing so that quality starts from 5 and
+            *                          not 0 if possible.
             **/
             void redraw(bool keepPrevious)
                 {
-                for (size_t i = 0; i < _vecThread.size(); i++) { (_vecThread[i])->redraw(keepPrevious); }
+                if (_vecThread.size() == 0) return;
+                _stopAll();
+                _queue.redraw(keepPrevious);
+                _restartAll();
                 }
 
 
+            /**
+            * The cache of completed drawings (disabled by default). Set a positive memory budget with
+            * renderCache().maxMemory() to enable it and call renderCache().invalidate() whenever the
+            * object drawn changes.
+            **/
+            RenderCache & renderCache() { return _queue.renderCache(); }
+
+
         private:
 
 
-            /* compute the range of a subbox */
-            fBox2 _computeRange(fBox2 range, iBox2 subBox, iBox2 cBox)
+            /* stop all the threads and wait until they do not access the tiles anymore */
+            void _stopAll()
                 {
-                const double px = range.lx() / (subBox.lx() + 1);
-                const double py = range.ly() / (subBox.ly() + 1);
-                const double xmin = range.min[0] + px*(cBox.min[0] - subBox.min[0]);
-                const double xmax = range.max[0] - px*(subBox.max[0] - cBox.max[0]);
-                const double ymin = range.min[1] + py*(cBox.min[1] - subBox.min[1]);
-                const double ymax = range.max[1] - py*(subBox.max[1] - cBox.max[1]);
-                return fBox2(xmin, xmax, ymin, ymax);
+                for (size_t i = 0; i < _vecThread.size(); i++) { (_vecThread[i])->stop(); }
+                sync();
+                }
+
+
+            /* restart all the threads */
+            void _restartAll()
+                {
+                for (size_t i = 0; i < _vecThread.size(); i++) { (_vecThread[i])->restart(); }
                 }
 
 
@@ -1179,6 +1351,7 @@ namespace mtools
 
 
             ObjType * _obj;                                             // the object to draw.
+            internals_pixeldrawer::TileQueue _queue;                    // the tiles shared by the threads
             std::vector< ThreadPixelDrawer<ObjType>*  > _vecThread;     // vector of all the threads. 
 
 
@@ -1189,4 +1362,3 @@ namespace mtools
     }
 
 /* end of file */
-
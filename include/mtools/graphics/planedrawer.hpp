@@ -29,24 +29,139 @@
 #include "../misc/misc.hpp"
 #include "../misc/metaprog.hpp"
 #include "../random/gen_fastRNG.hpp"
+#include "../maths/doubledouble.hpp"
+#include "progressimg.hpp"
 #include "internal/getcolorselector.hpp"
+#include "internal/drawtiles.hpp"
 
 #include <algorithm>
 #include <ctime>
 #include <mutex>
 #include <atomic>
+#include <vector>
+#include <limits>
 
 
 namespace mtools
 {
 
 
+    namespace internals_planedrawer
+        {
+
+
+        /**
+         * Queue of tiles shared by the workers of a PlaneDrawer.
+         *
+         * The part of the image to draw is split in small tiles. The fast drawing and each pass of
+         * stochastic sampling of a tile are separate steps and the workers always pull the least
+         * advanced tile so the whole image progresses uniformly.
+         *
+         * When the view is panned at a fixed scale, the previous drawing is scrolled and only the newly
+         * exposed strips are drawn from scratch: the scrolled tiles continue from where they were.
+         *
+         * The range of the tiles is relative to a reference point (the origin except for deep zooms).
+         *
+         * The parameters must only be changed while no worker is drawing.
+         **/
+        class TileQueue : public internals_drawtiles::DrawTileQueue
+            {
+
+            public:
+
+                static const int STAGE_FAST = 1;
+                static const int STAGE_STOCHASTIC = 2;
+
+                static const int NB_STOCHASTIC_PASSES = 254;    // number of stochastic passes (the norm of a pixel fits in a uint8)
+
+
+                /** Constructor. The parameters are initially invalid. */
+                TileQueue() : DrawTileQueue(), _ref(0.0, 0.0)
+                    {
+                    }
+
+
+                /** The reference point of the ranges (set by setParameters()). */
+                const ddVec2 & reference() const { return _ref; }
+
+
+                /**
+                 * Sets the drawing parameters and reset all the tiles (or only those of the newly exposed
+                 * part of the image if the range is a translation of the previous one by an integer number
+                 * of pixels). The previous drawing is saved in the render cache if completed and the new one
+                 * is taken from the cache if available. Changing the reference point discards the previous
+                 * drawing and the content of the cache.
+                 *
+                 * @return  true if the parameters are valid. If not, nothing will be drawn.
+                 **/
+                bool setParameters(const ddVec2 & reference, const fBox2 & range, ProgressImg * im, iBox2 subBox)
+                    {
+                    const int MIN_IMAGE_SIZE = 2;
+                    const double RANGE_MIN_VALUE = std::numeric_limits<double>::min() * 100000;
+                    const double RANGE_MAX_VALUE = std::numeric_limits<double>::max() / 100000;
+                    std::unique_lock<std::mutex> lock(_mut);
+                    const bool sameref = (reference == _ref);
+                    if (sameref) { _storeView(); } else { _ref = reference; _cache.clear(); }
+                    if ((im == nullptr) || (im->width() < MIN_IMAGE_SIZE) || (im->height() < MIN_IMAGE_SIZE)) { _invalidate(); return false; }   // make sure im is not nullptr and is big enough.
+                    if (subBox.isEmpty()) { subBox = iBox2(0, im->width() - 1, 0, im->height() - 1); } // subbox = whole image if empty.
+                    if ((subBox.min[0] < 0) || (subBox.max[0] >= (int64)im->width()) || (subBox.min[1] < 0) || (subBox.max[1] >= (int64)im->height())) { _invalidate(); return false; } // make sure subBox is a proper subbox of im
+                    if ((subBox.lx() < MIN_IMAGE_SIZE) || (subBox.ly() < MIN_IMAGE_SIZE)) { _invalidate(); return false; }
+                    if ((range.lx() < RANGE_MIN_VALUE) || (range.ly() < RANGE_MIN_VALUE)) { _invalidate(); return false; } // prevent zooming in too far
+                    if ((std::abs(range.min[0]) > RANGE_MAX_VALUE) || (std::abs(range.max[0]) > RANGE_MAX_VALUE) || (std::abs(range.min[1]) > RANGE_MAX_VALUE) || (std::abs(range.max[1]) > RANGE_MAX_VALUE)) { _invalidate(); return false; } // prevent zooming out too far
+                    int64 dx, dy;
+                    const bool pan = ((sameref) && (_isPan(range, im, subBox, dx, dy)));
+                    if (_restoreView(range, im, subBox)) return true;
+                    if (pan)
+                        {
+                        _scroll(range, dx, dy, STAGE_FAST);
+                        for (size_t i = 0; i < _nbtiles; i++)
+                            { // the pixels of a scrolled tile may come from tiles with more passes: normalize so the norm cannot overflow
+                            internals_drawtiles::DrawTile & T = _tiles[i];
+                            if ((T.reused) && (T.stage == STAGE_STOCHASTIC)) _im->normalize(T.box);
+                            }
+                        return true;
+                        }
+                    _setTiles(range, im, subBox, STAGE_FAST);
+                    return true;
+                    }
+
+
+                /** Reset the tiles to start a new drawing. */
+                void redraw()
+                    {
+                    std::unique_lock<std::mutex> lock(_mut);
+                    if (!_valid) return;
+                    for (size_t i = 0; i < _nbtiles; i++)
+                        {
+                        internals_drawtiles::DrawTile & T = _tiles[i];
+                        T.busy = false;
+                        T.progress = 0;
+                        T.stage = STAGE_FAST;
+                        }
+                    _newDrawing();
+                    }
+
+
+            private:
+
+                TileQueue(const TileQueue &) = delete;
+                TileQueue & operator=(const TileQueue &) = delete;
+
+                ddVec2 _ref;    // reference point of the ranges
+
+            };
+
+
+        }
+
+
     /**
      * ThreadPlaneDrawer class
      * 
-     * Use a single thread to draw from a getColor function into a progressImg. Used by the
-     * PlaneDrawer class which combined several instance of the class to optimized the drawing using
-     * several threads.
+     * Worker used to draw from a getColor function into a progressImg. Several workers share a queue
+     * of tiles: each one repeatedly takes the least advanced tile and performs the next drawing step
+     * on it. Used by the PlaneDrawer class which combines several instances of the class to draw
+     * using several threads.
      *
      * @tparam  ObjType Type of the object to draw. Must implement a method recognized by
      *                  GetColorPlaneSelector (cf file getcolorselector.hpp).
@@ -62,21 +177,19 @@ namespace mtools
             *
             * @param [in,out]  obj     pointer to the object to be drawn. Must implement a method recognized
             *                          by GetColorPlaneSelector
+            * @param [in,out]  queue   the queue of tiles to draw (shared with the other workers).
             * @param [in,out]  opaque  (Optional) The opaque data to passed to getColor(), nullptr if not
             *                          specified.
             **/
-            ThreadPlaneDrawer(ObjType * obj, void * opaque = nullptr) : ThreadWorker(),
+            ThreadPlaneDrawer(ObjType * obj, internals_planedrawer::TileQueue * queue, void * opaque = nullptr) : ThreadWorker(),
                 _obj(obj),
                 _opaque(opaque),
-                _validParam(false),
+                _queue(queue),
                 _range(fBox2()),
-                _temp_range(fBox2()),
                 _im(nullptr),
-                _temp_im(nullptr),
-                _subBox(iBox2()),
-                _temp_subBox(iBox2())
+                _subBox(iBox2())
                 {
-                static_assert(mtools::GetColorPlaneSelector<ObjType>::has_getColor, "The object must be implement one of the getColor() method recognized by GetColorPlaneSelector.");
+                static_assert((mtools::GetColorPlaneSelector<ObjType>::has_getColor) || (mtools::GetColorPlaneSelector<ObjType>::has_getColorRow) || (mtools::GetColorPlaneSelector<ObjType>::has_getColorDeep), "The object must be implement one of the getColor() or getColorRow() method recognized by GetColorPlaneSelector.");
                 }
 
 
@@ -91,45 +204,27 @@ namespace mtools
 
 
             /**
-            * Determines if the drawing parameter are valid. Return false if for example, the image is set
-            * to nullptr, or the subbox is incorrect, or if the range is too small, or too large, or empty.
-            *
-            * If it return false, nothing will be drawn and the quality will stay 0.
-            *
-            * @return  true if the paramter are valid and flase otherwise.
-            **/
-            inline bool validParam()  const { return (bool)_validParam; }
-
-
-            /**
-            * Sets the drawing parameters.
+            * Start drawing the tiles of the queue (from their current state).
             *
             * Returns immediately, use sync() to wait for the operation to complete.
-            *
-            * @param   range       The range to draw.
-            * @param [in,out]  im  The image to draw into.
-            * @param   subBox      The part of the image to draw (border inclusive). If empty, use the whole
-            *                      image.
             **/
-            void setParameters(const fBox2 & range, ProgressImg * im, const iBox2 & subBox = iBox2())
+            void restart()
                 {
                 sync();
-                _temp_range = range;
-                _temp_im = im;
-                _temp_subBox = subBox;
-                signal(SIGNAL_NEWPARAM);
+                signal(SIGNAL_RESTART);
                 }
 
 
             /**
-             * Force a redraw.
-             * 
-             * Returns immediately, use sync() to wait for the operation to complete.
-             **/
-            void redraw()
+            * Stop drawing. Once the command is completed (use sync()), the worker does not access the
+            * queue of tiles anymore.
+            *
+            * Returns immediately, use sync() to wait for the operation to complete.
+            **/
+            void stop()
                 {
                 sync();
-                signal(SIGNAL_REDRAW);
+                signal(SIGNAL_STOP);
                 }
 
 
@@ -144,69 +239,73 @@ namespace mtools
                 {
                 switch (code)
                     {
-                    case SIGNAL_NEWPARAM: { return _setNewParam(); }
-                    case SIGNAL_REDRAW: { return _setRedraw(); }
+                    case SIGNAL_RESTART: { return (_queue->valid() ? THREAD_RESET : THREAD_RESET_AND_WAIT); }
+                    case SIGNAL_STOP: { return THREAD_RESET_AND_WAIT; }
                     default: { MTOOLS_ERROR("wtf!"); return 0; }
                     }
                 }
 
 
-            /* set the new parameter */
-            int _setNewParam()
-                {
-                const int MIN_IMAGE_SIZE = 2;
-                const double RANGE_MIN_VALUE = std::numeric_limits<double>::min() * 100000;
-                const double RANGE_MAX_VALUE = std::numeric_limits<double>::max() / 100000;
-                _range = _temp_range;
-                _im = _temp_im;
-                _subBox = _temp_subBox;
-                if ((_im == nullptr) || (_im->width() < MIN_IMAGE_SIZE) || (_im->height() < MIN_IMAGE_SIZE)) { setProgress(0); _validParam = false; return THREAD_RESET_AND_WAIT; }   // make sure im is not nullptr and is big enough.
-                if (_subBox.isEmpty()) { _subBox = iBox2(0, _im->width() - 1, 0, _im->height() - 1); } // subbox = whole image if empty. 
-                if ((_subBox.min[0] < 0) || (_subBox.max[0] >= (int64)_im->width()) || (_subBox.min[1] < 0) || (_subBox.max[1] >= (int64)_im->height())) { setProgress(0); _validParam = false; return THREAD_RESET_AND_WAIT; } // make sure _subBox is a proper subbox of im
-                if ((_subBox.lx() < MIN_IMAGE_SIZE) || (_subBox.ly() < MIN_IMAGE_SIZE)) { setProgress(0); _validParam = false; return THREAD_RESET_AND_WAIT; } // make sure _subBox is a proper subbox of im
-                const double rlx = _range.lx();
-                const double rly = _range.ly();
-                if ((rlx < RANGE_MIN_VALUE) || (rly < RANGE_MIN_VALUE)) { setProgress(0); _validParam = false; return THREAD_RESET_AND_WAIT; } // prevent zooming in too far
-                if ((std::abs(_range.min[0]) > RANGE_MAX_VALUE) || (std::abs(_range.max[0]) > RANGE_MAX_VALUE) || (std::abs(_range.min[1]) > RANGE_MAX_VALUE) || (std::abs(_range.max[1]) > RANGE_MAX_VALUE)) { setProgress(0); _validParam = false; return THREAD_RESET_AND_WAIT; } // prevent zooming out too far
-                setProgress(0);
-                _validParam = true;
-                return THREAD_RESET;
-                }
-
-
-
-            /* trigger a redraw */
-            int _setRedraw()
-                {
-                if (!((bool)_validParam)) return THREAD_RESET_AND_WAIT;
-                setProgress(0);
-                return THREAD_RESET;
-                }
-
-
-
             /**
             * Override from ThreadWorker.
-            * The main 'work' method
+            * The main 'work' method: draw tiles until there is nothing left to do.
             **/
             virtual void work() override
                 {
-                MTOOLS_INSURE((bool)_validParam);
-                _drawFast();
-                setProgress(1);
-                for (int i = 0; i < 254;i++)
+                MTOOLS_INSURE(_queue->valid());
+                while (1)
                     {
-                    _drawStochastic();
-                    setProgress(1 + (i*99)/255);
+                    internals_drawtiles::DrawTile * T = _queue->acquire();
+                    if (T == nullptr) return;
+                    TileGuard guard(_queue, T); // give the tile back even if interrupted
+                    _range = T->range;
+                    _ref = _queue->reference();
+                    if ((!mtools::GetColorPlaneSelector<ObjType>::has_getColorDeep) && (_ref != ddVec2(0.0, 0.0)))
+                        { // the object only accepts absolute positions in double precision
+                        _range = fBox2((_ref.X() + _range.min[0]).toDouble(), (_ref.X() + _range.max[0]).toDouble(), (_ref.Y() + _range.min[1]).toDouble(), (_ref.Y() + _range.max[1]).toDouble());
+                        }
+                    _im = _queue->image();
+                    _subBox = T->box;
+                    switch (T->stage)
+                        {
+                        case internals_planedrawer::TileQueue::STAGE_FAST:
+                            {
+                            _drawFast();
+                            T->passes = 0;
+                            T->stage = internals_planedrawer::TileQueue::STAGE_STOCHASTIC;
+                            T->progress = 1;
+                            break;
+                            }
+                        case internals_planedrawer::TileQueue::STAGE_STOCHASTIC:
+                            {
+                            _drawStochastic();
+                            T->passes++;
+                            if (T->passes < internals_planedrawer::TileQueue::NB_STOCHASTIC_PASSES) { T->progress = 1 + ((T->passes - 1) * 99) / 255; break; }
+                            T->stage = internals_planedrawer::TileQueue::STAGE_DONE;
+                            T->progress = 100;
+                            break;
+                            }
+                        default: { MTOOLS_ERROR("wtf!"); }
+                        }
                     }
-                setProgress(100);
                 }
 
 
+            /* give back the tile to the queue when going out of scope */
+            struct TileGuard
+                {
+                TileGuard(internals_planedrawer::TileQueue * queue, internals_drawtiles::DrawTile * tile) : Q(queue), T(tile) {}
+                ~TileGuard() { Q->release(T); }
+                internals_planedrawer::TileQueue * Q;
+                internals_drawtiles::DrawTile * T;
+                };
+
 
             /* draw by sampling the color at the center of each pixel */
             void _drawFast()
                 {
+                if (mtools::GetColorPlaneSelector<ObjType>::has_getColorDeep) { _drawFastDeep(); return; }
+                if (mtools::GetColorPlaneSelector<ObjType>::has_getColorRow) { _drawFastRow(); return; }
                 RGBc64 * imData = _im->imData();
                 uint8 * normData = _im->normData();
                 const fBox2 r = _range;
@@ -240,8 +339,11 @@ namespace mtools
 
 
 
+            /* add a sample taken uniformly in each pixel */
             void _drawStochastic()
                 {
+                if (mtools::GetColorPlaneSelector<ObjType>::has_getColorDeep) { _drawStochasticDeep(); return; }
+                if (mtools::GetColorPlaneSelector<ObjType>::has_getColorRow) { _drawStochasticRow(); return; }
                 RGBc64 * imData = _im->imData();
                 uint8 * normData = _im->normData();
                 const fBox2 r = _range;
@@ -281,27 +383,159 @@ namespace mtools
                 }
 
 
+            /* same as _drawFast() but query the colors of a whole row of the tile with getColorRow() */
+            void _drawFastRow()
+                {
+                RGBc64 * imData = _im->imData();
+                uint8 * normData = _im->normData();
+                const fBox2 r = _range;
+                const int64 ilx = _subBox.lx() + 1;
+                const int64 ily = _subBox.ly() + 1;
+                const double px = r.lx() / ilx;
+                const double py = r.ly() / ily;
+                const size_t w = (size_t)_im->width();
+                size_t off = (size_t)(_subBox.min[0] + _im->width()*(_subBox.min[1]));
+                _rowx.resize((size_t)ilx);
+                _rowc.resize((size_t)ilx);
+                double x = r.min[0];
+                for (int64 i = 0; i < ilx; i++) { _rowx[i] = x + px / 2; x += px; }
+                double y = r.min[1];
+                for (int64 j = 0; j < ily; j++)
+                    {
+                    check();
+                    mtools::GetColorPlaneSelector<ObjType>::callRow(*_obj, _rowx.data(), y + py / 2, (size_t)ilx, _rowc.data());
+                    for (int64 i = 0; i < ilx; i++)
+                        {
+                        imData[off + i] = _rowc[i];
+                        normData[off + i] = 0;
+                        }
+                    off += w;
+                    y += py;
+                    }
+                }
+
+
+            /* same as _drawStochastic() but query the colors of a whole row of the tile with getColorRow():
+               the abscissa of each sample is uniform in its pixel and the ordinate is shared by the row */
+            void _drawStochasticRow()
+                {
+                RGBc64 * imData = _im->imData();
+                uint8 * normData = _im->normData();
+                const fBox2 r = _range;
+                const int64 ilx = _subBox.lx() + 1;
+                const int64 ily = _subBox.ly() + 1;
+                const double px = r.lx() / ilx;
+                const double py = r.ly() / ily;
+                const size_t w = (size_t)_im->width();
+                size_t off = (size_t)(_subBox.min[0] + _im->width()*(_subBox.min[1]));
+                _rowx.resize((size_t)ilx);
+                _rowc.resize((size_t)ilx);
+                double y = r.min[1];
+                for (int64 j = 0; j < ily; j++)
+                    {
+                    check();
+                    double x = r.min[0];
+                    for (int64 i = 0; i < ilx; i++) { _rowx[i] = x + _fastgen.unif()*px; x += px; }
+                    mtools::GetColorPlaneSelector<ObjType>::callRow(*_obj, _rowx.data(), y + _fastgen.unif()*py, (size_t)ilx, _rowc.data());
+                    for (int64 i = 0; i < ilx; i++)
+                        {
+                        imData[off + i].add(_rowc[i]);
+                        normData[off + i]++;
+                        }
+                    off += w;
+                    y += py;
+                    }
+                }
+
+
+            /* same as _drawFast() but with the deep zoom getColor() method: the positions are relative to the reference point */
+            void _drawFastDeep()
+                {
+                RGBc64 * imData = _im->imData();
+                uint8 * normData = _im->normData();
+                const fBox2 r = _range;
+                const int64 ilx = _subBox.lx() + 1;
+                const int64 ily = _subBox.ly() + 1;
+                const double px = r.lx() / ilx;
+                const double py = r.ly() / ily;
+                size_t off = (size_t)(_subBox.min[0] + _im->width()*(_subBox.min[1]));
+                const size_t pa = (size_t)(_im->width() - ilx);
+                for (int64 j = 0; j < ily; j++)
+                    {
+                    check();
+                    const double y0 = r.min[1] + j*py;
+                    for (int64 i = 0; i < ilx; i++)
+                        {
+                        const double x0 = r.min[0] + i*px;
+                        const fBox2 cbox(x0, x0 + px, y0, y0 + py);
+                        imData[off] = (mtools::GetColorPlaneSelector<ObjType>::callDeep(*_obj, _ref, fVec2{ x0 + px / 2, y0 + py / 2 }, cbox)).first;
+                        normData[off] = 0;
+                        off++;
+                        }
+                    off += pa;
+                    }
+                }
+
+
+            /* same as _drawStochastic() but with the deep zoom getColor() method: the positions are relative to the reference point */
+            void _drawStochasticDeep()
+                {
+                RGBc64 * imData = _im->imData();
+                uint8 * normData = _im->normData();
+                const fBox2 r = _range;
+                const int64 ilx = _subBox.lx() + 1;
+                const int64 ily = _subBox.ly() + 1;
+                const double px = r.lx() / ilx;
+                const double py = r.ly() / ily;
+                size_t off = (size_t)(_subBox.min[0] + _im->width()*(_subBox.min[1]));
+                const size_t pa = (size_t)(_im->width() - ilx);
+                for (int64 j = 0; j < ily; j++)
+                    {
+                    check();
+                    const double y0 = r.min[1] + j*py;
+                    for (int64 i = 0; i < ilx; i++)
+                        {
+                        const double x0 = r.min[0] + i*px;
+                        const fBox2 cbox(x0, x0 + px, y0, y0 + py);
+                        std::pair<RGBc, bool> P = mtools::GetColorPlaneSelector<ObjType>::callDeep(*_obj, _ref, fVec2{ x0 + _fastgen.unif()*px , y0 + _fastgen.unif()*py }, cbox);
+                        if (P.second)
+                            {
+                            imData[off] = P.first;
+                            normData[off] = 0;
+                            }
+                        else
+                            {
+                            imData[off].add(P.first);
+                            normData[off]++;
+                            }
+                        off++;
+                        }
+                    off += pa;
+                    }
+                }
+
+
             // no copy
             ThreadPlaneDrawer(const ThreadPlaneDrawer &) = delete;
             ThreadPlaneDrawer & operator=(const ThreadPlaneDrawer &) = delete;
 
 
-            static const int SIGNAL_NEWPARAM = 4;
-            static const int SIGNAL_REDRAW = 5;
+            static const int SIGNAL_RESTART = 4;
+            static const int SIGNAL_STOP = 5;
 
             ObjType * _obj;                         // the object to draw.
             void * _opaque;                         // opaque data passed to _obj;
 
-            std::atomic<bool> _validParam;          // indicate if the parameter are valid.
+            internals_planedrawer::TileQueue * _queue;  // the queue of tiles
 
-            fBox2 _range;                           // the range
-            std::atomic<fBox2> _temp_range;         // and the temporary use to communicate with the thread.
+            fBox2 _range;                           // the range of the current tile
+            ddVec2 _ref;                            // the reference point of the range
             ProgressImg* _im;                       // the image to draw onto
-            std::atomic<ProgressImg*> _temp_im;     // and the temporary use to communicate with the thread.
-            iBox2 _subBox;                          // part of the image to draw
-            std::atomic<iBox2> _temp_subBox;        // and the temporary use to communicate with the thread.
+            iBox2 _subBox;                          // part of the image covered by the current tile
 
             FastRNG _fastgen;                       // fast RNG
+            std::vector<double> _rowx;              // abscissas of the row passed to getColorRow()
+            std::vector<RGBc> _rowc;                // colors returned by getColorRow()
 
         };
 
@@ -310,8 +544,18 @@ namespace mtools
     /**
      * PlaneDrawer class
      * 
-     * Combine several instances of ThreadPlaneDrawer (hence use several threads) to draw from a
-     * getColor function into a progressImg.
+     * Uses several threads to draw from a getColor function into a progressImg.
+     *
+     * The image is split into small tiles which are dispatched dynamically to the threads. When the
+     * range is only translated by an integer number of pixels, the previous drawing is reused and only
+     * the newly exposed part of the image is computed.
+     *
+     * If the object implements the batch method getColorRow(), the colors are queried one tile row
+     * at a time, which lets the object evaluate several pixels at once (e.g. with SIMD instructions).
+     *
+     * For deep zooms, the range can be given relative to a reference point with double-double
+     * precision. Objects which implement the deep zoom getColor() method then receive the reference
+     * point and the positions relative to it.
      *
      * @tparam  ObjType Type of the object to draw. Must implement a method recognized by
      *                  GetColorPlaneSelector.
@@ -328,7 +572,7 @@ namespace mtools
             **/
             PlaneDrawer(ObjType * obj, int nbthread = 1) :  _obj(obj), _vecThread()
                 {
-                static_assert(mtools::GetColorPlaneSelector<ObjType>::has_getColor, "The object must be implement one of the getColor() methods recognized by GetColorPlaneSelector.");
+                static_assert((mtools::GetColorPlaneSelector<ObjType>::has_getColor) || (mtools::GetColorPlaneSelector<ObjType>::has_getColorRow) || (mtools::GetColorPlaneSelector<ObjType>::has_getColorDeep), "The object must be implement one of the getColor() or getColorRow() methods recognized by GetColorPlaneSelector.");
                 if (nbthread < 1) nbthread = 1;
                 nbThreads(nbthread);
                 }
@@ -358,7 +602,7 @@ namespace mtools
                 if (nb == nbThreads()) return;
                 _deleteAllThread();
                 _vecThread.resize(nb);
-                for (int i = 0; i < nb; i++) { _vecThread[i] = new ThreadPlaneDrawer<ObjType>(_obj); }
+                for (int i = 0; i < nb; i++) { _vecThread[i] = new ThreadPlaneDrawer<ObjType>(_obj, &_queue); }
                 }
 
 
@@ -369,8 +613,7 @@ namespace mtools
                 {
                 if (_vecThread.size() == 0) return false;
                 sync();
-                for (size_t i = 0; i < _vecThread.size(); i++) { if (!((_vecThread[i])->validParam())) return false; }
-                return true;
+                return _queue.valid();
                 }
 
 
@@ -385,18 +628,12 @@ namespace mtools
 
 
             /**
-            * Get the current progress value (which is the min of the progress of all the threads).
+            * Get the current progress value (which is the min of the progress of all the tiles).
             **/
             inline int progress() const
                 {
                 if (_vecThread.size() == 0) return 0;
-                int pr = (_vecThread[0])->progress();
-                for (size_t i = 1; i < _vecThread.size(); i++)
-                    {
-                    const int q = (_vecThread[i])->progress();
-                    if (q < pr) { pr = q; }
-                    }
-                return pr;
+                return _queue.progress();
                 }
 
 
@@ -424,9 +661,12 @@ namespace mtools
 
 
             /**
-            * Sets the drawing parameters.
+            * Sets the drawing parameters. If the range is a translation of the previous range by an
+            * integer number of pixels (same image, same scale), the previous drawing is scrolled and only
+            * the newly exposed part of the image is redrawn.
             *
-            * Returns immediately, use sync() to wait for the operation to complete.
+            * Wait for the threads to stop drawing with the previous parameters then returns immediately,
+            * use sync() to wait for the operation to complete.
             *
             * @param   range       The range to draw.
             * @param [in,out]  im  The image to draw into.
@@ -435,52 +675,72 @@ namespace mtools
             **/
             void setParameters(const fBox2 & range, ProgressImg * im, iBox2 subBox = iBox2())
                 {
-                if (subBox.isEmpty()) { subBox = iBox2(0, im->width() - 1, 0, im->height() - 1); }
-                const size_t nt = _vecThread.size();
-                const int64 H = subBox.ly() + 1;
-                if ((nt == 0) || (H < (int64)(3 * nt))) return;
-                int64 h = H / nt;
-                size_t m = (size_t)(H % nt);
-                iBox2 cbox(subBox.min[0], subBox.max[0], subBox.min[1], subBox.min[1] + h - 1);
-                for (size_t i = 0; i < (nt - m); i++)
-                    {
-                    _vecThread[i]->setParameters(_computeRange(range, subBox, cbox), im, cbox);
-                    cbox.min[1] += h; cbox.max[1] += h;
-                    }
-                cbox.max[1]++;
-                for (size_t i = (nt - m); i < nt; i++)
-                    {
-                    _vecThread[i]->setParameters(_computeRange(range, subBox, cbox), im, cbox);
-                    cbox.min[1] += (h + 1); cbox.max[1] += (h + 1);
-                    }
-                MTOOLS_INSURE(cbox.min[1] == 1 + subBox.max[1]);
+                setParameters(ddVec2(0.0, 0.0), range, im, subBox);
+                }
+
+
+            /**
+            * Sets the drawing parameters for a range given relatively to a reference point (deep zoom).
+            * The deep zoom getColor() method of the object (if any) is called with the reference point and
+            * positions relative to it. Otherwise, the positions are converted to absolute positions in
+            * double precision.
+            *
+            * Wait for the threads to stop drawing with the previous parameters then returns immediately,
+            * use sync() to wait for the operation to complete.
+            *
+            * @param   reference   The reference point.
+            * @param   range       The range to draw, relative to the reference point.
+            * @param [in,out]  im  The image to draw into.
+            * @param   subBox      The part of the image to draw (border inclusive). If empty, use the whole
+            *                      image.
+            **/
+            void setParameters(const ddVec2 & reference, const fBox2 & range, ProgressImg * im, iBox2 subBox = iBox2())
+                {
+                if (_vecThread.size() == 0) return;
+                _stopAll();
+                _queue.setParameters(reference, range, im, subBox);
+                _restartAll();
                 }
 
 
             /**
             * Force a redraw.
             *
-            * Returns immediately, use sync() to wait for the operation to complete.
+            * Wait for the threads to stop drawing then returns immediately, use sync() to wait for the
+            * operation to complete.
             **/
             void redraw()
                 {
-                for (size_t i = 0; i < _vecThread.size(); i++) { (_vecThread[i])->redraw(); }
+                if (_vecThread.size() == 0) return;
+                _stopAll();
+                _queue.redraw();
+                _restartAll();
                 }
 
 
+            /**
+            * The cache of completed drawings (disabled by default). Set a positive memory budget with
+            * renderCache().maxMemory() to enable it and call renderCache().invalidate() whenever the
+            * object drawn changes.
+            **/
+            RenderCache & renderCache() { return _queue.renderCache(); }
+
+
         private:
 
 
-            /* compute the range of a subbox */
-            fBox2 _computeRange(fBox2 range, iBox2 subBox, iBox2 cBox)
+            /* stop all the threads and wait until they do not access the tiles anymore */
+            void _stopAll()
+                {
+                for (size_t i = 0; i < _vecThread.size(); i++) { (_vecThread[i])->stop(); }
+                sync();
+                }
+
+
+            /* restart all the threads */
+            void _restartAll()
                 {
-                const double px = range.lx() / (subBox.lx() + 1);
-                const double py = range.ly() / (subBox.ly() + 1);
-                const double xmin = range.min[0] + px*(cBox.min[0] - subBox.min[0]);
-                const double xmax = range.max[0] - px*(subBox.max[0] - cBox.max[0]);
-                const double ymin = range.min[1] + py*(cBox.min[1] - subBox.min[1]);
-                const double ymax = range.max[1] - py*(subBox.max[1] - cBox.max[1]);
-                return fBox2(xmin, xmax, ymin, ymax);
+                for (size_t i = 0; i < _vecThread.size(); i++) { (_vecThread[i])->restart(); }
                 }
 
 
@@ -498,6 +758,7 @@ namespace mtools
 
 
             ObjType * _obj;                                             // the object to draw.
+            internals_planedrawer::TileQueue _queue;                    // the tiles shared by the threads
             std::vector< ThreadPlaneDrawer<ObjType>*  > _vecThread;     // vector of all the threads. 
 
 
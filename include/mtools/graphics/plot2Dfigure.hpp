@@ -619,7 +619,11 @@ namespace mtools
 			while (1)
 				{
 				Figure::internals_figure::FigureInterface * obj;
-				while (!_queue.pop(obj)) { _emptyqueue = true;  check(); std::this_thread::yield(); }
+				if (!_queue.pop(obj))
+					{ // wait for the dispatcher without holding a slot of the thread pool
+					ThreadPool::BlockingScope bs;
+					while (!_queue.pop(obj)) { _emptyqueue = true;  check(); std::this_thread::yield(); }
+					}
 				_emptyqueue = false;
 				if (!R.isEmpty()) { obj->draw(*im, R, hq, min_thick); }
 				_nb_drawn++;
@@ -167,6 +167,8 @@ namespace mtools
 
 			virtual int drawOnto(Image & im, float opacity = 1.0) override;
 
+			virtual const ProgressImg * progressLayer(int & quality) override;
+
 			virtual int quality() const override;
 
 			virtual void enableThreads(bool status) override;
@@ -206,6 +206,15 @@ namespace mtools
                 }
 
 
+            /**
+            * The cache of completed drawings (disabled by default). Set a positive memory budget with
+            * renderCache().maxMemory() to make revisited views instantaneous and call
+            * renderCache().invalidate() whenever the lattice object changes. Only pixel-type drawings
+            * are cached.
+            **/
+            RenderCache & renderCache() { return _LD->renderCache(); }
+
+
             /**
              * Sets image type (pixel or images). The drawer may discard this request and decide to draw in
              * pixel mode anyway if there is no getImage() method or if we are too far away
@@ -132,6 +132,14 @@ namespace mtools
 				}
 
 
+			/**
+			* The cache of completed drawings (disabled by default). Set a positive memory budget with
+			* renderCache().maxMemory() to make revisited views instantaneous and call
+			* renderCache().invalidate() whenever the object drawn changes.
+			**/
+			RenderCache & renderCache() { return _LD->renderCache(); }
+
+
 
 
 
@@ -139,7 +147,7 @@ namespace mtools
 
 			virtual void setParam(mtools::fBox2 range, mtools::iVec2 imageSize) override
 				{
-				if ((_proImg->height() != (size_t)imageSize.X()) || (_proImg->width() != (size_t)imageSize.Y()))
+				if ((_proImg->width() != (size_t)imageSize.X()) || (_proImg->height() != (size_t)imageSize.Y()))
 					{
 					auto npimg = new ProgressImg((size_t)imageSize.X(), (size_t)imageSize.Y());
 					_LD->setParameters(range, npimg);
@@ -168,6 +176,12 @@ namespace mtools
 				return q;
 				}
 
+			virtual const ProgressImg * progressLayer(int & quality) override
+				{
+				quality = _LD->progress();
+				return _proImg;
+				}
+
 			virtual int quality() const override { return _LD->progress(); }
 
 
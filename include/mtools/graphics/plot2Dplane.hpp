@@ -74,6 +74,10 @@ namespace mtools
     /**
     * Plot Object which encapsulate a Plane object.
     *
+    * When the deep zoom mode of the plotter's range is enabled (range().deepZoom(true)), the range is
+    * passed to the PlaneDrawer with full precision: objects implementing the deep zoom getColor()
+    * method remain accurate far beyond the precision of a double.
+    *
     * @tparam  T   Object which fulfills the same requirements as those needed by the PlaneDrawer
     *              class.
     **/
@@ -132,6 +136,14 @@ namespace mtools
                 delete _LD;     // remove the plane drawer
                 delete _proImg; // and the progress image
                 }
+
+
+            /**
+            * The cache of completed drawings (disabled by default). Set a positive memory budget with
+            * renderCache().maxMemory() to make revisited views instantaneous and call
+            * renderCache().invalidate() whenever the object drawn changes.
+            **/
+            RenderCache & renderCache() { return _LD->renderCache(); }
   
 
         protected:
@@ -141,16 +153,20 @@ namespace mtools
              **/
             virtual void setParam(mtools::fBox2 range, mtools::iVec2 imageSize) override
                 {
-                if ((_proImg->height() != (size_t)imageSize.X()) || (_proImg->width() != (size_t)imageSize.Y()))
+                ddVec2 ref(0.0, 0.0);
+                fBox2 offsetRange = range;
+                const internals_graphics::RangeManager * rm = internals_graphics::Plotter2DObj::range();
+                if ((rm != nullptr) && (rm->deepZoom())) { rm->getDeepRange(range, ref, offsetRange); } // get the range with full precision
+                if ((_proImg->width() != (size_t)imageSize.X()) || (_proImg->height() != (size_t)imageSize.Y()))
                     {
                     auto npimg  = new ProgressImg((size_t)imageSize.X(), (size_t)imageSize.Y());
-                    _LD->setParameters(range, npimg);
+                    _LD->setParameters(ref, offsetRange, npimg);
                     _LD->sync();
                     delete _proImg;
                     _proImg = npimg;
                     return;
                     }
-                _LD->setParameters(range, _proImg);
+                _LD->setParameters(ref, offsetRange, _proImg);
                 _LD->sync();
                 _LD->enable(_LD->enable());
                 }
@@ -177,6 +193,16 @@ namespace mtools
                 }
 
 
+            /**
+            * Override from the Drawable2DInterface.
+            **/
+            virtual const ProgressImg * progressLayer(int & quality) override
+                {
+                quality = _LD->progress();
+                return _proImg;
+                }
+
+
             /**
             *Override from the Drawable2DInterface.
             **/
@@ -0,0 +1,186 @@
+/** @file pngwriter.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/error.hpp"
+#include "rgbc.hpp"
+
+#include <string>
+#include <vector>
+#include <cstdio>
+
+
+namespace mtools
+{
+
+
+    /**
+     * Streaming PNG writer (8 bits per channel RGBA, non-interlaced).
+     *
+     * The image is pushed by blocks of consecutive rows with write(). Each block is split into
+     * bands of rows which are filtered and deflated in parallel. The compressed bands are
+     * concatenated (pigz-style) into a single valid zlib stream: every band but the last one is
+     * terminated with a full flush so that it ends on a byte boundary and the last 32K of the
+     * previous band is used as a preset dictionary to keep the compression ratio close to the
+     * one obtained with a single sequential stream. The adler32 checksums of the bands are
+     * combined at the end.
+     *
+     * The compressed data is written to the file as soon as a batch of bands is complete hence
+     * the memory footprint is bounded by (nb of threads) x (band size) and the image is never
+     * copied as a whole.
+     *
+     * Usage:
+     *
+     *     PNGWriter png("out.png", lx, ly);
+     *     png.write(rows, stride, ly);       // may be called several times with consecutive blocks.
+     *     png.close();                       // return true if the file was correctly written.
+     *
+     * Colors are given in RGBc format. By default, they are assumed to be alpha-premultiplied
+     * (as in the Image class) and are converted to straight alpha before being written.
+     **/
+    class PNGWriter
+        {
+
+        public:
+
+            /** Filtering strategy applied to the scanlines before compression. */
+            enum FilterStrategy
+                {
+                FILTER_NONE = 0,        ///< no filtering (fastest, good for flat images with few colors).
+                FILTER_SUB = 1,         ///< difference with the pixel on the left.
+                FILTER_UP = 2,          ///< difference with the pixel above.
+                FILTER_AVERAGE = 3,     ///< difference with the average of left and up pixels.
+                FILTER_PAETH = 4,       ///< Paeth predictor.
+                FILTER_ADAPTIVE = 5     ///< select for each row the filter which minimizes the sum of absolute differences (libpng heuristic).
+                };
+
+
+            static const int DEFAULT_COMPRESSION_LEVEL = 6;             ///< default zlib compression level
+            static const int DEFAULT_FILTER = FILTER_ADAPTIVE;          ///< default filtering strategy
+            static const int64 DEFAULT_BAND_BYTES = 256 * 1024;        ///< default (approximate) size in bytes of a band of rows compressed by a single thread.
+
+
+            /**
+             * Constructor. Create the file and write the PNG header.
+             *
+             * @param   filename            name of the file to create.
+             * @param   lx                  width of the image.
+             * @param   ly                  height of the image.
+             * @param   compression_level   zlib compression level between 0 (no compression) and 9 (max compression).
+             * @param   filter_strategy     filtering strategy (one of the FilterStrategy values).
+             * @param   nb_threads          number of threads used for filtering/compression (0 to use all
+             *                              hardware threads).
+             * @param   band_rows           number of rows per band (0 to select automatically from the
+             *                              image width).
+             **/
+            PNGWriter(const std::string & filename, int64 lx, int64 ly, int compression_level = DEFAULT_COMPRESSION_LEVEL, int filter_strategy = DEFAULT_FILTER, int nb_threads = 0, int64 band_rows = 0);
+
+
+            /**
+             * Destructor. Close the file if not already done (if the image is not complete, the file
+             * is left truncated).
+             **/
+            ~PNGWriter();
+
+
+            /**
+             * Query if the writer is in a valid state (file opened and no error so far).
+             **/
+            bool ok() const { return (_handle != nullptr); }
+
+
+            /**
+             * Number of rows already written.
+             **/
+            int64 rowsWritten() const { return _rowsdone; }
+
+
+            /**
+             * Write the next block of rows.
+             *
+             * @param   rows            pointer to the first pixel of the first row of the block.
+             * @param   stride          number of RGBc between the start of two consecutive rows.
+             * @param   nb_rows         number of rows in the block.
+             * @param   remove_premult  true if the colors are alpha-premultiplied and should be converted.
+             *
+             * @return  true if the operation succeeded and false otherwise (the writer is then invalid).
+             **/
+            bool write(const RGBc * rows, int64 stride, int64 nb_rows, bool remove_premult = true);
+
+
+            /**
+             * Finalize the file. Must be called once all the rows have been written.
+             *
+             * @return  true if the file was correctly written and false otherwise.
+             **/
+            bool close();
+
+
+        private:
+
+            PNGWriter() = delete;
+            PNGWriter(const PNGWriter &) = delete;
+            PNGWriter & operator=(const PNGWriter &) = delete;
+
+
+            /* a band of rows processed by a single thread */
+            struct Band
+                {
+                const RGBc * src;               // first row of the band
+                int64 stride;                   // stride of the source rows
+                const RGBc * prev;              // row above the band (nullptr if not in the current block)
+                const uint8 * prevrgba;         // row above the band already converted to RGBA (nullptr if first row of the image)
+                int64 nb;                       // number of rows in the band
+                bool last;                      // true if this is the last band of the image
+                std::vector<uint8> filtered;    // filtered scanlines
+                std::vector<uint8> out;         // compressed data
+                uint32 adler;                   // adler32 of the filtered scanlines
+                bool ok;                        // true if compression succeeded
+                };
+
+
+            void _filterBand(Band & band, bool remove_premult);
+
+            void _compressBand(Band & band, const uint8 * dict, size_t dictlen);
+
+            bool _writeChunk(const char * type, const uint8 * data, size_t len);
+
+            bool _fail();
+
+            int64 _lx, _ly;
+            int _level, _filter, _nbthreads;
+            int64 _bandrows;
+            int64 _rowsdone;
+            uint32 _adler;
+            FILE * _handle;
+            std::vector<uint8> _lastrow;       // last row of the previous block (straight RGBA)
+            std::vector<uint8> _dict;          // last 32K of the previous block of filtered data
+            std::vector<Band> _bands;          // the bands of the current batch.
+        };
+
+
+}
+
+
+/* end of file */
+
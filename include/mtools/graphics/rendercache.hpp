@@ -0,0 +1,273 @@
+/** @file rendercache.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/error.hpp"
+#include "../maths/box.hpp"
+#include "progressimg.hpp"
+
+#include <cstring>
+#include <cmath>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+
+namespace mtools
+    {
+
+
+    /**
+     * Render cache class.
+     *
+     * LRU cache of completed drawings used by the drawers (PixelDrawer, PlaneDrawer, LatticeDrawer)
+     * so that revisiting a view (e.g. zooming in and back out) is instantaneous. Each entry holds the
+     * content of a ProgressImg for a given range and image size, tagged with the version of the
+     * model at the time of the drawing.
+     *
+     * The cache is disabled by default (memory budget of 0). The version counter must be bumped (with
+     * invalidate() or version()) whenever the object drawn changes: entries with another version are
+     * never returned. A drawer records the version when it starts a drawing and passes it to store():
+     * a drawing started before the last invalidation is discarded.
+     *
+     * All methods are thread-safe.
+     **/
+    class RenderCache
+        {
+
+        public:
+
+            /**
+             * Constructor.
+             *
+             * @param   maxMemory   (Optional) The memory budget in bytes (0 to disable the cache).
+             **/
+            RenderCache(size_t maxMemory = 0) : _maxmem(maxMemory), _mem(0), _version(0) {}
+
+
+            /** Query if the cache is enabled (i.e. if the memory budget is positive). */
+            bool enabled() const { return (_maxmem > 0); }
+
+
+            /** Return the memory budget in bytes. */
+            size_t maxMemory() const { return _maxmem; }
+
+
+            /**
+             * Set the memory budget in bytes. Setting 0 disables the cache and release all entries.
+             **/
+            void maxMemory(size_t maxmem)
+                {
+                std::unique_lock<std::mutex> lock(_mut);
+                _maxmem = maxmem;
+                _evict(0);
+                }
+
+
+            /** Return the memory currently used by the entries (in bytes). */
+            size_t memory() const
+                {
+                std::unique_lock<std::mutex> lock(_mut);
+                return _mem;
+                }
+
+
+            /** Return the number of entries in the cache. */
+            size_t size() const
+                {
+                std::unique_lock<std::mutex> lock(_mut);
+                return _entries.size();
+                }
+
+
+            /** Return the current version of the model. */
+            uint64 version() const { return _version; }
+
+
+            /**
+             * Set the version of the model. If it differs from the current one, all the entries are
+             * discarded.
+             **/
+            void version(uint64 v)
+                {
+                std::unique_lock<std::mutex> lock(_mut);
+                if (v == _version) return;
+                _version = v;
+                _clear();
+                }
+
+
+            /** Bump the version counter (to call when the model changed): discard all the entries. */
+            void invalidate()
+                {
+                std::unique_lock<std::mutex> lock(_mut);
+                _version++;
+                _clear();
+                }
+
+
+            /** Remove all the entries (the version is unchanged). */
+            void clear()
+                {
+                std::unique_lock<std::mutex> lock(_mut);
+                _clear();
+                }
+
+
+            /**
+             * Store a drawing: the portion subBox of image im which represents the given range. Replace
+             * any previous entry for the same view. The least recently used entries are discarded to
+             * respect the memory budget.
+             *
+             * @param   range   The range represented by the drawing.
+             * @param   im      The image containing the drawing.
+             * @param   subBox  The part of im containing the drawing.
+             * @param   version The version of the model when the drawing was started (as returned by
+             *                  version() at that time). The drawing is not stored if the version changed
+             *                  since.
+             *
+             * @return  true if the drawing was stored and false if the cache is disabled, the version is
+             *          outdated or the drawing is larger than the memory budget.
+             **/
+            bool store(const fBox2 & range, const ProgressImg & im, const iBox2 & subBox, uint64 version)
+                {
+                if ((!enabled()) || (subBox.isEmpty())) return false;
+                const int64 lx = subBox.lx() + 1;
+                const int64 ly = subBox.ly() + 1;
+                const size_t bytes = (size_t)(lx*ly)*(sizeof(RGBc64) + 1);
+                std::unique_lock<std::mutex> lock(_mut);
+                if ((version != _version) || (bytes > _maxmem)) return false;
+                for (auto it = _entries.begin(); it != _entries.end(); ++it)
+                    {
+                    if ((it->lx == lx) && (it->ly == ly) && (_sameView(it->range, range, lx, ly))) { _mem -= it->bytes; _entries.erase(it); break; }
+                    }
+                _evict(bytes);
+                _entries.emplace_front();
+                Entry & E = _entries.front();
+                E.range = range;
+                E.lx = lx;
+                E.ly = ly;
+                E.version = _version;
+                E.bytes = bytes;
+                E.imData.reset(new RGBc64[(size_t)(lx*ly)]);
+                E.normData.reset(new uint8[(size_t)(lx*ly)]);
+                for (int64 j = 0; j < ly; j++)
+                    {
+                    std::memcpy(E.imData.get() + j*lx, im.imData(subBox.min[0], subBox.min[1] + j), (size_t)lx*sizeof(RGBc64));
+                    std::memcpy(E.normData.get() + j*lx, im.normData(subBox.min[0], subBox.min[1] + j), (size_t)lx);
+                    }
+                _mem += bytes;
+                return true;
+                }
+
+
+            /**
+             * Look for a drawing of the given range with the same image size (and the current version).
+             * If found, copy it into the portion subBox of im.
+             *
+             * @return  true if the drawing was found (and copied) and false otherwise.
+             **/
+            bool retrieve(const fBox2 & range, ProgressImg & im, const iBox2 & subBox)
+                {
+                if ((!enabled()) || (subBox.isEmpty())) return false;
+                const int64 lx = subBox.lx() + 1;
+                const int64 ly = subBox.ly() + 1;
+                std::unique_lock<std::mutex> lock(_mut);
+                for (auto it = _entries.begin(); it != _entries.end(); ++it)
+                    {
+                    if ((it->version != _version) || (it->lx != lx) || (it->ly != ly) || (!_sameView(it->range, range, lx, ly))) continue;
+                    _entries.splice(_entries.begin(), _entries, it); // most recently used
+                    const Entry & E = _entries.front();
+                    for (int64 j = 0; j < ly; j++)
+                        {
+                        std::memcpy(im.imData(subBox.min[0], subBox.min[1] + j), E.imData.get() + j*lx, (size_t)lx*sizeof(RGBc64));
+                        std::memcpy(im.normData(subBox.min[0], subBox.min[1] + j), E.normData.get() + j*lx, (size_t)lx);
+                        }
+                    return true;
+                    }
+                return false;
+                }
+
+
+        private:
+
+            /* a cached drawing */
+            struct Entry
+                {
+                fBox2 range;                        // range of the drawing
+                int64 lx, ly;                       // size of the drawing in pixels
+                uint64 version;                     // version of the model
+                size_t bytes;                       // memory used
+                std::unique_ptr<RGBc64[]> imData;   // color buffer
+                std::unique_ptr<uint8[]> normData;  // normalization buffer
+                };
+
+
+            /* query if two ranges drawn on lx x ly pixels give the same view (same scale and same pixel grid) */
+            static bool _sameView(const fBox2 & R1, const fBox2 & R2, int64 lx, int64 ly)
+                {
+                const double SCALE_TOLERANCE = 1.0e-9;  // relative difference of pixel size below which the scale is considered unchanged
+                const double SHIFT_TOLERANCE = 1.0e-3;  // maximal distance (in pixels) between the grids
+                const double px = R1.lx() / lx;
+                const double py = R1.ly() / ly;
+                if ((std::abs(R2.lx() / lx - px) > SCALE_TOLERANCE*px) || (std::abs(R2.ly() / ly - py) > SCALE_TOLERANCE*py)) return false;
+                return ((std::abs(R2.min[0] - R1.min[0]) <= SHIFT_TOLERANCE*px) && (std::abs(R2.min[1] - R1.min[1]) <= SHIFT_TOLERANCE*py));
+                }
+
+
+            /* remove the least recently used entries until 'bytes' more bytes fit in the budget, _mut must be locked */
+            void _evict(size_t bytes)
+                {
+                while ((!_entries.empty()) && (_mem + bytes > _maxmem))
+                    {
+                    _mem -= _entries.back().bytes;
+                    _entries.pop_back();
+                    }
+                }
+
+
+            /* remove all the entries, _mut must be locked */
+            void _clear()
+                {
+                _entries.clear();
+                _mem = 0;
+                }
+
+
+            RenderCache(const RenderCache &) = delete;
+            RenderCache & operator=(const RenderCache &) = delete;
+
+            mutable std::mutex  _mut;           // mutex protecting the entries
+            std::atomic<size_t> _maxmem;        // memory budget
+            size_t              _mem;           // memory used
+            std::atomic<uint64> _version;       // current version of the model
+            std::list<Entry>    _entries;       // entries, most recently used first
+        };
+
+
+    }
+
+
+/* end of file */
+
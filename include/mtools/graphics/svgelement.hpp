@@ -26,9 +26,11 @@
 #include "../misc/misc.hpp"
 #include "../maths/box.hpp"
 
-#include "tinyxml2.h"
-
 #include <atomic>
+#include <string>
+#include <vector>
+#include <utility>
+#include <ostream>
 
 
 namespace mtools
@@ -38,26 +40,94 @@ namespace mtools
 	static const char * SVGElement_DEFAULT_NAME = "g";  // by default, we create an empty group (which is a valid svg object)
 
 
+	namespace internals_svgelement
+		{
+
+		/**
+		 * Minimal XML node (name, attributes in insertion order and text) used while writing SVG files.
+		 * Provides the subset of the tinyxml2::XMLElement interface used by the figures.
+		 **/
+		class XMLNode
+			{
+
+			public:
+
+				XMLNode() : name(SVGElement_DEFAULT_NAME), attributes(), text() {}
+
+				/* set the element name */
+				void SetName(const char * str) { name = str; }
+
+				/* set an attribute, replace its value if it already exists */
+				void SetAttribute(const char * attr, const char * value)
+					{
+					for (auto & A : attributes) { if (A.first == attr) { A.second = value; return; } }
+					attributes.push_back(std::pair<std::string, std::string>(attr, value));
+					}
+
+				void SetAttribute(const char * attr, const std::string & value) { SetAttribute(attr, value.c_str()); }
+				void SetAttribute(const char * attr, bool value) { SetAttribute(attr, (value ? "true" : "false")); }
+				void SetAttribute(const char * attr, double value) { SetAttribute(attr, _toStr("%.17g", value).c_str()); }
+				void SetAttribute(const char * attr, float value) { SetAttribute(attr, _toStr("%.8g", (double)value).c_str()); }
+				void SetAttribute(const char * attr, int value) { SetAttribute(attr, std::to_string(value)); }
+				void SetAttribute(const char * attr, unsigned int value) { SetAttribute(attr, std::to_string(value)); }
+				void SetAttribute(const char * attr, long value) { SetAttribute(attr, std::to_string(value)); }
+				void SetAttribute(const char * attr, unsigned long value) { SetAttribute(attr, std::to_string(value)); }
+				void SetAttribute(const char * attr, long long value) { SetAttribute(attr, std::to_string(value)); }
+				void SetAttribute(const char * attr, unsigned long long value) { SetAttribute(attr, std::to_string(value)); }
+
+				/* remove an attribute */
+				void DeleteAttribute(const char * attr)
+					{
+					for (size_t i = 0; i < attributes.size(); i++) { if (attributes[i].first == attr) { attributes.erase(attributes.begin() + i); return; } }
+					}
+
+				/* return the value of an attribute (nullptr if not found) */
+				const char * Attribute(const char * attr) const
+					{
+					for (auto & A : attributes) { if (A.first == attr) return A.second.c_str(); }
+					return nullptr;
+					}
+
+				/* set the text of the element */
+				void SetText(const char * str) { text = str; }
+
+				std::string name;
+				std::vector<std::pair<std::string, std::string> > attributes;
+				std::string text;
+
+			private:
+
+				static std::string _toStr(const char * format, double v)
+					{
+					char buf[64];
+					snprintf(buf, sizeof(buf), format, v);
+					return std::string(buf);
+					}
+			};
+
+		}
+
+
 	/**
-	 * Class that extend tinyxml::XMLElement to provide useful method when writing SVG documents.
+	 * Class representing an SVG element while exporting a figure.
 	 *
-	 * TODO : find a way to derive from tinyxml::XMLElement (not possible before ctor/dtor are private).
+	 * An element is a small tree (name, attributes, text, children and comments). Each figure writes
+	 * its description into an element which is then serialized by a SVGWriter and discarded. Thus,
+	 * no DOM of the whole document is ever built.
 	 **/
 	class SVGElement
 	{
 
 
 		template<int NN> friend class FigureCanvas; // friend class can create objects. 
+		friend class SVGWriter;
 	
 
 		/**
-		 * Constructor. 
-		 * If el is not null, then the object constructed is added as last child of el
-		 * otherwise it is added as last child of xmlDoc
+		 * Constructor. Create an empty element.
 		 **/
-		SVGElement(tinyxml2::XMLDocument & xmlDoc, tinyxml2::XMLElement * father) : xml(xmlDoc.NewElement(SVGElement_DEFAULT_NAME)), _xmlDoc(&xmlDoc), _children()
+		SVGElement() : xml(&_node), _node(), _children(), _comment(false)
 			{
-			father->InsertEndChild(xml);
 			}
 
 
@@ -76,7 +146,7 @@ namespace mtools
 		 **/
 		SVGElement * NewChildSVGElement(const char * name = SVGElement_DEFAULT_NAME)
 			{
-			SVGElement * el = new SVGElement(*_xmlDoc, xml);
+			SVGElement * el = new SVGElement();
 			_children.push_back(el); // we keep ownership: register for deletion when this object is destoyed. 
 			el->SetName(name);
 			return el;
@@ -97,7 +167,10 @@ namespace mtools
 		 **/
 		void Comment(const char * str)
 			{
-			xml->LinkEndChild(_xmlDoc->NewComment(str));
+			SVGElement * el = new SVGElement();
+			el->_comment = true;
+			el->_node.text = str;
+			_children.push_back(el);
 			}
 
 
@@ -178,8 +251,8 @@ namespace mtools
 		*/
 
 
-		/** give acces to the underlying xml element */
-		tinyxml2::XMLElement * xml;
+		/** give acces to the underlying xml node */
+		internals_svgelement::XMLNode * xml;
 
 		/** Coordinate transform to apply on the x-axis */
 		static double tx(double x) { return x; } 
@@ -196,14 +269,145 @@ namespace mtools
 		static int64 tr(int64 r)  { return r; }
 
 
+		/**
+		 * Append the XML description of the element (and of its children) to a string.
+		 *
+		 * @param [in,out]	out  	The string to append to.
+		 * @param 		  	depth	indentation level.
+		 **/
+		void write(std::string & out, int depth = 0) const;
+
+
 	private:
 
-		tinyxml2::XMLDocument * _xmlDoc;			// Associated XMLDocument
+		SVGElement(const SVGElement &) = delete;
+		SVGElement & operator=(const SVGElement &) = delete;
+
+		internals_svgelement::XMLNode _node;		// the element itself
 		std::vector<SVGElement*> _children;			// vector of all the children that should be deleted when this object is deleted. 
+		bool _comment;								// true if the element is a comment (stored in _node.text)
 		static std::atomic<int64> _id;
 	};
 
 
+
+	/**
+	 * Streaming SVG writer.
+	 *
+	 * Elements are serialized into an internal buffer which is flushed to the output stream whenever
+	 * it grows larger than BUFFER_SIZE so that the memory used does not depend on the size of the
+	 * document.
+	 *
+	 * When path merging is enabled, consecutive <line> and <polyline> elements (without
+	 * transformation or clipping) that share the same style are merged into a single <path>
+	 * element. This makes the output much smaller. Note that overlapping parts of merged
+	 * translucent strokes are then blended only once.
+	 **/
+	class SVGWriter
+	{
+
+	public:
+
+		static const size_t BUFFER_SIZE = 1024 * 1024;	///< size of the buffer before writing to the stream.
+		static const size_t MAX_MERGE = 4096;			///< maximum number of lines merged into a single path.
+
+
+		/**
+		 * Constructor.
+		 *
+		 * @param [in,out]	os		  	The output stream.
+		 * @param 		  	mergepaths	true to merge consecutive lines/polylines with the same style.
+		 **/
+		SVGWriter(std::ostream & os, bool mergepaths = true) : _os(os), _merge(mergepaths), _buf(), _pcount(0), _pdepth(0)
+			{
+			_buf.reserve(BUFFER_SIZE + 4096);
+			}
+
+
+		/** Destructor. Flush everything to the output stream. */
+		~SVGWriter() { flush(); }
+
+
+		/**
+		 * Write an element.
+		 *
+		 * @param	el   	The element.
+		 * @param	depth	indentation level.
+		 **/
+		void write(const SVGElement & el, int depth = 0);
+
+
+		/**
+		 * Write a raw string (the caller is responsible for its validity as XML).
+		 **/
+		void raw(const std::string & str)
+			{
+			_flushPath();
+			_buf += str;
+			_check();
+			}
+
+
+		/**
+		 * Write a text, escaping the characters '&', '<' and '>'.
+		 **/
+		void text(const std::string & str)
+			{
+			_flushPath();
+			escape(_buf, str, false);
+			_check();
+			}
+
+
+		/**
+		 * Flush all pending data to the output stream.
+		 **/
+		void flush()
+			{
+			_flushPath();
+			if (_buf.size()) { _os.write(_buf.data(), _buf.size()); _buf.clear(); }
+			_os.flush();
+			}
+
+
+		/**
+		 * Append str to out, escaping the XML special characters.
+		 *
+		 * @param [in,out]	out   	The string to append to.
+		 * @param 		  	str   	The string to escape.
+		 * @param 		  	quotes	true to also escape double quotes (for attribute values).
+		 **/
+		static void escape(std::string & out, const std::string & str, bool quotes);
+
+
+	private:
+
+		SVGWriter(const SVGWriter &) = delete;
+		SVGWriter & operator=(const SVGWriter &) = delete;
+
+		/* flush the buffer if needed */
+		void _check() { if (_buf.size() >= BUFFER_SIZE) { _os.write(_buf.data(), _buf.size()); _buf.clear(); } }
+
+		/* write the pending path, if any */
+		void _flushPath();
+
+		/* check if an element can be merged into a path, if so, compute its style, id, path data and comment. */
+		static bool _mergeable(const SVGElement & el, std::string & style, std::string & id, std::string & d, std::string & comment);
+
+		std::ostream & _os;			// output stream
+		bool _merge;				// true if path merging is enabled
+		std::string _buf;			// output buffer
+
+		std::string _pstyle;		// style of the pending path
+		std::string _pid;			// id of the pending path
+		std::string _pcomment;		// comment of the pending path
+		std::string _pd;			// path data of the pending path
+		std::string _pfirst;		// serialization of the first element merged (used if it is the only one).
+		size_t _pcount;				// number of elements in the pending path
+		int _pdepth;				// indentation level of the pending path
+	};
+
+
 }
 
 
@@ -19,6 +19,9 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
+#include <utility>
+#include <functional>
 
 #include "vec.hpp"
 
@@ -102,6 +105,9 @@ namespace mtools
             VoronoiEdgesIndices.clear();
             VoronoiNormals.clear();
             DelaunayVertices.clear();
+            DelaunayEdgesAdded.clear();
+            DelaunayEdgesRemoved.clear();
+            _clearTopology();
             }
 
 
@@ -111,7 +117,7 @@ namespace mtools
          * ctor. Does nothing
          * Waits for compute() to be called. 
          **/
-        DelaunayVoronoi()
+        DelaunayVoronoi() : _nbinserted(0), _walkrng(1)
             {
             }
 
@@ -126,7 +132,7 @@ namespace mtools
          * @param   vertices    Set of vertice in the plane to triangulate and compute the Voronoi
          *                      diagrams.
         **/
-        DelaunayVoronoi(const std::vector<mtools::fVec2>& vertices) : DelaunayVertices(vertices)
+        DelaunayVoronoi(const std::vector<mtools::fVec2>& vertices) : DelaunayVertices(vertices), _nbinserted(0), _walkrng(1)
             {
             compute();
             }
@@ -150,6 +156,52 @@ namespace mtools
         void compute();
 
 
+        /**
+         * Insert the vertices of DelaunayVertices that were added since the last call to compute() or
+         * update() into the current triangulation, without recomputing it from scratch.
+         * 
+         * The points are inserted one at a time with the Bowyer-Watson algorithm: the triangles whose
+         * circumcircle contains the new point are removed and the cavity is re-triangulated from the
+         * point. The new points are first sorted along a Hilbert curve and the triangle containing
+         * each point is found by walking from the last triangle created, so a batch of k points
+         * costs O(k log k) plus the size of the cavities (instead of O(n log n) for compute()).
+         * 
+         * Only the entries of the output vectors affected by the insertions are modified: a triangle
+         * or an edge removed frees its index, which is reused by a new one, and the new ones are
+         * appended at the end (the number of triangles and edges never decreases). The net change of
+         * the set of Delaunay edges is stored in DelaunayEdgesAdded and DelaunayEdgesRemoved.
+         * 
+         * The vertices already triangulated must not be modified (call compute() in that case). If
+         * there is no triangulation yet (or if a floating point inconsistency is detected), compute()
+         * is called instead. A new point equal to an existing vertex is not triangulated (as with
+         * compute()). The structure used for the insertions is built on the first call to update()
+         * after compute(), so compute() alone does not pay for it.
+        **/
+        void update();
+
+
+        /**
+         * Append a set of vertices to DelaunayVertices and insert them in the triangulation. Same as
+         * pushing them at the end of DelaunayVertices and calling update().
+        **/
+        void insert(const std::vector<mtools::fVec2>& vertices)
+            {
+            DelaunayVertices.insert(DelaunayVertices.end(), vertices.begin(), vertices.end());
+            update();
+            }
+
+
+        /**
+         * Append a vertex to DelaunayVertices and insert it in the triangulation. Same as pushing it
+         * at the end of DelaunayVertices and calling update().
+        **/
+        void insert(const mtools::fVec2 & vertex)
+            {
+            DelaunayVertices.push_back(vertex);
+            update();
+            }
+
+
         /**
         * Set of vertices in the Voronoi diagram.
          *
@@ -205,9 +257,54 @@ namespace mtools
         std::vector<mtools::fVec2>  VoronoiNormals;
 
 
+        /**
+         * Delaunay edges (given by the indexes of their two vertices, smallest first) created by the
+         * last call to update() and not present before it.
+         * 
+         * [This vector is set by update(). compute() clears it]
+        **/
+        std::vector<mtools::iVec2>  DelaunayEdgesAdded;
+
+
+        /**
+         * Delaunay edges (given by the indexes of their two vertices, smallest first) present before
+         * the last call to update() and removed by it.
+         * 
+         * [This vector is set by update(). compute() clears it]
+        **/
+        std::vector<mtools::iVec2>  DelaunayEdgesRemoved;
+
+
     private:
 
 
+        /* triangle of the internal structure used by update(). The triangles with a vertex -1 are 
+         * 'ghost' triangles (a, b, infinity) outside each edge (a, b) of the convex hull. */
+        struct _Tri
+            {
+            int v[3];   // vertices in counter-clockwise order (v[2] = -1 for a ghost triangle)
+            int n[3];   // n[j] = neighbour triangle across the edge opposite to v[j]
+            int e[3];   // e[j] = index of the edge opposite to v[j] in DelaunayEdgesIndices (-1 if none)
+            int pub;    // index in DelaunayTrianglesIndices (-1 for a ghost triangle)
+            };
+
+        void _clearTopology();
+
+        void _buildTopology();
+
+        int _locate(const mtools::fVec2 & P, int hint);
+
+        bool _conflict(int t, const mtools::fVec2 & P) const;
+
+        int _insertVertex(int p, int hint);
+
+        void _updateVoronoiEdge(int e);
+
+        void _updateVoronoiVertex(int t);
+
+        void _recomputeAll();
+
+
         void _copy(std::vector<mtools::fVec2>& vec, const double* data, int len);
 
         void _copy(std::vector<mtools::iVec2>& vec, const int* data, int len);
@@ -216,9 +313,106 @@ namespace mtools
 
         void _freeall(void * p);
 
+
+        std::vector<_Tri>   _tri;           // triangles (and ghost triangles) of the current triangulation
+        std::vector<int>    _edgeSide;      // _edgeSide[e] = 3*t + j where side j of triangle t is edge e
+        std::vector<int>    _freeTri;       // indices in DelaunayTrianglesIndices freed during an insertion
+        std::vector<int>    _freeEdge;      // indices in DelaunayEdgesIndices freed during an insertion
+        std::vector<int>    _cavity;        // work vectors used by _insertVertex()
+        std::vector<int>    _mark;          //
+        std::vector<int>    _vstart;        //
+        std::vector<int>    _vend;          //
+        size_t              _nbinserted;    // number of vertices of DelaunayVertices already in the triangulation (0 if no triangulation, _tri is empty until the first update())
+        uint64_t            _walkrng;       // state of the rng used by the stochastic walk
+        std::vector<std::pair<uint64_t, bool> > _changes; // edges added (true) / removed (false) during the current update()
+
     };
 
 
+
+    /**
+     * A cell of the Voronoi diagram of a set of sites (see computeVoronoiCells()).
+    **/
+    struct VoronoiCell
+    {
+
+        /** Index of the site of the cell. */
+        int64 site;
+
+        /** Position of the site. */
+        mtools::fVec2 position;
+
+        /** 
+         * Vertices of the cell, in counter-clockwise order. For an unbounded cell, these are the
+         * finite vertices: the boundary of the cell starts with a semi-infinite ray ending at
+         * vertices.front() and ends with a semi-infinite ray starting at vertices.back().
+        **/
+        std::vector<mtools::fVec2> vertices;
+
+        /** 
+         * Sites of the neighbouring cells: neighbours[i] is the site on the other side of the edge
+         * starting at vertices[i] (i.e. the edge [vertices[i], vertices[i+1]], the last one going
+         * back to vertices[0] for a bounded cell). For an unbounded cell, the last edge is the ray
+         * starting at vertices.back() and there is an additional neighbour neighbours.back() on
+         * the other side of the ray ending at vertices.front().
+        **/
+        std::vector<int64> neighbours;
+
+        /** True if the cell is bounded, false if the site is on the convex hull. */
+        bool bounded;
+
+        /** For an unbounded cell: unit direction of the ray ending at vertices.front() (pointing to infinity). */
+        mtools::fVec2 rayFirst;
+
+        /** For an unbounded cell: unit direction of the ray starting at vertices.back(). */
+        mtools::fVec2 rayLast;
+
+
+        /** Area of the cell (infinity if the cell is unbounded). */
+        double area() const;
+
+    };
+
+
+    /**
+     * Compute the Voronoi cells of a (possibly very large) set of sites in parallel, without
+     * constructing the whole Delaunay triangulation / Voronoi diagram in memory.
+     * 
+     * The bounding box of the sites is divided into square tiles containing about tilesize sites
+     * each. The tiles are processed concurrently: the sites of a tile and those in a margin
+     * around it are triangulated (with the incremental insertion of DelaunayVoronoi::update()) and
+     * the cell of a site of the tile is kept only when it is certified to be the same as in the
+     * diagram of all the sites: the circumcircle of each Delaunay triangle around the site must
+     * not contain any site outside of the triangulated region (which is checked using a grid of
+     * buckets), and a site on the boundary of the local triangulation must be on the convex hull
+     * of all the sites (which is computed beforehand).
+     * The other sites are processed again in a new round, with a region made of a square of grid
+     * cells around each of them and of the grid cells that intersect the circumcircles which
+     * contained an outside site (at most 4096 cells per circumcircle). The square is kept when
+     * the site failed because of such a circumcircle and its half-width is doubled otherwise.
+     * After 32 rounds (or once the region covers a quarter of the grid), all the sites are
+     * triangulated. Thus, each cell is reported exactly once and the tiles need not be stitched
+     * together.
+     * 
+     * Memory usage is the input vector plus O(n) integers, plus the local triangulation of each
+     * tile being processed.
+     * 
+     * When several sites are at the same position, only one of them (unspecified) has a cell, the
+     * cells of the others are not reported.
+     * If all the sites are aligned, there is no cell.
+     *
+     * @param   sites       The sites.
+     * @param   fun         Function called for each cell. Calls are never concurrent but the
+     *                      cells are reported in no particular order (and not necessarily from the
+     *                      same thread).
+     * @param   nbthreads   Number of threads to use (0 = number of hardware threads).
+     * @param   tilesize    Average number of sites per tile.
+     *
+     * @return  The number of cells reported.
+    **/
+    int64 computeVoronoiCells(const std::vector<mtools::fVec2> & sites, std::function<void(const VoronoiCell &)> fun, int nbthreads = 0, int64 tilesize = 65536);
+
+
 }
 
 /** end of file DelaunayVoronoi.hpp */
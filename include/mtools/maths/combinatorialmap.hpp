@@ -29,6 +29,7 @@
 #include "../random/classiclaws.hpp"
 #include "permutation.hpp"
 #include "dyckword.hpp"
+#include "csrgraph.hpp"
 
 namespace mtools
 	{
@@ -152,6 +153,24 @@ namespace mtools
 			inline int nbDarts() const { return ((int)_alpha.size()); }
 
 
+			/**
+			* Reserve memory for a map with up to nbdarts darts.
+			* 
+			* Local operations such as addTriangle(), addSplittingTriangle() or collapseFaceOfSize2() do 
+			* not reallocate memory as long as the number of darts stays below this value. Useful before
+			* long peeling processes when the final size of the map is known (or can be bounded) in advance.
+			**/
+			void reserve(int nbdarts)
+				{
+				_alpha.reserve(nbdarts);
+				_sigma.reserve(nbdarts);
+				_vertices.reserve(nbdarts);
+				_faces.reserve(nbdarts);
+				_facedart.reserve(nbdarts);
+				_facesize.reserve(nbdarts);
+				}
+
+
 			/**
 			 * Return the index of the root dart (i.e. oriented edge).
 			 **/
@@ -286,7 +305,8 @@ namespace mtools
 
 
 			/**
-			* Compute the number of edge that compose the face to which a given dart belongs.
+			* Return the number of edge that compose the face to which a given dart belongs.
+			* The size of each face is maintained by the object so this takes constant time.
 			*
 			* @param	dartIndex	the dart index whose associated face size is to be computed.
 			* 						(note that this is NOT the index of the face itself!).
@@ -296,9 +316,7 @@ namespace mtools
 			int faceSize(int dartIndex) const
 				{
 				MTOOLS_ASSERT((dartIndex >= 0) && (dartIndex < nbDarts()));
-				int n = 1, j = phi(dartIndex);
-				while (j != dartIndex) { j = phi(j); n++; }
-				return n;
+				return _facesize[_faces[dartIndex]];
 				}
 
 
@@ -360,6 +378,7 @@ namespace mtools
 				cm._nbvertices = _nbfaces;
 				cm._faces = _vertices;
 				cm._nbfaces = _nbvertices;
+				cm._computeFaceInfo();
 				cm._root = _root;
 				return cm;
 				}
@@ -388,6 +407,8 @@ namespace mtools
 					_sigma[2*i + 1] = ((2*i + 2)%(2*n)); _sigma[(2*i + 2)%(2*n)] = 2*i + 1;
 					_vertices[2*i + 1] = ((i+1)%n); _vertices[(2*i + 2)%(2*n)] = ((i+1)%n);
 					}
+				_facedart.assign({ 0, 1 });
+				_facesize.assign({ n, n });
 				CHECKCONSISTENCY;
 				}
 
@@ -405,6 +426,8 @@ namespace mtools
 			* the edges 0,1,2,3 are ordered according to the exploration of the face ie
 			* such that phi(i) = i+1. The numbering of the vertices also start from the
 			* root vertex (ie vertice(0) =0) and follow the contour of the tree.
+			* 
+			* The word is read only once: the vertices are numbered during the exploration.
 			**/
 			void fromDyckWord(const DyckWord & dw)
 				{
@@ -414,21 +437,28 @@ namespace mtools
 				_alpha.reserve(2 * (n + 1));	// useful when performing Poulalhon-Schaeffer bijection
 				_sigma.resize(2 * n);
 				_alpha.resize(2 * n);
+				_vertices.resize(2 * n);
 				const int nbuds = dw.weight() - 1;
 				_root = 0; // rooted at the first edge
-				std::vector<int> st;
+				std::vector<int> st;	// stack of the darts going up
+				std::vector<int> vst;	// stack of the vertices 
 				st.reserve((int)(sqrt(dw.nups())) + 1);
+				vst.reserve((int)(sqrt(dw.nups())) + 1);
 				// match the half-edges. 
 				if (nbuds == 0)
 					{ // weight = 1, general tree
+					int cur = 0; // current vertex
+					_nbvertices = 1;
 					for (int i = 0; i < 2 * n; i++)
 						{
-						if (dw[i] == 1) { st.push_back(i); }
+						_vertices[i] = cur;
+						if (dw[i] == 1) { st.push_back(i); vst.push_back(cur); cur = _nbvertices++; }
 						else
 							{
 							_alpha[st.back()] = i;
 							_alpha[i] = st.back();
 							st.pop_back();
+							cur = vst.back(); vst.pop_back();
 							}
 						}
 					}
@@ -440,6 +470,9 @@ namespace mtools
 					int j = 1;
 					_alpha[0] = 2 * n - 1;
 					_alpha[2 * n - 1] = 0;
+					_vertices[0] = 0;	// root leaf 
+					int cur = 1;		// current vertex
+					_nbvertices = 2;
 					buds_passed.push_back(1); // passed one bud at height 0
 					for (int i = 0; i < dw.length() - 1; i++)
 						{
@@ -448,6 +481,8 @@ namespace mtools
 							st.push_back(j);
 							buds_passed.push_back(0);
 							h++;
+							_vertices[j] = cur;
+							vst.push_back(cur); cur = _nbvertices++;
 							j++;
 							}
 						else
@@ -459,6 +494,8 @@ namespace mtools
 								_alpha[j] = st.back();
 								st.pop_back();
 								buds_passed.pop_back();
+								_vertices[j] = cur;
+								cur = vst.back(); vst.pop_back();
 								j++;
 								}
 							else
@@ -466,18 +503,24 @@ namespace mtools
 								++(buds_passed[h]);
 								_alpha[j] = j + 1;
 								_alpha[j + 1] = j;
+								_vertices[j] = cur;
+								_vertices[j + 1] = _nbvertices++; // new leaf
 								j += 2;
 								}
 							}
 						}
 					MTOOLS_ASSERT(h == 0);
 					MTOOLS_ASSERT(buds_passed[0] == nbuds);
+					MTOOLS_ASSERT(j == 2 * n - 1);
+					_vertices[2 * n - 1] = cur;
 					}
 				MTOOLS_ASSERT(st.size() == 0);
 				// construct sigma by going around the exterior face
 				for (int i = 0; i < (2 * n); i++) { _sigma[i] = (_alpha[i] + 1) % (2 * n); }
-				_computeVerticeSet();
-				_computeFaceSet();
+				_faces.assign(2 * n, 0); // a tree has a single face
+				_nbfaces = 1;
+				_facedart.assign(1, 0);
+				_facesize.assign(1, 2 * n);
 				CHECKCONSISTENCY;
 				}
 
@@ -550,7 +593,9 @@ namespace mtools
 			 * Inverse operation of fromGraph() in the sense that toGraph(fromGraph(G)) = G
 			 * [but fromGraph(toGraph(CM)) may be different from CM].
 			 *
-			 * @tparam	GRAPH	Type of the graph. For example std::vector<std::vector<int> >.
+			 * @tparam	GRAPH	Type of the graph. For example std::vector<std::vector<int> >. With
+			 * 					CSRGraph, the arrays of the graph are filled directly from the
+			 * 					permutations.
 			 *
 			 * @return	The graph object. The numbering of the vertices is unchanged. 
 			 * 			
@@ -558,7 +603,9 @@ namespace mtools
 			template<typename GRAPH> GRAPH toGraph() const
 				{
 				CHECKCONSISTENCY;
-				return _toGraph<GRAPH>();
+				GRAPH gr;
+				_toGraph(gr);
+				return gr;
 				}
 
 
@@ -575,7 +622,8 @@ namespace mtools
 			 * Construct a triangulation by adding a single vertice inside each face of degree larger than 3.
 			 * 
 			 * - The numbering of the vertices already present is unchanged and the new ones follow.
-			 * - The numbering of the faces may change, even for faces that where already triangulations !
+			 * - The numbering of the faces already present is unchanged: a face that is triangulated keeps
+			 *   its index for one of its triangles and the new ones follow.
 			 *
 			 * @return	the number of vertices inserted (which is also the number of faces that were not
 			 * 			triangles).
@@ -588,7 +636,6 @@ namespace mtools
 					{ 
 					_triangulateFace(i); 
 					}
-				_computeFaceSet();
 				CHECKCONSISTENCY;
 				return nbVertices() - nbv;
 				}
@@ -600,7 +647,8 @@ namespace mtools
 			 * to it.
 			 * 
 			 * - The numbering of the vertices already present is unchanged and the new one follow.
-			 * - The numbering of the faces may change, even for faces that where already present !
+			 * - The numbering of the faces already present is unchanged. The triangle containing dartIndex
+			 *   keeps the index of the face and the new ones follow.
 			 *
 			 * @param	dartIndex	The index of a dart that identifies the face to triangulate 
 			 * 						(note that this is NOT the index of the face itself!).
@@ -610,7 +658,6 @@ namespace mtools
 			int triangulateFace(int dartIndex)
 				{
 				int d = _triangulateFace(dartIndex);
-				_computeFaceSet();
 				CHECKCONSISTENCY;
 				return d;
 				}
@@ -647,6 +694,9 @@ namespace mtools
 					}
 				cm._nbvertices = _nbvertices;
 				cm._nbfaces = _nbfaces;
+				cm._facedart.resize(_nbfaces);
+				for (int f = 0; f < _nbfaces; f++) { cm._facedart[f] = perm.inv(_facedart[f]); }
+				cm._facesize = _facesize;
 				cm._root = perm.inv(_root);
 				CHECKCONSISTENCY;
 				return cm;
@@ -820,8 +870,15 @@ namespace mtools
 			 * NB: the method work also for double edge but not for loop i.e. it is forbidden that
 			 *     dartIndexTarget = dartIndexBase or phi(dartIndexBase)...
 			 *
-			 * This method only creates new darts, vertices and faces but does not change any previous numbering
-			 * (of darts, vertices, faces etc...).
+			 * This method only creates new darts and faces and does not change the numbering of the previous
+			 * darts and vertices. However, the numbering of the split face F is NOT preserved: the triangle
+			 * gets the first new face index and, among the two other parts of F, the larger one keeps the
+			 * index F while the smaller one gets the second new face index (on a tie, the part containing
+			 * dartIndexTarget is the one renumbered). Thus, the side of dartIndexBase keeps the index F only
+			 * when it is the larger one. This way, relabeling takes time proportional to the size of the
+			 * smaller part. Use face(dartIndexBase) and face(dartIndexTarget) after the call to retrieve the
+			 * new indices. When an edge is not created because of collapsedoubleedge, the rest of the face
+			 * keeps the index F.
 			 *
 			 * @param	dartIndexBase  		The dart PRECEDING the base of the triangle
 			 * @param	dartIndexTarget		The dart whose ENDPOINT is the third vertex of the triangle
@@ -853,7 +910,9 @@ namespace mtools
 			 * 
 			`* -> Reduces the number of edges by 1 (hence the number of darts by 2) and reduces the number
 			 *    of faces by 1. The numbering of vertices remain unchanged but the numbering of the dart and 
-			 *    faces are modified.
+			 *    faces are modified: the last two darts and the last face take the place of the removed ones.
+			 *    
+			 * -> Runs in time proportional to the size of the last face (not to the size of the map).
 			 *
 			 * -> The method cannot be use to remove double edges that do not define a face of size two (ie if
 			 *    there are edges in between).
@@ -865,11 +924,16 @@ namespace mtools
 				CHECKCONSISTENCY;
 				const int f1 = _collapseFaceOfSize2(dart);  // remove the face
 				const int f2 = _nbfaces - 1;
-				const int l = (int)_alpha.size();
-				for (int i = 0; i < l; i++) // face f1 has disappeared, move f2 to f1
-					{ 
-					if (_faces[i] == f2) { _faces[i] = f1; }
+				if (f1 != f2)
+					{ // face f1 has disappeared, move f2 to f1
+					const int s = _facedart[f2];
+					int i = s;
+					do { _faces[i] = f1; i = phi(i); } while (i != s);
+					_facedart[f1] = s;
+					_facesize[f1] = _facesize[f2];
 					}
+				_facedart.pop_back();
+				_facesize.pop_back();
 				_nbfaces--;
 				CHECKCONSISTENCY;
 				}
@@ -969,6 +1033,7 @@ namespace mtools
 				ar & _sigma;
 				ar & _vertices;
 				ar & _faces;
+				_computeFaceInfo();
 				CHECKCONSISTENCY;
 				}
 
@@ -1050,6 +1115,19 @@ namespace mtools
 					}
 				MTOOLS_INSURE(fs.size() == (size_t)_nbfaces);
 				}
+
+				{ // check the representative dart and the size of each face
+				MTOOLS_INSURE(_facedart.size() == (size_t)_nbfaces);
+				MTOOLS_INSURE(_facesize.size() == (size_t)_nbfaces);
+				std::vector<int> fsize(_nbfaces, 0);
+				for (int i = 0; i < (int)l; i++) { fsize[_faces[i]]++; }
+				for (int f = 0; f < _nbfaces; f++)
+					{
+					MTOOLS_INSURE((_facedart[f] >= 0) && (_facedart[f] < (int)l));
+					MTOOLS_INSURE(_faces[_facedart[f]] == f);
+					MTOOLS_INSURE(_facesize[f] == fsize[f]);
+					}
+				}
 				return;
 				}
 
@@ -1096,6 +1174,10 @@ namespace mtools
 				_faces[l + 1] = _nbfaces;
 				_faces[l + 0] = F;
 				_faces[l + 2] = F;
+				if (_facedart[F] == b) { _facedart[F] = l + 0; }
+				_facesize[F]++;
+				_facedart.push_back(b);
+				_facesize.push_back(3);
 				_nbfaces++;
 				}
 
@@ -1144,13 +1226,17 @@ namespace mtools
 					_faces[b] = _nbfaces;
 					_faces[d] = _nbfaces;
 					_faces[l + 1] = _nbfaces;
+					if ((_facedart[F] == b) || (_facedart[F] == d)) { _facedart[F] = l + 0; }
+					_facesize[F]--;
+					_facedart.push_back(b);
+					_facesize.push_back(3);
 					_nbfaces++;
 					return 2;
 					}
 
 				if (ignore1)
 					{ // only 1 edge to add
-					int len = faceSize(dartIndexBase); // compute size of face before changes
+					int len = faceSize(dartIndexBase); // size of face before changes
 					const int l = (int)_alpha.size();
 					_alpha.resize(l + 2);
 					_sigma.resize(l + 2);
@@ -1175,6 +1261,10 @@ namespace mtools
 					_faces[f] = _nbfaces;
 					_faces[b] = _nbfaces;
 					_faces[l + 1] = _nbfaces;
+					if ((_facedart[F] == f) || (_facedart[F] == b)) { _facedart[F] = l + 0; }
+					_facesize[F]--;
+					_facedart.push_back(b);
+					_facesize.push_back(3);
 					_nbfaces++;
 					return len - 1;
 					}
@@ -1211,27 +1301,53 @@ namespace mtools
 				_vertices[l + 1] = v3;
 				_vertices[l + 2] = v3;
 
+				const int s = _facesize[F]; // size of the face before changes
+
 				_faces[l + 0] = F;
+				_faces[l + 2] = F;
 				_faces[b] = _nbfaces;
 				_faces[l + 3] = _nbfaces;
 				_faces[l + 1] = _nbfaces;
+				_facedart.push_back(b);
+				_facesize.push_back(3);
 				_nbfaces++;
 
+				// the rest of face F is split between the target side (d ... l+2) and the base 
+				// side (f ... l+0). Walk both simultaneously and relabel only the smallest one.  
 				int len = 1;
-				int k = d;
-				while (k != (l + 2))
-					{
-					_faces[k] = _nbfaces; k = phi(k); len++;
+				int k1 = d, k2 = f;
+				while ((k1 != (l + 2)) && (k2 != (l + 0))) { k1 = phi(k1); k2 = phi(k2); len++; }
+				int lent;
+				if (k1 == (l + 2))
+					{ // the target side is the smallest: it gets the new label.
+					lent = len;
+					int k = d;
+					while (k != (l + 2)) { _faces[k] = _nbfaces; k = phi(k); }
+					_faces[k] = _nbfaces;
+					_facedart[F] = l + 0;
+					_facesize[F] = s + 1 - lent;
+					_facedart.push_back(l + 2);
+					_facesize.push_back(lent);
+					}
+				else
+					{ // the base side is the smallest: it gets the new label.
+					lent = s + 1 - len;
+					int k = f;
+					while (k != (l + 0)) { _faces[k] = _nbfaces; k = phi(k); }
+					_faces[k] = _nbfaces;
+					_facedart[F] = l + 2;
+					_facesize[F] = lent;
+					_facedart.push_back(l + 0);
+					_facesize.push_back(len);
 					}
-				_faces[k] = _nbfaces;
 				_nbfaces++;
-				return len;
+				return lent;
 				}
 
 
-			/* private method. leaves _faces[] and _nbfaces inconsistent since there
-			   is one less face (but renumbering is not performed and _nbfaces is not
-			   decremented).
+			/* private method. leaves _faces[], _facedart[], _facesize[] and _nbfaces 
+			   inconsistent since there is one less face (but renumbering is not 
+			   performed and _nbfaces is not decremented).
 			   Return the (now available) index of the face that was removed. */
 			int _collapseFaceOfSize2(int dart)
 				{
@@ -1250,6 +1366,7 @@ namespace mtools
 				_sigma[invsigma(b)] = c;
 				_sigma[d] = _sigma[a];
 				_faces[c] = _faces[b];
+				if (_facedart[_faces[b]] == b) { _facedart[_faces[b]] = c; }
 				if (_root == a) { _root = d; }
 				else if (_root == b) { _root = c; }
 				_alpha.resize(l - 2);
@@ -1292,40 +1409,31 @@ namespace mtools
 				}
 
 
-			/* move a dart from i to f, used by _swapdarts 
-			   leave the object in an inconsistent state */
-			void _movedart(int i, int f)
-				{
-				int a = _alpha[i];
-				_alpha[f] = a;
-				_alpha[a] = f;
-				int n = _sigma[i];
-				int p = invsigma(i);
-				_sigma[f] = ((n == i) ? f : n);
-				_sigma[p] = f;
-				_faces[f] = _faces[i];
-				_vertices[f] = _vertices[i];
-				if (_root == i) { _root = f; }
-				}
-
-
-			/* swap indexes i1 and i2 without modifiying the graph */
+			/* swap indexes i and j without modifiying the graph */
 			void _swapdarts(int i, int j)
 				{
-				/* TODO : implement without resize() */
 				if (i == j) return;
-				const int l = (int)_alpha.size();
-				_alpha.resize(l + 1);
-				_sigma.resize(l + 1);
-				_vertices.resize(l + 1);
-				_faces.resize(l + 1);
-				_movedart(i, l);
-				_movedart(j, i);
-				_movedart(l, j);
-				_alpha.resize(l);
-				_sigma.resize(l);
-				_vertices.resize(l);
-				_faces.resize(l);
+				auto tau = [i, j](int x) { return ((x == i) ? j : ((x == j) ? i : x)); };
+				// the new permutations are tau o P o tau: only the images of i, j and of their preimages change.
+				const int ka[4] = { i, j, _alpha[i], _alpha[j] };
+				const int ks[4] = { i, j, invsigma(i), invsigma(j) };
+				int va[4], vs[4];
+				for (int k = 0; k < 4; k++)
+					{
+					va[k] = tau(_alpha[tau(ka[k])]);
+					vs[k] = tau(_sigma[tau(ks[k])]);
+					}
+				for (int k = 0; k < 4; k++)
+					{
+					_alpha[ka[k]] = va[k];
+					_sigma[ks[k]] = vs[k];
+					}
+				std::swap(_vertices[i], _vertices[j]);
+				std::swap(_faces[i], _faces[j]);
+				const int fi = _faces[i], fj = _faces[j];
+				_facedart[fi] = tau(_facedart[fi]);
+				if (fj != fi) { _facedart[fj] = tau(_facedart[fj]); }
+				_root = tau(_root);
 				}
 				
 				
@@ -1360,36 +1468,59 @@ namespace mtools
 				const int l = (int)_alpha.size();;
 				_faces.clear();
 				_faces.resize(l, -1);
+				_facedart.clear();
+				_facesize.clear();
 				_nbfaces = 0;
 				for(int i = 0; i < l; i++)
 					{
 					if (_faces[i] < 0)
 						{
 						_faces[i] = _nbfaces;
+						int n = 1;
 						int j = phi(i);
 						while (j != i)
 							{
 							MTOOLS_ASSERT(_faces[j] < 0);
 							_faces[j] = _nbfaces;
 							j = phi(j);
+							n++;
 							}
+						_facedart.push_back(i);
+						_facesize.push_back(n);
 						_nbfaces++;
 						}
 					}
 				}
 
 
-			/* Triangulate a face but do not recompute the _faces vector */
+			/* compute the representative dart and the size of each face from the _faces vector */
+			void _computeFaceInfo()
+				{
+				const int l = (int)_faces.size();
+				_facedart.assign(_nbfaces, -1);
+				_facesize.assign(_nbfaces, 0);
+				for (int i = l - 1; i >= 0; i--) 
+					{ 
+					_facedart[_faces[i]] = i; 
+					_facesize[_faces[i]]++; 
+					}
+				}
+
+
+			/* Triangulate a face. The triangle containing dartIndex keeps the index of the face
+			   and the other ones get new indexes. */
 			int _triangulateFace(int dartIndex)
 				{
 				const int d = faceSize(dartIndex);
 				MTOOLS_ASSERT(d >= 3);
 				if (d == 3) return 3; // nothing to do
+				const int F = _faces[dartIndex];
 				int f = (int)_alpha.size();
 				int i = dartIndex;
 				_alpha.resize(f + 2*d);
 				_sigma.resize(f + 2*d);
 				_vertices.resize(f + 2*d);
+				_faces.resize(f + 2*d);
 				for (int h = 0; h < d; h++)
 					{
 					const int nexti = phi(i);
@@ -1400,11 +1531,19 @@ namespace mtools
 					_sigma[f] = _sigma[_alpha[i]];
 					_sigma[_alpha[i]] = f;
 					_alpha[f] = f + 1;
+					// the h-th triangle is (i, f, f-1) and f+1 belongs to the next one.
+					const int lab = ((h > 0) ? (_nbfaces + h - 1) : F);
+					_faces[i] = lab;
+					_faces[f] = lab;
+					_faces[f + 1] = ((h + 1 < d) ? (_nbfaces + h) : F);
+					if (h > 0) { _facedart.push_back(i); _facesize.push_back(3); }
 					f += 2;
 					i = nexti;
 					}
+				_facedart[F] = dartIndex;
+				_facesize[F] = 3;
+				_nbfaces += d - 1;
 				_nbvertices++;
-				// now, _nbfaces and _faces are dirty. Call _computeFaceSet() to make it straight.
 				return d;
 				}
 
@@ -1535,10 +1674,9 @@ namespace mtools
 
 
 			/* convert to a graph, private method */
-			template<typename GRAPH> GRAPH _toGraph() const
+			template<typename GRAPH> void _toGraph(GRAPH & gr) const
 				{
 				const int l = nbDarts();
-				GRAPH gr;
 				gr.resize(_nbvertices);
 				for (int i = 0; i < l; i++)
 					{
@@ -1554,7 +1692,32 @@ namespace mtools
 							}
 						}
 					}
-				return gr;
+				}
+
+
+			/* same as above, filling the arrays of a CSRGraph in two passes over the darts */
+			void _toGraph(CSRGraph & gr) const
+				{
+				const int l = nbDarts();
+				std::vector<int> off(_nbvertices + 1, 0);
+				std::vector<int> first(_nbvertices, -1);
+				for (int i = 0; i < l; i++)
+					{
+					const int v = _vertices[i];
+					off[v + 1]++;
+					if (first[v] < 0) { first[v] = i; }
+					}
+				for (int v = 0; v < _nbvertices; v++) { off[v + 1] += off[v]; }
+				std::vector<int> adj(l);
+				for (int v = 0; v < _nbvertices; v++)
+					{
+					const int i = first[v];
+					if (i < 0) continue;
+					int * p = adj.data() + off[v];
+					int j = i;
+					do { *(p++) = _vertices[_alpha[j]]; j = _sigma[j]; } while (j != i);
+					}
+				gr = CSRGraph(std::move(off), std::move(adj));
 				}
 
 
@@ -1566,6 +1729,8 @@ namespace mtools
 			std::vector<int> _sigma;	// rotations around vertices
 			std::vector<int> _vertices;	// index of vertices associated with half edges
 			std::vector<int> _faces;	// index of faces associated with half edges
+			std::vector<int> _facedart;	// a half edge of each face
+			std::vector<int> _facesize;	// number of half edges of each face
 
 		};
 
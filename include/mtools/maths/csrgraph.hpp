@@ -0,0 +1,201 @@
+/** @file csrgraph.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/error.hpp"
+
+#include <vector>
+#include <type_traits>
+#include <utility>
+
+
+namespace mtools
+	{
+
+
+	/**
+	 * Graph stored in compressed sparse row format.
+	 *
+	 * The neighbours of all the vertices are stored contiguously in a single array: the neighbours
+	 * of vertex i are adj[off[i]], ..., adj[off[i+1]-1]. Compared to a std::vector<std::vector<int> >
+	 * this uses a single allocation (instead of one per vertex) and exploring the graph reads the
+	 * memory linearly, which makes a large difference for graphs with millions of vertices.
+	 *
+	 * The class can be used as the GRAPH type of the methods of graph.hpp, circlePacking.hpp and
+	 * CombinatorialMap: size() returns the number of vertices and operator[] returns the list of
+	 * neighbours of a vertex as a range (with begin(), end(), size() and operator[]). The number of
+	 * neighbours of a vertex cannot be changed, but the neighbours themselves can be modified.
+	 *
+	 * Use CombinatorialMap::toGraph<CSRGraph>() to construct the graph associated with a map
+	 * directly, without creating the intermediate vector of vectors.
+	 **/
+	class CSRGraph
+		{
+
+		public:
+
+			/** The list of neighbours of a vertex (view inside the graph). */
+			template<typename T> class Range
+				{
+				public:
+
+					typedef T * iterator;
+					typedef T * const_iterator;
+					typedef T value_type;
+
+					Range(T * b, T * e) : _b(b), _e(e) {}
+
+					iterator begin() const { return _b; }
+					iterator end() const { return _e; }
+					size_t size() const { return (size_t)(_e - _b); }
+					bool empty() const { return (_e == _b); }
+					T & operator[](size_t i) const { MTOOLS_ASSERT(i < size()); return _b[i]; }
+					T & front() const { MTOOLS_ASSERT(!empty()); return *_b; }
+					T & back() const { MTOOLS_ASSERT(!empty()); return *(_e - 1); }
+
+					/** Copy the list into a vector. */
+					operator std::vector<int>() const { return std::vector<int>(_b, _e); }
+
+				private:
+
+					T * _b;
+					T * _e;
+				};
+
+			typedef Range<int> NeighbourList;
+			typedef Range<const int> ConstNeighbourList;
+
+
+			/** Default constructor. Empty graph. */
+			CSRGraph() : _off(1, 0) {}
+
+
+			/**
+			 * Construct a graph with nbvertices vertices from the offset and adjacency arrays (which are
+			 * moved into the object).
+			 *
+			 * @param	off	The offsets: size nbvertices + 1, non-decreasing, with off[0] = 0 and
+			 * 				off[nbvertices] = adj.size().
+			 * @param	adj	The neighbours of all the vertices, one after another.
+			 **/
+			CSRGraph(std::vector<int> && off, std::vector<int> && adj) : _off(std::move(off)), _adj(std::move(adj))
+				{
+				MTOOLS_INSURE((_off.size() > 0) && (_off.front() == 0) && (_off.back() == (int)_adj.size()));
+				}
+
+
+			/**
+			 * Construct the object from any graph (e.g. a std::vector<std::vector<int> >). The numbering
+			 * of the vertices and the order of the neighbours are preserved.
+			 **/
+			template<typename GRAPH, typename = typename std::enable_if<!std::is_same<typename std::decay<GRAPH>::type, CSRGraph>::value>::type>
+			explicit CSRGraph(const GRAPH & gr)
+				{
+				fromGraph(gr);
+				}
+
+
+			/** Set the object from any graph (e.g. a std::vector<std::vector<int> >). **/
+			template<typename GRAPH> void fromGraph(const GRAPH & gr)
+				{
+				const size_t l = gr.size();
+				_off.resize(l + 1);
+				_off[0] = 0;
+				for (size_t i = 0; i < l; i++) { _off[i + 1] = _off[i] + (int)gr[i].size(); }
+				_adj.resize(_off[l]);
+				int * p = _adj.data();
+				for (size_t i = 0; i < l; i++)
+					{
+					for (auto it = gr[i].begin(); it != gr[i].end(); ++it) { *(p++) = (int)(*it); }
+					}
+				}
+
+
+			/** Convert the object into another type of graph (e.g. a std::vector<std::vector<int> >). */
+			template<typename GRAPH> GRAPH toGraph() const
+				{
+				const size_t l = size();
+				GRAPH gr;
+				gr.resize(l);
+				for (size_t i = 0; i < l; i++) { gr[i].assign(_adj.data() + _off[i], _adj.data() + _off[i + 1]); }
+				return gr;
+				}
+
+
+			/** Number of vertices. */
+			size_t size() const { return _off.size() - 1; }
+
+
+			/** Query if the graph has no vertex. */
+			bool empty() const { return (_off.size() == 1); }
+
+
+			/** Number of oriented edges (i.e. sum of the degrees of the vertices). */
+			size_t nbOrientedEdges() const { return _adj.size(); }
+
+
+			/** Number of neighbours of vertex i. */
+			size_t degree(size_t i) const { MTOOLS_ASSERT(i < size()); return (size_t)(_off[i + 1] - _off[i]); }
+
+
+			/** The list of neighbours of vertex i. */
+			NeighbourList operator[](size_t i) { MTOOLS_ASSERT(i < size()); return NeighbourList(_adj.data() + _off[i], _adj.data() + _off[i + 1]); }
+
+
+			/** The list of neighbours of vertex i. */
+			ConstNeighbourList operator[](size_t i) const { MTOOLS_ASSERT(i < size()); return ConstNeighbourList(_adj.data() + _off[i], _adj.data() + _off[i + 1]); }
+
+
+			/** The offset array (size() + 1 elements). */
+			const std::vector<int> & offsets() const { return _off; }
+
+
+			/** The adjacency array (nbOrientedEdges() elements). */
+			const std::vector<int> & adjacency() const { return _adj; }
+
+
+			/** Remove all the vertices. */
+			void clear() { _off.assign(1, 0); _adj.clear(); }
+
+
+			/** Swap the content with another graph. */
+			void swap(CSRGraph & gr) { _off.swap(gr._off); _adj.swap(gr._adj); }
+
+
+			/** Equality operator (same number of vertices and same lists of neighbours). */
+			bool operator==(const CSRGraph & gr) const { return ((_off == gr._off) && (_adj == gr._adj)); }
+			bool operator!=(const CSRGraph & gr) const { return !(operator==(gr)); }
+
+
+		private:
+
+			std::vector<int> _off;	// offsets of the list of neighbours of each vertex (with a sentinel at the end)
+			std::vector<int> _adj;	// neighbours of all the vertices
+		};
+
+
+	}
+
+
+/* end of file */
+
@@ -0,0 +1,256 @@
+/** @file doubledouble.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../misc/internal/mtools_export.hpp"
+#include "../misc/misc.hpp"
+#include "../misc/error.hpp"
+#include "vec.hpp"
+
+#include <cmath>
+#include <cctype>
+#include <string>
+#include <ostream>
+
+
+namespace mtools
+    {
+
+
+    /**
+     * Double-double floating point number.
+     *
+     * The value is represented as the unevaluated sum hi + lo of two doubles with |lo| <= ulp(hi)/2,
+     * which gives about 32 significant decimal digits (but the same exponent range as a double).
+     * The arithmetic operations use error-free transformations (two-sum and fma based two-product)
+     * so they are only a few times slower than with plain doubles.
+     *
+     * Used to describe positions in the plane with more precision than a double allows, e.g. the
+     * reference point of deep zooms in the RangeManager and the PlaneDrawer.
+     **/
+    class DoubleDouble
+        {
+
+        public:
+
+            double hi;  ///< leading part
+            double lo;  ///< trailing part
+
+
+            /** Default constructor. Set to zero. */
+            DoubleDouble() : hi(0.0), lo(0.0) {}
+
+
+            /** Constructor from a double. */
+            DoubleDouble(double x) : hi(x), lo(0.0) {}
+
+
+            /** Constructor from the sum of two doubles (which do not need to be normalized). */
+            DoubleDouble(double h, double l) { hi = _twoSum(h, l, lo); }
+
+
+            /**
+             * Constructor from a decimal string of the form [+|-]digits[.digits][e|E[+|-]digits] (all
+             * the digits are taken into account). Set to zero if the string cannot be parsed.
+             **/
+            explicit DoubleDouble(const std::string & s) : hi(0.0), lo(0.0)
+                {
+                size_t i = 0;
+                const size_t n = s.size();
+                while ((i < n) && (std::isspace((unsigned char)s[i]))) i++;
+                bool neg = false;
+                if ((i < n) && ((s[i] == '+') || (s[i] == '-'))) { neg = (s[i] == '-'); i++; }
+                DoubleDouble x;
+                int exp10 = 0;
+                bool dot = false, digit = false;
+                for (; i < n; i++)
+                    {
+                    const char c = s[i];
+                    if ((c >= '0') && (c <= '9')) { x = x * 10.0 + (double)(c - '0'); if (dot) exp10--; digit = true; }
+                    else if ((c == '.') && (!dot)) { dot = true; }
+                    else break;
+                    }
+                if (!digit) return;
+                if ((i < n) && ((s[i] == 'e') || (s[i] == 'E')))
+                    {
+                    i++;
+                    bool eneg = false;
+                    if ((i < n) && ((s[i] == '+') || (s[i] == '-'))) { eneg = (s[i] == '-'); i++; }
+                    int e = 0;
+                    for (; (i < n) && (s[i] >= '0') && (s[i] <= '9'); i++) { if (e < 100000) e = 10 * e + (s[i] - '0'); }
+                    exp10 += (eneg ? -e : e);
+                    }
+                x = (exp10 >= 0) ? (x * pow10(exp10)) : (x / pow10(-exp10));
+                *this = (neg ? -x : x);
+                }
+
+
+            /** Return the value rounded to the nearest double. */
+            double toDouble() const { return hi + lo; }
+
+
+            /** Explicit conversion to double. */
+            explicit operator double() const { return hi + lo; }
+
+
+            /** Return 10^n (n >= 0). */
+            static DoubleDouble pow10(int n)
+                {
+                MTOOLS_ASSERT(n >= 0);
+                DoubleDouble r(1.0), p(10.0);
+                while (n > 0)
+                    {
+                    if (n & 1) r *= p;
+                    p *= p;
+                    n >>= 1;
+                    }
+                return r;
+                }
+
+
+            /**
+             * Decimal representation of the number (scientific notation).
+             *
+             * @param   digits  (Optional) The number of significant digits (at most 32).
+             **/
+            std::string toString(int digits = 32) const
+                {
+                if (digits < 1) digits = 1;
+                if (digits > 32) digits = 32;
+                if (std::isnan(hi)) return std::string("nan");
+                if (std::isinf(hi)) return std::string((hi > 0) ? "inf" : "-inf");
+                if (hi == 0.0) return std::string("0");
+                DoubleDouble x = ((hi < 0) ? -(*this) : (*this));
+                int e = (int)std::floor(std::log10(x.hi));
+                x = (e >= 0) ? (x / pow10(e)) : (x * pow10(-e));
+                if (x.hi >= 10.0) { x /= 10.0; e++; }
+                if (x.hi < 1.0) { x *= 10.0; e--; }
+                std::string res((hi < 0) ? "-" : "");
+                for (int k = 0; k < digits; k++)
+                    {
+                    int d = (int)std::floor(x.hi);
+                    if (d < 0) d = 0;
+                    if (d > 9) d = 9;
+                    res += (char)('0' + d);
+                    if ((k == 0) && (digits > 1)) res += '.';
+                    x = (x - (double)d) * 10.0;
+                    }
+                res += "e" + std::to_string(e);
+                return res;
+                }
+
+
+            DoubleDouble operator-() const { DoubleDouble r; r.hi = -hi; r.lo = -lo; return r; }
+
+            DoubleDouble & operator+=(const DoubleDouble & y) { *this = (*this) + y; return *this; }
+            DoubleDouble & operator-=(const DoubleDouble & y) { *this = (*this) - y; return *this; }
+            DoubleDouble & operator*=(const DoubleDouble & y) { *this = (*this) * y; return *this; }
+            DoubleDouble & operator/=(const DoubleDouble & y) { *this = (*this) / y; return *this; }
+
+
+            /** Addition. */
+            friend DoubleDouble operator+(const DoubleDouble & a, const DoubleDouble & b)
+                {
+                double e1, e2;
+                const double s = _twoSum(a.hi, b.hi, e1);
+                const double t = _twoSum(a.lo, b.lo, e2);
+                double h = _quickTwoSum(s, e1 + t, e1);
+                DoubleDouble r;
+                r.hi = _quickTwoSum(h, e1 + e2, r.lo);
+                return r;
+                }
+
+            /** Subtraction. */
+            friend DoubleDouble operator-(const DoubleDouble & a, const DoubleDouble & b) { return a + (-b); }
+
+
+            /** Multiplication. */
+            friend DoubleDouble operator*(const DoubleDouble & a, const DoubleDouble & b)
+                {
+                const double p = a.hi * b.hi;
+                const double e = std::fma(a.hi, b.hi, -p) + (a.hi * b.lo + a.lo * b.hi);
+                DoubleDouble r;
+                r.hi = _quickTwoSum(p, e, r.lo);
+                return r;
+                }
+
+
+            /** Division. */
+            friend DoubleDouble operator/(const DoubleDouble & a, const DoubleDouble & b)
+                {
+                const double q1 = a.hi / b.hi;
+                const DoubleDouble r = a - b * q1;
+                const double q2 = r.hi / b.hi;
+                const DoubleDouble r2 = r - b * q2;
+                const double q3 = r2.hi / b.hi;
+                DoubleDouble q;
+                q.hi = _quickTwoSum(q1, q2, q.lo);
+                return q + q3;
+                }
+
+
+            friend bool operator==(const DoubleDouble & a, const DoubleDouble & b) { return ((a.hi == b.hi) && (a.lo == b.lo)); }
+            friend bool operator!=(const DoubleDouble & a, const DoubleDouble & b) { return ((a.hi != b.hi) || (a.lo != b.lo)); }
+            friend bool operator<(const DoubleDouble & a, const DoubleDouble & b) { return ((a.hi < b.hi) || ((a.hi == b.hi) && (a.lo < b.lo))); }
+            friend bool operator>(const DoubleDouble & a, const DoubleDouble & b) { return (b < a); }
+            friend bool operator<=(const DoubleDouble & a, const DoubleDouble & b) { return (!(b < a)); }
+            friend bool operator>=(const DoubleDouble & a, const DoubleDouble & b) { return (!(a < b)); }
+
+
+            /** Absolute value. */
+            friend DoubleDouble abs(const DoubleDouble & a) { return ((a.hi < 0.0) ? -a : a); }
+
+
+            /** Print the number with all its digits. */
+            friend std::ostream & operator<<(std::ostream & os, const DoubleDouble & a) { os << a.toString(); return os; }
+
+
+        private:
+
+            /* s = a + b exactly as s + err */
+            static MTOOLS_FORCEINLINE double _twoSum(double a, double b, double & err)
+                {
+                const double s = a + b;
+                const double bb = s - a;
+                err = (a - (s - bb)) + (b - bb);
+                return s;
+                }
+
+            /* same as _twoSum() when |a| >= |b| */
+            static MTOOLS_FORCEINLINE double _quickTwoSum(double a, double b, double & err)
+                {
+                const double s = a + b;
+                err = b - (s - a);
+                return s;
+                }
+
+        };
+
+
+    /** A 2 dimensional vector with double-double coordinates. */
+    typedef Vec<DoubleDouble, 2> ddVec2;
+
+
+    }
+
+
+/* end of file */
+
@@ -28,6 +28,12 @@
 #include "box.hpp"
 #include "../random/classiclaws.hpp"
 #include "permutation.hpp"
+#include "csrgraph.hpp"
+#include "../random/gen_xorgen4096_64.hpp"
+#include "../misc/internal/threadworker.hpp"
+
+#include <vector>
+#include <bitset>
 
 
 namespace mtools
@@ -44,6 +50,8 @@ namespace mtools
 	*                
 	* When weight > 1, there are weight adlissible rooting of the word that
 	* satisfy the prefix condition.
+	* 
+	* The word is stored with one bit per letter (bit set <-> up).
 	*
 	* NOTE: the case weight > 1 encode the set of tree considered by Poulalhon and Schaeffer                
 	*       for their bijection with simple planar triangulation. 
@@ -56,9 +64,8 @@ namespace mtools
 			/** default ctor. Empty dyck word with 1 ups and weight 1.  
 			 *  The corresponding tree is reduced to a single edge.
 			 **/
-			DyckWord() : _weight(1), _nup(1), _root(0), _vec(3, 0)
+			DyckWord() : _weight(1), _nup(1), _root(0), _len(3), _bits(1, 1)
 				{
-				_vec[0] = 1;
 				}
 
 
@@ -69,8 +76,10 @@ namespace mtools
 				{
 				MTOOLS_ASSERT(weight > 0);
 				MTOOLS_ASSERT(nup >= 0);
-				_vec.resize((_weight == 1) ? (2 * _nup + 1) : ((1 + _weight)*_nup + (_weight - 1)));
-				for (int i = 0; i < _nup; i++) { _vec[i] = 1; }
+				_len = ((_weight == 1) ? (2 * _nup + 1) : ((1 + _weight)*_nup + (_weight - 1)));
+				_bits.assign((size_t)((_len + 63) / 64), 0);
+				for (size_t k = 0; k < (size_t)(_nup / 64); k++) { _bits[k] = ~((uint64)0); }
+				if (_nup % 64) { _bits[_nup / 64] = (((uint64)1) << (_nup % 64)) - 1; }
 				}
 
 
@@ -78,37 +87,40 @@ namespace mtools
 			 * Shuffles the world uniformly. 
 			 * 
 			 * If weight > 1, there are weight possible choices that make a legal word.
+			 * 
+			 * The letters are drawn by blocks in parallel, each block using its own generator seeded 
+			 * from gen so the result does not depend on the number of threads. 
 			 *   
+			 * @param	gen		  	the random number generator.
 			 * @param	upminimum	true to choose a rooting such that the word start with 
 			 * 						an up. False to choose any rooting possible rooting uniformly
 			 * 						among the weight possible ones (there is only one legal rooting
 			 * 						when weight = 1).  
+			 * @param	nbthreads	number of threads to use (0 = number of hardware threads). 
 			 **/
-			template<typename random_t> void shuffle(random_t gen,bool upminimum = true)
+			template<typename random_t> void shuffle(random_t & gen, bool upminimum = true, int nbthreads = 0)
 				{
-				randomShuffle(_vec, gen); // shuffle the word.
+				_randomize(gen, nbthreads); // shuffle the word.
 				reroot(); // find a minimum that always start with an up. 
 				if ((_weight == 1) || (upminimum)) return; // done
 				// choose another rooting uniformly among all other.
-				const int l = (int)_vec.size();
 				int mx = -((int)(Unif(gen)*_weight)); // there are _weight choices
 				if (mx == 0) return;
-				int x = 0;
-				for (int i = 0; i < l; i++)
-					{
-					x += ((this->operator[](i) == 0) ? -1 : _weight);
-					if (x == mx) { _root = ((_root + i + 1) % l); return; }
-					}
-				MTOOLS_ERROR("should not be possible...");
+				const _ByteTable T(_weight);
+				int64 x = 0;
+				int64 p = _walkUntilBelow(_root, _len, x, mx + 1, T);
+				if (p == _len) { p = _walkUntilBelow(0, _root, x, mx + 1, T); }
+				MTOOLS_INSURE(x == mx); // should not be possible otherwise...
+				_root = (int)((p + 1) % _len);
 				}
 
 
 			/** Access a Dyck word letter (circular). **/
-			const char & operator[](int i) const
+			char operator[](int i) const
 				{
-				const int l = (int)_vec.size();
-				const int p = i + _root;
-				return _vec[(p%l) + ((p<0) ? l : 0)];
+				int64 p = (int64)i + _root;
+				if ((p < 0) || (p >= _len)) { p %= _len; if (p < 0) { p += _len; } }
+				return (char)((_bits[(size_t)(p >> 6)] >> (p & 63)) & 1);
 				}
 
 
@@ -118,7 +130,7 @@ namespace mtools
 			* weight > 1: this is (1 + weight)*nup + (weight - 1) [the word is rooted at a bud 
 			*             so the word ends when the RW reaches -(weigth-1)]
 			**/
-			inline int length() const { return (int)_vec.size(); }
+			inline int length() const { return _len; }
 
 
 			/**
@@ -147,6 +159,30 @@ namespace mtools
 			inline int nups() const { return _nup; }
 
 
+			/**
+			* Construct the tree encoded by the word directly (without creating the CombinatorialMap).
+			* 
+			* The numbering of the vertices and the order of the neighbours are the same as for 
+			* CombinatorialMap(dw).toGraph<GRAPH>(). The word is read sequentially and no other memory 
+			* than the graph itself (and a stack of size the height of the tree) is used. 
+			**/
+			template<typename GRAPH> GRAPH toGraph() const
+				{
+				GRAPH gr;
+				_toGraph(gr);
+				return gr;
+				}
+
+
+			/**
+			* Default choice for graph is std::vector<std::vector<int> >
+			**/
+			std::vector<std::vector<int> > toGraph() const
+				{
+				return toGraph< std::vector<std::vector<int> > >();
+				}
+
+
 			/**
 			* Print the word into a string
 			**/
@@ -154,7 +190,7 @@ namespace mtools
 				{
 				OSS os; 
 				os << "[";
-				for (int i = 0; i < (int)_vec.size(); i++) { os <<  ((this->operator[](i))*_weight + '0'); }
+				for (int i = 0; i < _len; i++) { os <<  ((this->operator[](i))*_weight + '0'); }
 				os << "]";
 				return os.str();
 				}
@@ -169,13 +205,118 @@ namespace mtools
 				Archive & _weight;
 				Archive & _nup;
 				Archive & _root;
-				Archive & _vec;
+				Archive & _len;
+				Archive & _bits;
 				}
 
 
 		private:
 
 
+			/* Variation of the walk (and its minimum) for each possible byte. */
+			struct _ByteTable
+				{
+				_ByteTable(int weight)
+					{
+					for (int b = 0; b < 256; b++)
+						{
+						int x = 0, m = 8 * weight;
+						for (int k = 0; k < 8; k++) { x += (((b >> k) & 1) ? weight : -1); if (x < m) { m = x; } }
+						sum[b] = x; 
+						min[b] = m;
+						}
+					}
+				int sum[256];	// variation of the walk along the byte
+				int min[256];	// minimum of the walk after each letter of the byte
+				};
+
+
+			/* Walk along the letters in [a,b) starting at height x. Return the first index i such that 
+			   the walk after letter i is strictly below level (x is then this height) or b if there
+			   is none (x is then the height at the end). Words are skipped at once when the walk 
+			   cannot go below level inside them. */
+			int64 _walkUntilBelow(int64 a, int64 b, int64 & x, int64 level, const _ByteTable & T) const
+				{
+				const int64 w = _weight;
+				int64 p = a;
+				while (p < b)
+					{
+					if (((p & 63) == 0) && (p + 64 <= b))
+						{
+						const uint64 v = _bits[(size_t)(p >> 6)];
+						const int64 nu = (int64)std::bitset<64>(v).count();
+						if (x - (64 - nu) >= level) { x += nu*w - (64 - nu); p += 64; continue; }
+						for (int k = 0; k < 8; k++, p += 8)
+							{
+							const int c = (int)((v >> (8 * k)) & 255);
+							if (x + T.min[c] >= level) { x += T.sum[c]; continue; }
+							for (int j = 0; j < 8; j++, p++)
+								{
+								x += (((c >> j) & 1) ? w : -1);
+								if (x < level) return p;
+								}
+							}
+						continue;
+						}
+					x += (((_bits[(size_t)(p >> 6)] >> (p & 63)) & 1) ? w : -1);
+					if (x < level) return p;
+					p++;
+					}
+				return b;
+				}
+
+
+			/* Replace the word by a uniform word with _nup ups. Letters are first drawn iid with
+			   a probability close to _nup/_len to be an up (in parallel), then uniformly chosen letters 
+			   are flipped until there are exactly _nup ups. The law of the word is invariant by 
+			   permutation of the letters at each step so the final word is uniform. */
+			template<typename random_t> void _randomize(random_t & gen, int nbthreads)
+				{
+				const int64 l = _len;
+				const int64 nw = (int64)_bits.size();
+				// each letter is an up with probability j/2^16 (close to _nup/_len)
+				int64 j = (int64)(65536.0 * _nup / l + 0.5);
+				if (j < 1) { j = 1; } else if (j > 65535) { j = 65535; }
+				int t = 0; while (((j >> t) & 1) == 0) { t++; }
+				const int64 BLOCK = 65536; // number of words per block
+				const int64 nblocks = (nw + BLOCK - 1) / BLOCK;
+				std::vector<uint64> seeds((size_t)nblocks);
+				std::vector<int64> counts((size_t)nblocks, 0);
+				for (int64 k = 0; k < nblocks; k++) { seeds[(size_t)k] = Unif_64(gen); }
+				parallelFor(nblocks, [&](int64 k)
+					{
+					XorGen4096_64 g(seeds[(size_t)k]);
+					const int64 w1 = std::min<int64>(nw, (k + 1) * BLOCK);
+					int64 c = 0;
+					for (int64 i = k * BLOCK; i < w1; i++)
+						{ // each bit is set with probability j/2^16 (bitsliced comparison with a uniform)
+						uint64 v = g();
+						for (int r = t + 1; r < 16; r++) { v = (((j >> r) & 1) ? (v | g()) : (v & g())); }
+						if ((i == nw - 1) && (l % 64)) { v &= ((((uint64)1) << (l % 64)) - 1); }
+						_bits[(size_t)i] = v;
+						c += (int64)std::bitset<64>(v).count();
+						}
+					counts[(size_t)k] = c;
+					}, nbthreads);
+				int64 c = 0;
+				for (int64 k = 0; k < nblocks; k++) { c += counts[(size_t)k]; }
+				while (c > _nup)
+					{
+					const int64 i = (int64)(Unif(gen) * l);
+					uint64 & v = _bits[(size_t)(i >> 6)];
+					const uint64 m = ((uint64)1) << (i & 63);
+					if (v & m) { v &= ~m; c--; }
+					}
+				while (c < _nup)
+					{
+					const int64 i = (int64)(Unif(gen) * l);
+					uint64 & v = _bits[(size_t)(i >> 6)];
+					const uint64 m = ((uint64)1) << (i & 63);
+					if (!(v & m)) { v |= m; c++; }
+					}
+				}
+
+
 			/**
 			 * Reroots the word such that it satisfies the prefix condition but
 			 * also that it starts with an up. 
@@ -183,22 +324,118 @@ namespace mtools
 			inline void reroot()
 				{
 				if (_nup == 0) { _root = 0; return; }
-				const int l = (int)_vec.size();
-				for (int i = 0; i < l; i++) { if (_vec[i] != 0) { _root = i; } } // choose root such that the word start with an up
-				int x = 0, min_x = 0, min_index = 0;
-				for (int i = 0; i < l; i++) // find the absolute minimum.
+				// choose root such that the word start with an up (ie the last up).
+				int64 r = (int64)_bits.size() - 1;
+				while (_bits[(size_t)r] == 0) { r--; }
+				int b = 63; while (((_bits[(size_t)r] >> b) & 1) == 0) { b--; }
+				const int64 r0 = 64 * r + b;
+				// find the first absolute minimum of the walk started at r0.
+				const _ByteTable T(_weight);
+				int64 x = 0, min_x = 0, min_pos = r0;
+				for (int pass = 0; pass < 2; pass++)
 					{
-					x += ((this->operator[](i) == 0) ? -1 : _weight);
-					if (x < min_x) { min_x = x; min_index = i; }
+					const int64 a = ((pass == 0) ? r0 : 0);
+					const int64 e = ((pass == 0) ? (int64)_len : r0);
+					int64 p = a;
+					while (p < e)
+						{
+						p = _walkUntilBelow(p, e, x, min_x, T);
+						if (p < e) { min_x = x; min_pos = p; p++; }
+						}
 					}
-				_root = ((_root + min_index + 1) % l); // reroot, if the min is in the interior of the interval, it must start again with an up...
+				_root = (int)((min_pos + 1) % _len); // reroot, if the min is in the interior of the interval, it must start again with an up...
 				}
 
 
-			int _weight;			// weight of the ups
-			int _nup;				// number of ups. 
-			int _root;				// position of the root
-			std::vector<char> _vec;	// the word itself
+			/* Walk around the tree encoded by the word and call add(v,u) each time u should be added to 
+			   the list of neighbours of v (in the order of the neighbours of CombinatorialMap(dw)). */
+			template<typename FUN> void _contour(FUN add) const
+				{
+				std::vector<int> st; // stack of the ancestors of the current vertex
+				st.reserve((int)(sqrt(_nup)) + 1);
+				int64 p = _root;
+				auto next = [&]() -> int // read the letters sequentially
+					{
+					const int c = (int)((_bits[(size_t)(p >> 6)] >> (p & 63)) & 1);
+					if (++p == _len) { p = 0; }
+					return c;
+					};
+				if (_weight == 1)
+					{
+					const int n = nbedges();
+					int cur = 0, nbv = 1;
+					for (int i = 0; i < 2 * n; i++)
+						{
+						if (next() == 1) { const int c = nbv++; add(cur, c); st.push_back(cur); cur = c; }
+						else { add(cur, st.back()); cur = st.back(); st.pop_back(); }
+						}
+					return;
+					}
+				const int nbuds = _weight - 1;
+				std::vector<int> buds_passed;
+				buds_passed.reserve((int)(sqrt(_nup)) + 1);
+				buds_passed.push_back(1); // passed one bud at height 0 (the root leaf)
+				add(0, 1);
+				int cur = 1, nbv = 2, h = 0;
+				for (int i = 0; i < _len - 1; i++)
+					{
+					if (next() == 1)
+						{
+						const int c = nbv++;
+						add(cur, c); st.push_back(cur); cur = c;
+						buds_passed.push_back(0);
+						h++;
+						}
+					else
+						{
+						if (buds_passed[h] == nbuds)
+							{
+							h--;
+							add(cur, st.back()); cur = st.back(); st.pop_back();
+							buds_passed.pop_back();
+							}
+						else
+							{
+							++(buds_passed[h]);
+							const int c = nbv++;
+							add(cur, c); add(c, cur);
+							}
+						}
+					}
+				MTOOLS_ASSERT((h == 0) && (cur == 1));
+				add(1, 0);
+				}
+
+
+			/* convert to a graph, private method */
+			template<typename GRAPH> void _toGraph(GRAPH & gr) const
+				{
+				gr.clear();
+				gr.resize(nbedges() + 1);
+				_contour([&](int v, int u) { gr[v].push_back(u); });
+				}
+
+
+			/* same as above, in two passes over the word */
+			void _toGraph(CSRGraph & gr) const
+				{
+				const int nbv = nbedges() + 1;
+				std::vector<int> off(nbv + 1, 0);
+				_contour([&](int v, int) { off[v + 1]++; });
+				for (int v = 0; v < nbv; v++) { off[v + 1] += off[v]; }
+				std::vector<int> adj(off[nbv]);
+				_contour([&](int v, int u) { adj[off[v]++] = u; }); // off[v] now points to the end of the list of v
+				for (int v = nbv; v > 0; v--) { off[v] = off[v - 1]; }
+				off[0] = 0;
+				gr = CSRGraph(std::move(off), std::move(adj));
+				}
+
+
+			int _weight;				// weight of the ups
+			int _nup;					// number of ups. 
+			int _root;					// position of the root
+			int _len;					// length of the word
+			std::vector<uint64> _bits;	// the word itself, one bit per letter (1 = up)
 
 		};
 
@@ -207,4 +444,3 @@ namespace mtools
 	}
 
 /* end of file */
-
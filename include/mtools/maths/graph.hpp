@@ -29,6 +29,11 @@
 #include "../random/classiclaws.hpp"
 #include "permutation.hpp"
 #include "combinatorialmap.hpp"
+#include "csrgraph.hpp"
+#include "../misc/internal/threadworker.hpp"
+
+#include <atomic>
+#include <memory>
 
 namespace mtools
 	{
@@ -37,6 +42,7 @@ namespace mtools
 	typedef std::vector<std::vector<int> >	Graph1;
 	typedef std::vector<std::deque<int> >	Graph2;
 	typedef std::vector<std::list<int> >	Graph3;
+	typedef CSRGraph						Graph4;	// compressed sparse row format: best for large graphs.
 
 	typedef Graph1 Graph; // default choice. 
 
@@ -87,6 +93,66 @@ namespace mtools
 		}
 
 
+	/** Specialization for CSRGraph: the new arrays are filled in a single pass. **/
+	template<> inline CSRGraph permuteGraph<CSRGraph>(const CSRGraph & graph, const Permutation & perm)
+		{
+		const size_t l = graph.size();
+		MTOOLS_INSURE(perm.size() == l);
+		std::vector<int> off(l + 1);
+		off[0] = 0;
+		for (size_t i = 0; i < l; i++) { off[i + 1] = off[i] + (int)graph.degree(perm[i]); }
+		std::vector<int> adj(off[l]);
+		int * p = adj.data();
+		for (size_t i = 0; i < l; i++)
+			{
+			for (int j : graph[perm[i]]) { *(p++) = perm.inv(j); }
+			}
+		return CSRGraph(std::move(off), std::move(adj));
+		}
+
+
+	namespace internals_graph
+		{
+
+		/* conversion between graph types (used by convertGraph() which cannot be partially specialized) */
+		template<typename GRAPH_A, typename GRAPH_B> struct GraphConverter
+			{
+			static GRAPH_B convert(const GRAPH_A & graph)
+				{
+				GRAPH_B res;
+				const size_t l = graph.size();
+				if (l == 0) return res;
+				res.resize(l);
+				for (size_t i = 0; i < l; i++)
+					{
+					auto & lv1 = graph[i];
+					auto & lv2 = res[i];
+					for (auto it = lv1.begin(); it != lv1.end(); ++it) { lv2.push_back(*it); }
+					}
+				return res;
+				}
+			};
+
+		/* conversion to a CSRGraph */
+		template<typename GRAPH_A> struct GraphConverter<GRAPH_A, CSRGraph>
+			{
+			static CSRGraph convert(const GRAPH_A & graph) { CSRGraph res; res.fromGraph(graph); return res; }
+			};
+
+		/* conversion from a CSRGraph: each list is created with its final size */
+		template<typename GRAPH_B> struct GraphConverter<CSRGraph, GRAPH_B>
+			{
+			static GRAPH_B convert(const CSRGraph & graph) { return graph.toGraph<GRAPH_B>(); }
+			};
+
+		template<> struct GraphConverter<CSRGraph, CSRGraph>
+			{
+			static CSRGraph convert(const CSRGraph & graph) { return graph; }
+			};
+
+		}
+
+
 
 
 	/**
@@ -94,17 +160,7 @@ namespace mtools
 	**/
 	template<typename GRAPH_A, typename GRAPH_B> GRAPH_B convertGraph(const GRAPH_A & graph)
 		{
-		GRAPH_B res;
-		const size_t l = graph.size();
-		if (l == 0) return res;
-		res.resize(l);
-		for (size_t i = 0; i < l; i++)
-			{
-			auto & lv1 = graph[i];
-			auto & lv2 = res[i];
-			for (auto it = lv1.begin(); it != lv1.end(); ++it) { lv2.push_back(*it); }
-			}
-		return res;
+		return internals_graph::GraphConverter<GRAPH_A, GRAPH_B>::convert(graph);
 		}
 
 
@@ -130,6 +186,23 @@ namespace mtools
 		}
 
 
+	/** Specialization for CSRGraph. **/
+	template<> inline CSRGraph resizeGraph<CSRGraph>(const CSRGraph & graph, size_t newSize)
+		{
+		MTOOLS_ASSERT(newSize <= graph.size());
+		std::vector<int> off(newSize + 1);
+		std::vector<int> adj;
+		adj.reserve(graph.offsets()[newSize]);
+		off[0] = 0;
+		for (size_t i = 0; i < newSize; i++)
+			{
+			for (int j : graph[i]) { if (j < (int)newSize) adj.push_back(j); }
+			off[i + 1] = (int)adj.size();
+			}
+		return CSRGraph(std::move(off), std::move(adj));
+		}
+
+
 
 	
 	namespace internals_graph
@@ -183,6 +256,29 @@ namespace mtools
 		}
 
 
+	/** Specialization for CSRGraph: the lists are rotated in place. **/
+	template<> inline void rotateGraphNeighbourList<CSRGraph>(CSRGraph & gr, const std::vector<int> & bound)
+		{
+		for (size_t i = 0; i < gr.size(); i++)
+			{
+			if (bound[i] > 0)
+				{
+				auto L = gr[i];
+				const size_t m = L.size();
+				size_t k;
+				for (k = 0; k < m; k++)
+					{
+					if ((bound[L[k]] > 0) && (bound[L[(k + 1) % m]] > 0))
+						{
+						std::rotate(L.begin(), L.begin() + ((k + 1) % m), L.end()); k = m + 2;
+						}
+					}
+				MTOOLS_INSURE(k == (m + 3));
+				}
+			}
+		}
+
+
 
 
 	/**
@@ -228,7 +324,8 @@ namespace mtools
 	* Explore the graph starting from a given set of vertices.
 	* use breadth-first search. Each vertex is visited only once.
 	*
-	* Accept a lambda functions.
+	* Accept a lambda functions (the visitor is a template parameter so the call is inlined, a
+	* std::function may also be used).
 	*
 	* See the implementation method computeDistances() below for an example of how to use it.
 	*
@@ -242,7 +339,7 @@ namespace mtools
 	*
 	* @return	the total number of vertices visited.
 	**/
-	template<typename GRAPH> int exploreGraph(const GRAPH & gr, const std::vector<int> & startset, std::function<bool(int, int)> fun)
+	template<typename GRAPH, typename FUN> int exploreGraph(const GRAPH & gr, const std::vector<int> & startset, FUN fun)
 		{
 		const size_t l = gr.size();
 		std::vector<char> vis(l, 0);
@@ -286,6 +383,43 @@ namespace mtools
 		}
 
 
+	/**
+	 * Overload for CSRGraph. The vertices are stored in a single queue: the vertices at
+	 * distance d are contiguous so the queue is also the list of the vertices in order of
+	 * visit and the neighbours are read directly from the adjacency array.
+	 **/
+	template<typename FUN> int exploreGraph(const CSRGraph & gr, const std::vector<int> & startset, FUN fun)
+		{
+		const size_t l = gr.size();
+		const int * off = gr.offsets().data();
+		const int * adj = gr.adjacency().data();
+		std::vector<char> vis(l, 0);
+		std::vector<int> queue(l + startset.size());
+		size_t head = 0, tail = 0;
+		for (int v : startset) { vis[v] = 1; queue[tail++] = v; }
+		int sum = (int)startset.size();
+		int d = 0;
+		while (head < tail)
+			{
+			const size_t end = tail;	// end of the vertices at distance d
+			for (; head < end; head++)
+				{
+				const int k = queue[head];
+				if (fun(k, d))
+					{
+					for (int e = off[k]; e < off[k + 1]; e++)
+						{
+						const int n = adj[e];
+						if (vis[n] == 0) { vis[n] = 1; queue[tail++] = n; sum++; }
+						}
+					}
+				}
+			d++;
+			}
+		return sum;
+		}
+
+
 	/**
 	* Explore the graph starting from a root vertex and following the oriented edges.
 	* use breadth-first search. Each vertex is visited only once.
@@ -304,7 +438,7 @@ namespace mtools
 	*
 	* @return	the total number of vertices visited.
 	**/
-	template<typename GRAPH> int exploreGraph(const GRAPH & gr, int origin, std::function<bool(int, int)> fun)
+	template<typename GRAPH, typename FUN> int exploreGraph(const GRAPH & gr, int origin, FUN fun)
 		{
 		std::vector<int> startvec(1, origin);
 		return exploreGraph(gr, startvec, fun);
@@ -348,9 +482,236 @@ namespace mtools
 		}
 
 
+
+	namespace internals_graph
+		{
+
+		/**
+		 * Multithreaded direction-optimizing breadth-first search of an undirected graph.
+		 *
+		 * While the frontier is small, the search goes top-down: the neighbours of the vertices of the
+		 * frontier are claimed with an atomic operation on the visited bitmap. When the edges leaving
+		 * the frontier become a significant fraction of the unexplored edges, the search switches to
+		 * bottom-up steps: every unvisited vertex looks for a neighbour in the frontier and stops at
+		 * the first one found (which skips most of the edges in the middle of the search). It switches
+		 * back to top-down once the frontier is small again. In bottom-up steps, each task handles a
+		 * block of consecutive vertices (a multiple of 64) so it owns whole words of the bitmaps.
+		 *
+		 * The distances do not depend on the number of threads.
+		 *
+		 * @param	gr		  	The graph (must be undirected).
+		 * @param	sources   	The set of vertices at distance 0.
+		 * @param	dist	  	[out] dist[v] = distance of v from the sources (-1 if not reachable).
+		 * @param	nbthreads	Number of threads to use (0 for all the hardware threads).
+		 **/
+		template<typename GRAPH> void parallelBFS(const GRAPH & gr, const std::vector<int> & sources, std::vector<int> & dist, int nbthreads)
+			{
+			const int64 ALPHA = 14;			// switch to bottom-up when the frontier has more than (unexplored edges)/ALPHA edges
+			const int64 BETA = 24;			// switch back to top-down when the frontier has less than n/BETA vertices
+			const int64 CHUNK = 1024;		// number of frontier vertices per task in top-down steps
+			const int64 BLOCK = 64 * 64;	// number of vertices per task in bottom-up steps (multiple of 64)
+			const int64 n = (int64)gr.size();
+			const int64 nw = (n + 63) / 64;
+			dist.assign((size_t)n, -1);
+			if (n == 0) return;
+			std::unique_ptr<std::atomic<uint64>[]> visited(new std::atomic<uint64>[(size_t)nw]);
+			for (int64 i = 0; i < nw; i++) { visited[i].store(0, std::memory_order_relaxed); }
+			std::vector<uint64> front((size_t)nw, 0);
+			std::vector<uint64> next((size_t)nw, 0);
+			std::vector<int> frontier;
+			int64 mu = 0; // number of unexplored (oriented) edges
+			for (int64 i = 0; i < n; i++) { mu += (int64)gr[i].size(); }
+			for (int v : sources)
+				{
+				MTOOLS_ASSERT((v >= 0) && (v < n));
+				if (dist[v] >= 0) continue;
+				dist[v] = 0;
+				visited[v >> 6].fetch_or(((uint64)1) << (v & 63), std::memory_order_relaxed);
+				frontier.push_back(v);
+				mu -= (int64)gr[v].size();
+				}
+			int64 nf = (int64)frontier.size();
+			bool topdown = true;
+			int d = 0;
+			while (nf > 0)
+				{
+				if (topdown)
+					{
+					int64 mf = 0;
+					for (int v : frontier) { mf += (int64)gr[v].size(); }
+					if (mf > mu / ALPHA)
+						{ // switch to bottom-up
+						topdown = false;
+						std::fill(front.begin(), front.end(), (uint64)0);
+						for (int v : frontier) { front[v >> 6] |= (((uint64)1) << (v & 63)); }
+						}
+					}
+				if (topdown)
+					{
+					const int64 nbchunks = (nf + CHUNK - 1) / CHUNK;
+					std::vector<std::vector<int> > found((size_t)nbchunks);
+					std::vector<int64> edges((size_t)nbchunks, 0);
+					parallelFor(nbchunks, [&](int64 c)
+						{
+						std::vector<int> & F = found[(size_t)c];
+						int64 e = 0;
+						const int64 end = std::min<int64>(nf, (c + 1)*CHUNK);
+						for (int64 i = c*CHUNK; i < end; i++)
+							{
+							const auto & L = gr[frontier[(size_t)i]];
+							for (auto it = L.begin(); it != L.end(); ++it)
+								{
+								const int v = (int)(*it);
+								const uint64 bit = ((uint64)1) << (v & 63);
+								std::atomic<uint64> & w = visited[v >> 6];
+								if (((w.load(std::memory_order_relaxed) & bit) == 0) && ((w.fetch_or(bit, std::memory_order_relaxed) & bit) == 0))
+									{ // v claimed by this task
+									dist[v] = d + 1;
+									F.push_back(v);
+									e += (int64)gr[v].size();
+									}
+								}
+							}
+						edges[(size_t)c] = e;
+						}, nbthreads);
+					frontier.clear();
+					for (int64 c = 0; c < nbchunks; c++) { frontier.insert(frontier.end(), found[(size_t)c].begin(), found[(size_t)c].end()); mu -= edges[(size_t)c]; }
+					nf = (int64)frontier.size();
+					}
+				else
+					{
+					const int64 nbblocks = (n + BLOCK - 1) / BLOCK;
+					std::vector<int64> count((size_t)nbblocks, 0);
+					std::vector<int64> edges((size_t)nbblocks, 0);
+					parallelFor(nbblocks, [&](int64 c)
+						{
+						const int64 start = c*BLOCK;
+						const int64 end = std::min<int64>(n, start + BLOCK);
+						int64 k = 0, e = 0;
+						for (int64 wi = (start >> 6); wi < ((end + 63) >> 6); wi++) { next[(size_t)wi] = 0; }
+						for (int64 v = start; v < end; v++)
+							{
+							const uint64 bit = ((uint64)1) << (v & 63);
+							if (visited[v >> 6].load(std::memory_order_relaxed) & bit) continue;
+							const auto & L = gr[v];
+							for (auto it = L.begin(); it != L.end(); ++it)
+								{
+								const int u = (int)(*it);
+								if (front[u >> 6] & (((uint64)1) << (u & 63)))
+									{
+									dist[v] = d + 1;
+									next[v >> 6] |= bit;
+									k++;
+									e += (int64)L.size();
+									break;
+									}
+								}
+							}
+						for (int64 wi = (start >> 6); wi < ((end + 63) >> 6); wi++) { visited[wi].fetch_or(next[(size_t)wi], std::memory_order_relaxed); }
+						count[(size_t)c] = k;
+						edges[(size_t)c] = e;
+						}, nbthreads);
+					nf = 0;
+					for (int64 c = 0; c < nbblocks; c++) { nf += count[(size_t)c]; mu -= edges[(size_t)c]; }
+					front.swap(next);
+					if (nf < n / BETA)
+						{ // switch back to top-down
+						topdown = true;
+						frontier.clear();
+						for (int64 wi = 0; wi < nw; wi++)
+							{
+							const uint64 w = front[(size_t)wi];
+							if (w == 0) continue;
+							for (int b = 0; b < 64; b++) { if (w & (((uint64)1) << b)) { frontier.push_back((int)(64 * wi + b)); } }
+							}
+						}
+					}
+				d++;
+				}
+			}
+
+		}
+
+
+	/**
+	 * Compute the distances from a set of vertices in an undirected graph using several threads.
+	 *
+	 * Return the same distances as computeGraphDistances() (with several start vertices) but uses
+	 * a direction-optimizing breadth-first search shared between the threads, see
+	 * internals_graph::parallelBFS(). Much faster for large graphs, especially with CSRGraph.
+	 *
+	 * @param	gr		  	The graph. Must be undirected: the bottom-up steps look for the parents
+	 * 						of a vertex among its neighbours.
+	 * @param	sources   	The set of vertices to compute the distance to.
+	 * @param	nbthreads	(Optional) Number of threads to use (0 for all the hardware threads).
+	 *
+	 * @return	a vector containing the distance for each vertex of the graph (-1 if not reachable).
+	 **/
+	template<typename GRAPH> std::vector<int> computeGraphDistancesParallel(const GRAPH & gr, const std::vector<int> & sources, int nbthreads = 0)
+		{
+		std::vector<int> dist;
+		internals_graph::parallelBFS(gr, sources, dist, nbthreads);
+		return dist;
+		}
+
+
+	/**
+	 * Multithreaded version of computeGraphDistances(gr, rootVertex, maxdistance, connected) for
+	 * undirected graphs.
+	 **/
+	template<typename GRAPH> std::vector<int> computeGraphDistancesParallel(const GRAPH & gr, int rootVertex, int & maxdistance, bool & connected, int nbthreads = 0)
+		{
+		std::vector<int> dist;
+		internals_graph::parallelBFS(gr, std::vector<int>(1, rootVertex), dist, nbthreads);
+		int md = 0;
+		connected = true;
+		for (int d : dist) { if (d > md) { md = d; } if (d < 0) { connected = false; } }
+		maxdistance = md;
+		return dist;
+		}
+
+
+	/**
+	 * Estimate the distribution of the distance between two vertices of an undirected graph.
+	 *
+	 * Breadth-first searches are performed from nbsamples sources chosen uniformly at random
+	 * (with computeGraphDistancesParallel()) and the distances from each source to all the
+	 * vertices are counted. Setting nbsamples = gr.size() does not give the exact distribution
+	 * because the sources are drawn with replacement.
+	 *
+	 * @param	gr		  	The graph (must be undirected).
+	 * @param	nbsamples 	Number of sources.
+	 * @param	gen		  	The random number generator.
+	 * @param	nbthreads	(Optional) Number of threads to use (0 for all the hardware threads).
+	 *
+	 * @return	a vector res where res[d] is the number of pairs (source, vertex) at distance d (the
+	 * 			pairs which are not connected are not counted).
+	 **/
+	template<typename GRAPH, typename random_t> std::vector<int64> sampleGraphDistances(const GRAPH & gr, int nbsamples, random_t & gen, int nbthreads = 0)
+		{
+		std::vector<int64> res;
+		const int64 n = (int64)gr.size();
+		if (n == 0) return res;
+		std::vector<int> dist;
+		for (int k = 0; k < nbsamples; k++)
+			{
+			const int source = (int)Unif_int(0, n - 1, gen);
+			internals_graph::parallelBFS(gr, std::vector<int>(1, source), dist, nbthreads);
+			for (int d : dist)
+				{
+				if (d < 0) continue;
+				if ((size_t)d >= res.size()) { res.resize((size_t)d + 1, 0); }
+				res[(size_t)d]++;
+				}
+			}
+		return res;
+		}
+
+
 	/* forward declaration */
 	struct GraphInfo;
 	template<typename GRAPH>  GraphInfo graphInfo(const GRAPH & gr);
+	template<typename GRAPH>  bool isGraphValid(const GRAPH & gr);
 
 
 	/** Structure holding informations about a graph. */
@@ -531,6 +892,15 @@ namespace mtools
 		}
 
 
+	/**  Specialization for CSRGraph (single pass over the adjacency array) **/
+	template<>  inline bool isGraphValid<CSRGraph>(const CSRGraph & gr)
+		{
+		const int nbv = (int)gr.size();
+		for (int j : gr.adjacency()) { if ((j < 0) || (j >= nbv)) { return false; } }
+		return true;
+		}
+
+
 	/** Queries if a graph is empty. **/
 	template<typename GRAPH>  bool isGraphEmpty(const GRAPH & gr) { return(gr.size() == 0); }
 
@@ -575,6 +945,18 @@ namespace mtools
 		return maxout;
 		}
 
+
+	/**
+	 * Specialization for CSRGraph (only reads the offsets).
+	 **/
+	template<>  inline int maxOutDegreeGraph<CSRGraph>(const CSRGraph & gr)
+		{
+		int maxout = 0;
+		const std::vector<int> & off = gr.offsets();
+		for (size_t i = 0; i + 1 < off.size(); i++) { if (off[i + 1] - off[i] > maxout) { maxout = off[i + 1] - off[i]; } }
+		return maxout;
+		}
+
 	
 
 	/**
@@ -0,0 +1,486 @@
+/** @file threadpool.hpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "../misc.hpp"
+#include "../error.hpp"
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <exception>
+#include <chrono>
+
+namespace mtools
+{
+
+    /**
+     * Return the number of hardware threads.
+     *
+     * @return  Number of hardware threads. 1 if not detected.
+     **/
+    inline int nbHardwareThreads()
+        {
+        unsigned int nb = std::thread::hardware_concurrency();
+        if (nb == 0) return 1;
+        return (int)nb;
+        }
+
+
+    /**
+     * Cancellation token.
+     *
+     * Copies of a token share the same flag: cancelling one copy cancels them all. Tasks submitted
+     * with a token are discarded if the token is cancelled before they start. Running tasks may poll
+     * cancelled() to stop early.
+     **/
+    class CancelToken
+        {
+
+        public:
+
+            /** Create a new (not cancelled) token. */
+            CancelToken() : _flag(std::make_shared<std::atomic<bool> >(false)) {}
+
+            /** Cancel the token (and all its copies). */
+            void cancel() { _flag->store(true); }
+
+            /** Query if the token is cancelled. */
+            MTOOLS_FORCEINLINE bool cancelled() const { return _flag->load(std::memory_order_relaxed); }
+
+        private:
+
+            std::shared_ptr<std::atomic<bool> > _flag;
+        };
+
+
+    /**
+     * Work stealing thread pool.
+     *
+     * At most concurrency() threads execute tasks at the same time. Each worker thread has its own
+     * deques of tasks: tasks submitted from inside a worker are pushed on its own deque (and popped
+     * in LIFO order) while tasks submitted from other threads go into a global queue. An idle worker
+     * first looks at its own deque, then at the global queue and finally steals the oldest task of
+     * another worker. Tasks with higher priority are always considered first.
+     *
+     * A task that must wait for an event (a message, another task...) should do so inside a
+     * BlockingScope: the pool then lets another thread execute tasks in the meantime so that cores are
+     * not left idle (and to prevent deadlocks).
+     *
+     * Threads are created lazily. Use ThreadPool::shared() to access the process-wide pool.
+     **/
+    class ThreadPool
+        {
+
+        public:
+
+            static const int PRIORITY_HIGH = 0;     // interactive work, the caller is waiting for it
+            static const int PRIORITY_NORMAL = 1;   // default priority
+            static const int PRIORITY_LOW = 2;      // background work
+            static const int NB_PRIORITIES = 3;
+
+            static const int MAX_THREADS = 1024;    // maximum number of threads (including the blocked ones).
+
+
+            /**
+             * Constructor.
+             *
+             * @param   concurrency maximum number of tasks executed simultaneously (0 = number of hardware threads).
+             **/
+            explicit ThreadPool(int concurrency = 0) : _concurrency((concurrency <= 0) ? nbHardwareThreads() : concurrency),
+                _nbthreads(0), _active(0), _blocked(0), _idle(0), _queued(0), _quit(false), _workers(new Worker*[MAX_THREADS])
+                {
+                }
+
+
+            /** Destructor. Wait for the running tasks to complete. Pending tasks are discarded. */
+            ~ThreadPool()
+                {
+                    {
+                    std::unique_lock<std::mutex> lock(_m);
+                    _quit = true;
+                    _cv.notify_all();
+                    }
+                const int n = _nbthreads;
+                for (int i = 0; i < n; i++) { _workers[i]->th.join(); delete _workers[i]; }
+                delete[] _workers;
+                }
+
+
+            /**
+             * The process-wide thread pool, sized from nbHardwareThreads(). It is never destroyed (the
+             * threads are simply killed when the process exits).
+             **/
+            static ThreadPool & shared()
+                {
+                static ThreadPool * pool = new ThreadPool();
+                return *pool;
+                }
+
+
+            /** Maximum number of tasks executed simultaneously. */
+            int concurrency() const { return _concurrency; }
+
+
+            /** Number of threads created so far. */
+            int nbThreads() const { return _nbthreads; }
+
+
+            /** Number of tasks waiting to be executed. */
+            int64 nbQueued() const { return _queued; }
+
+
+            /**
+             * Submit a task.
+             *
+             * @param   task        the task to execute.
+             * @param   priority    (Optional) one of PRIORITY_HIGH, PRIORITY_NORMAL, PRIORITY_LOW.
+             **/
+            void submit(std::function<void()> task, int priority = PRIORITY_NORMAL)
+                {
+                if (priority < 0) priority = 0; else if (priority >= NB_PRIORITIES) priority = NB_PRIORITIES - 1;
+                const int w = (_tlsPool() == this) ? _tlsIndex() : -1;
+                if (w >= 0)
+                    {
+                    std::unique_lock<std::mutex> lock(_workers[w]->m);
+                    _workers[w]->q[priority].push_back(std::move(task));
+                    }
+                else
+                    {
+                    std::unique_lock<std::mutex> lock(_gm);
+                    _global[priority].push_back(std::move(task));
+                    }
+                _queued++;
+                std::unique_lock<std::mutex> lock(_m);
+                if (_idle > 0) { _cv.notify_one(); return; }
+                if (_nbthreads - _blocked < _concurrency) _spawn();
+                }
+
+
+            /**
+             * Submit a task which is discarded if the token is cancelled before it starts.
+             *
+             * @param   task        the task to execute.
+             * @param   token       the cancellation token.
+             * @param   priority    (Optional) one of PRIORITY_HIGH, PRIORITY_NORMAL, PRIORITY_LOW.
+             **/
+            void submit(std::function<void()> task, const CancelToken & token, int priority = PRIORITY_NORMAL)
+                {
+                submit([task, token]() { if (!token.cancelled()) task(); }, priority);
+                }
+
+
+            /**
+             * Object to create (on the stack) around code that waits inside a task. While the object
+             * exists, the thread does not count against the concurrency of its pool. Does nothing if the
+             * calling thread is not a worker thread. Can be nested.
+             **/
+            class BlockingScope
+                {
+                public:
+
+                    BlockingScope() : _pool(_tlsPool())
+                        {
+                        if (_pool == nullptr) return;
+                        if ((_tlsDepth()++) == 0) _pool->_beginBlocking(); else _pool = nullptr;
+                        }
+
+                    ~BlockingScope()
+                        {
+                        if (_pool == nullptr) return;
+                        _tlsDepth()--;
+                        _pool->_endBlocking();
+                        }
+
+                private:
+
+                    BlockingScope(const BlockingScope &) = delete;
+                    BlockingScope & operator=(const BlockingScope &) = delete;
+
+                    ThreadPool * _pool;
+                };
+
+
+        private:
+
+            ThreadPool(const ThreadPool &) = delete;
+            ThreadPool & operator=(const ThreadPool &) = delete;
+
+
+            /* a worker thread with its deques */
+            struct Worker
+                {
+                std::mutex m;
+                std::deque<std::function<void()> > q[NB_PRIORITIES];
+                std::thread th;
+                };
+
+
+            /* thread local data: pool the thread belongs to, index of the thread and depth of blocking scopes */
+            static ThreadPool * & _tlsPool() { thread_local ThreadPool * p = nullptr; return p; }
+            static int & _tlsIndex() { thread_local int i = -1; return i; }
+            static int & _tlsDepth() { thread_local int d = 0; return d; }
+
+
+            /* create a new worker thread. _m must be locked */
+            void _spawn()
+                {
+                if ((_nbthreads >= MAX_THREADS) || (_quit)) return;
+                const int w = _nbthreads;
+                _workers[w] = new Worker();
+                _workers[w]->th = std::thread(&ThreadPool::_workerProc, this, w);
+                _nbthreads.store(w + 1, std::memory_order_release);
+                }
+
+
+            /* try to pop a task: own deque first, then the global queue and finally steal from other workers */
+            bool _pop(int w, std::function<void()> & task)
+                {
+                if (_queued.load() <= 0) return false;
+                const int n = _nbthreads.load(std::memory_order_acquire);
+                for (int p = 0; p < NB_PRIORITIES; p++)
+                    {
+                    if (w >= 0)
+                        {
+                        std::unique_lock<std::mutex> lock(_workers[w]->m);
+                        auto & Q = _workers[w]->q[p];
+                        if (!Q.empty()) { task = std::move(Q.back()); Q.pop_back(); _queued--; return true; }
+                        }
+                        {
+                        std::unique_lock<std::mutex> lock(_gm);
+                        auto & Q = _global[p];
+                        if (!Q.empty()) { task = std::move(Q.front()); Q.pop_front(); _queued--; return true; }
+                        }
+                    for (int k = 1; k <= n; k++)
+                        {
+                        const int v = (w + k) % n;
+                        if (v == w) continue;
+                        std::unique_lock<std::mutex> lock(_workers[v]->m);
+                        auto & Q = _workers[v]->q[p];
+                        if (!Q.empty()) { task = std::move(Q.front()); Q.pop_front(); _queued--; return true; }
+                        }
+                    }
+                return false;
+                }
+
+
+            /* the worker thread procedure */
+            void _workerProc(int w)
+                {
+                _tlsPool() = this;
+                _tlsIndex() = w;
+                std::unique_lock<std::mutex> lock(_m);
+                while (1)
+                    {
+                    if (_active < _concurrency)
+                        {
+                        _active++;
+                        lock.unlock();
+                        std::function<void()> task;
+                        const bool got = _pop(w, task);
+                        if (got) { task(); task = nullptr; }
+                        lock.lock();
+                        _active--;
+                        if (got) continue;
+                        }
+                    if (_quit) return;
+                    if ((_queued.load() > 0) && (_active < _concurrency)) continue;
+                    _idle++;
+                    _cv.wait_for(lock, std::chrono::milliseconds(50));
+                    _idle--;
+                    }
+                }
+
+
+            /* the current task starts waiting */
+            void _beginBlocking()
+                {
+                std::unique_lock<std::mutex> lock(_m);
+                _active--;
+                _blocked++;
+                if (_queued.load() <= 0) return;
+                if (_idle > 0) { _cv.notify_one(); return; }
+                if (_nbthreads - _blocked < _concurrency) _spawn();
+                }
+
+
+            /* the current task stops waiting */
+            void _endBlocking()
+                {
+                std::unique_lock<std::mutex> lock(_m);
+                _active++;
+                _blocked--;
+                }
+
+
+            const int               _concurrency;   // max number of threads executing tasks
+            std::atomic<int>        _nbthreads;     // number of threads created
+            int                     _active;        // number of threads executing a task (and not blocked)
+            int                     _blocked;       // number of threads inside a blocking scope
+            int                     _idle;          // number of threads waiting for work
+            std::atomic<int64>      _queued;        // number of queued tasks
+            bool                    _quit;          // true when the pool is destroyed
+
+            std::mutex              _m;             // mutex protecting the counters above
+            std::condition_variable _cv;            // used to wake up idle workers
+
+            std::mutex              _gm;            // mutex for the global queues
+            std::deque<std::function<void()> > _global[NB_PRIORITIES];  // tasks submitted from outside the pool
+
+            Worker **               _workers;       // worker threads (fixed size array so that it can be read without locking)
+        };
+
+
+    /**
+     * Group of tasks executed on a thread pool.
+     *
+     * wait() returns once all the tasks of the group are completed. Tasks that are not yet started
+     * when wait() is called are executed by the calling thread itself so waiting never deadlocks even
+     * if the pool is busy. The first exception thrown by a task is rethrown by wait().
+     *
+     * The tasks of the group share a cancellation token: after cancel(), the tasks not yet started
+     * are discarded and running tasks may poll cancelled() to stop early.
+     **/
+    class TaskGroup
+        {
+
+        public:
+
+            /**
+             * Constructor.
+             *
+             * @param   priority    (Optional) priority of the tasks of the group.
+             * @param   pool        (Optional) the thread pool to use.
+             **/
+            TaskGroup(int priority = ThreadPool::PRIORITY_NORMAL, ThreadPool & pool = ThreadPool::shared()) : _pool(pool), _priority(priority), _token(), _pending(0), _exc(nullptr)
+                {
+                }
+
+
+            /** Destructor. Wait for the completion of all the tasks (exceptions are discarded). */
+            ~TaskGroup() { _wait(); }
+
+
+            /** Add a task to the group (thread safe, may also be called from inside a task of the group). */
+            template<typename FUN> void run(FUN && fun)
+                {
+                std::shared_ptr<Job> job = std::make_shared<Job>(std::forward<FUN>(fun));
+                    {
+                    std::unique_lock<std::mutex> lock(_m);
+                    _jobs.push_back(job);
+                    _pending++;
+                    }
+                _pool.submit([this, job]() { if (!job->claimed.exchange(true)) _execute(*job); }, _priority);
+                }
+
+
+            /** Wait for the completion of all the tasks. Rethrow the first exception thrown by a task (if any). */
+            void wait()
+                {
+                _wait();
+                std::exception_ptr e = nullptr;
+                std::swap(e, _exc);
+                if (e != nullptr) std::rethrow_exception(e);
+                }
+
+
+            /** Cancel the tasks of the group. */
+            void cancel() { _token.cancel(); }
+
+
+            /** Query if the group was cancelled. */
+            MTOOLS_FORCEINLINE bool cancelled() const { return _token.cancelled(); }
+
+
+            /** The cancellation token shared by the tasks of the group. */
+            const CancelToken & token() const { return _token; }
+
+
+        private:
+
+            TaskGroup(const TaskGroup &) = delete;
+            TaskGroup & operator=(const TaskGroup &) = delete;
+
+
+            /* a task of the group */
+            struct Job
+                {
+                template<typename FUN> Job(FUN && f) : claimed(false), fun(std::forward<FUN>(f)) {}
+                std::atomic<bool> claimed;       // set by the thread which executes the task
+                std::function<void()> fun;
+                };
+
+
+            /* execute a job (which was claimed by the calling thread) */
+            void _execute(Job & job)
+                {
+                if (!_token.cancelled())
+                    {
+                    try { job.fun(); }
+                    catch (...) { std::unique_lock<std::mutex> lock(_m); if (_exc == nullptr) _exc = std::current_exception(); }
+                    }
+                job.fun = nullptr;
+                std::unique_lock<std::mutex> lock(_m); // the group may be destroyed as soon as the lock is released
+                if ((--_pending) == 0) _cv.notify_all();
+                }
+
+
+            /* run the unclaimed tasks and wait for the others */
+            void _wait()
+                {
+                while (1)
+                    {
+                    std::vector<std::shared_ptr<Job> > jobs;
+                        {
+                        std::unique_lock<std::mutex> lock(_m);
+                        if ((_pending == 0) && (_jobs.empty())) return;
+                        jobs.swap(_jobs);
+                        }
+                    for (auto & job : jobs) { if (!job->claimed.exchange(true)) _execute(*job); }
+                    if (jobs.empty())
+                        {
+                        ThreadPool::BlockingScope bs;
+                        std::unique_lock<std::mutex> lock(_m);
+                        if ((_pending > 0) && (_jobs.empty())) _cv.wait_for(lock, std::chrono::milliseconds(1));
+                        }
+                    }
+                }
+
+
+            ThreadPool &                        _pool;      // the pool
+            const int                           _priority;  // priority of the tasks
+            CancelToken                         _token;     // cancellation token
+            std::mutex                          _m;         // mutex protecting the fields below
+            std::condition_variable             _cv;        // notified when _pending reaches 0
+            int64                               _pending;   // number of tasks not yet completed
+            std::vector<std::shared_ptr<Job> >  _jobs;      // tasks not yet examined by wait()
+            std::exception_ptr                  _exc;       // first exception thrown
+        };
+
+
+}
+
+/* end of file */
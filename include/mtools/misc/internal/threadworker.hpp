@@ -22,26 +22,42 @@
 
 #include "../misc.hpp"
 #include "../error.hpp"
+#include "threadpool.hpp"
 
 #include <ctime>
 #include <atomic>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <vector>
 
 namespace mtools
 {
 
     /**
-     * Return the number of hardware threads.
+     * Execute fun(0), fun(1), ... , fun(n-1) using several threads. The indices are distributed
+     * dynamically between the threads (the calling thread participates to the work). The method
+     * returns once all the calls are completed.
      *
-     * @return  Number of hardware threads. 1 if not detected. 
+     * The helper tasks are submitted to the shared thread pool with high priority. If the pool is
+     * busy, fewer threads may be used (possibly only the calling one) so fun() must not rely on
+     * being executed concurrently. If a call throws, the exception is propagated to the caller.
+     *
+     * @param   n           number of calls.
+     * @param   fun         function/functor with signature void(int64) (must be thread safe).
+     * @param   nbthreads   maximum number of threads to use (0 to use all the hardware threads).
      **/
-    inline int nbHardwareThreads()
+    template<typename FUN> void parallelFor(int64 n, FUN && fun, int nbthreads = 0)
         {
-        unsigned int nb = std::thread::hardware_concurrency();
-        if (nb == 0) return 1;
-        return (int)nb;
+        if (nbthreads <= 0) nbthreads = nbHardwareThreads();
+        if ((int64)nbthreads > n) nbthreads = (int)n;
+        if (nbthreads <= 1) { for (int64 i = 0; i < n; i++) { fun(i); } return; }
+        std::atomic<int64> next(0);
+        auto proc = [&]() { int64 i; while ((i = next++) < n) { fun(i); } };
+        TaskGroup G(ThreadPool::PRIORITY_HIGH);
+        for (int k = 1; k < nbthreads; k++) { G.run(proc); }
+        proc();
+        G.wait();
         }
 
 
@@ -64,6 +80,10 @@ namespace mtools
 	*                                 virtual method. When, active, the thread performs the work() method. When inactive
 	*                                 it waits until being active again before continuing/starting the work method.  
 	*                                 Once work() is finished, this flag is set to inactive.
+	*
+	* The object does not own a thread: while there is work to do, work() runs as a task of the shared
+	* ThreadPool (with normal priority). Messages received while no task is running are processed
+	* directly by the calling thread.
     */
     class ThreadWorker
         {
@@ -79,10 +99,12 @@ namespace mtools
                 _thread_status(false),
                 _work_status(false),
                 _msg(MSG_NONE),
-                _code(0)
+                _code(0),
+                _quit(false),
+                _ctrl(std::make_shared<Control>())
                 {
-                _th = new std::thread(&ThreadWorker::_threadProc, this);
-                sync();
+                _ctrl->state = STATE_IDLE;
+                _ctrl->worker = this;
                 }
 
 
@@ -91,8 +113,9 @@ namespace mtools
                 {
                 sync();
                 _signal(MSG_QUIT);
-                _th->join();
-                delete _th;
+                std::unique_lock<std::mutex> lock(_ctrl->m);
+                while ((_ctrl->state == STATE_RUNNING) || (_ctrl->state == STATE_CALLER)) { _ctrl->cv.wait_for(lock, std::chrono::milliseconds(1)); }
+                _ctrl->worker = nullptr; // tasks still in the queue of the pool are now discarded
                 }
 
 
@@ -138,8 +161,9 @@ namespace mtools
             void sync()
                 {
                 if (((int)_msg) == MSG_NONE) return;
-                std::unique_lock<std::mutex> lock(_mut_wait);
-                while (((int)_msg) != MSG_NONE) { _cv_wait.wait_for(lock,std::chrono::milliseconds(1)); }
+                ThreadPool::BlockingScope bs;
+                std::unique_lock<std::mutex> lock(_ctrl->m);
+                while (((int)_msg) != MSG_NONE) { _ctrl->cv.wait_for(lock,std::chrono::milliseconds(1)); }
                 }
 
 
@@ -220,12 +244,25 @@ namespace mtools
 
             std::atomic<int>    _msg;               // message type, one of MSG_NONE, MSG_CODE, MSG_QUIT, MSG_ENABLE, MSG_DISABLE
             std::atomic<int64>  _code;              // code used for communication
+            bool                _quit;              // set once MSG_QUIT is processed
+
+
+            static const int STATE_IDLE = 0;        // no task: messages are processed by the caller
+            static const int STATE_QUEUED = 1;      // a task is waiting in the pool
+            static const int STATE_RUNNING = 2;     // a task is running
+            static const int STATE_CALLER = 3;      // a caller thread is processing a message
 
-            std::condition_variable _cv_wakeup;     // used for waking up the thread
-            std::mutex _mut_wakeup;                 // associated condition variable.
-            std::condition_variable _cv_wait;       // used for waiting for the thread to answer
-            std::mutex _mut_wait;                   // associated condition variable.
-            std::thread * _th;                      // the thread object.
+
+            /* state shared with the tasks submitted to the pool (which may outlive the object) */
+            struct Control
+                {
+                std::mutex m;                       // protects state and worker
+                std::condition_variable cv;         // used for waking up the task and for waiting for it to answer
+                int state;                          // one of STATE_XXX
+                ThreadWorker * worker;              // the object, nullptr once destroyed
+                };
+
+            std::shared_ptr<Control> _ctrl;
 
 
             static const int PROGRESS_NONE = 0;
@@ -243,10 +280,14 @@ namespace mtools
             void _signal(int msg, int64 code = CODE_NONE)
                 {
                 MTOOLS_ASSERT(((int)_msg) == MSG_NONE);
-                std::unique_lock<std::mutex> lock(_mut_wakeup);
-                _code = code;
-                _msg = msg;
-                _cv_wakeup.notify_one();
+                    {
+                    std::unique_lock<std::mutex> lock(_ctrl->m);
+                    _code = code;
+                    _msg = msg;
+                    if ((_ctrl->state == STATE_RUNNING) || (_ctrl->state == STATE_CALLER)) { _ctrl->cv.notify_all(); return; }
+                    _ctrl->state = STATE_CALLER; // no task running: the message is processed here (a queued task is discarded)
+                    }
+                _run(false);
                 }
 
 
@@ -254,8 +295,9 @@ namespace mtools
             void _threadSleep()
                 {
                 if (((int)_msg) != MSG_NONE) return;
-                std::unique_lock<std::mutex> lock(_mut_wakeup);
-                while (((int)_msg) == MSG_NONE) { _cv_wakeup.wait_for(lock, std::chrono::milliseconds(10)); }
+                ThreadPool::BlockingScope bs;
+                std::unique_lock<std::mutex> lock(_ctrl->m);
+                while (((int)_msg) == MSG_NONE) { _ctrl->cv.wait_for(lock, std::chrono::milliseconds(10)); }
                 }
 
 
@@ -263,24 +305,33 @@ namespace mtools
             void _threadReady()
                 {
                 MTOOLS_ASSERT(((int)_msg) != MSG_NONE);
-                std::unique_lock<std::mutex> lock(_mut_wait);
+                std::unique_lock<std::mutex> lock(_ctrl->m);
                 _msg = MSG_NONE;
                 _code = CODE_NONE;
-                _cv_wait.notify_one();
+                _ctrl->cv.notify_all();
                 }
 
 
-            /* the thread procedure */
-            void _threadProc()
+            /* the task submitted to the pool */
+            static void _task(std::shared_ptr<Control> ctrl)
                 {
+                    {
+                    std::unique_lock<std::mutex> lock(ctrl->m);
+                    if ((ctrl->worker == nullptr) || (ctrl->state != STATE_QUEUED)) return; // stale task
+                    ctrl->state = STATE_RUNNING;
+                    }
+                ctrl->worker->_run(true);
+                }
 
-            wait_label:
-                _threadSleep();
+
+            /* process a message received while work() is not running */
+            void _processMessage()
+                {
                 switch ((int)_msg)
                     {
                     case MSG_ENABLE: { _thread_status = true; break; }
                     case MSG_DISABLE: { _thread_status = false; break; }
-                    case MSG_QUIT: { _threadReady(); return; }
+                    case MSG_QUIT: { _quit = true; break; }
                     case MSG_CODE:
                         {
                         int r = message(_code);
@@ -297,24 +348,47 @@ namespace mtools
                     default: { MTOOLS_ERROR("wtf?"); }
                     }
                 _threadReady();
+                }
 
-            work_label:
-                if ((!((bool)_thread_status)) || (!((bool)_work_status))) goto wait_label;
-                try
-                    {
-                    work();
-                    _work_status = false;
-                    goto wait_label;
-                    }
-                catch (int r)
+
+            /* process messages and (if intask is true) perform the work until there is nothing left to do.
+               The calling thread owns the object (state STATE_RUNNING or STATE_CALLER). */
+            void _run(bool intask)
+                {
+                while (1)
                     {
-                    if ((int)_msg == MSG_QUIT) { _threadReady(); return; }
-                    switch (r)
+                    if (((int)_msg) != MSG_NONE) { _processMessage(); continue; }
+                    const bool mustwork = ((!_quit) && ((bool)_thread_status) && ((bool)_work_status));
+                    if ((intask) && (mustwork))
                         {
-                        case THREAD_RESET: { _work_status = true; _threadReady(); goto work_label; }
-                        case THREAD_RESET_AND_WAIT: { _work_status = false; _threadReady(); goto wait_label; }
-                        default: { MTOOLS_ERROR("wtf?"); }
+                        try
+                            {
+                            work();
+                            _work_status = false;
+                            }
+                        catch (int r)
+                            {
+                            if ((int)_msg == MSG_QUIT) { _quit = true; _threadReady(); continue; }
+                            switch (r)
+                                {
+                                case THREAD_RESET: { _work_status = true; _threadReady(); break; }
+                                case THREAD_RESET_AND_WAIT: { _work_status = false; _threadReady(); break; }
+                                default: { MTOOLS_ERROR("wtf?"); }
+                                }
+                            }
+                        continue;
+                        }
+                    std::shared_ptr<Control> ctrl = _ctrl;
+                    std::unique_lock<std::mutex> lock(ctrl->m);
+                    if (((int)_msg) != MSG_NONE) continue;
+                    if (mustwork)
+                        { // hand over the work to the pool
+                        ctrl->state = STATE_QUEUED;
+                        ThreadPool::shared().submit([ctrl]() { _task(ctrl); }, ThreadPool::PRIORITY_NORMAL);
                         }
+                    else { ctrl->state = STATE_IDLE; }
+                    ctrl->cv.notify_all();
+                    return;
                     }
                 }
 
@@ -30,6 +30,7 @@
 #include <utility>
 #include <string>
 #include <type_traits>
+#include <vector>
 
 
 namespace mtools
@@ -763,6 +764,205 @@ namespace mtools
 	template<typename T1, typename T2, size_t AllocSize, size_t PoolSize> inline bool operator!=(const SingleObjectAllocator<T1, AllocSize, PoolSize>& alloc1, const SingleObjectAllocator<T2, AllocSize, PoolSize>& alloc2) { return (alloc1._memPool != alloc2._memPool); }
 
 
+	/**
+	* Arena allocator with size classes.
+	*
+	* Allocation requests are rounded up to a multiple of GRANULARITY bytes and each size class is
+	* served from its own slabs of SLAB_SIZE bytes by simply incrementing a pointer. Requests larger
+	* than MAX_SMALL_SIZE bytes are allocated individually with malloc().
+	*
+	* Memory cannot be released individually: reset() releases everything at once in time
+	* proportional to the number of slabs (not to the number of allocated blocks). Allocated blocks
+	* can be enumerated with iterateOver(), which makes it possible to call the destructors of the
+	* objects stored in the arena without keeping a list of pointers.
+	*
+	* Every returned pointer is aligned for any fundamental type (provided GRANULARITY is a multiple
+	* of the alignment of malloc()).
+	*
+	* The arena is not thread safe. It can be moved but not copied.
+	**/
+	class SizeClassArena
+	{
+
+	public:
+
+		static const size_t GRANULARITY = 16;									// size classes are multiples of this number of bytes
+		static const size_t MAX_SMALL_SIZE = 512;								// larger requests are allocated individually
+		static const size_t NB_CLASSES = MAX_SMALL_SIZE / GRANULARITY;			// number of size classes
+		static const size_t SLAB_SIZE = MEM_KB(64);								// size of a slab
+
+
+		/** Default constructor. Create an empty arena. */
+		SizeClassArena() : _nbblocks(0), _mem(0) {}
+
+
+		/** Destructor. Release all the memory (without calling any destructor). */
+		~SizeClassArena() { reset(true); }
+
+
+		/** Move constructor. The source arena is left empty. */
+		SizeClassArena(SizeClassArena && o) : _large(std::move(o._large)), _nbblocks(o._nbblocks), _mem(o._mem)
+			{
+			for (size_t i = 0; i < NB_CLASSES; i++) { _classes[i] = std::move(o._classes[i]); o._classes[i] = SizeClass(); }
+			o._large.clear();
+			o._nbblocks = 0;
+			o._mem = 0;
+			}
+
+
+		/** Move assignment operator. The current content is released (without calling any destructor). */
+		SizeClassArena & operator=(SizeClassArena && o)
+			{
+			if (&o == this) return *this;
+			reset(true);
+			for (size_t i = 0; i < NB_CLASSES; i++) { _classes[i] = std::move(o._classes[i]); o._classes[i] = SizeClass(); }
+			_large = std::move(o._large); o._large.clear();
+			_nbblocks = o._nbblocks; o._nbblocks = 0;
+			_mem = o._mem; o._mem = 0;
+			return *this;
+			}
+
+
+		/**
+		* Allocate a block of memory.
+		*
+		* @param	size	size of the block in bytes (must be non zero).
+		*
+		* @return	pointer to the block, valid until reset() is called or the arena is destroyed.
+		**/
+		MTOOLS_FORCEINLINE void * allocate(size_t size)
+			{
+			MTOOLS_ASSERT(size > 0);
+			_nbblocks++;
+			if (size > MAX_SMALL_SIZE) return _allocateLarge(size);
+			const size_t cl = (size - 1) / GRANULARITY;
+			SizeClass & C = _classes[cl];
+			if (C.used == C.nbcells) _newSlab(C, (cl + 1)*GRANULARITY);
+			void * p = C.slabs[C.current - 1] + C.used*C.cellsize;
+			C.used++;
+			return p;
+			}
+
+
+		/**
+		* Call fun(void * p, size_t size) for each block allocated in the arena. 'size' is the size of
+		* the block after rounding up to its size class. The order of enumeration is unspecified.
+		**/
+		template<typename FUN> void iterateOver(FUN fun) const
+			{
+			for (size_t cl = 0; cl < NB_CLASSES; cl++)
+				{
+				const SizeClass & C = _classes[cl];
+				for (size_t s = 0; s < C.current; s++)
+					{
+					const size_t n = (s + 1 == C.current) ? C.used : C.nbcells;
+					char * q = C.slabs[s];
+					for (size_t k = 0; k < n; k++) { fun((void *)(q + k*C.cellsize), C.cellsize); }
+					}
+				}
+			for (auto & B : _large) { fun(B.first, B.second); }
+			}
+
+
+		/**
+		* Call the destructor ~T() on each block of the arena (which must therefore all contain objects
+		* derived from T with a virtual destructor, or of type T) and then reset the arena.
+		*
+		* @param	releaseMemory	true to give the slabs back to the system, false to keep them for
+		* 							subsequent allocations.
+		**/
+		template<typename T> void destroyAll(bool releaseMemory = true)
+			{
+			iterateOver([](void * p, size_t) { ((T*)p)->~T(); });
+			reset(releaseMemory);
+			}
+
+
+		/**
+		* Discard all the blocks allocated in the arena (no destructor is called).
+		*
+		* @param	releaseMemory	true to give the slabs back to the system, false to keep them for
+		* 							subsequent allocations (large blocks are always released).
+		**/
+		void reset(bool releaseMemory = true)
+			{
+			for (size_t cl = 0; cl < NB_CLASSES; cl++)
+				{
+				SizeClass & C = _classes[cl];
+				if (releaseMemory)
+					{
+					for (char * q : C.slabs) { free(q); _mem -= SLAB_SIZE; }
+					C = SizeClass();
+					}
+				else { C.current = 0; C.used = C.nbcells = 0; }
+				}
+			for (auto & B : _large) { free(B.first); _mem -= B.second; }
+			_large.clear();
+			_nbblocks = 0;
+			}
+
+
+		/** Return the number of blocks currently allocated. */
+		inline size_t size() const { return _nbblocks; }
+
+
+		/** Return the number of bytes currently obtained from the system. */
+		inline size_t memory() const { return _mem; }
+
+
+	private:
+
+		SizeClassArena(const SizeClassArena &) = delete;
+		SizeClassArena & operator=(const SizeClassArena &) = delete;
+
+
+		/* slabs of a given size class. The cells in use are those of slabs[0..current-2] and the first 'used' cells of slabs[current-1] */
+		struct SizeClass
+			{
+			SizeClass() : slabs(), current(0), used(0), nbcells(0), cellsize(0) {}
+			std::vector<char *> slabs;	// slabs of this class (some may be unused after reset(false))
+			size_t current;				// number of slabs in use
+			size_t used;				// number of cells used in the last slab in use
+			size_t nbcells;				// number of cells per slab (0 if no slab in use)
+			size_t cellsize;			// size of a cell
+			};
+
+
+		/* make a new slab current for size class C */
+		void _newSlab(SizeClass & C, size_t cellsize)
+			{
+			if (C.current == C.slabs.size())
+				{
+				char * q = (char *)malloc(SLAB_SIZE);
+				if (q == nullptr) { MTOOLS_ERROR("SizeClassArena: malloc() failed."); }
+				C.slabs.push_back(q);
+				_mem += SLAB_SIZE;
+				}
+			C.current++;
+			C.cellsize = cellsize;
+			C.nbcells = SLAB_SIZE / cellsize;
+			C.used = 0;
+			}
+
+
+		/* allocate a large block */
+		void * _allocateLarge(size_t size)
+			{
+			void * p = malloc(size);
+			if (p == nullptr) { MTOOLS_ERROR("SizeClassArena: malloc() failed."); }
+			_large.push_back(std::pair<void *, size_t>(p, size));
+			_mem += size;
+			return p;
+			}
+
+
+		SizeClass									_classes[NB_CLASSES];	// slabs for each size class
+		std::vector<std::pair<void *, size_t> >		_large;					// large blocks
+		size_t										_nbblocks;				// number of blocks allocated
+		size_t										_mem;					// memory obtained from the system
+	};
+
+
 
 }
 
@@ -36,6 +36,7 @@
 // maths
 #include "maths/rootSolver.hpp"
 #include "maths/vec.hpp"
+#include "maths/doubledouble.hpp"
 #include "maths/box.hpp"
 #include "maths/sqrmatrix.hpp"
 #include "maths/circle.hpp"
@@ -43,6 +44,7 @@
 #include "maths/specialFunctions.hpp"
 #include "maths/permutation.hpp"
 #include "maths/dyckword.hpp"
+#include "maths/csrgraph.hpp"
 #include "maths/combinatorialmap.hpp"
 #include "maths/combinatorialmap_random_triangulation.hpp"
 #include "maths/graph.hpp"
@@ -81,7 +83,9 @@
 #include "graphics/image.hpp"
 #include "graphics/font.hpp"
 #include "graphics/progressimg.hpp"
+#include "graphics/rendercache.hpp"
 #include "graphics/simpleBMP.hpp"
+#include "graphics/pngwriter.hpp"
 #include "graphics/edgesiteimage.hpp"
 #include "graphics/interpolation.hpp"
 #include "graphics/planedrawer.hpp"
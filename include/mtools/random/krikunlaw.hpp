@@ -36,6 +36,7 @@
 #include "../misc/misc.hpp" 
 
 #include <cmath>
+#include <algorithm>
 
 namespace mtools
 {
@@ -796,12 +797,8 @@ inline unsigned int KrikunLaw_posi(double a)
         v = pow(v,2.0/3.0);
         return(((unsigned int)v)+1);
         }
-    unsigned int p = 1;
-    while(1)
-        {
-        if (a < KRIKUNLAW_TAB[p]) {return(p);}
-        p++;
-        }
+    // binary search for the first p such that a < KRIKUNLAW_TAB[p]
+    return (unsigned int)(std::upper_bound(KRIKUNLAW_TAB + 1, KRIKUNLAW_TAB + 5001, a) - KRIKUNLAW_TAB);
     }
 
 
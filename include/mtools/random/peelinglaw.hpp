@@ -28,11 +28,99 @@
 
 #include <cmath>
 #include <random>
+#include <vector>
 
 namespace mtools
 	{
 
 
+	namespace internals_peelinglaw
+		{
+
+		/** number of values stored in the tables of the laws with unbounded support */
+		const int64 LAW_TABLE_SIZE = 4096;
+
+		/** the tables for the Boltzmann laws of the (m+2)-gon are cached for m < BOLTZMANN_TABLE_MAXM */
+		const int64 BOLTZMANN_TABLE_MAXM = 256;
+
+
+		/**
+		* Values of a CDF on [kmin, kmax] together with a guide table (Chen & Asau 1974) used to
+		* invert it in constant expected time.
+		*
+		* Values above kmax are found by searching with the CDF functor itself so sampling is exact:
+		* inv(a) returns the same value as sampleDiscreteRVfromCDF() does for the uniform variable a.
+		**/
+		class CDFTable
+			{
+
+			public:
+
+				/** Empty table */
+				CDFTable() : _kmin(0) {}
+
+				/** Construct the table of cdf on [kmin, kmax] */
+				template<class CDF> CDFTable(CDF cdf, int64 kmin, int64 kmax) { set(cdf, kmin, kmax); }
+
+				/** (Re)compute the table of cdf on [kmin, kmax] */
+				template<class CDF> void set(CDF cdf, int64 kmin, int64 kmax)
+					{
+					MTOOLS_ASSERT(kmax >= kmin);
+					const size_t n = (size_t)(kmax - kmin + 1);
+					_kmin = kmin;
+					_cdf.resize(n);
+					for (size_t i = 0; i < n; i++) { _cdf[i] = cdf(kmin + (int64)i); }
+					_guide.resize(n);
+					size_t j = 0;
+					for (size_t g = 0; g < n; g++)
+						{ // _guide[g] = first index i such that _cdf[i] > g/n
+						const double a = ((double)g) / ((double)n);
+						while ((j < n) && (_cdf[j] <= a)) { j++; }
+						_guide[g] = (int)j;
+						}
+					}
+
+				/** Query if the table is empty */
+				bool empty() const { return _cdf.empty(); }
+
+				/**
+				* Return the smallest k such that a < cdf(k). We must have cdf(kmin - 1) <= a < 1.
+				**/
+				template<class CDF> int64 inv(double a, CDF cdf) const
+					{
+					const size_t n = _cdf.size();
+					size_t g = (size_t)(a * n);
+					if (g >= n) { g = n - 1; }
+					size_t i = (size_t)_guide[g];
+					while ((i < n) && (_cdf[i] <= a)) { i++; }
+					if (i < n) { return _kmin + (int64)i; }
+					// tail of the distribution: cdf(lo) <= a.
+					int64 lo = _kmin + (int64)n - 1;
+					int64 step = 1;
+					int64 hi = lo + 1;
+					while (cdf(hi) <= a)
+						{
+						if (hi >= 4611686018427387904) return 4611686018427387904;   // out of bounds
+						lo = hi; step *= 2; hi = lo + step;
+						}
+					while ((hi - lo) > 1)
+						{
+						const int64 m = lo + (hi - lo) / 2;
+						if (a >= cdf(m)) { lo = m; } else { hi = m; }
+						}
+					return hi;
+					}
+
+			private:
+
+				int64 _kmin;				// first value in the table
+				std::vector<double> _cdf;	// _cdf[i] = cdf(_kmin + i)
+				std::vector<int> _guide;	// guide table
+			};
+
+		}
+
+
 	/*******************************************************************************************************************
 	* 
 	*                                     UI(H)PT : UNIFORM INFINITE (HALF)-PLANAR TRIANGULATION
@@ -88,6 +176,19 @@ namespace mtools
 		}
 
 
+	namespace internals_peelinglaw
+		{
+
+		/* table of UIHPT_CDF (shared by all threads, constructed on first use) */
+		inline const CDFTable & UIHPTTable()
+			{
+			static const CDFTable tab(UIHPT_CDF, -1, LAW_TABLE_SIZE - 2);
+			return tab;
+			}
+
+		}
+
+
 	/**
 	* Sample a random variable according to the law of the walk associated with the peeling process
 	* of the Infinite Uniform Half plane Triangulation.
@@ -96,7 +197,7 @@ namespace mtools
 	**/
 	template<class random_t> inline int64 UIHPTLaw(random_t & gen)
 		{
-		return sampleDiscreteRVfromCDF(UIHPT_CDF, gen);
+		return internals_peelinglaw::UIHPTTable().inv(Unif(gen), UIHPT_CDF);
 		}
 
 
@@ -140,9 +241,33 @@ namespace mtools
 		};
 
 
+	namespace internals_peelinglaw
+		{
+
+		/* Return h(m-k)/h(m+1) where h(x) = Gamma(x + 3/2)/Gamma(x + 1) is such that 
+		   p_{k,m} = (h(m-k)/h(m))p_k. Since h is increasing, this is the probability of accepting 
+		   k drawn from the UIHPT law with rejection constant h(m+1)/h(m). */
+		inline double UIPTAcceptProb(int64 k, int64 m)
+			{
+			if (k < 32)
+				{ // h(x+1)/h(x) = (x + 3/2)/(x + 1)
+				double r = 1.0;
+				for (int64 j = m - k; j <= m; j++) { r *= (j + 1.0) / (j + 1.5); }
+				return r;
+				}
+			return exp(gammln(m - k + 1.5) - gammln(m - k + 1.0) + gammln(m + 2.0) - gammln(m + 2.5));
+			}
+
+		}
+
+
 	/**
 	* Sample a random variable according to increment of the size of the boundary when peeling to
 	* UIPT of type II with a boundary of (m+2) vertices i.e. sampled from the CDF UIPTpeelCDF(.,m).
+	* 
+	* The value is obtained by rejection from the UIHPT law (which is tabulated) using the h-transform
+	* so the cost does not depend on m and the CDF UIPT_CDF() is never evaluated. The expected number
+	* of trials is (m + 3/2)/(m + 1).
 	*
 	* @param   m           the size of the boudary is m+2.
 	* @param [in,out]  gen the random number generator.
@@ -151,8 +276,14 @@ namespace mtools
 	**/
 	template<class random_t> inline int64 UIPTLaw(int64 m, random_t & gen)
 		{
-		UIPT_CDF_obj O(m);
-		return sampleDiscreteRVfromCDF(O, gen);
+		if (m <= 0) return -1; // always discover a new vertex when boundary has size 2
+		const internals_peelinglaw::CDFTable & tab = internals_peelinglaw::UIHPTTable();
+		while (1)
+			{
+			const int64 k = tab.inv(Unif(gen), UIHPT_CDF);
+			if (k == -1) return -1; // accepted with probability 1
+			if ((k <= m) && (Unif(gen) < internals_peelinglaw::UIPTAcceptProb(k, m))) return k;
+			}
 		}
 
 
@@ -207,6 +338,23 @@ namespace mtools
 		};
 
 
+	namespace internals_peelinglaw
+		{
+
+		/* table of freeBoltzmanTriangulation_CDF(.,m) for m < BOLTZMANN_TABLE_MAXM (one set per thread, 
+		   each table is constructed on first use) */
+		inline const CDFTable & freeBoltzmanTriangulationTable(int64 m)
+			{
+			MTOOLS_ASSERT((m >= 0) && (m < BOLTZMANN_TABLE_MAXM));
+			thread_local std::vector<CDFTable> tabs((size_t)BOLTZMANN_TABLE_MAXM);
+			CDFTable & tab = tabs[(size_t)m];
+			if (tab.empty()) { tab.set(freeBoltzmanTriangulation_CDF_obj(m), -1, m); }
+			return tab;
+			}
+
+		}
+
+
 	/**
 	* Sample a random variable according to the splitting of the boundary when peeling
 	* a Free Boltzmann Triangulation (type II) of the m+2 gon.
@@ -226,7 +374,7 @@ namespace mtools
 	template<class random_t> inline int64 freeBoltzmanTriangulationLaw(int64 m, random_t & gen)
 		{
 		freeBoltzmanTriangulation_CDF_obj O(m);
-		int64 v = sampleDiscreteRVfromCDF(O, gen);
+		int64 v = (m < internals_peelinglaw::BOLTZMANN_TABLE_MAXM) ? internals_peelinglaw::freeBoltzmanTriangulationTable(m).inv(Unif(gen), O) : sampleDiscreteRVfromCDF(O, gen);
 		if ((m > 0) && (v > 0) && (Unif_1(gen))) { v = m + 1 - v; } // re-symmetrize to reduce numerical error, even if it is theorically uneeded.
 		return v;
 		}
@@ -293,6 +441,25 @@ namespace mtools
 		};
 
 
+	namespace internals_peelinglaw
+		{
+
+		/* table of hyperbolicIHPT_CDF(.,theta) (one per thread, recomputed when theta changes) */
+		inline const CDFTable & hyperbolicIHPTTable(double theta)
+			{
+			thread_local CDFTable tab;
+			thread_local double tabtheta = -1.0;
+			if ((tab.empty()) || (tabtheta != theta)) 
+				{ 
+				tab.set(hyperbolicIHPT_CDF_obj(theta), -1, LAW_TABLE_SIZE - 2); 
+				tabtheta = theta; 
+				}
+			return tab;
+			}
+
+		}
+
+
 	/**
 	* Sample a random variable according to the law of the walk associated with the peeling process
 	* of an hyperbolic infinite Half plane Triangulation.
@@ -302,8 +469,7 @@ namespace mtools
 	**/
 	template<class random_t> inline int64 hyperbolicIHPTLaw(double theta, random_t & gen)
 		{
-		hyperbolicIHPT_CDF_obj O(theta);
-		return sampleDiscreteRVfromCDF(O, gen);
+		return internals_peelinglaw::hyperbolicIHPTTable(theta).inv(Unif(gen), hyperbolicIHPT_CDF_obj(theta));
 		}
 
 
@@ -330,15 +496,16 @@ namespace mtools
 	template<class random_t> inline int64 hyperbolicIPTLaw(int64 m, double theta, random_t & gen)
 		{
 		hyperbolicIHPT_CDF_obj O(theta);
+		const internals_peelinglaw::CDFTable & tab = internals_peelinglaw::hyperbolicIHPTTable(theta);
 		const int NBSTEP = 10;
 		while (1)
 			{
-			int64 x0 = sampleDiscreteRVfromCDF(O, gen);
+			int64 x0 = tab.inv(Unif(gen), O);
 			int64 pos = m - x0;
 			for (int i = 0; i < NBSTEP; i++)
 				{
 				if (pos < 0) { break; }
-				pos -= sampleDiscreteRVfromCDF(O, gen);
+				pos -= tab.inv(Unif(gen), O);
 				}
 			if (pos >= 0) { return x0;  }
 			}
@@ -419,6 +586,29 @@ namespace mtools
 		};
 
 
+	namespace internals_peelinglaw
+		{
+
+		/* table of generalBoltzmanTriangulation_CDF(.,m,theta) for m < BOLTZMANN_TABLE_MAXM (one set 
+		   per thread, each table is constructed on first use and all are discarded when theta changes) */
+		inline const CDFTable & generalBoltzmanTriangulationTable(int64 m, double theta)
+			{
+			MTOOLS_ASSERT((m >= 0) && (m < BOLTZMANN_TABLE_MAXM));
+			thread_local std::vector<CDFTable> tabs((size_t)BOLTZMANN_TABLE_MAXM);
+			thread_local double tabtheta = -1.0;
+			if (tabtheta != theta) 
+				{ 
+				tabs.assign((size_t)BOLTZMANN_TABLE_MAXM, CDFTable()); 
+				tabtheta = theta; 
+				}
+			CDFTable & tab = tabs[(size_t)m];
+			if (tab.empty()) { tab.set(generalBoltzmanTriangulation_CDF_obj(m, theta), -1, m); }
+			return tab;
+			}
+
+		}
+
+
 	/**
 	* Sample a random variable according to the splitting of the boundary when peeling
 	* a general Boltzmann Triangulation (type II) of the m+2 gon with parameter theta
@@ -462,7 +652,7 @@ namespace mtools
 	template<class random_t> inline int64 generalBoltzmanTriangulationLaw(int64 m, double theta, random_t & gen)
 		{
 		generalBoltzmanTriangulation_CDF_obj O(m,theta);
-		int64 v = sampleDiscreteRVfromCDF(O, gen);
+		int64 v = (m < internals_peelinglaw::BOLTZMANN_TABLE_MAXM) ? internals_peelinglaw::generalBoltzmanTriangulationTable(m, theta).inv(Unif(gen), O) : sampleDiscreteRVfromCDF(O, gen);
 		if ((m > 0) && (v > 0) && (Unif_1(gen))) { v = m + 1 - v; } // re-symmetrize to reduce numerical error, even if it is theorically uneeded.
 		return v;
 		}
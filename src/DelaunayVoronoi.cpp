@@ -334,12 +334,88 @@ extern "C"
 
 
 #include "maths/DelaunayVoronoi.hpp"
+#include "misc/internal/threadworker.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+#include <mutex>
+#include <limits>
+#include <cmath>
 
 
 namespace mtools
 {
 
 
+    namespace internals_delaunayvoronoi
+    {
+
+        /* twice the signed area of triangle (a,b,c): positive if (a,b,c) is counter-clockwise */
+        inline double orient(const mtools::fVec2 & a, const mtools::fVec2 & b, const mtools::fVec2 & c)
+            {
+            return (b.X() - a.X()) * (c.Y() - a.Y()) - (b.Y() - a.Y()) * (c.X() - a.X());
+            }
+
+
+        /* positive if d lies inside the circumcircle of the counter-clockwise triangle (a,b,c) */
+        inline double incircle(const mtools::fVec2 & a, const mtools::fVec2 & b, const mtools::fVec2 & c, const mtools::fVec2 & d)
+            {
+            const double adx = a.X() - d.X(), ady = a.Y() - d.Y();
+            const double bdx = b.X() - d.X(), bdy = b.Y() - d.Y();
+            const double cdx = c.X() - d.X(), cdy = c.Y() - d.Y();
+            const double alift = adx * adx + ady * ady;
+            const double blift = bdx * bdx + bdy * bdy;
+            const double clift = cdx * cdx + cdy * cdy;
+            return alift * (bdx * cdy - cdx * bdy) + blift * (cdx * ady - adx * cdy) + clift * (adx * bdy - bdx * ady);
+            }
+
+
+        /* circumcenter of triangle (a,b,c) */
+        inline mtools::fVec2 circumcenter(const mtools::fVec2 & a, const mtools::fVec2 & b, const mtools::fVec2 & c)
+            {
+            const double bx = b.X() - a.X(), by = b.Y() - a.Y();
+            const double cx = c.X() - a.X(), cy = c.Y() - a.Y();
+            const double d = 2 * (bx * cy - by * cx);
+            const double b2 = bx * bx + by * by;
+            const double c2 = cx * cx + cy * cy;
+            return mtools::fVec2(a.X() + (cy * b2 - by * c2) / d, a.Y() + (bx * c2 - cx * b2) / d);
+            }
+
+
+        /* position of (x,y) in [0,2^16)^2 along the Hilbert curve */
+        inline uint64_t hilbertIndex(uint32_t x, uint32_t y)
+            {
+            const uint32_t n = (1u << 16);
+            uint64_t d = 0;
+            for (uint32_t s = n / 2; s > 0; s /= 2)
+                {
+                const uint32_t rx = ((x & s) > 0) ? 1 : 0;
+                const uint32_t ry = ((y & s) > 0) ? 1 : 0;
+                d += (uint64_t)s * s * ((3 * rx) ^ ry);
+                if (ry == 0)
+                    {
+                    if (rx == 1) { x = n - 1 - x; y = n - 1 - y; }
+                    std::swap(x, y);
+                    }
+                }
+            return d;
+            }
+
+
+        /* Triangle uses global variables hence calls to triangulate() must not be concurrent */
+        std::mutex triangleMutex;
+
+
+        /* key identifying the (unoriented) edge (a,b) */
+        inline uint64_t edgeKey(int a, int b)
+            {
+            if (a > b) std::swap(a, b);
+            return ((((uint64_t)(uint32_t)a) << 32) | ((uint64_t)(uint32_t)b));
+            }
+
+    }
+
+
     void DelaunayVoronoi::compute()
         {
         struct triangulateio in, mid, out, vorout;
@@ -358,7 +434,10 @@ namespace mtools
         // v = output voronoi diagram
         // Q = quiet, no info
         char param[6] = "czevQ";
-        triangulate(param, &in, &mid, &vorout);
+            {
+            std::lock_guard<std::mutex> lock(internals_delaunayvoronoi::triangleMutex);
+            triangulate(param, &in, &mid, &vorout);
+            }
 
         _copy(VoronoiVertices, vorout.pointlist, vorout.numberofpoints);
         trifree(vorout.pointlist);
@@ -395,11 +474,415 @@ namespace mtools
                 }
             }
 
+        DelaunayEdgesAdded.clear();
+        DelaunayEdgesRemoved.clear();
+        _clearTopology(); // the structure used by update() is built on its first call
+        _nbinserted = DelaunayVertices.size();
+
         _freeall((void*)&mid);
         _freeall((void*)&vorout);
         }
 
 
+    void DelaunayVoronoi::update()
+        {
+        const size_t nv = DelaunayVertices.size();
+        DelaunayEdgesAdded.clear();
+        DelaunayEdgesRemoved.clear();
+        _changes.clear();
+        if (_nbinserted == nv) return;
+        if ((_nbinserted > 0) && (_nbinserted < nv) && (_tri.size() == 0)) { _buildTopology(); } // first update() since compute()
+        if ((_nbinserted == 0) || (_nbinserted > nv)) { _recomputeAll(); return; }
+        // sort the new vertices along a Hilbert curve so that consecutive points are close
+        double minx = DelaunayVertices[_nbinserted].X(), maxx = minx;
+        double miny = DelaunayVertices[_nbinserted].Y(), maxy = miny;
+        for (size_t i = _nbinserted; i < nv; i++)
+            {
+            const mtools::fVec2 & P = DelaunayVertices[i];
+            minx = std::min(minx, P.X()); maxx = std::max(maxx, P.X());
+            miny = std::min(miny, P.Y()); maxy = std::max(maxy, P.Y());
+            }
+        const double sx = (maxx > minx) ? (65535.0 / (maxx - minx)) : 0.0;
+        const double sy = (maxy > miny) ? (65535.0 / (maxy - miny)) : 0.0;
+        std::vector<std::pair<uint64_t, int> > order;
+        order.reserve(nv - _nbinserted);
+        for (size_t i = _nbinserted; i < nv; i++)
+            {
+            const mtools::fVec2 & P = DelaunayVertices[i];
+            order.push_back({ internals_delaunayvoronoi::hilbertIndex((uint32_t)((P.X() - minx) * sx), (uint32_t)((P.Y() - miny) * sy)), (int)i });
+            }
+        std::sort(order.begin(), order.end());
+        _vstart.resize(nv + 1);
+        _vend.resize(nv + 1);
+        int hint = 0;
+        for (auto & o : order)
+            {
+            const int r = _insertVertex(o.second, hint);
+            if (r == -2) { _recomputeAll(); return; } // inconsistent predicates: start again from scratch
+            if (r >= 0) hint = r;
+            }
+        _nbinserted = nv;
+        // net changes of the set of edges
+        std::stable_sort(_changes.begin(), _changes.end(), [](const std::pair<uint64_t, bool> & a, const std::pair<uint64_t, bool> & b) { return a.first < b.first; });
+        for (size_t i = 0; i < _changes.size();)
+            {
+            size_t j = i;
+            while ((j + 1 < _changes.size()) && (_changes[j + 1].first == _changes[i].first)) j++;
+            if (_changes[i].second == _changes[j].second)
+                { // otherwise, the edge was added and removed (or removed and added back) 
+                const mtools::iVec2 E((int64)(_changes[i].first >> 32), (int64)(_changes[i].first & 0xFFFFFFFF));
+                if (_changes[i].second) DelaunayEdgesAdded.push_back(E); else DelaunayEdgesRemoved.push_back(E);
+                }
+            i = j + 1;
+            }
+        _changes.clear();
+        }
+
+
+    void DelaunayVoronoi::_recomputeAll()
+        {
+        // set of edges before the call to update()
+        std::vector<uint64_t> before;
+        before.reserve(DelaunayEdgesIndices.size());
+        for (auto & E : DelaunayEdgesIndices) { before.push_back(internals_delaunayvoronoi::edgeKey((int)E.X(), (int)E.Y())); }
+        std::sort(before.begin(), before.end());
+        if (_changes.size() > 0)
+            { // undo the insertions already performed
+            std::stable_sort(_changes.begin(), _changes.end(), [](const std::pair<uint64_t, bool> & a, const std::pair<uint64_t, bool> & b) { return a.first < b.first; });
+            std::vector<uint64_t> added, removed;
+            for (size_t i = 0; i < _changes.size();)
+                {
+                size_t j = i;
+                while ((j + 1 < _changes.size()) && (_changes[j + 1].first == _changes[i].first)) j++;
+                if (_changes[i].second == _changes[j].second) { if (_changes[i].second) added.push_back(_changes[i].first); else removed.push_back(_changes[i].first); }
+                i = j + 1;
+                }
+            std::vector<uint64_t> tmp;
+            std::set_difference(before.begin(), before.end(), added.begin(), added.end(), std::back_inserter(tmp));
+            before.clear();
+            std::set_union(tmp.begin(), tmp.end(), removed.begin(), removed.end(), std::back_inserter(before));
+            _changes.clear();
+            }
+        if (DelaunayVertices.size() >= 3)
+            {
+            compute();
+            }
+        else
+            {
+            VoronoiVertices.clear();
+            DelaunayEdgesIndices.clear();
+            DelaunayTrianglesIndices.clear();
+            VoronoiEdgesIndices.clear();
+            VoronoiNormals.clear();
+            _clearTopology();
+            }
+        std::vector<uint64_t> after;
+        after.reserve(DelaunayEdgesIndices.size());
+        for (auto & E : DelaunayEdgesIndices) { after.push_back(internals_delaunayvoronoi::edgeKey((int)E.X(), (int)E.Y())); }
+        std::sort(after.begin(), after.end());
+        std::vector<uint64_t> added, removed;
+        std::set_difference(after.begin(), after.end(), before.begin(), before.end(), std::back_inserter(added));
+        std::set_difference(before.begin(), before.end(), after.begin(), after.end(), std::back_inserter(removed));
+        DelaunayEdgesAdded.clear();
+        DelaunayEdgesRemoved.clear();
+        for (uint64_t k : added) { DelaunayEdgesAdded.push_back(mtools::iVec2((int64)(k >> 32), (int64)(k & 0xFFFFFFFF))); }
+        for (uint64_t k : removed) { DelaunayEdgesRemoved.push_back(mtools::iVec2((int64)(k >> 32), (int64)(k & 0xFFFFFFFF))); }
+        }
+
+
+    void DelaunayVoronoi::_clearTopology()
+        {
+        _tri.clear();
+        _edgeSide.clear();
+        _freeTri.clear();
+        _freeEdge.clear();
+        _changes.clear();
+        _nbinserted = 0;
+        }
+
+
+    void DelaunayVoronoi::_buildTopology()
+        {
+        const size_t nv = _nbinserted;
+        _clearTopology();
+        const int nt = (int)DelaunayTrianglesIndices.size();
+        if (nt == 0) return;
+        // index of the edges
+        std::unordered_map<uint64_t, int> edges;
+        edges.reserve(DelaunayEdgesIndices.size() * 2);
+        for (size_t k = 0; k < DelaunayEdgesIndices.size(); k++) { edges[internals_delaunayvoronoi::edgeKey((int)DelaunayEdgesIndices[k].X(), (int)DelaunayEdgesIndices[k].Y())] = (int)k; }
+        // triangles with their edges, the neighbours are found as the other side of each edge
+        _tri.resize(nt);
+        _edgeSide.assign(DelaunayEdgesIndices.size(), -1);
+        for (int t = 0; t < nt; t++)
+            {
+            _Tri & T = _tri[t];
+            for (int j = 0; j < 3; j++) { T.v[j] = (int)DelaunayTrianglesIndices[t][j]; T.n[j] = -1; }
+            T.pub = t;
+            }
+        for (int t = 0; t < nt; t++)
+            {
+            for (int j = 0; j < 3; j++)
+                {
+                auto it = edges.find(internals_delaunayvoronoi::edgeKey(_tri[t].v[(j + 1) % 3], _tri[t].v[(j + 2) % 3]));
+                if (it == edges.end()) { _clearTopology(); return; }
+                const int k = it->second;
+                _tri[t].e[j] = k;
+                const int u = _edgeSide[k];
+                if (u < 0) { _edgeSide[k] = 3 * t + j; continue; }
+                if (_tri[u / 3].n[u % 3] >= 0) { _clearTopology(); return; } // edge shared by more than two triangles
+                _tri[t].n[j] = u / 3;
+                _tri[u / 3].n[u % 3] = t;
+                }
+            }
+        // ghost triangles outside the convex hull
+        std::vector<int> gstart(nv, -1), gend(nv, -1);
+        for (int t = 0; t < nt; t++)
+            {
+            for (int j = 0; j < 3; j++)
+                {
+                if (_tri[t].n[j] >= 0) continue;
+                const int a = _tri[t].v[(j + 2) % 3], b = _tri[t].v[(j + 1) % 3];
+                const int g = (int)_tri.size();
+                _Tri G;
+                G.v[0] = a; G.v[1] = b; G.v[2] = -1;
+                G.n[0] = -1; G.n[1] = -1; G.n[2] = t;
+                G.e[0] = -1; G.e[1] = -1; G.e[2] = _tri[t].e[j];
+                G.pub = -1;
+                _tri.push_back(G);
+                _tri[t].n[j] = g;
+                gstart[a] = g;
+                gend[b] = g;
+                }
+            }
+        for (size_t g = nt; g < _tri.size(); g++)
+            {
+            _tri[g].n[0] = gstart[_tri[g].v[1]];
+            _tri[g].n[1] = gend[_tri[g].v[0]];
+            }
+        _mark.assign(_tri.size(), 0);
+        _nbinserted = nv;
+        }
+
+
+    int DelaunayVoronoi::_locate(const mtools::fVec2 & P, int hint)
+        {
+        using internals_delaunayvoronoi::orient;
+        const int ntri = (int)_tri.size();
+        int t = ((hint >= 0) && (hint < ntri)) ? hint : 0;
+        if (_tri[t].pub < 0) t = _tri[t].n[2];
+        // stochastic walk (the random choice of the first edge tested prevents cycles)
+        for (int steps = 0; steps < ntri; steps++)
+            {
+            const _Tri & T = _tri[t];
+            if (T.pub < 0) return t; // outside the convex hull
+            _walkrng ^= (_walkrng << 13); _walkrng ^= (_walkrng >> 7); _walkrng ^= (_walkrng << 17);
+            const int r = (int)(_walkrng % 3);
+            int k;
+            for (k = 0; k < 3; k++)
+                {
+                const int j = (r + k) % 3;
+                if (orient(DelaunayVertices[T.v[(j + 1) % 3]], DelaunayVertices[T.v[(j + 2) % 3]], P) < 0) { t = T.n[j]; break; }
+                }
+            if (k == 3) return t;
+            }
+        // the walk failed (rounding errors): linear search
+        for (int u = 0; u < ntri; u++)
+            {
+            const _Tri & T = _tri[u];
+            if (T.pub < 0) continue;
+            if ((orient(DelaunayVertices[T.v[0]], DelaunayVertices[T.v[1]], P) >= 0) && (orient(DelaunayVertices[T.v[1]], DelaunayVertices[T.v[2]], P) >= 0) && (orient(DelaunayVertices[T.v[2]], DelaunayVertices[T.v[0]], P) >= 0)) return u;
+            }
+        for (int u = 0; u < ntri; u++) { if ((_tri[u].pub < 0) && (_conflict(u, P))) return u; }
+        return -1;
+        }
+
+
+    bool DelaunayVoronoi::_conflict(int t, const mtools::fVec2 & P) const
+        {
+        const _Tri & T = _tri[t];
+        const mtools::fVec2 & A = DelaunayVertices[T.v[0]];
+        const mtools::fVec2 & B = DelaunayVertices[T.v[1]];
+        if (T.pub >= 0) return (internals_delaunayvoronoi::incircle(A, B, DelaunayVertices[T.v[2]], P) > 0);
+        // ghost triangle: P must be strictly on the outer side of the hull edge (A,B) or inside the segment.
+        const double o = internals_delaunayvoronoi::orient(A, B, P);
+        if (o != 0) return (o > 0);
+        const double d = (P.X() - A.X()) * (B.X() - A.X()) + (P.Y() - A.Y()) * (B.Y() - A.Y());
+        return ((d > 0) && (d < (B.X() - A.X()) * (B.X() - A.X()) + (B.Y() - A.Y()) * (B.Y() - A.Y())));
+        }
+
+
+    int DelaunayVoronoi::_insertVertex(int p, int hint)
+        {
+        using internals_delaunayvoronoi::orient;
+        using internals_delaunayvoronoi::edgeKey;
+        const mtools::fVec2 P = DelaunayVertices[p];
+        const int t0 = _locate(P, hint);
+        if (t0 < 0) return -2;
+        for (int j = 0; j < 3; j++)
+            {
+            const int v = _tri[t0].v[j];
+            if ((v >= 0) && (DelaunayVertices[v].X() == P.X()) && (DelaunayVertices[v].Y() == P.Y())) return -1; // duplicate vertex
+            }
+        if (!_conflict(t0, P)) return -1;
+        // cavity: the triangles whose circumcircle contain P (connected set containing t0)
+        if (_mark.size() < _tri.size()) _mark.resize(_tri.size(), 0);
+        const int stamp = p + 1;
+        _cavity.clear();
+        _cavity.push_back(t0);
+        _mark[t0] = stamp;
+        for (size_t i = 0; i < _cavity.size(); i++)
+            {
+            const _Tri & T = _tri[_cavity[i]];
+            for (int j = 0; j < 3; j++)
+                {
+                const int nb = T.n[j];
+                if ((_mark[nb] != stamp) && (_conflict(nb, P))) { _mark[nb] = stamp; _cavity.push_back(nb); }
+                }
+            }
+        // boundary of the cavity (check that it is star shaped w.r.t. P before modifying anything)
+        struct Bnd { int a, b, o, jo, e; };
+        std::vector<Bnd> bnd;
+        bnd.reserve(_cavity.size() + 2);
+        for (int t : _cavity)
+            {
+            const _Tri & T = _tri[t];
+            for (int j = 0; j < 3; j++)
+                {
+                const int nb = T.n[j];
+                if (_mark[nb] == stamp) continue;
+                Bnd B;
+                B.a = T.v[(j + 1) % 3]; B.b = T.v[(j + 2) % 3]; B.o = nb; B.e = T.e[j];
+                B.jo = 0; while (_tri[nb].n[B.jo] != t) { B.jo++; }
+                if ((B.a >= 0) && (B.b >= 0) && (orient(DelaunayVertices[B.a], DelaunayVertices[B.b], P) <= 0)) return -2;
+                bnd.push_back(B);
+                }
+            }
+        if (bnd.size() != _cavity.size() + 2) return -2; // the cavity is not a topological disk
+        // remove the edges inside the cavity and free the slots of the triangles
+        for (int t : _cavity)
+            {
+            const _Tri & T = _tri[t];
+            for (int j = 0; j < 3; j++)
+                {
+                const int nb = T.n[j];
+                if ((_mark[nb] != stamp) || (nb < t) || (T.e[j] < 0)) continue;
+                _changes.push_back({ edgeKey(T.v[(j + 1) % 3], T.v[(j + 2) % 3]), false });
+                _edgeSide[T.e[j]] = -1;
+                _freeEdge.push_back(T.e[j]);
+                }
+            if (T.pub >= 0) _freeTri.push_back(T.pub);
+            }
+        // slots of the new triangles: the slots of the cavity and new ones
+        const int nb = (int)bnd.size();
+        std::vector<int> slot(nb);
+        for (int i = 0; i < nb; i++)
+            {
+            if (i < (int)_cavity.size()) slot[i] = _cavity[i]; else { slot[i] = (int)_tri.size(); _tri.push_back(_Tri()); }
+            _vstart[bnd[i].a + 1] = i;
+            _vend[bnd[i].b + 1] = i;
+            }
+        if (_mark.size() < _tri.size()) _mark.resize(_tri.size(), 0);
+        // create the triangles (a,b,P) in canonical order, then rotate the ghosts so that -1 is in position 2
+        for (int i = 0; i < nb; i++)
+            {
+            const Bnd & B = bnd[i];
+            const int cv[3] = { B.a, B.b, p };
+            const int cn[3] = { slot[_vstart[B.b + 1]], slot[_vend[B.a + 1]], B.o };
+            const int ce[3] = { -1, -1, B.e };
+            const int r = (B.a < 0) ? 1 : ((B.b < 0) ? 2 : 0);
+            _Tri & T = _tri[slot[i]];
+            for (int j = 0; j < 3; j++) { T.v[j] = cv[(j + r) % 3]; T.n[j] = cn[(j + r) % 3]; T.e[j] = ce[(j + r) % 3]; }
+            T.pub = -1;
+            _tri[B.o].n[B.jo] = slot[i];
+            _mark[slot[i]] = 0;
+            }
+        // public index of the new (real) triangles
+        for (int i = 0; i < nb; i++)
+            {
+            _Tri & T = _tri[slot[i]];
+            if (T.v[2] < 0) continue;
+            if (_freeTri.size() > 0) { T.pub = _freeTri.back(); _freeTri.pop_back(); }
+            else
+                {
+                T.pub = (int)DelaunayTrianglesIndices.size();
+                DelaunayTrianglesIndices.push_back(mtools::iVec3());
+                VoronoiVertices.push_back(mtools::fVec2());
+                VoronoiNormals.push_back(mtools::fVec2());
+                }
+            DelaunayTrianglesIndices[T.pub] = mtools::iVec3(T.v[0], T.v[1], T.v[2]);
+            }
+        MTOOLS_ASSERT(_freeTri.size() == 0);
+        // edges: the boundary edges are kept and a new edge (a,P) is created for each vertex a of the boundary
+        for (int i = 0; i < nb; i++)
+            {
+            const Bnd & B = bnd[i];
+            const int r = (B.a < 0) ? 1 : ((B.b < 0) ? 2 : 0);
+            const int s = slot[i];
+            if (B.e >= 0) { const int j = (5 - r) % 3; _edgeSide[B.e] = (_tri[s].pub >= 0) ? (3 * s + j) : (3 * B.o + B.jo); }
+            if (B.a < 0) continue;
+            // edge (P,a) is opposite to b in triangle s and opposite to the first vertex in the triangle ending at a
+            int k;
+            if (_freeEdge.size() > 0) { k = _freeEdge.back(); _freeEdge.pop_back(); }
+            else
+                {
+                k = (int)DelaunayEdgesIndices.size();
+                DelaunayEdgesIndices.push_back(mtools::iVec2());
+                VoronoiEdgesIndices.push_back(mtools::iVec2());
+                _edgeSide.push_back(-1);
+                }
+            DelaunayEdgesIndices[k] = mtools::iVec2(B.a, p);
+            _changes.push_back({ edgeKey(B.a, p), true });
+            const int j1 = (4 - r) % 3;                     // position of canonical side 1 in triangle s
+            _tri[s].e[j1] = k;
+            const int i2 = _vend[B.a + 1];
+            const int s2 = slot[i2];
+            const int r2 = (bnd[i2].a < 0) ? 1 : ((bnd[i2].b < 0) ? 2 : 0);
+            const int j2 = (3 - r2) % 3;                    // position of canonical side 0 in triangle s2
+            _tri[s2].e[j2] = k;
+            _edgeSide[k] = (_tri[s].pub >= 0) ? (3 * s + j1) : (3 * s2 + j2);
+            }
+        MTOOLS_ASSERT(_freeEdge.size() == 0);
+        // update the Voronoi diagram around the new vertex
+        int res = -1;
+        for (int i = 0; i < nb; i++)
+            {
+            const int s = slot[i];
+            if (_tri[s].pub >= 0) { _updateVoronoiVertex(s); res = s; }
+            for (int j = 0; j < 3; j++) { if (_tri[s].e[j] >= 0) _updateVoronoiEdge(_tri[s].e[j]); }
+            if (_tri[bnd[i].o].pub >= 0) _updateVoronoiVertex(bnd[i].o); // its normal may change
+            }
+        return res;
+        }
+
+
+    void DelaunayVoronoi::_updateVoronoiEdge(int e)
+        {
+        int t = _edgeSide[e] / 3;
+        const int j = _edgeSide[e] % 3;
+        int nb = _tri[t].n[j];
+        if (_tri[t].pub < 0) std::swap(t, nb);
+        VoronoiEdgesIndices[e] = mtools::iVec2(_tri[t].pub, _tri[nb].pub); // pub = -1 for a ghost: semi-infinite ray
+        }
+
+
+    void DelaunayVoronoi::_updateVoronoiVertex(int t)
+        {
+        const _Tri & T = _tri[t];
+        VoronoiVertices[T.pub] = internals_delaunayvoronoi::circumcenter(DelaunayVertices[T.v[0]], DelaunayVertices[T.v[1]], DelaunayVertices[T.v[2]]);
+        mtools::fVec2 N(0, 0);
+        for (int j = 0; j < 3; j++)
+            {
+            if (_tri[T.n[j]].pub >= 0) continue;
+            // edge of the convex hull: the ray goes outward i.e. on the right of (a,b)
+            const mtools::fVec2 D = DelaunayVertices[T.v[(j + 2) % 3]] - DelaunayVertices[T.v[(j + 1) % 3]];
+            N = mtools::fVec2(D.Y(), -D.X());
+            N.normalize();
+            }
+        VoronoiNormals[T.pub] = N;
+        }
+
+
     void DelaunayVoronoi::_copy(std::vector<mtools::fVec2>& vec, const double* data, int len)
         {
         vec.clear();
@@ -453,6 +936,447 @@ namespace mtools
         }
 
 
+    double VoronoiCell::area() const
+        {
+        if (!bounded) return std::numeric_limits<double>::infinity();
+        const size_t l = vertices.size();
+        double a = 0;
+        for (size_t i = 0; i < l; i++)
+            {
+            const mtools::fVec2 & P = vertices[i];
+            const mtools::fVec2 & Q = vertices[(i + 1) % l];
+            a += P.X() * Q.Y() - P.Y() * Q.X();
+            }
+        return a / 2;
+        }
+
+
+    namespace internals_delaunayvoronoi
+    {
+
+        /* axis aligned rectangle */
+        struct Rect { double xmin, xmax, ymin, ymax; };
+
+
+        /* Convex hull of the sites with indices in idx, in counter-clockwise order. The points on 
+         * the edges of the hull are kept. Only one site is kept among sites at the same position. */
+        std::vector<int> convexHull(const std::vector<mtools::fVec2> & sites, std::vector<int> idx)
+            {
+            std::sort(idx.begin(), idx.end(), [&](int a, int b) { const mtools::fVec2 & P = sites[a], & Q = sites[b]; return (P.X() < Q.X()) || ((P.X() == Q.X()) && ((P.Y() < Q.Y()) || ((P.Y() == Q.Y()) && (a < b)))); });
+            idx.erase(std::unique(idx.begin(), idx.end(), [&](int a, int b) { return (sites[a].X() == sites[b].X()) && (sites[a].Y() == sites[b].Y()); }), idx.end());
+            const int l = (int)idx.size();
+            if (l < 3) return idx;
+            std::vector<int> H(2 * l);
+            int k = 0;
+            for (int i = 0; i < l; i++)
+                { // lower hull
+                while ((k >= 2) && (orient(sites[H[k - 2]], sites[H[k - 1]], sites[idx[i]]) < 0)) k--;
+                H[k++] = idx[i];
+                }
+            for (int i = l - 2, t = k + 1; i >= 0; i--)
+                { // upper hull
+                while ((k >= t) && (orient(sites[H[k - 2]], sites[H[k - 1]], sites[idx[i]]) < 0)) k--;
+                H[k++] = idx[i];
+                }
+            H.resize(k - 1);
+            return H;
+            }
+
+
+        /* interval [l,r] of abscissa of the intersection of the convex polygon H with the horizontal line at height y */
+        void hullSection(const std::vector<mtools::fVec2> & sites, const std::vector<int> & H, double y, double & l, double & r)
+            {
+            l = std::numeric_limits<double>::infinity();
+            r = -std::numeric_limits<double>::infinity();
+            const size_t h = H.size();
+            for (size_t i = 0; i < h; i++)
+                {
+                const mtools::fVec2 & A = sites[H[i]];
+                const mtools::fVec2 & B = sites[H[(i + 1) % h]];
+                if ((y < std::min(A.Y(), B.Y())) || (y > std::max(A.Y(), B.Y()))) continue;
+                const double x = (A.Y() == B.Y()) ? A.X() : (A.X() + (y - A.Y()) * (B.X() - A.X()) / (B.Y() - A.Y()));
+                l = std::min(l, x); r = std::max(r, x);
+                if (A.Y() == B.Y()) { l = std::min(l, B.X()); r = std::max(r, B.X()); }
+                }
+            }
+
+
+        /* bounding box [xlo,xhi]x[ylo,yhi] of the intersection of the disk D(C,r) with the box B. Return false if the intersection is empty */
+        inline bool diskBoxExtent(const mtools::fVec2 & C, double r, const Rect & B, double & xlo, double & xhi, double & ylo, double & yhi)
+            {
+            const double dy = (C.Y() < B.ymin) ? (B.ymin - C.Y()) : ((C.Y() > B.ymax) ? (C.Y() - B.ymax) : 0.0);
+            const double dx = (C.X() < B.xmin) ? (B.xmin - C.X()) : ((C.X() > B.xmax) ? (C.X() - B.xmax) : 0.0);
+            if ((dx > r) || (dy > r)) return false;
+            const double hx = std::sqrt(r * r - dy * dy); // half width of the disk inside the horizontal band of the box
+            const double hy = std::sqrt(r * r - dx * dx); // half height of the disk inside the vertical band of the box
+            xlo = std::max(C.X() - hx, B.xmin); xhi = std::min(C.X() + hx, B.xmax);
+            ylo = std::max(C.Y() - hy, B.ymin); yhi = std::min(C.Y() + hy, B.ymax);
+            return ((xlo <= xhi) && (ylo <= yhi));
+            }
+
+    }
+
+
+    int64 computeVoronoiCells(const std::vector<mtools::fVec2> & sites, std::function<void(const VoronoiCell &)> fun, int nbthreads, int64 tilesize)
+        {
+        using internals_delaunayvoronoi::orient;
+        using internals_delaunayvoronoi::Rect;
+        const int64 n = (int64)sites.size();
+        MTOOLS_INSURE(n < (int64)std::numeric_limits<int>::max());
+        if (n < 3) return 0;
+        if (tilesize < 16) tilesize = 16;
+
+        // bounding box and grid of cells with about 8 sites per cell
+        Rect box = { sites[0].X(), sites[0].X(), sites[0].Y(), sites[0].Y() };
+        for (int64 i = 1; i < n; i++)
+            {
+            box.xmin = std::min(box.xmin, sites[i].X()); box.xmax = std::max(box.xmax, sites[i].X());
+            box.ymin = std::min(box.ymin, sites[i].Y()); box.ymax = std::max(box.ymax, sites[i].Y());
+            }
+        const double W = box.xmax - box.xmin, H = box.ymax - box.ymin;
+        if ((W <= 0) || (H <= 0)) return 0; // aligned sites
+        const double maxcells = (double)(n / 8 + 1);
+        double h = std::sqrt(W * H / maxcells);
+        h = std::max(h, std::max(W, H) / maxcells);
+        const int gx = std::max(1, std::min((int)maxcells, (int)std::ceil(W / h)));
+        const int gy = std::max(1, std::min((int)maxcells, (int)std::ceil(H / h)));
+        auto cellX = [&](double x) { return std::max(0, std::min(gx - 1, (int)((x - box.xmin) / h))); };
+        auto cellY = [&](double y) { return std::max(0, std::min(gy - 1, (int)((y - box.ymin) / h))); };
+
+        // sort the sites by cells
+        std::vector<int> cellstart((size_t)gx * gy + 1, 0);
+        for (int64 i = 0; i < n; i++) { cellstart[(size_t)cellY(sites[i].Y()) * gx + cellX(sites[i].X()) + 1]++; }
+        for (size_t c = 1; c < cellstart.size(); c++) { cellstart[c] += cellstart[c - 1]; }
+        std::vector<int> cellsites((size_t)n);
+            {
+            std::vector<int> pos(cellstart.begin(), cellstart.end() - 1);
+            for (int64 i = 0; i < n; i++) { cellsites[pos[(size_t)cellY(sites[i].Y()) * gx + cellX(sites[i].X())]++] = (int)i; }
+            }
+
+        // convex hull: the hull of the extremal sites of each row and column of cells is computed
+        // first. Then only the cells not strictly inside it need to be considered.
+        std::vector<int> hull;
+            {
+            std::vector<int> colmin(gx, -1), colmax(gx, -1), rowmin(gy, -1), rowmax(gy, -1);
+            for (int64 i = 0; i < n; i++)
+                {
+                const int cx = cellX(sites[i].X()), cy = cellY(sites[i].Y());
+                if ((colmin[cx] < 0) || (sites[i].Y() < sites[colmin[cx]].Y())) colmin[cx] = (int)i;
+                if ((colmax[cx] < 0) || (sites[i].Y() > sites[colmax[cx]].Y())) colmax[cx] = (int)i;
+                if ((rowmin[cy] < 0) || (sites[i].X() < sites[rowmin[cy]].X())) rowmin[cy] = (int)i;
+                if ((rowmax[cy] < 0) || (sites[i].X() > sites[rowmax[cy]].X())) rowmax[cy] = (int)i;
+                }
+            std::vector<int> cand;
+            for (const std::vector<int> * v : { &colmin, &colmax, &rowmin, &rowmax }) { for (int i : *v) { if (i >= 0) cand.push_back(i); } }
+            const std::vector<int> H0 = internals_delaunayvoronoi::convexHull(sites, cand);
+            const double tol = 1.0e-9 * (W + H);
+            double l0, r0, l1, r1;
+            internals_delaunayvoronoi::hullSection(sites, H0, box.ymin, l0, r0);
+            for (int cy = 0; cy < gy; cy++)
+                {
+                internals_delaunayvoronoi::hullSection(sites, H0, box.ymin + (cy + 1) * h, l1, r1);
+                const double l = std::max(l0, l1) + tol, r = std::min(r0, r1) - tol;
+                for (int cx = 0; cx < gx; cx++)
+                    {
+                    if ((box.xmin + cx * h > l) && (box.xmin + (cx + 1) * h < r)) continue; // cell strictly inside H0
+                    const size_t c = (size_t)cy * gx + cx;
+                    cand.insert(cand.end(), cellsites.begin() + cellstart[c], cellsites.begin() + cellstart[c + 1]);
+                    }
+                l0 = l1; r0 = r1;
+                }
+            hull = internals_delaunayvoronoi::convexHull(sites, cand);
+            }
+        if (hull.size() < 3) return 0;
+        std::unordered_map<int, std::pair<int, int> > hullnb; // site -> (previous, next) on the hull
+        for (size_t i = 0; i < hull.size(); i++) { hullnb[hull[i]] = std::make_pair(hull[(i + hull.size() - 1) % hull.size()], hull[(i + 1) % hull.size()]); }
+
+        // for each cell, the endpoints of the hull edges passing nearby: they are added to the local
+        // triangulations so that the local convex hull coincides with the global one.
+        std::vector<int> hullcellstart((size_t)gx * gy + 1, 0), hullcellsites;
+            {
+            std::vector<std::pair<int, int> > ch; // (cell, site)
+            const size_t l = hull.size();
+            for (size_t i = 0; i < l; i++)
+                {
+                const mtools::fVec2 & A = sites[hull[i]];
+                const mtools::fVec2 & B = sites[hull[(i + 1) % l]];
+                const int m = (int)std::ceil((B - A).norm() / (0.5 * h)) + 1;
+                for (int s = 0; s <= m; s++)
+                    {
+                    const mtools::fVec2 M = A + (B - A) * ((double)s / m);
+                    const int cx = cellX(M.X()), cy = cellY(M.Y());
+                    for (int y = std::max(0, cy - 1); y <= std::min(gy - 1, cy + 1); y++) for (int x = std::max(0, cx - 1); x <= std::min(gx - 1, cx + 1); x++)
+                        {
+                        ch.push_back({ y * gx + x, hull[i] });
+                        ch.push_back({ y * gx + x, hull[(i + 1) % l] });
+                        }
+                    }
+                }
+            std::sort(ch.begin(), ch.end());
+            ch.erase(std::unique(ch.begin(), ch.end()), ch.end());
+            hullcellsites.reserve(ch.size());
+            for (auto & e : ch) { hullcellstart[(size_t)e.first + 1]++; hullcellsites.push_back(e.second); }
+            for (size_t c = 1; c < hullcellstart.size(); c++) { hullcellstart[c] += hullcellstart[c - 1]; }
+            }
+
+        // tiles of T x T cells
+        const double sitespercell = (double)n / ((double)gx * gy);
+        const int T = std::max(1, (int)std::lround(std::sqrt((double)tilesize / sitespercell)));
+        const int ntx = (gx + T - 1) / T, nty = (gy + T - 1) / T;
+        const int MAXROUNDS = 32;       // number of retries before triangulating all the sites
+        const size_t MAXDISKCELLS = 4096; // maximum number of cells added at once for a site
+
+        std::mutex funmutex;
+        int64 nbcells = 0;
+        parallelFor((int64)ntx * nty, [&](int64 tile)
+            {
+            const int tx0 = (int)(tile % ntx) * T, ty0 = (int)(tile / ntx) * T;
+            const int tx1 = std::min(gx, tx0 + T) - 1, ty1 = std::min(gy, ty0 + T) - 1;
+            std::vector<int> pending;   // sites of the tile whose cell remains to be computed (sorted)
+            std::vector<int> prad;      // radius (in cells) of the region around each pending site
+            for (int cy = ty0; cy <= ty1; cy++) for (int cx = tx0; cx <= tx1; cx++)
+                {
+                const size_t c = (size_t)cy * gx + cx;
+                pending.insert(pending.end(), cellsites.begin() + cellstart[c], cellsites.begin() + cellstart[c + 1]);
+                }
+            std::sort(pending.begin(), pending.end());
+            prad.assign(pending.size(), 2);
+            // the region of the local triangulation is the union of the rectangle [rx0,rx1]x[ry0,ry1] 
+            // and of the (sorted) cells in reg. At first, it is the tile with a margin of 2 cells.
+            int rx0 = std::max(0, tx0 - 2), rx1 = std::min(gx - 1, tx1 + 2);
+            int ry0 = std::max(0, ty0 - 2), ry1 = std::min(gy - 1, ty1 + 2);
+            std::vector<int> reg, need;
+            bool full = false;
+            auto inRegion = [&](int cx, int cy)
+                {
+                if ((full) || ((cx >= rx0) && (cx <= rx1) && (cy >= ry0) && (cy <= ry1))) return true;
+                return std::binary_search(reg.begin(), reg.end(), cy * gx + cx);
+                };
+            // check that no site outside the region lies in the closed disk D(C,r) (enlarged a little
+            // to be safe). If there is one, the cells that intersect the disk are put in diskcells.
+            std::vector<int> diskcells;
+            auto emptyDisk = [&](const mtools::fVec2 & C, double r)
+                {
+                r *= (1.0 + 1.0e-9);
+                double xlo, xhi, ylo, yhi;
+                if (!internals_delaunayvoronoi::diskBoxExtent(C, r, box, xlo, xhi, ylo, yhi)) return true;
+                const int cx0 = cellX(xlo), cx1 = cellX(xhi), cy0 = cellY(ylo), cy1 = cellY(yhi);
+                if ((cx0 >= rx0) && (cx1 <= rx1) && (cy0 >= ry0) && (cy1 <= ry1)) return true;
+                const double r2 = r * r;
+                bool empty = true;
+                diskcells.clear();
+                for (int cy = cy0; cy <= cy1; cy++) for (int cx = cx0; cx <= cx1; cx++)
+                    {
+                    if (inRegion(cx, cy)) continue; // sites already in the local triangulation
+                    const double ex = std::max(0.0, std::max(box.xmin + cx * h - C.X(), C.X() - box.xmin - (cx + 1) * h));
+                    const double ey = std::max(0.0, std::max(box.ymin + cy * h - C.Y(), C.Y() - box.ymin - (cy + 1) * h));
+                    if (ex * ex + ey * ey > 1.0001 * r2) continue; // the cell does not intersect the disk
+                    const size_t c = (size_t)cy * gx + cx;
+                    diskcells.push_back((int)c);
+                    if (!empty) continue;
+                    for (int k = cellstart[c]; k < cellstart[c + 1]; k++)
+                        {
+                        const mtools::fVec2 & S = sites[cellsites[k]];
+                        if ((S.X() - C.X()) * (S.X() - C.X()) + (S.Y() - C.Y()) * (S.Y() - C.Y()) <= r2) { empty = false; break; }
+                        }
+                    if ((!empty) && (diskcells.size() > MAXDISKCELLS)) break;
+                    }
+                return empty;
+                };
+            std::vector<VoronoiCell> cells;
+            std::vector<int> loc, slot, extra, failed, failedrad, inc, incstart;
+            struct Corner { int t, a, b; };
+            std::vector<Corner> fan;
+            int round = 0;
+            while (pending.size() > 0)
+                {
+                // sites of the region and endpoints of the hull edges nearby
+                loc.clear();
+                slot.clear();
+                extra.clear();
+                auto addCell = [&](int c)
+                    {
+                    for (int k = cellstart[c]; k < cellstart[c + 1]; k++)
+                        {
+                        const int i = cellsites[k];
+                        auto it = std::lower_bound(pending.begin(), pending.end(), i);
+                        loc.push_back(i);
+                        slot.push_back(((it != pending.end()) && (*it == i)) ? (int)(it - pending.begin()) : -1);
+                        }
+                    extra.insert(extra.end(), hullcellsites.begin() + hullcellstart[c], hullcellsites.begin() + hullcellstart[c + 1]);
+                    };
+                if (full)
+                    {
+                    for (int c = 0; c < gx * gy; c++) addCell(c);
+                    }
+                else
+                    {
+                    for (int cy = ry0; cy <= ry1; cy++) for (int cx = rx0; cx <= rx1; cx++) addCell(cy * gx + cx);
+                    for (int c : reg) addCell(c);
+                    }
+                std::sort(extra.begin(), extra.end());
+                extra.erase(std::unique(extra.begin(), extra.end()), extra.end());
+                for (int i : extra)
+                    {
+                    if (!inRegion(cellX(sites[i].X()), cellY(sites[i].Y()))) { loc.push_back(i); slot.push_back(-1); }
+                    }
+                // put three non-aligned sites first
+                size_t j1 = 1, j2;
+                while ((j1 < loc.size()) && (sites[loc[j1]].X() == sites[loc[0]].X()) && (sites[loc[j1]].Y() == sites[loc[0]].Y())) j1++;
+                for (j2 = j1 + 1; j2 < loc.size(); j2++) { if (orient(sites[loc[0]], sites[loc[j1]], sites[loc[j2]]) != 0) break; }
+                failed.clear();
+                failedrad.clear();
+                if (j2 >= loc.size())
+                    { // all the local sites are aligned
+                    failed = pending;
+                    for (int r : prad) failedrad.push_back(2 * r);
+                    }
+                else
+                    {
+                    std::swap(loc[1], loc[j1]); std::swap(slot[1], slot[j1]);
+                    std::swap(loc[2], loc[j2]); std::swap(slot[2], slot[j2]);
+                    // local triangulation
+                    DelaunayVoronoi D;
+                    D.DelaunayVertices.reserve(loc.size());
+                    for (int k = 0; k < 3; k++) { D.DelaunayVertices.push_back(sites[loc[k]]); }
+                    D.compute();
+                    for (size_t k = 3; k < loc.size(); k++) { D.DelaunayVertices.push_back(sites[loc[k]]); }
+                    D.update();
+                    // triangles around each pending site
+                    incstart.assign(pending.size() + 1, 0);
+                    const int nt = (int)D.DelaunayTrianglesIndices.size();
+                    for (int t = 0; t < nt; t++) for (int j = 0; j < 3; j++)
+                        {
+                        const int sl = slot[(size_t)D.DelaunayTrianglesIndices[t][j]];
+                        if (sl >= 0) incstart[sl + 1]++;
+                        }
+                    for (size_t k = 1; k < incstart.size(); k++) incstart[k] += incstart[k - 1];
+                    inc.resize(incstart.back());
+                        {
+                        std::vector<int> pos(incstart.begin(), incstart.end() - 1);
+                        for (int t = 0; t < nt; t++) for (int j = 0; j < 3; j++)
+                            {
+                            const int sl = slot[(size_t)D.DelaunayTrianglesIndices[t][j]];
+                            if (sl >= 0) inc[pos[sl]++] = 3 * t + j;
+                            }
+                        }
+                    for (size_t sl = 0; sl < pending.size(); sl++)
+                        {
+                        const int site = pending[sl];
+                        const mtools::fVec2 & P = sites[site];
+                        const int k = incstart[sl + 1] - incstart[sl];
+                        if (k == 0)
+                            { // site not triangulated: drop it if there is another site at the same position 
+                            const size_t c = (size_t)cellY(P.Y()) * gx + cellX(P.X());
+                            bool dup = false;
+                            for (int u = cellstart[c]; u < cellstart[c + 1]; u++)
+                                {
+                                const int i = cellsites[u];
+                                if ((i != site) && (sites[i].X() == P.X()) && (sites[i].Y() == P.Y())) { dup = true; break; }
+                                }
+                            if (!dup) { failed.push_back(site); failedrad.push_back(2 * prad[sl]); }
+                            continue;
+                            }
+                        // order the triangles (site, a, b) counter-clockwise around the site
+                        fan.clear();
+                        for (int u = incstart[sl]; u < incstart[sl + 1]; u++)
+                            {
+                            const int t = inc[u] / 3, j = inc[u] % 3;
+                            fan.push_back({ t, (int)D.DelaunayTrianglesIndices[t][(j + 1) % 3], (int)D.DelaunayTrianglesIndices[t][(j + 2) % 3] });
+                            }
+                        int start = 0;
+                        for (int u = 0; u < k; u++)
+                            {
+                            bool found = false;
+                            for (int w = 0; w < k; w++) { if (fan[w].b == fan[u].a) { found = true; break; } }
+                            if (!found) { start = u; break; }
+                            }
+                        std::swap(fan[0], fan[start]);
+                        int m = 1;
+                        for (; m < k; m++)
+                            {
+                            int w = m;
+                            while ((w < k) && (fan[w].a != fan[m - 1].b)) w++;
+                            if (w == k) break;
+                            std::swap(fan[m], fan[w]);
+                            }
+                        bool ok = (m == k);
+                        bool conflict = false;
+                        const bool bounded = ok && (fan[k - 1].b == fan[0].a);
+                        if ((ok) && (!full))
+                            { // check that the cell is also a cell of the whole diagram
+                            for (int u = 0; (ok) && (u < k); u++)
+                                {
+                                const mtools::fVec2 & C = D.VoronoiVertices[fan[u].t];
+                                if (!emptyDisk(C, (C - P).norm())) { ok = false; conflict = (diskcells.size() <= MAXDISKCELLS); }
+                                }
+                            if ((ok) && (!bounded))
+                                {
+                                auto it = hullnb.find(site);
+                                ok = ((it != hullnb.end()) && (it->second.second == loc[fan[0].a]) && (it->second.first == loc[fan[k - 1].b]));
+                                }
+                            }
+                        if (!ok)
+                            {
+                            failed.push_back(site);
+                            if (conflict)
+                                { // add the cells of the disk to the region
+                                failedrad.push_back(prad[sl]);
+                                need.insert(need.end(), diskcells.begin(), diskcells.end());
+                                }
+                            else failedrad.push_back(2 * prad[sl]);
+                            continue;
+                            }
+                        VoronoiCell cell;
+                        cell.site = site;
+                        cell.position = P;
+                        cell.bounded = bounded;
+                        cell.vertices.reserve(k);
+                        cell.neighbours.reserve(k + 1);
+                        for (int u = 0; u < k; u++)
+                            {
+                            cell.vertices.push_back(D.VoronoiVertices[fan[u].t]);
+                            cell.neighbours.push_back(loc[fan[u].b]);
+                            }
+                        cell.rayFirst = mtools::fVec2(0, 0);
+                        cell.rayLast = mtools::fVec2(0, 0);
+                        if (!bounded)
+                            {
+                            cell.neighbours.push_back(loc[fan[0].a]);
+                            const mtools::fVec2 D0 = sites[loc[fan[0].a]] - P;
+                            const mtools::fVec2 D1 = P - sites[loc[fan[k - 1].b]];
+                            cell.rayFirst = mtools::fVec2(D0.Y(), -D0.X()); cell.rayFirst.normalize();
+                            cell.rayLast = mtools::fVec2(D1.Y(), -D1.X()); cell.rayLast.normalize();
+                            }
+                        cells.push_back(std::move(cell));
+                        }
+                    }
+                if (full) break; // the cells of the remaining sites are not defined (aligned or duplicate sites)
+                pending.swap(failed);
+                prad.swap(failedrad);
+                if (pending.size() == 0) break;
+                // new region: the cells around the remaining sites and those needed by the previous rounds
+                rx0 = 0; rx1 = -1; ry0 = 0; ry1 = -1;
+                std::sort(need.begin(), need.end());
+                need.erase(std::unique(need.begin(), need.end()), need.end());
+                reg = need;
+                for (size_t sl = 0; sl < pending.size(); sl++)
+                    {
+                    const int cx = cellX(sites[pending[sl]].X()), cy = cellY(sites[pending[sl]].Y()), r = prad[sl];
+                    for (int y = std::max(0, cy - r); y <= std::min(gy - 1, cy + r); y++) for (int x = std::max(0, cx - r); x <= std::min(gx - 1, cx + r); x++) reg.push_back(y * gx + x);
+                    }
+                std::sort(reg.begin(), reg.end());
+                reg.erase(std::unique(reg.begin(), reg.end()), reg.end());
+                if ((++round >= MAXROUNDS) || (reg.size() >= (size_t)gx * gy / 4)) full = true;
+                }
+            std::lock_guard<std::mutex> lock(funmutex);
+            for (auto & cell : cells) { fun(cell); }
+            nbcells += (int64)cells.size();
+            }, nbthreads);
+        return nbcells;
+        }
+
+
 }
 
 
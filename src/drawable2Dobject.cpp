@@ -19,6 +19,7 @@
 
 
 #include "graphics/internal/drawable2Dobject.hpp"
+#include "misc/internal/threadpool.hpp"
 
 
 namespace mtools
@@ -29,7 +30,7 @@ namespace internals_graphics
 
 
      
-    AutoDrawable2DObject::AutoDrawable2DObject(Drawable2DObject * obj, bool startThread) :  _mustexit(false), _threadon(false), _obj(obj)
+    AutoDrawable2DObject::AutoDrawable2DObject(Drawable2DObject * obj, bool startThread) :  _threadon(false), _obj(obj)
             {
             MTOOLS_ASSERT(obj != nullptr);
             if ((!_obj->needWork())||(!startThread)) return; // no work needed, return directly
@@ -48,6 +49,7 @@ namespace internals_graphics
             {
             std::lock_guard<std::mutex> lg(_mut);
             _obj->setParam(range, imageSize);
+            _wakeUp();
             }
 
 
@@ -55,6 +57,7 @@ namespace internals_graphics
             {
             std::lock_guard<std::mutex> lg(_mut);
             _obj->resetDrawing();
+            _wakeUp();
             }
 
 
@@ -62,7 +65,9 @@ namespace internals_graphics
         int AutoDrawable2DObject::drawOnto(Image & im, float opacity)
             {
             std::lock_guard<std::mutex> lg(_mut);
-            return _obj->drawOnto(im,opacity);
+            const int q = _obj->drawOnto(im,opacity);
+            if (q < 100) { _wakeUp(); } // the drawing may have changed without a call to setParam()/resetDrawing() (e.g. change of image type)
+            return q;
             }
 
 
@@ -93,54 +98,78 @@ namespace internals_graphics
             }
 
 
-        /* the thread procedure doing the work */
-        void AutoDrawable2DObject::_workerThread()
+        /* one quantum of work, executed as a task of the shared thread pool. The task is resubmitted
+           until the drawing is complete and then waits for _wakeUp() to be submitted again. The task
+           only keeps a reference to the shared state so it may safely be discarded after the object is
+           stopped/destroyed */
+        void AutoDrawable2DObject::_workerTask(std::shared_ptr<WorkerState> state, Drawable2DObject * obj)
             {
+                {
+                std::lock_guard<std::mutex> lock(state->m);
+                if (state->stop) { state->queued = false; return; } // we are off
+                state->executing = true;
+                state->dirty = false;
+                }
+            int q = 0;
             try
                 {
-                int nb = 0;
-                _threadon = true; // ok we are on...
-                while (!_mustexit) // loop until we are required to exit
-                    {
-                    int q = _obj->work(500); // work for 1/3 of a second
-                    if (q == 100) {
-                        std::this_thread::yield();
-                        if (nb >= 100) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); nb = 0; }
-                        nb++;
-                        }
-                    else { nb = 0; }
-                    }
-                _threadon = false; // ...and we are off
+                q = obj->work(500); // work for 1/3 of a second
                 }
             catch (std::exception & exc)
                 {
                 std::string msg = std::string("Exception caught in an autoDrawable2DObject : [") + exc.what() + "].";
                 MTOOLS_ERROR(msg.c_str());
                 }
+                {
+                std::lock_guard<std::mutex> lock(state->m);
+                state->executing = false;
+                if ((state->stop) || ((q == 100) && (!state->dirty)))
+                    { // stopped or drawing complete: do not resubmit
+                    state->queued = false;
+                    state->cv.notify_all();
+                    return;
+                    }
+                }
+            ThreadPool::shared().submit([state, obj]() { _workerTask(state, obj); }, ThreadPool::PRIORITY_LOW);
+            }
+
+
+        /* submit the task again if the worker is enabled but idle (called when the drawing changed) */
+        void AutoDrawable2DObject::_wakeUp()
+            {
+            if (_state == nullptr) return;
+            std::lock_guard<std::mutex> lock(_state->m);
+            if (_state->stop) return;
+            _state->dirty = true;
+            if (_state->queued) return; // the running task will see the dirty flag
+            _state->queued = true;
+            auto state = _state;
+            Drawable2DObject * obj = _obj;
+            ThreadPool::shared().submit([state, obj]() { _workerTask(state, obj); }, ThreadPool::PRIORITY_LOW);
             }
 
 
         /* start the thread if it is not active */
         void AutoDrawable2DObject::_startThread()
         {
-        if ((_obj->needWork() == false) || (_threadon == true)) return; // do nothing if no work needed or thread already started
-        _mustexit = false;
-        std::thread th(&AutoDrawable2DObject::_workerThread, this); // launch the thread
-        while (_threadon == false) { std::this_thread::yield(); } // wait for confirmation
-        th.detach(); // useless but still...
+        if ((_obj->needWork() == false) || (_state != nullptr)) return; // do nothing if no work needed or thread already started
+        _state = std::make_shared<WorkerState>();
+        _threadon = true; // ok we are on...
+        _wakeUp(); // the work is done by the shared thread pool
         }
 
 
-        /* stop the thread if it is active */
+        /* stop the thread if it is active: only waits for a task currently inside work(), queued tasks are discarded */
         void AutoDrawable2DObject::_stopThread()
             {
-            if (_threadon == true) // check if the thread is on
+            if (_state == nullptr) return;
                 {
-                _mustexit = true;
-                _obj->stopWork();
-                while (_threadon == true) { _obj->stopWork();  std::this_thread::yield(); }
+                std::unique_lock<std::mutex> lock(_state->m);
+                _state->stop = true;
+                while (_state->executing) { _obj->stopWork(); _state->cv.wait_for(lock, std::chrono::milliseconds(1)); }
                 }
-            _mustexit = false;
+            _state.reset();
+            _threadon = false;
             }
 
 }
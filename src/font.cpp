@@ -19,13 +19,16 @@
 
 #include "graphics/font.hpp"
 
+#include <map>
+#include <list>
+
 
 namespace mtools
 	{
 
 
 
-	Font::Font(const std::string & filename, int fontsize) : _fontsize(fontsize), _tab()
+	Font::Font(const std::string & filename, int fontsize) : _fontsize(fontsize), _tab(), _id(_newId())
 		{
 		std::string bff = mtools::loadStringFromFile(filename);
 		if (bff.size() == 0) { MTOOLS_ERROR("readBFF() : Cannot read file [" << filename << "]"); }
@@ -74,6 +77,7 @@ namespace mtools
 	void Font::createFrom(const Font & ft, int fontsize)
 		{
 		_tab.clear();
+		_id = _newId();
 		_fontsize = (fontsize <= 0) ? 0 : fontsize;
 		if ((_fontsize <= 0) || (ft._fontsize <= 0)) return;
 		double scale = ((double)_fontsize) / ((double)ft._fontsize);
@@ -99,6 +103,11 @@ namespace mtools
 		{
 		if ((!_fontsize) || (txt.size() == 0)) return;
 		auto npos = _upperleft(pos, txt, txt_pos);
+		if (_fontsize <= MAX_ATLAS_FONT_SIZE)
+			{
+			atlas(color)->drawText(im, npos, txt);
+			return;
+			}
 		int64 x = npos.X();
 		int64 y = npos.Y();
 		int64 x0 = x;
@@ -117,6 +126,186 @@ namespace mtools
 		}
 
 
+	uint64 Font::_newId()
+		{
+		static std::atomic<uint64> counter(0);
+		return ++counter;
+		}
+
+
+	namespace internals_font
+		{
+
+		/**
+		 * Global cache of glyph atlases, keyed by (font id, color) and shared by all threads.
+		 * The least recently used atlases are discarded when the memory budget is exceeded.
+		 **/
+		class GlyphAtlasCache
+			{
+
+			public:
+
+				static const size_t MAX_MEMORY = 64 * 1024 * 1024; // memory budget (in bytes)
+
+				GlyphAtlasCache() : _mem(0) {}
+
+				std::shared_ptr<const GlyphAtlas> get(uint64 id, const Font & font, RGBc color)
+					{
+					const Key key(id, color.color);
+					{
+					std::lock_guard<std::mutex> lock(_mut);
+					auto it = _map.find(key);
+					if (it != _map.end())
+						{
+						_lru.splice(_lru.begin(), _lru, it->second.second);
+						return it->second.first;
+						}
+					}
+					// not found: construct the atlas without holding the lock
+					std::shared_ptr<const GlyphAtlas> A = std::make_shared<const GlyphAtlas>(font, color);
+					std::lock_guard<std::mutex> lock(_mut);
+					auto it = _map.find(key);
+					if (it != _map.end()) { return it->second.first; } // created meanwhile by another thread
+					_lru.push_front(key);
+					_map[key] = std::make_pair(A, _lru.begin());
+					_mem += A->memory();
+					while ((_mem > MAX_MEMORY) && (_lru.size() > 1))
+						{
+						auto it2 = _map.find(_lru.back());
+						_mem -= it2->second.first->memory();
+						_map.erase(it2);
+						_lru.pop_back();
+						}
+					return A;
+					}
+
+			private:
+
+				typedef std::pair<uint64, uint32> Key;
+
+				std::mutex _mut;
+				size_t _mem;
+				std::list<Key> _lru;
+				std::map<Key, std::pair<std::shared_ptr<const GlyphAtlas>, std::list<Key>::iterator> > _map;
+			};
+
+
+		/* the global cache */
+		GlyphAtlasCache & _glyphAtlasCache()
+			{
+			static GlyphAtlasCache cache;
+			return cache;
+			}
+
+		}
+
+
+	std::shared_ptr<const GlyphAtlas> Font::atlas(RGBc color) const
+		{
+		if (!_fontsize) return nullptr;
+		return internals_font::_glyphAtlasCache().get(_id, *this, color);
+		}
+
+
+
+	GlyphAtlas::GlyphAtlas(const Font & font, RGBc color) : _fontsize(font._fontsize), _color(color), _atlas(), _sprites(256), _spans()
+		{
+		if (font._tab.size() < 256) return;
+		// shelf packing of the glyphs
+		int64 area = 0, maxlx = 1;
+		for (int c = 0; c < 256; c++)
+			{
+			const Image & G = font._tab[c].glyph;
+			area += G.lx()*G.ly();
+			maxlx = std::max<int64>(maxlx, G.lx());
+			}
+		const int64 W = std::max<int64>(maxlx, (int64)std::sqrt((double)area) * 5 / 4 + 1);
+		int64 x = 0, y = 0, h = 0, nbrows = 0;
+		for (int c = 0; c < 256; c++)
+			{
+			const Glyph & G = font._tab[c];
+			Sprite & S = _sprites[c];
+			S.lx = G.glyph.lx(); S.ly = G.glyph.ly();
+			S.offx = G.offx; S.offy = G.offy;
+			S.width = G.width;
+			if (x + S.lx > W) { x = 0; y += h; h = 0; }
+			S.x0 = x; S.y0 = y;
+			S.row = (size_t)nbrows;
+			x += S.lx;
+			h = std::max<int64>(h, S.ly);
+			nbrows += S.ly;
+			}
+		_atlas.resizeRaw(W, y + h);
+		_atlas.clear(RGBc::c_Transparent);
+		_spans.resize((size_t)nbrows);
+		// render the premultiplied sprites
+		for (int c = 0; c < 256; c++)
+			{
+			const Image & G = font._tab[c].glyph;
+			const Sprite & S = _sprites[c];
+			for (int64 j = 0; j < S.ly; j++)
+				{
+				int32 first = (int32)S.lx, last = -1;
+				for (int64 i = 0; i < S.lx; i++)
+					{
+					const RGBc P = RGBc::c_Transparent.get_blend(color, G(i, j).opacityInt());
+					_atlas(S.x0 + i, S.y0 + j) = P;
+					if (P.color != 0) { if (first > (int32)i) first = (int32)i; last = (int32)i; }
+					}
+				_spans[S.row + (size_t)j] = std::pair<int32, int32>(first, last);
+				}
+			}
+		}
+
+
+	void GlyphAtlas::drawText(Image & im, iVec2 pos, const std::string & txt) const
+		{
+		if ((_atlas.isEmpty()) || (txt.size() == 0)) return;
+		int64 x = pos.X();
+		int64 y = pos.Y();
+		const int64 x0 = x;
+		for (size_t i = 0; i < txt.size(); i++)
+			{
+			const char c = txt[i];
+			if (c == '\n') { x = x0; y += _fontsize; }
+			else if (c == '\t') { x += 4 * _sprites[' '].width; }
+			else if (c >= 32)
+				{
+				const Sprite & S = _sprites[c];
+				_blit(im, S, x, y);
+				x += S.width;
+				}
+			}
+		}
+
+
+	void GlyphAtlas::_blit(Image & im, const Sprite & S, int64 x, int64 y) const
+		{
+		x += S.offx;
+		y += S.offy;
+		const int64 lx = im.lx(), ly = im.ly();
+		if ((x >= lx) || (y >= ly) || (x + S.lx <= 0) || (y + S.ly <= 0)) return;
+		const int64 j0 = std::max<int64>(0, -y), j1 = std::min<int64>(S.ly, ly - y);
+		const int64 dstride = im.stride(), sstride = _atlas.stride();
+		const RGBc * src = _atlas.data() + (S.y0 + j0)*sstride + S.x0;
+		RGBc * dst = im.data() + (y + j0)*dstride + x;
+		for (int64 j = j0; j < j1; j++)
+			{
+			const std::pair<int32, int32> & span = _spans[S.row + (size_t)j];
+			const int64 i0 = std::max<int64>(span.first, -x);
+			const int64 i1 = std::min<int64>(span.second, lx - 1 - x);
+			for (int64 i = i0; i <= i1; i++)
+				{
+				const RGBc P = src[i];
+				if (P.comp.A == 0xFF) { dst[i] = P; }
+				else if (P.color != 0) { dst[i].blend(P); }
+				}
+			src += sstride;
+			dst += dstride;
+			}
+		}
+
+
 	void Font::_trim(int c)
 		{
 		Glyph & G = _tab[c];
@@ -207,6 +396,8 @@ namespace mtools
 		_nativeset.clear();
 		_fonts.clear();
 		_fonts.resize(MAX_FONT_SIZE + 1);
+		_ready.reset(new std::atomic<bool>[MAX_FONT_SIZE + 1]);
+		for (int i = 0; i <= MAX_FONT_SIZE; i++) { _ready[i].store(false); }
 		}
 
 
@@ -214,14 +405,18 @@ namespace mtools
 		{
 		if (fontsize == 0) return;
 		std::lock_guard<std::mutex> lock(_mut); // mutex lock for concurrent access. 
-		if (!(_fonts[fontsize].isEmpty())) return; // already created, nothing to do.
+		if (_ready[fontsize].load()) return; // already created, nothing to do.
+		if (_nativeset.size() == 0) return;
 		auto it = _nativeset.lower_bound(fontsize);
 		if (it == _nativeset.end())
 			{ // past the largest one. 
 			_fonts[fontsize].createFrom(_fonts[*(_nativeset.rbegin())], fontsize);
-			return;
 			}
-		_fonts[fontsize].createFrom(_fonts[*it], fontsize);
+		else
+			{
+			_fonts[fontsize].createFrom(_fonts[*it], fontsize);
+			}
+		_ready[fontsize].store(true, std::memory_order_release);
 		}
 
 
@@ -114,7 +114,7 @@ namespace mtools
 
 	void Plot2DImage::setParam(mtools::fBox2 range, mtools::iVec2 imageSize)
 		{
-		if ((_proImg->height() != (size_t)imageSize.X()) || (_proImg->width() != (size_t)imageSize.Y()))
+		if ((_proImg->width() != (size_t)imageSize.X()) || (_proImg->height() != (size_t)imageSize.Y()))
 			{
 			auto npimg = new ProgressImg((size_t)imageSize.X(), (size_t)imageSize.Y());
 			_PD->setParameters(range, npimg);
@@ -145,6 +145,13 @@ namespace mtools
 		}
 
 
+	const ProgressImg * Plot2DImage::progressLayer(int & quality)
+		{
+		quality = _PD->progress();
+		return _proImg;
+		}
+
+
 	int Plot2DImage::quality() const { return _PD->progress(); }
 
 
@@ -919,15 +919,32 @@ namespace mtools
                 { // ok, there should be something to draw.. (we now interrupt every worker thread)
                 if (_usesolidBK) { _mainImage->clear(((RGBc)_solidBKcolor).getOpaque()); } else { _mainImage->checkerboard(); }// draw the background of the image
                 int q = 100;
-				for (int i = (int)_vecPlot.size(); i > 0; i--)
+                // consecutive objects backed by a ProgressImg are composed together in a single pass
+                std::vector<const ProgressImg *> layers;
+                std::vector<float> opacities;
+                for (int i = (int)_vecPlot.size(); i > 0; i--)
                     {
                     if (_vecPlot[i - 1]->enable())
                         {
                         int r = 0;
-                        if (_vecPlot[i - 1]->quality() > 0) { r = _vecPlot[i - 1]->drawOnto(*_mainImage); }
+                        if (_vecPlot[i - 1]->quality() > 0)
+                            {
+                            const ProgressImg * L = _vecPlot[i - 1]->progressLayer(r);
+                            if (L != nullptr)
+                                {
+                                layers.push_back(L);
+                                opacities.push_back(_vecPlot[i - 1]->opacity());
+                                }
+                            else
+                                {
+                                if (layers.size() > 0) { ProgressImg::blitLayers(*_mainImage, layers.data(), opacities.data(), layers.size()); layers.clear(); opacities.clear(); }
+                                r = _vecPlot[i - 1]->drawOnto(*_mainImage);
+                                }
+                            }
                         if (r < q) { q = r; }
                         }
                     }
+                if (layers.size() > 0) { ProgressImg::blitLayers(*_mainImage, layers.data(), opacities.data(), layers.size()); }
 				_mainImageQuality = q;
                 if (_mainImageQuality != 0) // make sure the quality is indeed not zero. 
                     {
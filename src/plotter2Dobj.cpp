@@ -353,6 +353,15 @@ namespace mtools
             }
 
 
+        const ProgressImg * Plotter2DObj::progressLayer(int & quality)
+            {
+            if ((pnot)_ownercb == nullptr) return nullptr;  // not inserted
+            MTOOLS_ASSERT(((Drawable2DInterface*)_di) != nullptr);
+            if ((!_drawOn) || (_suspended)) return nullptr; // let drawOnto() deal with it
+            return ((Drawable2DInterface*)_di)->progressLayer(quality);
+            }
+
+
         void Plotter2DObj::setParam(mtools::fBox2 range, mtools::iVec2 imageSize)
             {
             if ((pnot)_ownercb == nullptr) return;  // do nothing if not inserted
@@ -0,0 +1,370 @@
+/** @file pngwriter.cpp */
+//
+// Copyright 2015 Arvind Singh
+//
+// This file is part of the mtools library.
+//
+// mtools is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with mtools  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "misc/error.hpp"
+#include "misc/internal/threadworker.hpp"
+#include "graphics/pngwriter.hpp"
+
+#include <zlib.h>
+
+#include <cstring>
+#include <algorithm>
+
+
+namespace mtools
+{
+
+#if defined (_MSC_VER)
+#pragma warning (push)
+#pragma warning (disable:4996)
+#endif
+
+
+    namespace internals_pngwriter
+        {
+
+        static const size_t DEFLATE_WINDOW = 32768;     // size of the deflate window (max dictionary length).
+
+
+        /* write a big endian uint32 */
+        inline void putU32(uint8 * p, uint32 v)
+            {
+            p[0] = (uint8)(v >> 24); p[1] = (uint8)(v >> 16); p[2] = (uint8)(v >> 8); p[3] = (uint8)v;
+            }
+
+
+        /* convert a row of RGBc into straight RGBA bytes */
+        inline void convertRow(const RGBc * src, int64 lx, uint8 * dst, bool remove_premult)
+            {
+            if (remove_premult)
+                {
+                for (int64 i = 0; i < lx; i++)
+                    {
+                    RGBc c = src[i]; c.unpremultiply();
+                    dst[0] = c.comp.R; dst[1] = c.comp.G; dst[2] = c.comp.B; dst[3] = c.comp.A; dst += 4;
+                    }
+                }
+            else
+                {
+                for (int64 i = 0; i < lx; i++)
+                    {
+                    const RGBc c = src[i];
+                    dst[0] = c.comp.R; dst[1] = c.comp.G; dst[2] = c.comp.B; dst[3] = c.comp.A; dst += 4;
+                    }
+                }
+            }
+
+
+        /* Paeth predictor */
+        MTOOLS_FORCEINLINE uint8 paeth(int a, int b, int c)
+            {
+            const int p = a + b - c;
+            const int pa = (p > a) ? (p - a) : (a - p);
+            const int pb = (p > b) ? (p - b) : (b - p);
+            const int pc = (p > c) ? (p - c) : (c - p);
+            if ((pa <= pb) && (pa <= pc)) return (uint8)a;
+            if (pb <= pc) return (uint8)b;
+            return (uint8)c;
+            }
+
+
+        /**
+         * Filter a scanline with a given filter type. 'out' receives n bytes (without the filter type
+         * byte). Return the sum of the absolute values of the filtered bytes seen as signed char.
+         **/
+        inline uint64 filterRow(int type, const uint8 * cur, const uint8 * prior, size_t n, uint8 * out)
+            {
+            const size_t bpp = 4;
+            uint64 sum = 0;
+            switch (type)
+                {
+                case PNGWriter::FILTER_NONE:
+                    {
+                    for (size_t i = 0; i < n; i++) { out[i] = cur[i]; }
+                    break;
+                    }
+                case PNGWriter::FILTER_SUB:
+                    {
+                    for (size_t i = 0; i < bpp; i++) { out[i] = cur[i]; }
+                    for (size_t i = bpp; i < n; i++) { out[i] = (uint8)(cur[i] - cur[i - bpp]); }
+                    break;
+                    }
+                case PNGWriter::FILTER_UP:
+                    {
+                    for (size_t i = 0; i < n; i++) { out[i] = (uint8)(cur[i] - prior[i]); }
+                    break;
+                    }
+                case PNGWriter::FILTER_AVERAGE:
+                    {
+                    for (size_t i = 0; i < bpp; i++) { out[i] = (uint8)(cur[i] - (prior[i] >> 1)); }
+                    for (size_t i = bpp; i < n; i++) { out[i] = (uint8)(cur[i] - ((((uint32)cur[i - bpp]) + prior[i]) >> 1)); }
+                    break;
+                    }
+                case PNGWriter::FILTER_PAETH:
+                    {
+                    for (size_t i = 0; i < bpp; i++) { out[i] = (uint8)(cur[i] - prior[i]); }
+                    for (size_t i = bpp; i < n; i++) { out[i] = (uint8)(cur[i] - paeth(cur[i - bpp], prior[i], prior[i - bpp])); }
+                    break;
+                    }
+                default: { MTOOLS_ERROR("PNGWriter: invalid filter type"); }
+                }
+            for (size_t i = 0; i < n; i++) { const int v = (int)((int8)out[i]); sum += (uint64)((v < 0) ? -v : v); }
+            return sum;
+            }
+
+        }
+
+
+    PNGWriter::PNGWriter(const std::string & filename, int64 lx, int64 ly, int compression_level, int filter_strategy, int nb_threads, int64 band_rows) :
+        _lx(lx), _ly(ly),
+        _level(compression_level), _filter(filter_strategy), _nbthreads(nb_threads),
+        _bandrows(band_rows), _rowsdone(0), _adler(1), _handle(nullptr)
+        {
+        MTOOLS_INSURE((lx > 0) && (ly > 0) && (lx < 0x7FFFFFFF) && (ly < 0x7FFFFFFF));
+        if (_level < 0) _level = 0; else if (_level > 9) _level = 9;
+        if ((_filter < FILTER_NONE) || (_filter > FILTER_ADAPTIVE)) _filter = DEFAULT_FILTER;
+        if (_nbthreads <= 0) _nbthreads = nbHardwareThreads();
+        if (_bandrows <= 0) { _bandrows = DEFAULT_BAND_BYTES / (4 * _lx + 1); if (_bandrows < 1) _bandrows = 1; }
+        _handle = fopen(filename.c_str(), "wb");
+        if (_handle == nullptr) return;
+        const uint8 signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+        if (fwrite(signature, 1, 8, _handle) != 8) { _fail(); return; }
+        uint8 ihdr[13];
+        internals_pngwriter::putU32(ihdr, (uint32)_lx);
+        internals_pngwriter::putU32(ihdr + 4, (uint32)_ly);
+        ihdr[8] = 8;    // bit depth
+        ihdr[9] = 6;    // color type: RGBA
+        ihdr[10] = 0;   // compression method: deflate
+        ihdr[11] = 0;   // filter method: adaptive
+        ihdr[12] = 0;   // no interlace
+        if (!_writeChunk("IHDR", ihdr, 13)) return;
+        }
+
+
+    PNGWriter::~PNGWriter()
+        {
+        if (_handle != nullptr)
+            {
+            if (_rowsdone == _ly) { close(); } else { fclose(_handle); _handle = nullptr; }
+            }
+        }
+
+
+    bool PNGWriter::_fail()
+        {
+        if (_handle != nullptr) { fclose(_handle); _handle = nullptr; }
+        _bands.clear();
+        return false;
+        }
+
+
+    bool PNGWriter::_writeChunk(const char * type, const uint8 * data, size_t len)
+        {
+        if (_handle == nullptr) return false;
+        uint8 head[8];
+        internals_pngwriter::putU32(head, (uint32)len);
+        memcpy(head + 4, type, 4);
+        uLong crc = crc32(0L, Z_NULL, 0);
+        crc = crc32(crc, (const Bytef *)type, 4);
+        if (len > 0) crc = crc32(crc, (const Bytef *)data, (uInt)len);
+        uint8 tail[4];
+        internals_pngwriter::putU32(tail, (uint32)crc);
+        if (fwrite(head, 1, 8, _handle) != 8) return _fail();
+        if ((len > 0) && (fwrite(data, 1, len, _handle) != len)) return _fail();
+        if (fwrite(tail, 1, 4, _handle) != 4) return _fail();
+        return true;
+        }
+
+
+    void PNGWriter::_filterBand(Band & band, bool remove_premult)
+        {
+        const size_t n = (size_t)(4 * _lx);
+        std::vector<uint8> rowA(n), rowB(n), zero, trial;
+        uint8 * cur = rowA.data();
+        uint8 * prior = rowB.data();
+        const uint8 * pprior;
+        if (band.prevrgba != nullptr) { pprior = band.prevrgba; }
+        else if (band.prev != nullptr) { internals_pngwriter::convertRow(band.prev, _lx, prior, remove_premult); pprior = prior; }
+        else { zero.assign(n, 0); pprior = zero.data(); }
+        if (_filter == FILTER_ADAPTIVE) trial.resize(n);
+        band.filtered.resize((n + 1) * (size_t)band.nb);
+        uint8 * out = band.filtered.data();
+        const RGBc * src = band.src;
+        const int64 stride = band.stride;
+        for (int64 j = 0; j < band.nb; j++)
+            {
+            internals_pngwriter::convertRow(src + j * stride, _lx, cur, remove_premult);
+            if (_filter != FILTER_ADAPTIVE)
+                {
+                out[0] = (uint8)_filter;
+                internals_pngwriter::filterRow(_filter, cur, pprior, n, out + 1);
+                }
+            else
+                { // try every filter and keep the one with minimum sum of absolute values.
+                int best = FILTER_NONE;
+                uint64 bestsum = internals_pngwriter::filterRow(FILTER_NONE, cur, pprior, n, out + 1);
+                for (int t = FILTER_SUB; t <= FILTER_PAETH; t++)
+                    {
+                    const uint64 s = internals_pngwriter::filterRow(t, cur, pprior, n, trial.data());
+                    if (s < bestsum) { bestsum = s; best = t; memcpy(out + 1, trial.data(), n); }
+                    }
+                out[0] = (uint8)best;
+                }
+            out += (n + 1);
+            // the current row becomes the prior row.
+            uint8 * tmp = prior; prior = cur; cur = tmp; pprior = prior;
+            }
+        band.adler = (uint32)adler32(adler32(0L, Z_NULL, 0), (const Bytef *)band.filtered.data(), (uInt)band.filtered.size());
+        }
+
+
+    void PNGWriter::_compressBand(Band & band, const uint8 * dict, size_t dictlen)
+        {
+        band.ok = false;
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        if (deflateInit2(&zs, _level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return;
+        if ((dict != nullptr) && (dictlen > 0))
+            {
+            if (deflateSetDictionary(&zs, (const Bytef *)dict, (uInt)dictlen) != Z_OK) { deflateEnd(&zs); return; }
+            }
+        band.out.resize(deflateBound(&zs, (uLong)band.filtered.size()) + 64);
+        zs.next_in = (Bytef *)band.filtered.data();
+        zs.avail_in = (uInt)band.filtered.size();
+        zs.next_out = (Bytef *)band.out.data();
+        zs.avail_out = (uInt)band.out.size();
+        const int flush = (band.last ? Z_FINISH : Z_FULL_FLUSH);
+        while (1)
+            {
+            const int r = deflate(&zs, flush);
+            if ((r != Z_OK) && (r != Z_STREAM_END) && (r != Z_BUF_ERROR)) { deflateEnd(&zs); return; }
+            if (band.last) { if (r == Z_STREAM_END) break; }
+            else if ((zs.avail_in == 0) && (zs.avail_out != 0)) break;
+            // output buffer full: enlarge it
+            const size_t done = band.out.size() - zs.avail_out;
+            band.out.resize(band.out.size() * 2);
+            zs.next_out = (Bytef *)(band.out.data() + done);
+            zs.avail_out = (uInt)(band.out.size() - done);
+            }
+        band.out.resize(band.out.size() - zs.avail_out);
+        deflateEnd(&zs);
+        band.ok = true;
+        }
+
+
+    bool PNGWriter::write(const RGBc * rows, int64 stride, int64 nb_rows, bool remove_premult)
+        {
+        if (_handle == nullptr) return false;
+        if (nb_rows <= 0) return true;
+        if ((rows == nullptr) || (stride < _lx) || (_rowsdone + nb_rows > _ly)) return _fail();
+        const size_t n = (size_t)(4 * _lx);
+        const int64 base = _rowsdone;   // number of rows written before this block
+        int64 j = 0;
+        while (j < nb_rows)
+            {
+            // create a batch of bands
+            _bands.resize((size_t)_nbthreads);
+            int nbb = 0;
+            while ((nbb < _nbthreads) && (j < nb_rows))
+                {
+                Band & B = _bands[nbb];
+                B.src = rows + j * stride;
+                B.stride = stride;
+                B.nb = std::min<int64>(_bandrows, nb_rows - j);
+                B.prev = ((j > 0) ? (rows + (j - 1) * stride) : nullptr);
+                B.prevrgba = (((j == 0) && (base > 0)) ? _lastrow.data() : nullptr);
+                B.last = (base + j + B.nb == _ly);
+                B.ok = false;
+                j += B.nb;
+                nbb++;
+                }
+            // filter the bands in parallel
+            mtools::parallelFor(nbb, [&](int64 i) { _filterBand(_bands[(size_t)i], remove_premult); }, _nbthreads);
+            // compress the bands in parallel, each one using the tail of the previous one as dictionary.
+            mtools::parallelFor(nbb, [&](int64 i)
+                {
+                const std::vector<uint8> & D = ((i == 0) ? _dict : _bands[(size_t)(i - 1)].filtered);
+                const size_t l = std::min<size_t>(D.size(), internals_pngwriter::DEFLATE_WINDOW);
+                _compressBand(_bands[(size_t)i], D.data() + (D.size() - l), l);
+                }, _nbthreads);
+            // write the compressed data in order
+            for (int i = 0; i < nbb; i++)
+                {
+                Band & B = _bands[i];
+                if (!B.ok) return _fail();
+                if (_rowsdone == 0)
+                    { // prepend the zlib header
+                    const uint8 flevel = (uint8)((_level < 2) ? 0 : ((_level < 6) ? 1 : ((_level == 6) ? 2 : 3)));
+                    const uint8 cmf = 0x78;
+                    uint8 flg = (uint8)(flevel << 6);
+                    flg = (uint8)(flg + (31 - ((((uint32)cmf) << 8) + flg) % 31));
+                    B.out.insert(B.out.begin(), { cmf, flg });
+                    }
+                _adler = (uint32)adler32_combine(_adler, B.adler, (z_off_t)B.filtered.size());
+                if (B.last)
+                    { // append the adler32 checksum
+                    uint8 a[4];
+                    internals_pngwriter::putU32(a, _adler);
+                    B.out.insert(B.out.end(), a, a + 4);
+                    }
+                // split into chunks of at most 1GB
+                const size_t MAXCHUNK = ((size_t)1) << 30;
+                size_t pos = 0;
+                while (pos < B.out.size())
+                    {
+                    const size_t l = std::min<size_t>(MAXCHUNK, B.out.size() - pos);
+                    if (!_writeChunk("IDAT", B.out.data() + pos, l)) return false;
+                    pos += l;
+                    }
+                _rowsdone += B.nb;
+                }
+            // keep the last 32K of filtered data as dictionary for the next batch.
+            const std::vector<uint8> & F = _bands[nbb - 1].filtered;
+            const size_t l = std::min<size_t>(F.size(), internals_pngwriter::DEFLATE_WINDOW);
+            _dict.assign(F.end() - l, F.end());
+            }
+        // keep a converted copy of the last row of the block (the caller may release it).
+        _lastrow.resize(n);
+        internals_pngwriter::convertRow(rows + (nb_rows - 1) * stride, _lx, _lastrow.data(), remove_premult);
+        _bands.clear();
+        return true;
+        }
+
+
+    bool PNGWriter::close()
+        {
+        if (_handle == nullptr) return false;
+        if (_rowsdone != _ly) return _fail();
+        if (!_writeChunk("IEND", nullptr, 0)) return false;
+        const bool r = (fclose(_handle) == 0);
+        _handle = nullptr;
+        return r;
+        }
+
+
+#if defined (_MSC_VER)
+#pragma warning (pop)
+#endif
+
+}
+
+
+/* end of file */
+
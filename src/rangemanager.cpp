@@ -21,6 +21,9 @@
 #include "misc/error.hpp"
 #include "graphics/internal/rangemanager.hpp"
 
+#include <cmath>
+#include <algorithm>
+
 
 namespace mtools
 {
@@ -29,6 +32,8 @@ namespace mtools
     {
 
         const double RangeManager::PRECISIONDOUBLE = 1.0e-11;
+        const double RangeManager::PRECISIONDOUBLEDOUBLE = 1.0e-28;
+        const double RangeManager::DEEPREBASE = 1000.0;
         const double RangeManager::MAXDOUBLE = 1.0e300;
         const double RangeManager::MINDOUBLE = 1.0e-300;
 
@@ -36,7 +41,7 @@ namespace mtools
 
 
         RangeManager::RangeManager(mtools::fBox2 startRange, mtools::iVec2 winSize, bool fixedAspectRatio, double minValue, double maxValue, double precision) :
-        _cbfun(nullptr), _data(nullptr), _data2(nullptr), _startRange(startRange), _range(startRange), _startWin(winSize), _winSize(winSize), _minValue(minValue), _maxValue(maxValue), _precision(precision), _fixedAR(fixedAspectRatio)
+        _cbfun(nullptr), _data(nullptr), _data2(nullptr), _startRange(startRange), _startRef(0.0, 0.0), _range(startRange), _ref(0.0, 0.0), _startWin(winSize), _winSize(winSize), _minValue(minValue), _maxValue(maxValue), _precision(precision), _fixedAR(fixedAspectRatio), _deep(false)
             {
                 MTOOLS_ASSERT((winSize.X() > 0) && (winSize.Y() > 0));
                 MTOOLS_ASSERT(minValue > 0.0);
@@ -50,7 +55,7 @@ namespace mtools
 
 
         RangeManager::RangeManager(mtools::iVec2 winSize, bool fixedAspectRatio, double minValue, double maxValue, double precision) :
-        _cbfun(nullptr), _data(nullptr), _data2(nullptr), _startRange(-1, 1, -1, 1), _range(-1, 1, -1, 1), _startWin(winSize), _winSize(winSize), _minValue(minValue), _maxValue(maxValue), _precision(precision), _fixedAR(fixedAspectRatio)
+        _cbfun(nullptr), _data(nullptr), _data2(nullptr), _startRange(-1, 1, -1, 1), _startRef(0.0, 0.0), _range(-1, 1, -1, 1), _ref(0.0, 0.0), _startWin(winSize), _winSize(winSize), _minValue(minValue), _maxValue(maxValue), _precision(precision), _fixedAR(fixedAspectRatio), _deep(false)
             {
                 MTOOLS_ASSERT((winSize.X() > 0) && (winSize.Y() > 0));
                 MTOOLS_ASSERT(minValue > 0.0);
@@ -63,7 +68,7 @@ namespace mtools
 
 
         RangeManager::RangeManager(const RangeManager & R) :
-        _cbfun(R._cbfun), _data(R._data), _data2(R._data2), _startRange(R._startRange), _range(R._range), _startWin(R._startWin), _winSize(R._winSize), _minValue(R._minValue), _maxValue(R._maxValue), _precision(R._precision), _fixedAR((bool)R._fixedAR) {}
+        _cbfun(R._cbfun), _data(R._data), _data2(R._data2), _startRange(R._startRange), _startRef(R._startRef), _range(R._range), _ref(R._ref), _startWin(R._startWin), _winSize(R._winSize), _minValue(R._minValue), _maxValue(R._maxValue), _precision(R._precision), _fixedAR((bool)R._fixedAR), _deep((bool)R._deep) {}
 
 
         RangeManager & RangeManager::operator=(const RangeManager & R)
@@ -74,13 +79,16 @@ namespace mtools
             _data = R._data;
             _data2 = R._data2;
             _startRange = R._startRange;
+            _startRef = R._startRef;
             _range = R._range;
+            _ref = R._ref;
             _winSize = R._winSize;
             _startWin = R._startWin;
             _minValue = R._minValue;
             _maxValue = R._maxValue;
             _precision = R._precision;
             _fixedAR = (bool)R._fixedAR;
+            _deep = (bool)R._deep;
             return(*this);
             }
 
@@ -92,6 +100,7 @@ namespace mtools
             {
             if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
             _startRange = _range;
+            _startRef = _ref;
             _startWin = _winSize;
             _mut.unlock();
             return true;
@@ -100,7 +109,7 @@ namespace mtools
 
         mtools::fBox2 RangeManager::getRange() const
             {
-            return _range;
+            return _toAbs(_range, _ref);
             }
 
 
@@ -112,7 +121,7 @@ namespace mtools
 
         mtools::fBox2 RangeManager::getDefaultRange() const
             {
-            return _startRange;
+            return _toAbs(_startRange, _startRef);
             }
 
 
@@ -127,10 +136,11 @@ namespace mtools
             if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
             bool resok = true;
             mtools::fBox2 oldr = _range;
-            _range = mtools::up(_range);
+            const mtools::ddVec2 oldref = _ref;
+            _range = _shiftedRange(0, 1);
             _fixRange();
-            if (!_rangeOK(_range)) { _range = oldr; }
-            if (_range != oldr) { if (!rangeNotification(true, false, false)) { _range = oldr;  resok = false; } }
+            if (!_rangeOK(_range)) { _range = oldr; _ref = oldref; }
+            if ((_range != oldr) || (_ref != oldref)) { if (!rangeNotification(true, false, false)) { _range = oldr; _ref = oldref;  resok = false; } }
             MTOOLS_ASSERT(_rangeOK(_range));
             _mut.unlock();
             return resok;
@@ -143,10 +153,11 @@ namespace mtools
                 if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
                 bool resok = true;
                 mtools::fBox2 oldr = _range;
-                _range = mtools::down(_range);
+                const mtools::ddVec2 oldref = _ref;
+                _range = _shiftedRange(0, -1);
                 _fixRange();
-                if (!_rangeOK(_range)) { _range = oldr; }
-                if (_range != oldr) { if (!rangeNotification(true, false, false)) { _range = oldr;  resok = false; } }
+                if (!_rangeOK(_range)) { _range = oldr; _ref = oldref; }
+                if ((_range != oldr) || (_ref != oldref)) { if (!rangeNotification(true, false, false)) { _range = oldr; _ref = oldref;  resok = false; } }
                 MTOOLS_ASSERT(_rangeOK(_range));
                 _mut.unlock();
                 return resok;
@@ -159,10 +170,11 @@ namespace mtools
                 if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
                 bool resok = true;
                 mtools::fBox2 oldr = _range;
-                _range = mtools::left(_range);
+                const mtools::ddVec2 oldref = _ref;
+                _range = _shiftedRange(-1, 0);
                 _fixRange();
-                if (!_rangeOK(_range)) { _range = oldr; }
-				if (_range != oldr)  {  if (!rangeNotification(true, false, false)) { _range = oldr;  resok = false; } }
+                if (!_rangeOK(_range)) { _range = oldr; _ref = oldref; }
+				if ((_range != oldr) || (_ref != oldref))  {  if (!rangeNotification(true, false, false)) { _range = oldr; _ref = oldref;  resok = false; } }
                 MTOOLS_ASSERT(_rangeOK(_range));
                 _mut.unlock();
                 return resok;
@@ -175,10 +187,11 @@ namespace mtools
                 if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
                 bool resok = true;
                 mtools::fBox2 oldr = _range;
-                _range = mtools::right(_range);
+                const mtools::ddVec2 oldref = _ref;
+                _range = _shiftedRange(1, 0);
                 _fixRange();
-                if (!_rangeOK(_range)) { _range = oldr; }
-                if (_range != oldr) { if (!rangeNotification(true, false, false)) { _range = oldr;  resok = false; } }
+                if (!_rangeOK(_range)) { _range = oldr; _ref = oldref; }
+                if ((_range != oldr) || (_ref != oldref)) { if (!rangeNotification(true, false, false)) { _range = oldr; _ref = oldref;  resok = false; } }
                 MTOOLS_ASSERT(_rangeOK(_range));
                 _mut.unlock();
                 return resok;
@@ -191,10 +204,11 @@ namespace mtools
                 if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
                 bool resok = true;
                 mtools::fBox2 oldr = _range;
+                const mtools::ddVec2 oldref = _ref;
                 _range = mtools::zoomIn(_range);
                 _fixRange();
-                if (!_rangeOK(_range)) { _range = oldr; }
-                if (_range != oldr) { if (!rangeNotification(true, false, false)) { _range = oldr;  resok = false; } }
+                if (!_rangeOK(_range)) { _range = oldr; _ref = oldref; }
+                if ((_range != oldr) || (_ref != oldref)) { if (!rangeNotification(true, false, false)) { _range = oldr; _ref = oldref;  resok = false; } }
                 MTOOLS_ASSERT(_rangeOK(_range));
                 _mut.unlock();
                 return resok;
@@ -206,10 +220,11 @@ namespace mtools
                 if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
                 bool resok = true;
                 mtools::fBox2 oldr = _range;
+                const mtools::ddVec2 oldref = _ref;
                 _range = mtools::zoomOut(_range);
                 _fixRange();
-                if (!_rangeOK(_range)) { _range = oldr; }
-                if (_range != oldr) { if (!rangeNotification(true, false, false)) { _range = oldr;  resok = false; } }
+                if (!_rangeOK(_range)) { _range = oldr; _ref = oldref; }
+                if ((_range != oldr) || (_ref != oldref)) { if (!rangeNotification(true, false, false)) { _range = oldr; _ref = oldref;  resok = false; } }
                 MTOOLS_ASSERT(_rangeOK(_range));
                 _mut.unlock();
                 return resok;
@@ -219,14 +234,31 @@ namespace mtools
         bool RangeManager::zoomIn(fVec2 center)
             {
                 if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
+                bool resok = _zoomIn(_toOffset(center, _ref));
+                _mut.unlock();
+                return resok;
+            }
+
+
+        bool RangeManager::zoomInPixel(iVec2 pixpos)
+            {
+                if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
+                bool resok = _zoomIn(_range.pixelToAbs(pixpos, _winSize));
+                _mut.unlock();
+                return resok;
+            }
+
+
+        bool RangeManager::_zoomIn(fVec2 center)
+            {
                 bool resok = true;
                 mtools::fBox2 oldr = _range;
+                const mtools::ddVec2 oldref = _ref;
                 _range = mtools::zoomIn(_range, center);
                 _fixRange();
-                if (!_rangeOK(_range)) { _range = oldr; }
-                if (_range != oldr) { if (!rangeNotification(true, false, false)) { _range = oldr;  resok = false; } }
+                if (!_rangeOK(_range)) { _range = oldr; _ref = oldref; }
+                if ((_range != oldr) || (_ref != oldref)) { if (!rangeNotification(true, false, false)) { _range = oldr; _ref = oldref;  resok = false; } }
                 MTOOLS_ASSERT(_rangeOK(_range));
-                _mut.unlock();
                 return resok;
             }
 
@@ -234,14 +266,31 @@ namespace mtools
         bool RangeManager::zoomOut(fVec2 center)
             {
                 if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
+                bool resok = _zoomOut(_toOffset(center, _ref));
+                _mut.unlock();
+                return resok;
+            }
+
+
+        bool RangeManager::zoomOutPixel(iVec2 pixpos)
+            {
+                if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
+                bool resok = _zoomOut(_range.pixelToAbs(pixpos, _winSize));
+                _mut.unlock();
+                return resok;
+            }
+
+
+        bool RangeManager::_zoomOut(fVec2 center)
+            {
                 bool resok = true;
                 mtools::fBox2 oldr = _range;
+                const mtools::ddVec2 oldref = _ref;
                 _range = mtools::zoomOut(_range, center);
                 _fixRange();
-                if (!_rangeOK(_range)) { _range = oldr; }
-                if (_range != oldr) { if (!rangeNotification(true, false, false)) { _range = oldr;  resok = false; } }
+                if (!_rangeOK(_range)) { _range = oldr; _ref = oldref; }
+                if ((_range != oldr) || (_ref != oldref)) { if (!rangeNotification(true, false, false)) { _range = oldr; _ref = oldref;  resok = false; } }
                 MTOOLS_ASSERT(_rangeOK(_range));
-                _mut.unlock();
                 return resok;
             }
 
@@ -258,6 +307,7 @@ namespace mtools
                 bool resok = true;
                 iVec2 oldsize = _winSize;
                 mtools::fBox2 oldr = _range;
+                const mtools::ddVec2 oldref = _ref;
                 double rx = (_range.lx()*newWinSize.X()) / (_winSize.X()*2);
                 double ry = (_range.ly()*newWinSize.Y()) / (_winSize.Y()*2);
                 double cx = (_range.min[0] + _range.max[0]) / 2;
@@ -267,12 +317,12 @@ namespace mtools
                 _range.min[1] = cy - ry;
                 _range.max[1] = cy + ry;
                 _winSize = newWinSize;
-                if (!_rangeOK(_range)) { _range = oldr; }
+                if (!_rangeOK(_range)) { _range = oldr; _ref = oldref; }
                 _fixRange();
                 if (!_rangeOK(_range)) { _defaultrange(); }
                 bool chwin = ((oldsize != _winSize) ? true : false);
-                bool chrange = ((_range != oldr) ? true : false);
-                if (!rangeNotification(chrange, chwin, false)) { _range = oldr; _winSize = oldsize;  resok = false; }
+                bool chrange = (((_range != oldr) || (_ref != oldref)) ? true : false);
+                if (!rangeNotification(chrange, chwin, false)) { _range = oldr; _ref = oldref; _winSize = oldsize;  resok = false; }
                 MTOOLS_ASSERT(_rangeOK(_range));
                 _mut.unlock();
                 return resok;
@@ -283,8 +333,28 @@ namespace mtools
         bool RangeManager::setRange(mtools::fBox2 newRange)
             {
                 if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
+                bool resok = _setRange(_toOffset(newRange, _ref));
+                _mut.unlock();
+                return resok;
+            }
+
+
+        bool RangeManager::setRangePixel(iVec2 pix1, iVec2 pix2)
+            {
+                if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
+                mtools::fBox2 R(_range.pixelToAbs(pix1, _winSize), _range.pixelToAbs(pix2, _winSize), true);
+                if (_fixedAR) { R = R.fixedRatioEnclosedRect(_range.lx() / _range.ly()); }
+                bool resok = _setRange(R);
+                _mut.unlock();
+                return resok;
+            }
+
+
+        bool RangeManager::_setRange(mtools::fBox2 newRange)
+            {
                 bool resok = true;
                 mtools::fBox2 oldr = _range;
+                const mtools::ddVec2 oldref = _ref;
                 if (_fixedAR)
                     {
                     _range = newRange.fixedRatioEnclosingRect(_range.lx() / _range.ly());
@@ -294,10 +364,9 @@ namespace mtools
                     _range = newRange;
                     }
                 _fixRange();
-                if (!_rangeOK(_range)) { _range = oldr; }
-                if (_range != oldr) { if (!rangeNotification(true, false, false)) { _range = oldr;  resok = false; } }
+                if (!_rangeOK(_range)) { _range = oldr; _ref = oldref; }
+                if ((_range != oldr) || (_ref != oldref)) { if (!rangeNotification(true, false, false)) { _range = oldr; _ref = oldref;  resok = false; } }
                 MTOOLS_ASSERT(_rangeOK(_range));
-                _mut.unlock();
                 return resok;
             }
 
@@ -306,6 +375,8 @@ namespace mtools
             {
                 if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
                 mtools::fBox2 oldr = _range;
+                const mtools::ddVec2 oldref = _ref;
+                newRange = _toOffset(newRange, _ref);
                 if (keepAspectRatio)
                     {
                     _range = newRange.fixedRatioEnclosingRect(_range.lx() / _range.ly());
@@ -315,7 +386,7 @@ namespace mtools
                     _range = newRange;
                     }
                 _fixRange();
-                if (!_rangeOK(_range)) { _range = oldr; }
+                if (!_rangeOK(_range)) { _range = oldr; _ref = oldref; }
                 MTOOLS_ASSERT(_rangeOK(_range));
                 _mut.unlock();
                 return true;
@@ -325,17 +396,34 @@ namespace mtools
         bool RangeManager::center(mtools::fVec2 center)
             {
                 if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
+                bool resok = _center(_toOffset(center, _ref));
+                _mut.unlock();
+                return resok;
+            }
+
+
+        bool RangeManager::centerPixel(iVec2 pixpos)
+            {
+                if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
+                bool resok = _center(_range.pixelToAbs(pixpos, _winSize));
+                _mut.unlock();
+                return resok;
+            }
+
+
+        bool RangeManager::_center(mtools::fVec2 center)
+            {
                 bool resok = true;
                 mtools::fBox2 oldr = _range;
+                const mtools::ddVec2 oldref = _ref;
                 double lx = _range.lx();
                 double ly = _range.ly();
                 _range.min[0] = center.X() - lx / 2.0; _range.max[0] = center.X() + lx / 2.0;
                 _range.min[1] = center.Y() - ly / 2.0; _range.max[1] = center.Y() + ly / 2.0;
                 _fixRange();
-                if (!_rangeOK(_range)) { _range = oldr; }
-                if (_range != oldr) { if (!rangeNotification(true, false, false)) { _range = oldr;  resok = false; } }
+                if (!_rangeOK(_range)) { _range = oldr; _ref = oldref; }
+                if ((_range != oldr) || (_ref != oldref)) { if (!rangeNotification(true, false, false)) { _range = oldr; _ref = oldref;  resok = false; } }
                 MTOOLS_ASSERT(_rangeOK(_range));
-                _mut.unlock();
                 return resok;
             }
 
@@ -368,14 +456,17 @@ namespace mtools
                 if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
                 bool resok = true;
                 mtools::fBox2 oldr = _range;
-                double xc = floor((_range.min[0] + _range.max[0]) / 2) + ((_winSize.X() % 2 == 0) ? 0.5 : 0.0);
-                double yc = floor((_range.min[1] + _range.max[1]) / 2) + ((_winSize.Y() % 2 == 0) ? 0.5 : 0.0);
+                const mtools::ddVec2 oldref = _ref;
+                const mtools::fBox2 absr = _toAbs(_range, _ref);
+                double xc = floor((absr.min[0] + absr.max[0]) / 2) + ((_winSize.X() % 2 == 0) ? 0.5 : 0.0);
+                double yc = floor((absr.min[1] + absr.max[1]) / 2) + ((_winSize.Y() % 2 == 0) ? 0.5 : 0.0);
                 double lx = ((double)_winSize.X());
                 double ly = ((double)_winSize.Y());
+                _ref = mtools::ddVec2(0.0, 0.0);
                 _range.min[0] = xc - lx / 2.0; _range.max[0] = xc + lx / 2.0;
                 _range.min[1] = yc - ly / 2.0; _range.max[1] = yc + ly / 2.0;
-                if (!_rangeOK(_range)) { _range = oldr; }
-                if (_range != oldr) { if (!rangeNotification(true, false, false)) { _range = oldr;  resok = false; } }
+                if (!_rangeOK(_range)) { _range = oldr; _ref = oldref; }
+                if ((_range != oldr) || (_ref != oldref)) { if (!rangeNotification(true, false, false)) { _range = oldr; _ref = oldref;  resok = false; } }
                 MTOOLS_ASSERT(_rangeOK(_range));
                 _mut.unlock();
                 return resok;
@@ -388,9 +479,10 @@ namespace mtools
                 if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
                 bool resok = true;
                 mtools::fBox2 oldr = _range;
+                const mtools::ddVec2 oldref = _ref;
                 mtools::fBox2 newr = _range.fixedRatioEnclosingRect(((double)_winSize.X()) / ((double)_winSize.Y()));
                 if (_rangeOK(newr)) _range = newr;
-                if (_range != oldr) { if (!rangeNotification(true, false, false)) { _range = oldr;  resok = false; } }
+                if ((_range != oldr) || (_ref != oldref)) { if (!rangeNotification(true, false, false)) { _range = oldr; _ref = oldref;  resok = false; } }
                 MTOOLS_ASSERT(_rangeOK(_range));
                 _mut.unlock();
                 return resok;
@@ -403,14 +495,16 @@ namespace mtools
                 if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
                 bool resok = true;
                 mtools::fBox2 oldr = _range;
+                const mtools::ddVec2 oldref = _ref;
                 _range = _startRange;
+                _ref = _startRef;
                 double rx = (_range.lx()*_winSize.X()) / _startWin.X();
                 double ry = (_range.ly()*_winSize.Y()) / _startWin.Y();
                 _range.max[0] = _range.min[0] + rx;
                 _range.min[1] = _range.max[1] - ry;
                 _fixRange();
-                if (!_rangeOK(_range)) { _range = oldr; }
-                if (_range != oldr) { if (!rangeNotification(true, false, false)) { _range = oldr; resok = false; } }
+                if (!_rangeOK(_range)) { _range = oldr; _ref = oldref; }
+                if ((_range != oldr) || (_ref != oldref)) { if (!rangeNotification(true, false, false)) { _range = oldr; _ref = oldref; resok = false; } }
                 MTOOLS_ASSERT(_rangeOK(_range));
                 _mut.unlock();
                 return resok;
@@ -423,8 +517,9 @@ namespace mtools
                 if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
                 bool resok = true;
                 mtools::fBox2 oldr = _range;
+                const mtools::ddVec2 oldref = _ref;
                 _defaultrange();
-                if (_range != oldr) { if (!rangeNotification(true, false, false)) { _range = oldr; resok = false; } }
+                if ((_range != oldr) || (_ref != oldref)) { if (!rangeNotification(true, false, false)) { _range = oldr; _ref = oldref; resok = false; } }
                 MTOOLS_ASSERT(_rangeOK(_range));
                 _mut.unlock();
                 return resok;
@@ -432,10 +527,47 @@ namespace mtools
 
 
 
-        fVec2 RangeManager::pixelToAbs(iVec2 pixpos) const { return _range.pixelToAbs(pixpos, _winSize); }
+        fVec2 RangeManager::pixelToAbs(iVec2 pixpos) const { return _toAbs(_range.pixelToAbs(pixpos, _winSize), _ref); }
 
 
-        iVec2 RangeManager::absToPix(fVec2 abspos) const { return _range.absToPixel(abspos, _winSize); }
+        iVec2 RangeManager::absToPix(fVec2 abspos) const { return _range.absToPixel(_toOffset(abspos, _ref), _winSize); }
+
+
+        bool RangeManager::deepZoom() const { return _deep; }
+
+
+        bool RangeManager::deepZoom(bool status)
+            {
+            if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
+            bool resok = true;
+            if ((status) || (!_deep)) { _deep = status; _mut.unlock(); return true; }
+            mtools::fBox2 oldr = _range;
+            const mtools::ddVec2 oldref = _ref;
+            const mtools::fBox2 oldsr = _startRange;
+            const mtools::ddVec2 oldsref = _startRef;
+            _deep = false;
+            _startRange = _toAbs(_startRange, _startRef); // round the ranges to double precision
+            _startRef = mtools::ddVec2(0.0, 0.0);
+            _range = _toAbs(_range, _ref);
+            _ref = mtools::ddVec2(0.0, 0.0);
+            if (!_rangeOK(_range)) { _defaultrange(); }
+            if ((_range != oldr) || (_ref != oldref)) { if (!rangeNotification(true, false, false)) { _range = oldr; _ref = oldref; _startRange = oldsr; _startRef = oldsref; _deep = true; resok = false; } }
+            MTOOLS_ASSERT(_rangeOK(_range));
+            _mut.unlock();
+            return resok;
+            }
+
+
+        bool RangeManager::getDeepRange(const mtools::fBox2 & absRange, mtools::ddVec2 & reference, mtools::fBox2 & offsetRange) const
+            {
+            reference = mtools::ddVec2(0.0, 0.0);
+            offsetRange = absRange;
+            if (!_mut.try_lock_for(std::chrono::milliseconds(MAXLOCKTIME))) return false;
+            const bool ok = (_toAbs(_range, _ref) == absRange);
+            if (ok) { reference = _ref; offsetRange = _range; }
+            _mut.unlock();
+            return ok;
+            }
 
 
         bool RangeManager::_rangeOK(mtools::fBox2 r)
@@ -448,12 +580,21 @@ namespace mtools
             if ((r.lx() / vx) < _precision) return false;
             double vy = std::abs(r.min[1]) + std::abs(r.max[1]);
             if ((r.ly() / vy) < _precision) return false;
+            if (_deep)
+                { // the reference point must also be representable with enough precision
+                const double ax = std::abs(_ref.X().hi);
+                const double ay = std::abs(_ref.Y().hi);
+                if ((std::isnan(ax)) || (std::isnan(ay)) || (ax >= _maxValue) || (ay >= _maxValue)) return false;
+                if ((r.lx() / (2 * ax + vx)) < PRECISIONDOUBLEDOUBLE) return false;
+                if ((r.ly() / (2 * ay + vy)) < PRECISIONDOUBLEDOUBLE) return false;
+                }
             return true;
             }
 
 
         void RangeManager::_fixRange()
             {
+            _rebase();
             double ratio = (_range.lx()*_winSize.Y()) / (_range.ly()*_winSize.X());
             if ((ratio == 1.0) || (ratio<0.99) || (ratio>1.01)) return;
             mtools::fBox2 newr = _range.fixedRatioEnclosingRect(((double)_winSize.X()) / ((double)_winSize.Y()));
@@ -464,13 +605,66 @@ namespace mtools
         void RangeManager::_defaultrange()
             {
             mtools::fBox2 oldr = _range;
+            const mtools::ddVec2 oldref = _ref;
             double xc = ((_winSize.X() % 2 == 0) ? 0.5 : 0.0);
             double yc = ((_winSize.Y() % 2 == 0) ? 0.5 : 0.0);
             double lx = ((double)_winSize.X());
             double ly = ((double)_winSize.Y());
+            _ref = mtools::ddVec2(0.0, 0.0);
             _range.min[0] = xc - lx / 2.0; _range.max[0] = xc + lx / 2.0;
             _range.min[1] = yc - ly / 2.0; _range.max[1] = yc + ly / 2.0;
-            if (!_rangeOK(_range)) { _range = oldr; }
+            if (!_rangeOK(_range)) { _range = oldr; _ref = oldref; }
+            }
+
+
+        mtools::fBox2 RangeManager::_shiftedRange(int sx, int sy) const
+            {
+            // shift by a whole number of pixels so that the drawers can scroll their previous drawing.
+            const double nx = std::max<double>(1.0, std::round(_winSize.X() / 20.0));
+            const double ny = std::max<double>(1.0, std::round(_winSize.Y() / 20.0));
+            const double offx = sx*nx*(_range.lx() / _winSize.X());
+            const double offy = sy*ny*(_range.ly() / _winSize.Y());
+            mtools::fBox2 r = _range;
+            r.min[0] += offx; r.max[0] += offx;
+            r.min[1] += offy; r.max[1] += offy;
+            return r;
+            }
+
+
+        void RangeManager::_rebase()
+            {
+            if (!_deep) return;
+            const double cx = (_range.min[0] + _range.max[0]) / 2;
+            const double cy = (_range.min[1] + _range.max[1]) / 2;
+            if ((std::abs(cx) <= DEEPREBASE*_range.lx()) && (std::abs(cy) <= DEEPREBASE*_range.ly())) return;
+            _ref.X() += cx;
+            _ref.Y() += cy;
+            _range.min[0] -= cx; _range.max[0] -= cx;
+            _range.min[1] -= cy; _range.max[1] -= cy;
+            }
+
+
+        mtools::fBox2 RangeManager::_toAbs(const mtools::fBox2 & r, const mtools::ddVec2 & ref)
+            {
+            return mtools::fBox2((ref.X() + r.min[0]).toDouble(), (ref.X() + r.max[0]).toDouble(), (ref.Y() + r.min[1]).toDouble(), (ref.Y() + r.max[1]).toDouble());
+            }
+
+
+        mtools::fVec2 RangeManager::_toAbs(const mtools::fVec2 & pos, const mtools::ddVec2 & ref)
+            {
+            return mtools::fVec2((ref.X() + pos.X()).toDouble(), (ref.Y() + pos.Y()).toDouble());
+            }
+
+
+        mtools::fBox2 RangeManager::_toOffset(const mtools::fBox2 & r, const mtools::ddVec2 & ref)
+            {
+            return mtools::fBox2((DoubleDouble(r.min[0]) - ref.X()).toDouble(), (DoubleDouble(r.max[0]) - ref.X()).toDouble(), (DoubleDouble(r.min[1]) - ref.Y()).toDouble(), (DoubleDouble(r.max[1]) - ref.Y()).toDouble());
+            }
+
+
+        mtools::fVec2 RangeManager::_toOffset(const mtools::fVec2 & pos, const mtools::ddVec2 & ref)
+            {
+            return mtools::fVec2((DoubleDouble(pos.X()) - ref.X()).toDouble(), (DoubleDouble(pos.Y()) - ref.Y()).toDouble());
             }
 
 
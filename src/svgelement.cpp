@@ -19,11 +19,200 @@
 
 #include "mtools/graphics/svgelement.hpp"
 
+#include <cctype>
+
 namespace mtools
 {
 
 	std::atomic<mtools::int64> SVGElement::_id = 0;
 
+
+	namespace internals_svgelement
+		{
+
+		/* append an indentation */
+		inline void indent(std::string & out, int depth) { out.append((size_t)(2 * depth), ' '); }
+
+		/* append a comment (the sequence "--" is not allowed inside comments) */
+		inline void comment(std::string & out, const std::string & str, int depth)
+			{
+			indent(out, depth);
+			out += "<!--";
+			for (size_t i = 0; i < str.size(); i++)
+				{
+				out += str[i];
+				if ((str[i] == '-') && ((i + 1 == str.size()) || (str[i + 1] == '-'))) out += ' ';
+				}
+			out += "-->\n";
+			}
+
+		}
+
+
+	void SVGElement::write(std::string & out, int depth) const
+		{
+		if (_comment) { internals_svgelement::comment(out, _node.text, depth); return; }
+		internals_svgelement::indent(out, depth);
+		out += '<';
+		out += _node.name;
+		for (auto & A : _node.attributes)
+			{
+			out += ' ';
+			out += A.first;
+			out += "=\"";
+			SVGWriter::escape(out, A.second, true);
+			out += '"';
+			}
+		if (_children.size() == 0)
+			{
+			if (_node.text.size() == 0) { out += "/>\n"; return; }
+			out += '>';
+			SVGWriter::escape(out, _node.text, false);
+			}
+		else
+			{
+			out += ">\n";
+			if (_node.text.size() != 0) { internals_svgelement::indent(out, depth + 1); SVGWriter::escape(out, _node.text, false); out += '\n'; }
+			for (SVGElement * el : _children) { el->write(out, depth + 1); }
+			internals_svgelement::indent(out, depth);
+			}
+		out += "</";
+		out += _node.name;
+		out += ">\n";
+		}
+
+
+	void SVGWriter::escape(std::string & out, const std::string & str, bool quotes)
+		{
+		for (const char c : str)
+			{
+			switch (c)
+				{
+				case '&': { out += "&amp;"; break; }
+				case '<': { out += "&lt;"; break; }
+				case '>': { out += "&gt;"; break; }
+				case '"': { if (quotes) out += "&quot;"; else out += c; break; }
+				default: { out += c; }
+				}
+			}
+		}
+
+
+	void SVGWriter::write(const SVGElement & el, int depth)
+		{
+		std::string style, id, d, comment;
+		if ((_merge) && (_mergeable(el, style, id, d, comment)))
+			{
+			if ((_pcount > 0) && ((_pcount >= MAX_MERGE) || (depth != _pdepth) || (style != _pstyle))) { _flushPath(); }
+			if (_pcount == 0)
+				{
+				_pstyle = style;
+				_pid = id;
+				_pcomment = comment;
+				_pdepth = depth;
+				_pd = d;
+				_pfirst.clear();
+				el.write(_pfirst, depth);
+				}
+			else
+				{
+				_pd += ' ';
+				_pd += d;
+				}
+			_pcount++;
+			return;
+			}
+		_flushPath();
+		el.write(_buf, depth);
+		_check();
+		}
+
+
+	void SVGWriter::_flushPath()
+		{
+		if (_pcount == 0) return;
+		if (_pcount == 1)
+			{ // single element, write it unchanged. 
+			_buf += _pfirst;
+			}
+		else
+			{
+			internals_svgelement::indent(_buf, _pdepth);
+			_buf += "<path";
+			if (_pid.size()) { _buf += " id=\""; escape(_buf, _pid, true); _buf += '"'; }
+			_buf += " d=\"";
+			_buf += _pd;
+			_buf += "\" fill=\"none\"";
+			_buf += _pstyle;
+			if (_pcomment.size() == 0) { _buf += "/>\n"; }
+			else
+				{
+				_buf += ">\n";
+				internals_svgelement::comment(_buf, _pcomment, _pdepth + 1);
+				internals_svgelement::indent(_buf, _pdepth);
+				_buf += "</path>\n";
+				}
+			}
+		_pcount = 0;
+		_check();
+		}
+
+
+	bool SVGWriter::_mergeable(const SVGElement & el, std::string & style, std::string & id, std::string & d, std::string & comment)
+		{
+		if ((el._comment) || (el._node.text.size() != 0)) return false;
+		const bool isline = (el._node.name == "line");
+		if ((!isline) && (el._node.name != "polyline")) return false;
+		for (SVGElement * c : el._children)
+			{ // only comments are allowed as children. 
+			if (!c->_comment) return false;
+			if (comment.size() == 0) comment = c->_node.text;
+			}
+		const char * x1 = nullptr, * y1 = nullptr, * x2 = nullptr, * y2 = nullptr, * points = nullptr;
+		for (auto & A : el._node.attributes)
+			{
+			const std::string & n = A.first;
+			if (n == "id") { id = A.second; }
+			else if (isline && (n == "x1")) { x1 = A.second.c_str(); }
+			else if (isline && (n == "y1")) { y1 = A.second.c_str(); }
+			else if (isline && (n == "x2")) { x2 = A.second.c_str(); }
+			else if (isline && (n == "y2")) { y2 = A.second.c_str(); }
+			else if ((!isline) && (n == "points")) { points = A.second.c_str(); }
+			else if ((n == "fill") || (n == "fill-opacity")) { if ((n == "fill") && (A.second != "none")) return false; }
+			else if (n == "transform") { return false; }
+			else
+				{
+				style += ' ';
+				style += n;
+				style += "=\"";
+				escape(style, A.second, true);
+				style += '"';
+				}
+			}
+		if (isline)
+			{
+			if ((x1 == nullptr) || (y1 == nullptr) || (x2 == nullptr) || (y2 == nullptr)) return false;
+			d = std::string("M") + x1 + "," + y1 + "L" + x2 + "," + y2;
+			return true;
+			}
+		if (points == nullptr) return false;
+		// split the list of points
+		const std::string pts(points);
+		size_t i = 0, k = 0;
+		while (1)
+			{
+			while ((i < pts.size()) && (std::isspace((unsigned char)pts[i]))) i++;
+			if (i >= pts.size()) break;
+			size_t j = i;
+			while ((j < pts.size()) && (!std::isspace((unsigned char)pts[j]))) j++;
+			if (k == 0) { d += 'M'; } else if (k == 1) { d += 'L'; } else { d += ' '; }
+			d.append(pts, i, j - i);
+			k++;
+			i = j;
+			}
+		return (k >= 2);
+		}
+
 }
 
 
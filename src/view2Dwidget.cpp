@@ -336,7 +336,7 @@ namespace mtools
                         if ((button == FL_MIDDLE_MOUSE) || (button == FL_RIGHT_MOUSE))
                             { // we center at this position
                             _zoomOn = false;
-                            _RM->center(_RM->pixelToAbs(((int64)_zoomFactor)*_currentMouse));
+                            _RM->centerPixel(((int64)_zoomFactor)*_currentMouse);
                             redrawView();
                             return 1;
                             }
@@ -362,10 +362,7 @@ namespace mtools
                             iBox2 R(_zoom1, _currentMouse,true);
                             if ((R.lx() > 10) && (R.ly() > 10))
                                 {
-                                fBox2 range = _RM->getRange();
-                                fBox2 R(_RM->pixelToAbs(((int64)_zoomFactor)*_zoom1), _RM->pixelToAbs(((int64)_zoomFactor)*_currentMouse), true); // absolute rectangle
-                                if (fixedRatio()) { R = R.fixedRatioEnclosedRect(range.lx() / range.ly()); }
-                                _RM->setRange(R);
+                                _RM->setRangePixel(((int64)_zoomFactor)*_zoom1, ((int64)_zoomFactor)*_currentMouse); // keep the aspect ratio if fixed
                                 redrawView();
                                 return 1;
                                 }
@@ -385,9 +382,9 @@ namespace mtools
                         take_focus();                        
                         if (!_isIn(_currentMouse)) { if (_zoomOn) { _zoomOn = false; redrawView(); return 1; } }
                         int d = Fl::event_dy();
-                        fVec2 pos = _RM->pixelToAbs({ ((int64)_zoomFactor) * _currentMouse.X(), ((int64)_zoomFactor) * _currentMouse.Y() });
-                        if (d < 0) { _RM->zoomIn(pos);  redrawView(); return 1; }
-                        if (d > 0) { _RM->zoomOut(pos); redrawView(); return 1; }                        
+                        iVec2 pos = { ((int64)_zoomFactor) * _currentMouse.X(), ((int64)_zoomFactor) * _currentMouse.Y() };
+                        if (d < 0) { _RM->zoomInPixel(pos);  redrawView(); return 1; }
+                        if (d > 0) { _RM->zoomOutPixel(pos); redrawView(); return 1; }                        
                         return 1;
                         }
                     case FL_KEYDOWN: